@@ -2,15 +2,25 @@
 #include "agent/context_builder.h"
 #include "mimi_config.h"
 #include "bus/message_bus.h"
+#include "bus/inbound_coalesce.h"
 #include "llm/llm_proxy.h"
 #include "memory/session_mgr.h"
+#include "memory/memory_index.h"
+#include "memory/memory_vec.h"
 #include "tools/tool_registry.h"
+#include "tools/tool_jobs.h"
+#include "skills/skill_loader.h"
+#include "deadline/deadline.h"
+#include "metrics/metrics.h"
+#include "channels/channel.h"
+#include "arena/arena.h"
 
 #include <string.h>
 #include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_heap_caps.h"
 #include "cJSON.h"
 
@@ -18,6 +28,110 @@ static const char *TAG = "agent";
 
 #define TOOL_OUTPUT_SIZE  (8 * 1024)
 
+#if MIMI_AGENT_SUPERSEDE
+/* The turn in flight, so a newer message from the same chat can stop it */
+static portMUX_TYPE s_turn_lock = portMUX_INITIALIZER_UNLOCKED;
+static struct {
+    deadline_t *deadline;       /* NULL between turns */
+    char channel[16];
+    char chat_id[32];
+    bool superseded;
+} s_turn;
+
+/* Text of the last superseded turn, folded into that chat's next turn */
+static mimi_msg_t s_carry;
+static TickType_t s_carry_at;
+#endif
+
+static void turn_begin(const mimi_msg_t *msg, deadline_t *d)
+{
+#if MIMI_AGENT_SUPERSEDE
+    if (strcmp(msg->channel, MIMI_CHAN_SYSTEM) == 0) return;
+    portENTER_CRITICAL(&s_turn_lock);
+    strncpy(s_turn.channel, msg->channel, sizeof(s_turn.channel) - 1);
+    strncpy(s_turn.chat_id, msg->chat_id, sizeof(s_turn.chat_id) - 1);
+    s_turn.superseded = false;
+    s_turn.deadline = d;
+    portEXIT_CRITICAL(&s_turn_lock);
+#endif
+}
+
+/* Returns true if the turn was stopped by a newer message */
+static bool turn_end(void)
+{
+#if MIMI_AGENT_SUPERSEDE
+    portENTER_CRITICAL(&s_turn_lock);
+    bool superseded = s_turn.superseded;
+    memset(&s_turn, 0, sizeof(s_turn));
+    portEXIT_CRITICAL(&s_turn_lock);
+    return superseded;
+#else
+    return false;
+#endif
+}
+
+void agent_loop_supersede(const char *channel, const char *chat_id)
+{
+#if MIMI_AGENT_SUPERSEDE
+    bool hit = false;
+    portENTER_CRITICAL(&s_turn_lock);
+    if (s_turn.deadline && !s_turn.superseded &&
+        strcmp(s_turn.chat_id, chat_id) == 0 && strcmp(s_turn.channel, channel) == 0) {
+        s_turn.superseded = true;
+        deadline_cancel(s_turn.deadline);
+        hit = true;
+    }
+    portEXIT_CRITICAL(&s_turn_lock);
+    if (hit) {
+        ESP_LOGI(TAG, "Newer message from %s:%s, stopping the turn in flight", channel, chat_id);
+    }
+#else
+    (void)channel;
+    (void)chat_id;
+#endif
+}
+
+#if MIMI_AGENT_SUPERSEDE
+/* Keep the user's text from a stopped turn; the tool results are dropped */
+static void carry_save(mimi_msg_t *msg)
+{
+    if (s_carry.content) {
+        ESP_LOGW(TAG, "Dropping carried text for %s:%s", s_carry.channel, s_carry.chat_id);
+        free(s_carry.content);
+    }
+    s_carry = *msg;             /* takes ownership of content */
+    s_carry_at = xTaskGetTickCount();
+    msg->content = NULL;
+}
+
+/* Prepend carried text to the next turn from the same chat */
+static void carry_fold(mimi_msg_t *msg)
+{
+    if (!s_carry.content || !msg->content ||
+        strcmp(s_carry.chat_id, msg->chat_id) != 0 || strcmp(s_carry.channel, msg->channel) != 0) {
+        return;
+    }
+
+    if (xTaskGetTickCount() - s_carry_at <= pdMS_TO_TICKS(MIMI_AGENT_CARRY_TTL_MS) &&
+        msg->content[0] != '/') {
+        size_t a = strlen(s_carry.content);
+        size_t b = strlen(msg->content);
+        char *joined = malloc(a + 1 + b + 1);
+        if (joined) {
+            memcpy(joined, s_carry.content, a);
+            joined[a] = '\n';
+            memcpy(joined + a + 1, msg->content, b + 1);
+            free(msg->content);
+            msg->content = joined;
+            ESP_LOGI(TAG, "Folded superseded message into turn for %s:%s",
+                     msg->channel, msg->chat_id);
+        }
+    }
+    free(s_carry.content);
+    memset(&s_carry, 0, sizeof(s_carry));
+}
+#endif
+
 /* Build the assistant content array from llm_response_t for the messages history.
  * Returns a cJSON array with text and tool_use blocks. */
 static cJSON *build_assistant_content(const llm_response_t *resp)
@@ -178,10 +292,20 @@ static cJSON *build_tool_results(const llm_response_t *resp, const mimi_msg_t *m
             tool_input = patched_input;
         }
 
-        /* Execute tool */
+        /* Execute tool; slow ones run in the background and report back
+         * to this chat as a follow-up turn */
         tool_output[0] = '\0';
-        tool_registry_execute(call->name, tool_input, tool_output, tool_output_size);
-        free(patched_input);
+        if (deadline_expired()) {
+            /* Turn was stopped or ran out of time: run nothing further */
+            snprintf(tool_output, tool_output_size,
+                     "Error: the turn was stopped before %s ran", call->name);
+        } else if (tool_jobs_should_defer(call->name, tool_input)) {
+            tool_jobs_submit(call->name, tool_input, msg->channel, msg->chat_id,
+                             tool_output, tool_output_size);
+        } else {
+            tool_registry_execute(call->name, tool_input, tool_output, tool_output_size);
+        }
+        cJSON_free(patched_input);
 
         ESP_LOGI(TAG, "Tool %s result: %d bytes", call->name, (int)strlen(tool_output));
 
@@ -196,6 +320,28 @@ static cJSON *build_tool_results(const llm_response_t *resp, const mimi_msg_t *m
     return content;
 }
 
+/* Text that picks this turn's tools: the message, the tail of the history
+ * (so a follow-up like "turn it off" keeps its tool) and matched skills */
+static void build_route_text(const char *content, const char *history_json,
+                             char *buf, size_t size)
+{
+    if (!content) content = "";
+    int n = snprintf(buf, size, "%s\n", content);
+    size_t off = (n < 0) ? 0 : ((size_t)n < size ? (size_t)n : size - 1);
+
+    size_t hlen = strlen(history_json);
+    size_t tail = hlen < MIMI_TOOL_ROUTE_HISTORY_BYTES ? hlen : MIMI_TOOL_ROUTE_HISTORY_BYTES;
+    if (tail > size - off - 1) tail = size - off - 1;
+    memcpy(buf + off, history_json + hlen - tail, tail);
+    off += tail;
+    buf[off] = '\0';
+
+    if (off + 2 < size) {
+        buf[off++] = '\n';
+        skill_loader_match(content, buf + off, size - off);
+    }
+}
+
 static void agent_loop_task(void *arg)
 {
     ESP_LOGI(TAG, "Agent loop started on core %d", xPortGetCoreID());
@@ -204,18 +350,21 @@ static void agent_loop_task(void *arg)
     char *system_prompt = heap_caps_calloc(1, MIMI_CONTEXT_BUF_SIZE, MALLOC_CAP_SPIRAM);
     char *history_json = heap_caps_calloc(1, MIMI_LLM_STREAM_BUF_SIZE, MALLOC_CAP_SPIRAM);
     char *tool_output = heap_caps_calloc(1, TOOL_OUTPUT_SIZE, MALLOC_CAP_SPIRAM);
+    char *route_text = heap_caps_calloc(1, MIMI_TOOL_ROUTE_BUF_SIZE, MALLOC_CAP_SPIRAM);
 
-    if (!system_prompt || !history_json || !tool_output) {
+    if (!system_prompt || !history_json || !tool_output || !route_text) {
         ESP_LOGE(TAG, "Failed to allocate PSRAM buffers");
         vTaskDelete(NULL);
         return;
     }
 
-    const char *tools_json = tool_registry_get_tools_json();
+    /* All JSON built during a turn is dropped together when it ends */
+    static arena_t turn_arena;
+    arena_init(&turn_arena, "agent_turn");
 
     while (1) {
         mimi_msg_t msg;
-        esp_err_t err = message_bus_pop_inbound(&msg, UINT32_MAX);
+        esp_err_t err = inbound_coalesce_pop(&msg);
         if (err != ESP_OK) continue;
 
         ESP_LOGI(TAG, "Processing message from %s:%s", msg.channel, msg.chat_id);
@@ -234,8 +383,20 @@ static void agent_loop_task(void *arg)
             continue;
         }
 
+#if MIMI_AGENT_SUPERSEDE
+        carry_fold(&msg);
+#endif
+
+        /* Every network call below (recall, LLM, tools) shares one budget */
+        deadline_t turn_deadline;
+        int64_t turn_start_us = esp_timer_get_time();
+        deadline_start(&turn_deadline, MIMI_AGENT_TURN_BUDGET_MS);
+        deadline_bind(&turn_deadline);
+        arena_bind(&turn_arena);
+        turn_begin(&msg, &turn_deadline);
+
         /* 1. Build system prompt */
-        context_build_system_prompt(system_prompt, MIMI_CONTEXT_BUF_SIZE);
+        context_build_system_prompt(msg.content, system_prompt, MIMI_CONTEXT_BUF_SIZE);
         append_turn_context_prompt(system_prompt, MIMI_CONTEXT_BUF_SIZE, &msg);
         ESP_LOGI(TAG, "LLM turn context: channel=%s chat_id=%s", msg.channel, msg.chat_id);
 
@@ -243,6 +404,14 @@ static void agent_loop_task(void *arg)
         session_get_history_json(msg.chat_id, history_json,
                                  MIMI_LLM_STREAM_BUF_SIZE, MIMI_AGENT_MAX_HISTORY);
 
+        /* Tool subset is chosen once and fixed for the whole turn, so every
+         * iteration sends the same request prefix */
+        llm_tools_t tools;
+        build_route_text(msg.content, history_json, route_text, MIMI_TOOL_ROUTE_BUF_SIZE);
+        if (tool_registry_select(msg.channel, route_text, &tools) != ESP_OK) {
+            ESP_LOGW(TAG, "No memory for tools array, calling LLM without tools");
+        }
+
         cJSON *messages = cJSON_Parse(history_json);
         if (!messages) messages = cJSON_CreateArray();
 
@@ -256,6 +425,11 @@ static void agent_loop_task(void *arg)
         char *final_text = NULL;
         int iteration = 0;
         bool sent_working_status = false;
+        /* The first step, and the one after the first tool results, are
+         * likely to be the answer: they go to the strong model. Only the
+         * steps of longer tool chains use the fast model */
+        llm_tier_t tier = LLM_TIER_STRONG;
+        int tool_rounds = 0;
 
         /* Collect tool call pairs (assistant tool_use + user tool_result) so we
          * can save them to session history after the turn completes.  Storing
@@ -266,9 +440,14 @@ static void agent_loop_task(void *arg)
         memset(tc_pairs, 0, sizeof(tc_pairs));
 
         while (iteration < MIMI_AGENT_MAX_TOOL_ITER) {
+            if (deadline_expired()) {
+                ESP_LOGW(TAG, "Turn budget exhausted after %d iterations", iteration);
+                break;
+            }
+
             /* Send "working" indicator before each API call */
 #if MIMI_AGENT_SEND_WORKING_STATUS
-            if (!sent_working_status && strcmp(msg.channel, MIMI_CHAN_SYSTEM) != 0) {
+            if (!sent_working_status && (channel_caps(msg.channel) & CHANNEL_CAP_STATUS)) {
                 mimi_msg_t status = {0};
                 strncpy(status.channel, msg.channel, sizeof(status.channel) - 1);
                 strncpy(status.chat_id, msg.chat_id, sizeof(status.chat_id) - 1);
@@ -285,13 +464,22 @@ static void agent_loop_task(void *arg)
 #endif
 
             llm_response_t resp;
-            err = llm_chat_tools(system_prompt, messages, tools_json, &resp);
+            err = llm_chat_tools(system_prompt, messages, &tools, tier, &resp);
 
             if (err != ESP_OK) {
                 ESP_LOGE(TAG, "LLM call failed: %s", esp_err_to_name(err));
                 break;
             }
 
+            if (!resp.tool_use && resp.fast_model && iteration + 1 < MIMI_AGENT_MAX_TOOL_ITER) {
+                /* The fast model is done with tools; the strong one writes the answer */
+                ESP_LOGI(TAG, "Fast model finished tool steps, asking for the final answer");
+                llm_response_free(&resp);
+                tier = LLM_TIER_STRONG;
+                iteration++;
+                continue;
+            }
+
             if (!resp.tool_use) {
                 /* Normal completion — save final text and break */
                 if (resp.text && resp.text_len > 0) {
@@ -329,19 +517,40 @@ static void agent_loop_task(void *arg)
                 tc_pairs[tc_count].result_json = results_for_session;
                 tc_count++;
             } else {
-                free(asst_for_session);
-                free(results_for_session);
+                cJSON_free(asst_for_session);
+                cJSON_free(results_for_session);
             }
 
             llm_response_free(&resp);
+            tool_rounds++;
+            tier = tool_rounds >= 2 ? LLM_TIER_FAST : LLM_TIER_STRONG;
             iteration++;
         }
 
         cJSON_Delete(messages);
+        bool superseded = turn_end();
+
+        metric_counter_t outcome = METRIC_TURNS_OK;
+        if (superseded) {
+            outcome = METRIC_TURNS_SUPERSEDED;
+        } else if (!final_text || !final_text[0]) {
+            outcome = deadline_expired() ? METRIC_TURNS_TIMED_OUT : METRIC_TURNS_FAILED;
+        }
+        metrics_inc(outcome);
+        metrics_observe_ms(METRIC_HIST_TURN,
+                           (uint32_t)((esp_timer_get_time() - turn_start_us) / 1000));
 
         /* 5. Send response */
-        if (final_text && final_text[0]) {
-            /* Save the complete turn to session atomically:
+        if (superseded) {
+            /* A newer message from this chat is queued; it answers for both */
+            ESP_LOGI(TAG, "Turn for %s:%s superseded after %d iterations",
+                     msg.channel, msg.chat_id, iteration);
+            free(final_text);
+#if MIMI_AGENT_SUPERSEDE
+            carry_save(&msg);
+#endif
+        } else if (final_text && final_text[0]) {
+            /* Save the complete turn to session as one committed batch:
              *   user message → [tool_use + tool_result pairs] → final assistant text
              *
              * tool_use and tool_result records are stored as serialised JSON
@@ -350,20 +559,30 @@ static void agent_loop_task(void *arg)
              * real structured evidence of prior tool calls in future turns.
              * This prevents the model from pattern-matching text responses
              * as a substitute for actually calling tools. */
-            session_append(msg.chat_id, "user", msg.content);
-            for (int i = 0; i < tc_count; i++) {
-                if (tc_pairs[i].asst_json)
-                    session_append(msg.chat_id, "assistant", tc_pairs[i].asst_json);
-                if (tc_pairs[i].result_json)
-                    session_append(msg.chat_id, "user", tc_pairs[i].result_json);
+            esp_err_t save_err = ESP_ERR_NO_MEM;
+            session_batch_t *batch = session_batch_begin(msg.chat_id);
+            if (batch) {
+                session_batch_add(batch, "user", msg.content);
+                for (int i = 0; i < tc_count; i++) {
+                    if (tc_pairs[i].asst_json)
+                        session_batch_add(batch, "assistant", tc_pairs[i].asst_json);
+                    if (tc_pairs[i].result_json)
+                        session_batch_add(batch, "user", tc_pairs[i].result_json);
+                }
+                session_batch_add(batch, "assistant", final_text);
+                save_err = session_batch_commit(batch);
             }
-            esp_err_t save_asst = session_append(msg.chat_id, "assistant", final_text);
-            if (save_asst != ESP_OK) {
+            if (save_err != ESP_OK) {
                 ESP_LOGW(TAG, "Session save failed for chat %s", msg.chat_id);
             } else {
                 ESP_LOGI(TAG, "Session saved for chat %s (%d tool pairs)", msg.chat_id, tc_count);
             }
 
+            /* Make the exchange recallable later (cron/heartbeat turns are not) */
+            if (channel_caps(msg.channel) & CHANNEL_CAP_RECALL) {
+                memory_vec_queue_turn(msg.chat_id, msg.content, final_text);
+            }
+
             /* Push response to outbound */
             mimi_msg_t out = {0};
             strncpy(out.channel, msg.channel, sizeof(out.channel) - 1);
@@ -383,7 +602,13 @@ static void agent_loop_task(void *arg)
             mimi_msg_t out = {0};
             strncpy(out.channel, msg.channel, sizeof(out.channel) - 1);
             strncpy(out.chat_id, msg.chat_id, sizeof(out.chat_id) - 1);
-            out.content = strdup("Sorry, I encountered an error.");
+            const char *reply = "Sorry, I encountered an error.";
+            if (deadline_expired()) {
+                reply = "Sorry, that took too long and was stopped. Please try again.";
+            } else if (err == ESP_ERR_INVALID_STATE) {
+                reply = "Sorry, the model service is unavailable right now. Please try again in a minute.";
+            }
+            out.content = strdup(reply);
             if (out.content) {
                 if (message_bus_push_outbound(&out) != ESP_OK) {
                     ESP_LOGW(TAG, "Outbound queue full, drop error response");
@@ -392,14 +617,21 @@ static void agent_loop_task(void *arg)
             }
         }
 
-        /* Free tool call pair strings (heap-allocated during react loop) */
+        /* Free tool call pair strings (cJSON output from the react loop) */
         for (int i = 0; i < tc_count; i++) {
-            free(tc_pairs[i].asst_json);
-            free(tc_pairs[i].result_json);
+            cJSON_free(tc_pairs[i].asst_json);
+            cJSON_free(tc_pairs[i].result_json);
         }
 
         /* Free inbound message content */
         free(msg.content);
+        tool_registry_free_tools(&tools);
+        deadline_bind(NULL);
+        arena_bind(NULL);
+        arena_reset(&turn_arena);
+
+        /* Persist index changes from any memory writes made during this turn */
+        memory_index_flush();
 
         /* Log memory status */
         ESP_LOGI(TAG, "Free PSRAM: %d bytes",
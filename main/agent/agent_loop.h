@@ -12,3 +12,12 @@ esp_err_t agent_loop_init(void);
  * Consumes from inbound queue, calls Claude API, pushes to outbound queue.
  */
 esp_err_t agent_loop_start(void);
+
+/**
+ * Note that a new user message from channel:chat_id has been queued.
+ * If the agent is in the middle of a turn for that chat, the turn is
+ * stopped at its next safe point (between LLM calls and tool runs, or
+ * between reads of a proxied response); its partial results are dropped
+ * and its text is folded into the chat's next turn. Safe from any task.
+ */
+void agent_loop_supersede(const char *channel, const char *chat_id);
@@ -1,6 +1,7 @@
 #include "context_builder.h"
 #include "mimi_config.h"
 #include "memory/memory_store.h"
+#include "memory/memory_vec.h"
 #include "skills/skill_loader.h"
 
 #include <stdio.h>
@@ -26,7 +27,7 @@ static size_t append_file(char *buf, size_t size, size_t offset, const char *pat
     return offset;
 }
 
-esp_err_t context_build_system_prompt(char *buf, size_t size)
+esp_err_t context_build_system_prompt(const char *query, char *buf, size_t size)
 {
     size_t off = 0;
 
@@ -35,25 +36,10 @@ esp_err_t context_build_system_prompt(char *buf, size_t size)
         "You are MimiClaw, a personal AI assistant running on an ESP32-S3 device.\n"
         "You communicate through Telegram and WebSocket.\n\n"
         "Be helpful, accurate, and concise.\n\n"
-        "## Available Tools\n"
-        "You have access to the following tools:\n"
-        "- web_search: Search the web for current information. "
-        "Use this when you need up-to-date facts, news, weather, or anything beyond your training data.\n"
-        "- get_current_time: Get the current date and time. "
-        "You do NOT have an internal clock — always use this tool when you need to know the time or date.\n"
-        "- read_file: Read a file from SPIFFS (path must start with /spiffs/).\n"
-        "- write_file: Write/overwrite a file on SPIFFS.\n"
-        "- edit_file: Find-and-replace edit a file on SPIFFS.\n"
-        "- list_dir: List files on SPIFFS, optionally filter by prefix.\n"
-        "- cron_add: Schedule a recurring or one-shot task. The message will trigger an agent turn when the job fires.\n"
-        "- cron_list: List all scheduled cron jobs.\n"
-        "- cron_remove: Remove a scheduled cron job by ID.\n"
-        "- wled_control: Control WLED smart LED lights (on/off/color/effect/brightness/preset). Use for ANY light request.\n"
-        "- http_get: Make an HTTP GET request to any URL. Use for local network APIs other than WLED.\n"
-        "- ota_update: Flash new firmware over WiFi. Call with no arguments to use the configured release URL.\n"
-        "- get_version: Get the current firmware version and build info.\n"
-        "- docker_status: Check and control Docker containers and stacks (Arcane API). "
-        "Use for any Docker/container/stack request.\n\n"
+        "## Tools\n"
+        "The tools relevant to this conversation are attached to each request; "
+        "their descriptions say when to use them.\n"
+        "You do NOT have an internal clock — always use get_current_time when you need to know the time or date.\n"
         "When using cron_add for Telegram delivery, always set channel='telegram' and a valid numeric chat_id.\n\n"
         "Use tools proactively — do not answer from memory when a tool would give a better result.\n"
         "For device control (lights, OTA, HTTP requests), ALWAYS call the relevant tool. "
@@ -67,6 +53,7 @@ esp_err_t context_build_system_prompt(char *buf, size_t size)
         "- When something noteworthy happens in a conversation, append it to today's daily note.\n"
         "- Always read_file MEMORY.md before writing, so you can edit_file to update without losing existing content.\n"
         "- Use get_current_time to know today's date before writing daily notes.\n"
+        "- Only a few notes are shown below. Use memory_search to recall anything else.\n"
         "- Keep MEMORY.md concise and organized — summarize, don't dump raw conversation.\n"
         "- You should proactively save memory without being asked. If the user tells you their name, preferences, or important facts, persist them immediately.\n\n"
         "## Skills\n"
@@ -84,9 +71,17 @@ esp_err_t context_build_system_prompt(char *buf, size_t size)
         off += snprintf(buf + off, size - off, "\n## Long-term Memory\n\n%s\n", mem_buf);
     }
 
-    /* Recent daily notes (last 3 days) */
+    /* Notes and past chats relevant to this message; when recall is
+     * unavailable or finds nothing, fall back to the raw daily notes of the
+     * last 3 days */
     char recent_buf[4096];
-    if (memory_read_recent(recent_buf, sizeof(recent_buf), 3) == ESP_OK && recent_buf[0]) {
+    recent_buf[0] = '\0';
+    if (query) {
+        memory_vec_recall(query, MIMI_MEMORY_RECALL_TOP_K, recent_buf, sizeof(recent_buf));
+    }
+    if (recent_buf[0]) {
+        off += snprintf(buf + off, size - off, "\n## Relevant Memories\n\n%s\n", recent_buf);
+    } else if (memory_read_recent(recent_buf, sizeof(recent_buf), 3) == ESP_OK && recent_buf[0]) {
         off += snprintf(buf + off, size - off, "\n## Recent Notes\n\n%s\n", recent_buf);
     }
 
@@ -122,7 +117,7 @@ esp_err_t context_build_messages(const char *history_json, const char *user_mess
     if (json_str) {
         strncpy(buf, json_str, size - 1);
         buf[size - 1] = '\0';
-        free(json_str);
+        cJSON_free(json_str);
     } else {
         snprintf(buf, size, "[{\"role\":\"user\",\"content\":\"%s\"}]", user_message);
     }
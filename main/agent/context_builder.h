@@ -5,12 +5,14 @@
 
 /**
  * Build the system prompt from bootstrap files (SOUL.md, USER.md)
- * and memory context (MEMORY.md + recent daily notes).
+ * and memory context (MEMORY.md + memories relevant to the query, or the
+ * recent daily notes when semantic recall is unavailable).
  *
- * @param buf   Output buffer (caller allocates, recommend MIMI_CONTEXT_BUF_SIZE)
- * @param size  Buffer size
+ * @param query  Current user message, used for memory recall (may be NULL)
+ * @param buf    Output buffer (caller allocates, recommend MIMI_CONTEXT_BUF_SIZE)
+ * @param size   Buffer size
  */
-esp_err_t context_build_system_prompt(char *buf, size_t size);
+esp_err_t context_build_system_prompt(const char *query, char *buf, size_t size);
 
 /**
  * Build the complete messages JSON array for LLM call.
@@ -0,0 +1,158 @@
+#include "arena/arena.h"
+#include "mimi_config.h"
+
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "cJSON.h"
+
+static const char *TAG = "arena";
+
+#define ARENA_ALIGN  8          /* cJSON nodes hold doubles */
+
+struct arena_chunk {
+    arena_chunk_t *next;
+    size_t size;                /* usable bytes after the header */
+    size_t used;
+    uint8_t data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+/* Compiler TLS: each task sees its own binding */
+static __thread arena_t *s_bound = NULL;
+
+/* Tasks register their arenas as they start, possibly at the same time.
+ * Append-only: a slot is filled before the count covers it */
+static portMUX_TYPE s_reg_lock = portMUX_INITIALIZER_UNLOCKED;
+static arena_t *s_arenas[MIMI_ARENA_MAX_COUNT];
+static int s_arena_count = 0;
+
+void arena_init(arena_t *a, const char *name)
+{
+    a->name = name;
+    a->head = NULL;
+    a->used = 0;
+    a->peak = 0;
+    a->reserved = 0;
+    a->fallbacks = 0;
+
+    bool listed = false;
+    portENTER_CRITICAL(&s_reg_lock);
+    if (s_arena_count < MIMI_ARENA_MAX_COUNT) {
+        s_arenas[s_arena_count] = a;
+        s_arena_count++;
+        listed = true;
+    }
+    portEXIT_CRITICAL(&s_reg_lock);
+
+    if (!listed) {
+        ESP_LOGW(TAG, "Arena %s not listed: raise MIMI_ARENA_MAX_COUNT", name);
+    }
+}
+
+void arena_bind(arena_t *a)
+{
+    s_bound = a;
+}
+
+void *arena_alloc(arena_t *a, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    arena_chunk_t *c = a->head;
+    if (!c || c->size - c->used < size) {
+        size_t want = size > MIMI_ARENA_CHUNK_SIZE ? size : MIMI_ARENA_CHUNK_SIZE;
+        if (a->reserved + want > MIMI_ARENA_MAX_SIZE) return NULL;
+        c = heap_caps_malloc(sizeof(*c) + want, MALLOC_CAP_SPIRAM);
+        if (!c) return NULL;
+        c->next = a->head;
+        c->size = want;
+        c->used = 0;
+        a->head = c;
+        a->reserved += want;
+    }
+
+    void *p = c->data + c->used;
+    c->used += size;
+    a->used += size;
+    return p;
+}
+
+void arena_reset(arena_t *a)
+{
+    if (a->used > a->peak) {
+        a->peak = a->used;
+        ESP_LOGI(TAG, "%s: new peak %u bytes (%u reserved, %u heap fallbacks)",
+                 a->name, (unsigned)a->peak, (unsigned)a->reserved, (unsigned)a->fallbacks);
+    }
+
+    /* Keep the oldest chunk; anything past it was overflow */
+    arena_chunk_t *c = a->head;
+    while (c && c->next) {
+        arena_chunk_t *next = c->next;
+        a->reserved -= c->size;
+        free(c);
+        c = next;
+    }
+    if (c) c->used = 0;
+    a->head = c;
+    a->used = 0;
+}
+
+int arena_count(void)
+{
+    portENTER_CRITICAL(&s_reg_lock);
+    int n = s_arena_count;
+    portEXIT_CRITICAL(&s_reg_lock);
+    return n;
+}
+
+const arena_t *arena_get(int index)
+{
+    return (index >= 0 && index < s_arena_count) ? s_arenas[index] : NULL;
+}
+
+/* ── cJSON hooks ──────────────────────────────────────────────── */
+
+#if MIMI_JSON_ARENA
+static bool arena_owns(const arena_t *a, const void *p)
+{
+    for (const arena_chunk_t *c = a->head; c; c = c->next) {
+        if ((const uint8_t *)p >= c->data && (const uint8_t *)p < c->data + c->size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *json_malloc(size_t size)
+{
+    arena_t *a = s_bound;
+    if (a) {
+        void *p = arena_alloc(a, size);
+        if (p) return p;
+        a->fallbacks++;
+    }
+    return malloc(size);
+}
+
+static void json_free(void *p)
+{
+    if (!p) return;
+    arena_t *a = s_bound;
+    if (a && arena_owns(a, p)) return;      /* released by arena_reset() */
+    free(p);
+}
+#endif
+
+void arena_hooks_install(void)
+{
+#if MIMI_JSON_ARENA
+    cJSON_Hooks hooks = {
+        .malloc_fn = json_malloc,
+        .free_fn = json_free,
+    };
+    cJSON_InitHooks(&hooks);
+    ESP_LOGI(TAG, "cJSON allocations use per-task arenas");
+#endif
+}
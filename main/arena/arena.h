@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Bump allocator in PSRAM for short-lived JSON work (an agent turn, a
+ * background job).
+ *
+ * Once arena_hooks_install() has run, cJSON allocates from the arena bound
+ * to the calling task, and frees of arena memory are no-ops; arena_reset()
+ * releases everything at once. Tasks without a bound arena use the heap as
+ * before. Nothing cJSON allocates while an arena is bound may outlive the
+ * next reset, and cJSON output must be released with cJSON_free().
+ */
+typedef struct arena_chunk arena_chunk_t;
+
+typedef struct {
+    const char *name;
+    arena_chunk_t *head;        /* chunk being filled; older ones follow */
+    size_t used;                /* bytes handed out since the last reset */
+    size_t peak;                /* largest used seen at a reset */
+    size_t reserved;            /* chunk bytes currently held */
+    uint32_t fallbacks;         /* allocations that went to the heap */
+} arena_t;
+
+/** Route cJSON allocations through the bound arena. Call once, early. */
+void arena_hooks_install(void);
+
+/** Prepare an arena and list it for diagnostics. Chunks are allocated on first use. */
+void arena_init(arena_t *a, const char *name);
+
+/** Bind an arena to the calling task; NULL unbinds. */
+void arena_bind(arena_t *a);
+
+/** Allocate from an arena; NULL when it is at MIMI_ARENA_MAX_SIZE or PSRAM is short. */
+void *arena_alloc(arena_t *a, size_t size);
+
+/** Drop every allocation, keeping the first chunk for the next use. */
+void arena_reset(arena_t *a);
+
+/** Number of arenas registered with arena_init(). */
+int arena_count(void);
+
+/** Registered arena by index, for diagnostics (read without locking). */
+const arena_t *arena_get(int index);
@@ -0,0 +1,221 @@
+#include "bus/inbound_coalesce.h"
+#include "mimi_config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+static const char *TAG = "coalesce";
+
+#define READY_MAX  4
+
+/* A burst being collected for one chat */
+typedef struct {
+    bool used;
+    mimi_msg_t msg;             /* content grows as parts arrive */
+    size_t len;
+    int parts;
+    bool labelled;              /* every part carries its sender's label */
+    TickType_t first;
+    TickType_t due;
+} pending_t;
+
+/* State is private to the agent task, so no locking */
+static pending_t s_pending[MIMI_COALESCE_SLOTS];
+static mimi_msg_t s_ready[READY_MAX];
+static int s_ready_head = 0;
+static int s_ready_count = 0;
+
+static uint32_t window_ms(const char *channel)
+{
+    if (strcmp(channel, MIMI_CHAN_TELEGRAM) == 0) return MIMI_COALESCE_TG_WINDOW_MS;
+    if (strcmp(channel, MIMI_CHAN_WEBSOCKET) == 0) return MIMI_COALESCE_WS_WINDOW_MS;
+    return 0;
+}
+
+static void ready_push(const mimi_msg_t *msg)
+{
+    if (s_ready_count == READY_MAX) {
+        /* Can't happen: each arrival readies at most two messages and the
+         * ready list is drained before the next arrival is read */
+        ESP_LOGE(TAG, "Ready list full, dropping message for %s", msg->chat_id);
+        free(msg->content);
+        return;
+    }
+    s_ready[(s_ready_head + s_ready_count) % READY_MAX] = *msg;
+    s_ready_count++;
+}
+
+static void release(pending_t *p)
+{
+    if (p->parts > 1) {
+        ESP_LOGI(TAG, "Merged %d messages from %s:%s into one turn",
+                 p->parts, p->msg.channel, p->msg.chat_id);
+    }
+    ready_push(&p->msg);
+    memset(p, 0, sizeof(*p));
+}
+
+/* Parts from a group chat are labelled "[name] " so the merged turn still
+ * shows who wrote each line */
+static const char *label_name(const mimi_msg_t *msg)
+{
+    return msg->sender[0] ? msg->sender : "unknown";
+}
+
+static size_t label_len(const mimi_msg_t *msg)
+{
+    return strlen(label_name(msg)) + 3;
+}
+
+static bool wants_label(const pending_t *p, const mimi_msg_t *msg)
+{
+    return p->labelled || p->msg.sender[0] || msg->sender[0];
+}
+
+/* Label the first part once a second one arrives */
+static bool label_first(pending_t *p)
+{
+    char tag[sizeof(p->msg.sender) + 4];
+    size_t pre = (size_t)snprintf(tag, sizeof(tag), "[%s] ", label_name(&p->msg));
+    char *s = realloc(p->msg.content, pre + p->len + 1);
+    if (!s) return false;
+    memmove(s + pre, s, p->len + 1);
+    memcpy(s, tag, pre);
+    p->msg.content = s;
+    p->len += pre;
+    p->labelled = true;
+    return true;
+}
+
+static pending_t *find_pending(const mimi_msg_t *msg)
+{
+    for (int i = 0; i < MIMI_COALESCE_SLOTS; i++) {
+        pending_t *p = &s_pending[i];
+        if (p->used && strcmp(p->msg.chat_id, msg->chat_id) == 0 &&
+            strcmp(p->msg.channel, msg->channel) == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static pending_t *earliest_due(void)
+{
+    pending_t *best = NULL;
+    for (int i = 0; i < MIMI_COALESCE_SLOTS; i++) {
+        pending_t *p = &s_pending[i];
+        if (p->used && (!best || (int32_t)(p->due - best->due) < 0)) {
+            best = p;
+        }
+    }
+    return best;
+}
+
+/* A free slot; if all are busy, the burst due soonest is released early */
+static pending_t *take_slot(void)
+{
+    for (int i = 0; i < MIMI_COALESCE_SLOTS; i++) {
+        if (!s_pending[i].used) return &s_pending[i];
+    }
+    pending_t *p = earliest_due();
+    release(p);
+    return p;
+}
+
+static void add(mimi_msg_t *msg)
+{
+    uint32_t window = window_ms(msg->channel);
+    pending_t *p = find_pending(msg);
+
+    if (window == 0 || !msg->content || msg->content[0] == '/' ||
+        (msg->flags & MIMI_MSG_NO_COALESCE)) {
+        if (p) release(p);
+        ready_push(msg);
+        return;
+    }
+
+    size_t len = strlen(msg->content);
+    if (p) {
+        size_t need = p->len + 1 + len;
+        if (wants_label(p, msg)) {
+            need += label_len(msg) + (p->labelled ? 0 : label_len(&p->msg));
+        }
+        if (need > MIMI_COALESCE_MAX_BYTES) {
+            release(p);
+            p = NULL;
+        }
+    }
+
+    TickType_t now = xTaskGetTickCount();
+    if (!p) {
+        p = take_slot();
+        p->used = true;
+        p->msg = *msg;          /* takes ownership of content */
+        p->len = len;
+        p->parts = 1;
+        p->first = now;
+    } else {
+        bool label = wants_label(p, msg);
+        size_t pre = label ? label_len(msg) : 0;
+        char *joined = NULL;
+        if (!label || p->labelled || label_first(p)) {
+            joined = realloc(p->msg.content, p->len + 1 + pre + len + 1);
+        }
+        if (!joined) {
+            /* Keep order: send what we have, then this part on its own */
+            release(p);
+            ready_push(msg);
+            return;
+        }
+        joined[p->len] = '\n';
+        if (label) {
+            char tag[sizeof(msg->sender) + 4];
+            snprintf(tag, sizeof(tag), "[%s] ", label_name(msg));
+            memcpy(joined + p->len + 1, tag, pre);
+        }
+        memcpy(joined + p->len + 1 + pre, msg->content, len + 1);
+        p->msg.content = joined;
+        p->len += 1 + pre + len;
+        p->parts++;
+        free(msg->content);
+    }
+
+    p->due = now + pdMS_TO_TICKS(window);
+    TickType_t cap = p->first + pdMS_TO_TICKS(MIMI_COALESCE_MAX_WAIT_MS);
+    if ((int32_t)(p->due - cap) > 0) {
+        p->due = cap;
+    }
+}
+
+esp_err_t inbound_coalesce_pop(mimi_msg_t *msg)
+{
+    while (1) {
+        if (s_ready_count > 0) {
+            *msg = s_ready[s_ready_head];
+            s_ready_head = (s_ready_head + 1) % READY_MAX;
+            s_ready_count--;
+            return ESP_OK;
+        }
+
+        uint32_t wait_ms = UINT32_MAX;
+        pending_t *next = earliest_due();
+        if (next) {
+            int32_t left = (int32_t)(next->due - xTaskGetTickCount());
+            if (left <= 0) {
+                release(next);
+                continue;
+            }
+            wait_ms = (uint32_t)left * portTICK_PERIOD_MS;
+        }
+
+        mimi_msg_t in;
+        if (message_bus_pop_inbound(&in, wait_ms) == ESP_OK) {
+            add(&in);
+        }
+    }
+}
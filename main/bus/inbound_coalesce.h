@@ -0,0 +1,19 @@
+#pragma once
+
+#include "esp_err.h"
+#include "bus/message_bus.h"
+
+/**
+ * Pop the next inbound message for the agent, merging bursts.
+ *
+ * Messages from one chat that arrive within the channel's debounce window
+ * of each other are joined (in arrival order, one per line) into a single
+ * message, so a user typing three short lines gets one turn. Each chat has
+ * its own timer; a burst is released once the chat has been quiet for the
+ * window, or MIMI_COALESCE_MAX_WAIT_MS after its first part. Commands
+ * ("/reset") and channels with a zero window pass straight through, after
+ * anything already pending for the same chat.
+ *
+ * Only the agent task may call this. Caller frees msg->content.
+ */
+esp_err_t inbound_coalesce_pop(mimi_msg_t *msg);
@@ -57,3 +57,9 @@ esp_err_t message_bus_pop_outbound(mimi_msg_t *msg, uint32_t timeout_ms)
     }
     return ESP_OK;
 }
+
+void message_bus_depths(int *inbound, int *outbound)
+{
+    *inbound = s_inbound_queue ? (int)uxQueueMessagesWaiting(s_inbound_queue) : 0;
+    *outbound = s_outbound_queue ? (int)uxQueueMessagesWaiting(s_outbound_queue) : 0;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdint.h>
 #include "esp_err.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
@@ -10,10 +11,15 @@
 #define MIMI_CHAN_CLI        "cli"
 #define MIMI_CHAN_SYSTEM     "system"
 
+/* mimi_msg_t flags */
+#define MIMI_MSG_NO_COALESCE  (1u << 0)     /* never merge with other messages (automatic follow-ups) */
+
 /* Message types on the bus */
 typedef struct {
     char channel[16];       /* "telegram", "websocket", "cli" */
     char chat_id[32];       /* Telegram chat_id or WS client id */
+    char sender[24];        /* Author in a group chat; empty when the chat has one user */
+    uint8_t flags;          /* MIMI_MSG_* */
     char *content;          /* Heap-allocated message text (caller must free) */
 } mimi_msg_t;
 
@@ -45,3 +51,8 @@ esp_err_t message_bus_push_outbound(const mimi_msg_t *msg);
  * Caller must free msg->content when done.
  */
 esp_err_t message_bus_pop_outbound(mimi_msg_t *msg, uint32_t timeout_ms);
+
+/**
+ * Number of messages currently waiting in each queue.
+ */
+void message_bus_depths(int *inbound, int *outbound);
@@ -0,0 +1,247 @@
+#include "channels/channel.h"
+#include "mimi_config.h"
+#include "bus/message_bus.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+static const char *TAG = "channel";
+
+#define NAME_BUCKETS  8         /* power of two, >= MIMI_CHANNEL_MAX */
+
+/* One entry in a channel's queue */
+typedef struct {
+    char chat_id[32];
+    char *text;
+} channel_item_t;
+
+typedef struct {
+    const channel_driver_t *drv;
+    uint32_t hash;
+    QueueHandle_t queue;
+    TaskHandle_t task;
+    uint32_t dropped;
+} channel_t;
+
+static SemaphoreHandle_t s_lock = NULL;
+static channel_t s_channels[MIMI_CHANNEL_MAX];
+static int s_count = 0;
+static int8_t s_index[NAME_BUCKETS];    /* id + 1; 0 is empty */
+static bool s_started = false;
+
+static uint32_t name_hash(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Lock-free: ids are only ever added, and an index slot is written after
+ * the channel it points to is complete */
+channel_id_t channel_lookup(const char *name)
+{
+    uint32_t hash = name_hash(name);
+    for (uint32_t i = hash & (NAME_BUCKETS - 1), n = 0; n < NAME_BUCKETS;
+         i = (i + 1) & (NAME_BUCKETS - 1), n++) {
+        int8_t slot = s_index[i];
+        if (slot == 0) break;
+        const channel_t *ch = &s_channels[slot - 1];
+        if (ch->hash == hash && strcmp(ch->drv->name, name) == 0) {
+            return slot - 1;
+        }
+    }
+    return CHANNEL_ID_NONE;
+}
+
+uint32_t channel_caps(const char *name)
+{
+    channel_id_t id = channel_lookup(name);
+    return id == CHANNEL_ID_NONE ? 0 : s_channels[id].drv->caps;
+}
+
+int channel_count(void)
+{
+    return s_count;
+}
+
+const char *channel_name(channel_id_t id)
+{
+    return (id >= 0 && id < s_count) ? s_channels[id].drv->name : NULL;
+}
+
+TaskHandle_t channel_task(channel_id_t id)
+{
+    return (id >= 0 && id < s_count) ? s_channels[id].task : NULL;
+}
+
+uint32_t channel_dropped(channel_id_t id)
+{
+    return (id >= 0 && id < s_count) ? __atomic_load_n(&s_channels[id].dropped, __ATOMIC_RELAXED) : 0;
+}
+
+/* ── Workers ──────────────────────────────────────────────────── */
+
+static void channel_worker_task(void *arg)
+{
+    channel_t *ch = (channel_t *)arg;
+    const channel_driver_t *drv = ch->drv;
+
+    if (drv->init && drv->init() != ESP_OK) {
+        ESP_LOGW(TAG, "%s: driver init failed, sending anyway", drv->name);
+    }
+
+    while (1) {
+        channel_item_t item;
+        if (xQueueReceive(ch->queue, &item, portMAX_DELAY) != pdTRUE) continue;
+
+        esp_err_t err = drv->send(item.chat_id, item.text);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "%s send failed for %s: %s", drv->name, item.chat_id, esp_err_to_name(err));
+        }
+        free(item.text);
+    }
+}
+
+static esp_err_t start_worker(channel_t *ch)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "out_%s", ch->drv->name);
+    uint32_t stack = ch->drv->stack_size ? ch->drv->stack_size : MIMI_CHANNEL_STACK;
+    if (xTaskCreatePinnedToCore(channel_worker_task, name, stack, ch,
+                                MIMI_CHANNEL_PRIO, &ch->task, MIMI_CHANNEL_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start worker for %s", ch->drv->name);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+channel_id_t channel_register(const channel_driver_t *driver)
+{
+    if (!s_lock) {
+        /* Registration happens during single-threaded startup, before any
+         * other task can race this */
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_lock) return CHANNEL_ID_NONE;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    channel_id_t id = channel_lookup(driver->name);
+    if (id != CHANNEL_ID_NONE) {
+        xSemaphoreGive(s_lock);
+        ESP_LOGW(TAG, "Channel %s already registered", driver->name);
+        return id;
+    }
+    if (s_count >= MIMI_CHANNEL_MAX) {
+        xSemaphoreGive(s_lock);
+        ESP_LOGE(TAG, "No room for channel %s", driver->name);
+        return CHANNEL_ID_NONE;
+    }
+
+    channel_t *ch = &s_channels[s_count];
+    ch->drv = driver;
+    ch->hash = name_hash(driver->name);
+    ch->queue = xQueueCreate(MIMI_CHANNEL_QUEUE_LEN, sizeof(channel_item_t));
+    if (!ch->queue) {
+        xSemaphoreGive(s_lock);
+        return CHANNEL_ID_NONE;
+    }
+    if (s_started && start_worker(ch) != ESP_OK) {
+        vQueueDelete(ch->queue);
+        memset(ch, 0, sizeof(*ch));
+        xSemaphoreGive(s_lock);
+        return CHANNEL_ID_NONE;
+    }
+
+    id = s_count++;
+    uint32_t i = ch->hash & (NAME_BUCKETS - 1);
+    while (s_index[i]) i = (i + 1) & (NAME_BUCKETS - 1);
+    s_index[i] = id + 1;
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TAG, "Registered channel %s (id %d)", driver->name, id);
+    return id;
+}
+
+/* ── Routing ──────────────────────────────────────────────────── */
+
+static esp_err_t enqueue(channel_id_t id, const char *chat_id, char *text)
+{
+    channel_t *ch = &s_channels[id];
+    channel_item_t item = { .text = text };
+    strncpy(item.chat_id, chat_id, sizeof(item.chat_id) - 1);
+
+    /* Never wait: a stuck channel must not hold up the others */
+    if (xQueueSend(ch->queue, &item, 0) != pdTRUE) {
+        __atomic_fetch_add(&ch->dropped, 1, __ATOMIC_RELAXED);
+        ESP_LOGE(TAG, "%s queue full, dropping reply for %s", ch->drv->name, chat_id);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static void outbound_router_task(void *arg)
+{
+    ESP_LOGI(TAG, "Outbound router started (%d channels)", s_count);
+
+    while (1) {
+        mimi_msg_t msg;
+        if (message_bus_pop_outbound(&msg, UINT32_MAX) != ESP_OK) continue;
+
+        channel_id_t id = channel_lookup(msg.channel);
+        if (id == CHANNEL_ID_NONE) {
+            ESP_LOGW(TAG, "Unknown channel: %s", msg.channel);
+            free(msg.content);
+            continue;
+        }
+
+        ESP_LOGD(TAG, "Routing response to %s:%s", msg.channel, msg.chat_id);
+        if (enqueue(id, msg.chat_id, msg.content) != ESP_OK) {
+            free(msg.content);
+        }
+    }
+}
+
+/* ── Built-in system channel: cron/heartbeat replies go to the log ── */
+
+static esp_err_t system_send(const char *chat_id, const char *text)
+{
+    ESP_LOGI(TAG, "System message [%s]: %.128s", chat_id, text);
+    return ESP_OK;
+}
+
+static const channel_driver_t s_system_driver = {
+    .name = MIMI_CHAN_SYSTEM,
+    .send = system_send,
+    .stack_size = 3 * 1024,
+};
+
+esp_err_t channel_start(void)
+{
+    if (s_started) return ESP_OK;
+    if (channel_register(&s_system_driver) == CHANNEL_ID_NONE) return ESP_FAIL;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < s_count; i++) {
+        if (start_worker(&s_channels[i]) != ESP_OK) {
+            xSemaphoreGive(s_lock);
+            return ESP_FAIL;
+        }
+    }
+    s_started = true;
+    xSemaphoreGive(s_lock);
+
+    if (xTaskCreatePinnedToCore(outbound_router_task, "outbound",
+                                MIMI_OUTBOUND_STACK, NULL,
+                                MIMI_OUTBOUND_PRIO, NULL, MIMI_OUTBOUND_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start outbound router");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* What a channel can render; callers check these instead of channel names */
+#define CHANNEL_CAP_STATUS     (1u << 0)   /* show interim "thinking..." notes */
+#define CHANNEL_CAP_RECALL     (1u << 1)   /* turns are worth indexing for recall */
+
+typedef int8_t channel_id_t;
+#define CHANNEL_ID_NONE  ((channel_id_t)-1)
+
+/*
+ * A channel driver delivers outbound text for one bus channel name. Each
+ * registered channel gets its own queue and worker task, so a slow or
+ * failing channel only ever delays its own messages.
+ */
+typedef struct {
+    const char *name;           /* bus channel name, e.g. MIMI_CHAN_TELEGRAM */
+    uint32_t caps;              /* CHANNEL_CAP_* */
+
+    /* Called once from the worker before the first send; may be NULL */
+    esp_err_t (*init)(void);
+
+    /* Deliver one complete message. The text stays owned by the caller. */
+    esp_err_t (*send)(const char *chat_id, const char *text);
+
+    uint32_t stack_size;        /* worker stack; 0 for MIMI_CHANNEL_STACK */
+} channel_driver_t;
+
+/**
+ * Register a driver. Usually called from the owning module's init; if the
+ * router is already running, the worker starts immediately.
+ * The driver struct must stay valid.
+ */
+channel_id_t channel_register(const channel_driver_t *driver);
+
+/** Resolve a bus channel name to its id, or CHANNEL_ID_NONE. */
+channel_id_t channel_lookup(const char *name);
+
+/** Capabilities of a named channel (0 if unknown). */
+uint32_t channel_caps(const char *name);
+
+/**
+ * Start the outbound router and one worker per registered channel.
+ * The router pops the bus outbound queue and hands each message to its
+ * channel's queue without waiting; a message that finds the queue full is
+ * dropped and counted.
+ */
+esp_err_t channel_start(void);
+
+/** Number of registered channels; ids are 0 .. count-1. */
+int channel_count(void);
+
+/** Name and worker task of a channel, for diagnostics. */
+const char *channel_name(channel_id_t id);
+TaskHandle_t channel_task(channel_id_t id);
+
+/** Messages dropped because the channel's queue was full. */
+uint32_t channel_dropped(channel_id_t id);
@@ -4,6 +4,7 @@
 #include "telegram/telegram_bot.h"
 #include "llm/llm_proxy.h"
 #include "memory/memory_store.h"
+#include "memory/memory_index.h"
 #include "memory/session_mgr.h"
 #include "proxy/http_proxy.h"
 #include "tools/tool_registry.h"
@@ -144,6 +145,55 @@ static int cmd_set_ollama_url(int argc, char **argv)
     return 0;
 }
 
+/* --- set_fast_model / set_ollama_model commands --- */
+static struct {
+    struct arg_str *model;
+    struct arg_end *end;
+} fast_model_args, ollama_model_args;
+
+static int cmd_set_fast_model(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&fast_model_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, fast_model_args.end, argv[0]);
+        return 1;
+    }
+    llm_set_fast_model(fast_model_args.model->sval[0]);
+    printf("Fast model set.\n");
+    return 0;
+}
+
+static int cmd_set_ollama_model(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&ollama_model_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, ollama_model_args.end, argv[0]);
+        return 1;
+    }
+    llm_set_ollama_model(ollama_model_args.model->sval[0]);
+    printf("Ollama fallback model set.\n");
+    return 0;
+}
+
+/* --- llm_routes command --- */
+static int cmd_llm_routes(int argc, char **argv)
+{
+    llm_route_info_t routes[4];
+    int n = llm_router_info(routes, 4);
+    if (n == 0) {
+        printf("No LLM routes configured.\n");
+        return 0;
+    }
+    printf("%-8s %-10s %-28s %8s %6s %6s\n", "ROUTE", "BACKEND", "MODEL", "AVG_MS", "OK", "FAIL");
+    for (int i = 0; i < n; i++) {
+        printf("%-8s %-10s %-28s %8u %6u %6u%s\n",
+               routes[i].name, routes[i].backend, routes[i].model,
+               (unsigned)routes[i].ewma_ms, (unsigned)routes[i].ok, (unsigned)routes[i].failed,
+               routes[i].degraded ? "  (degraded)" : "");
+    }
+    return 0;
+}
+
 /* --- memory_read command --- */
 static int cmd_memory_read(int argc, char **argv)
 {
@@ -175,6 +225,7 @@ static int cmd_memory_write(int argc, char **argv)
         return 1;
     }
     memory_write_long_term(memory_write_args.content->sval[0]);
+    memory_index_flush();
     printf("MEMORY.md updated.\n");
     return 0;
 }
@@ -383,14 +434,12 @@ static int cmd_skill_search(int argc, char **argv)
     }
 
     const char *keyword = skill_search_args.keyword->sval[0];
-    DIR *dir = opendir("/spiffs");
+    DIR *dir = opendir(MIMI_SKILLS_DIR);
     if (!dir) {
-        printf("Cannot open /spiffs.\n");
+        printf("Cannot open %s.\n", MIMI_SKILLS_DIR);
         return 1;
     }
 
-    const char *prefix = "skills/";
-    const size_t prefix_len = strlen(prefix);
     int matches = 0;
 
     struct dirent *ent;
@@ -398,12 +447,11 @@ static int cmd_skill_search(int argc, char **argv)
         const char *name = ent->d_name;
         size_t name_len = strlen(name);
 
-        if (strncmp(name, prefix, prefix_len) != 0) continue;
-        if (name_len < prefix_len + 4) continue;
+        if (name_len < 4) continue;
         if (strcmp(name + name_len - 3, ".md") != 0) continue;
 
         char full_path[296];
-        snprintf(full_path, sizeof(full_path), "/spiffs/%s", name);
+        snprintf(full_path, sizeof(full_path), "%s%s", MIMI_SKILLS_PREFIX, name);
 
         bool file_matched = contains_nocase(name, keyword);
         int matched_line = 0;
@@ -482,6 +530,9 @@ static int cmd_config_show(int argc, char **argv)
     print_config("API Key",    MIMI_NVS_LLM,    MIMI_NVS_KEY_API_KEY,  MIMI_SECRET_API_KEY,    true);
     print_config("Model",      MIMI_NVS_LLM,    MIMI_NVS_KEY_MODEL,    MIMI_SECRET_MODEL,      false);
     print_config("Provider",   MIMI_NVS_LLM,    MIMI_NVS_KEY_PROVIDER, MIMI_SECRET_MODEL_PROVIDER, false);
+    print_config("Fast Model", MIMI_NVS_LLM,    MIMI_NVS_KEY_FAST_MODEL, MIMI_SECRET_FAST_MODEL, false);
+    print_config("Ollama URL", MIMI_NVS_LLM,    MIMI_NVS_KEY_OLLAMA_URL, MIMI_SECRET_OLLAMA_URL, false);
+    print_config("Ollama Model", MIMI_NVS_LLM,  MIMI_NVS_KEY_OLLAMA_MODEL, MIMI_SECRET_OLLAMA_MODEL, false);
     print_config("Proxy Host", MIMI_NVS_PROXY,  MIMI_NVS_KEY_PROXY_HOST, MIMI_SECRET_PROXY_HOST, false);
     print_config("Proxy Port", MIMI_NVS_PROXY,  MIMI_NVS_KEY_PROXY_PORT, MIMI_SECRET_PROXY_PORT, false);
     print_config("Search Key", MIMI_NVS_SEARCH, MIMI_NVS_KEY_API_KEY,  MIMI_SECRET_SEARCH_KEY, true);
@@ -559,6 +610,8 @@ static int cmd_tool_exec(int argc, char **argv)
 static int cmd_restart(int argc, char **argv)
 {
     printf("Restarting...\n");
+    cron_service_flush();
+    telegram_bot_flush();
     esp_restart();
     return 0;  /* unreachable */
 }
@@ -671,6 +724,36 @@ esp_err_t serial_cli_init(void)
     };
     esp_console_cmd_register(&ollama_url_cmd);
 
+    /* set_fast_model */
+    fast_model_args.model = arg_str1(NULL, NULL, "<model>", "Model on the same provider, \"\" to disable");
+    fast_model_args.end = arg_end(1);
+    esp_console_cmd_t fast_model_cmd = {
+        .command = "set_fast_model",
+        .help = "Set a faster model for intermediate tool steps",
+        .func = &cmd_set_fast_model,
+        .argtable = &fast_model_args,
+    };
+    esp_console_cmd_register(&fast_model_cmd);
+
+    /* set_ollama_model */
+    ollama_model_args.model = arg_str1(NULL, NULL, "<model>", "Ollama model, \"\" to disable");
+    ollama_model_args.end = arg_end(1);
+    esp_console_cmd_t ollama_model_cmd = {
+        .command = "set_ollama_model",
+        .help = "Set the Ollama model used when the cloud provider is down or slow",
+        .func = &cmd_set_ollama_model,
+        .argtable = &ollama_model_args,
+    };
+    esp_console_cmd_register(&ollama_model_cmd);
+
+    /* llm_routes */
+    esp_console_cmd_t llm_routes_cmd = {
+        .command = "llm_routes",
+        .help = "Show LLM routes with latency and health",
+        .func = &cmd_llm_routes,
+    };
+    esp_console_cmd_register(&llm_routes_cmd);
+
     /* skill_list */
     esp_console_cmd_t skill_list_cmd = {
         .command = "skill_list",
@@ -0,0 +1,215 @@
+#include "cron/cron_expr.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+
+typedef struct {
+    int min;
+    int max;
+    const char *const *names;   /* 3-letter names, NULL-terminated */
+    int names_base;             /* value of names[0] */
+} field_spec_t;
+
+static const char *const s_month_names[] = {
+    "jan", "feb", "mar", "apr", "may", "jun",
+    "jul", "aug", "sep", "oct", "nov", "dec", NULL,
+};
+
+static const char *const s_day_names[] = {
+    "sun", "mon", "tue", "wed", "thu", "fri", "sat", NULL,
+};
+
+static const field_spec_t s_fields[5] = {
+    { 0, 59, NULL,          0 },    /* minute */
+    { 0, 23, NULL,          0 },    /* hour */
+    { 1, 31, NULL,          0 },    /* day of month */
+    { 1, 12, s_month_names, 1 },    /* month */
+    { 0, 7,  s_day_names,   0 },    /* day of week, 7 = Sunday */
+};
+
+static const struct {
+    const char *name;
+    const char *expr;
+} s_shortcuts[] = {
+    { "@yearly",   "0 0 1 1 *" },
+    { "@annually", "0 0 1 1 *" },
+    { "@monthly",  "0 0 1 * *" },
+    { "@weekly",   "0 0 * * 0" },
+    { "@daily",    "0 0 * * *" },
+    { "@midnight", "0 0 * * *" },
+    { "@hourly",   "0 * * * *" },
+};
+
+/* ── Parsing ──────────────────────────────────────────────────── */
+
+static bool parse_value(const char **p, const field_spec_t *f, int *out)
+{
+    const char *s = *p;
+    if (isdigit((unsigned char)*s)) {
+        int v = 0;
+        while (isdigit((unsigned char)*s)) {
+            v = v * 10 + (*s++ - '0');
+            if (v > 1000) return false;
+        }
+        *out = v;
+        *p = s;
+        return true;
+    }
+    if (f->names) {
+        for (int i = 0; f->names[i]; i++) {
+            if (strncasecmp(s, f->names[i], 3) == 0) {
+                *out = f->names_base + i;
+                *p = s + 3;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* Parse one field such as "1,5-10" into a bitmask; false if malformed */
+static bool parse_field(const char *s, const field_spec_t *f, uint64_t *mask)
+{
+    *mask = 0;
+    const char *p = s;
+
+    while (1) {
+        int lo, hi, step = 1;
+        bool open_end = false;
+
+        if (*p == '*') {
+            lo = f->min;
+            hi = f->max;
+            p++;
+        } else {
+            if (!parse_value(&p, f, &lo)) return false;
+            hi = lo;
+            if (*p == '-') {
+                p++;
+                if (!parse_value(&p, f, &hi)) return false;
+            } else {
+                open_end = true;
+            }
+        }
+
+        if (*p == '/') {
+            p++;
+            if (!isdigit((unsigned char)*p)) return false;
+            step = (int)strtol(p, (char **)&p, 10);
+            if (step <= 0 || step > f->max) return false;
+            if (open_end) hi = f->max;      /* "5/15" means 5-max/15 */
+        }
+
+        if (lo < f->min || hi > f->max || lo > hi) return false;
+        for (int v = lo; v <= hi; v += step) {
+            *mask |= 1ULL << v;
+        }
+
+        if (*p == '\0') return true;
+        if (*p != ',') return false;
+        p++;
+    }
+}
+
+esp_err_t cron_expr_parse(const char *text, cron_expr_t *out)
+{
+    if (!text || !out) return ESP_ERR_INVALID_ARG;
+
+    while (isspace((unsigned char)*text)) text++;
+    if (*text == '@') {
+        for (size_t i = 0; i < sizeof(s_shortcuts) / sizeof(s_shortcuts[0]); i++) {
+            size_t n = strlen(s_shortcuts[i].name);
+            if (strncasecmp(text, s_shortcuts[i].name, n) == 0 &&
+                (text[n] == '\0' || isspace((unsigned char)text[n]))) {
+                return cron_expr_parse(s_shortcuts[i].expr, out);
+            }
+        }
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char buf[96];
+    if (strlen(text) >= sizeof(buf)) return ESP_ERR_INVALID_ARG;
+    strcpy(buf, text);
+
+    char *fields[5];
+    int count = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(buf, " \t\r\n", &save); tok; tok = strtok_r(NULL, " \t\r\n", &save)) {
+        if (count == 5) return ESP_ERR_INVALID_ARG;
+        fields[count++] = tok;
+    }
+    if (count != 5) return ESP_ERR_INVALID_ARG;
+
+    uint64_t masks[5];
+    for (int i = 0; i < 5; i++) {
+        if (!parse_field(fields[i], &s_fields[i], &masks[i])) return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->minutes = masks[0];
+    out->hours = (uint32_t)masks[1];
+    out->days = (uint32_t)masks[2];
+    out->months = (uint16_t)masks[3];
+    out->weekdays = (uint8_t)((masks[4] | (masks[4] >> 7)) & 0x7F);
+    out->days_any = fields[2][0] == '*';
+    out->weekdays_any = fields[4][0] == '*';
+    return ESP_OK;
+}
+
+/* ── Next match ───────────────────────────────────────────────── */
+
+static bool day_matches(const cron_expr_t *e, const struct tm *tm)
+{
+    bool dom = (e->days >> tm->tm_mday) & 1;
+    bool dow = (e->weekdays >> tm->tm_wday) & 1;
+
+    if (e->days_any) return dow;
+    if (e->weekdays_any) return dom;
+    return dom || dow;
+}
+
+/* Let mktime() carry overflowed fields and fill in tm_wday */
+static void normalize(struct tm *tm)
+{
+    tm->tm_isdst = -1;
+    mktime(tm);
+}
+
+int64_t cron_expr_next(const cron_expr_t *e, int64_t after)
+{
+    time_t t = (time_t)after + 60;
+    struct tm tm;
+    localtime_r(&t, &tm);
+    tm.tm_sec = 0;
+    normalize(&tm);
+
+    /* Skip whole months, days and hours at a time rather than minutes */
+    int last_year = tm.tm_year + 5;
+    while (tm.tm_year <= last_year) {
+        if (!((e->months >> (tm.tm_mon + 1)) & 1)) {
+            tm.tm_mon++;
+            tm.tm_mday = 1;
+            tm.tm_hour = 0;
+            tm.tm_min = 0;
+        } else if (!day_matches(e, &tm)) {
+            tm.tm_mday++;
+            tm.tm_hour = 0;
+            tm.tm_min = 0;
+        } else if (!((e->hours >> tm.tm_hour) & 1)) {
+            tm.tm_hour++;
+            tm.tm_min = 0;
+        } else if (!((e->minutes >> tm.tm_min) & 1)) {
+            tm.tm_min++;
+        } else {
+            tm.tm_isdst = -1;
+            time_t next = mktime(&tm);
+            return next > after ? (int64_t)next : 0;
+        }
+        normalize(&tm);
+    }
+    return 0;
+}
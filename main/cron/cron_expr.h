@@ -0,0 +1,35 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Parsed 5-field cron expression: one bit per allowed value */
+typedef struct {
+    uint64_t minutes;      /* bits 0-59 */
+    uint32_t hours;        /* bits 0-23 */
+    uint32_t days;         /* bits 1-31 */
+    uint16_t months;       /* bits 1-12 */
+    uint8_t weekdays;      /* bits 0-6, Sunday = 0 */
+    bool days_any;         /* day-of-month field was '*' */
+    bool weekdays_any;     /* day-of-week field was '*' */
+} cron_expr_t;
+
+/**
+ * Parse a standard 5-field cron expression ("min hour dom month dow").
+ * Fields accept '*', numbers, ranges "a-b", lists "a,b" and a "/n" step
+ * after '*', a range or a start value; month and weekday also accept
+ * names ("jan", "mon"), and weekday 7 is Sunday like 0.
+ * The shortcuts @hourly, @daily, @weekly, @monthly and @yearly work too.
+ *
+ * @return ESP_ERR_INVALID_ARG if the expression is malformed
+ */
+esp_err_t cron_expr_parse(const char *text, cron_expr_t *out);
+
+/**
+ * Next time after 'after' (unix epoch) that matches, in local time.
+ * When both day-of-month and day-of-week are restricted, either may match.
+ *
+ * @return Epoch of the next match, or 0 if none within the next 5 years
+ */
+int64_t cron_expr_next(const cron_expr_t *expr, int64_t after);
@@ -1,13 +1,16 @@
 #include "cron/cron_service.h"
 #include "mimi_config.h"
 #include "bus/message_bus.h"
+#include "storage/storage.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <sys/time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_random.h"
 #include "cJSON.h"
@@ -19,6 +22,16 @@ static const char *TAG = "cron";
 static cron_job_t s_jobs[MAX_CRON_JOBS];
 static int s_job_count = 0;
 static TaskHandle_t s_cron_task = NULL;
+static SemaphoreHandle_t s_lock = NULL;
+
+/* Min-heap of indices into s_jobs, keyed by next_run: the root is the next
+ * job to fire. Holds every enabled job with a next_run. */
+static uint8_t s_heap[MAX_CRON_JOBS];
+static int s_heap_len = 0;
+
+/* last_run values not yet written to MIMI_CRON_STATE_FILE */
+static bool s_state_dirty = false;
+static TickType_t s_state_dirty_tick = 0;
 
 static esp_err_t cron_save_jobs(void);
 
@@ -50,14 +63,85 @@ static bool cron_sanitize_destination(cron_job_t *job)
     return changed;
 }
 
+static const char *cron_kind_name(cron_kind_t kind)
+{
+    switch (kind) {
+    case CRON_KIND_EVERY: return "every";
+    case CRON_KIND_AT:    return "at";
+    default:              return "cron";
+    }
+}
+
 /* ── Persistence ──────────────────────────────────────────────── */
 
+/*
+ * Job definitions live in MIMI_CRON_FILE and are rewritten only when a job
+ * is added, removed or disabled. The only field that changes on every
+ * firing, last_run, goes to a small "<id> <last_run>" text file flushed at
+ * most every MIMI_CRON_STATE_FLUSH_MS; next_run is derived on boot.
+ */
+
 static void cron_generate_id(char *id_buf)
 {
     uint32_t r = esp_random();
     snprintf(id_buf, 9, "%08x", (unsigned int)r);
 }
 
+static cron_job_t *find_job(const char *id)
+{
+    for (int i = 0; i < s_job_count; i++) {
+        if (strcmp(s_jobs[i].id, id) == 0) return &s_jobs[i];
+    }
+    return NULL;
+}
+
+static void cron_load_state(void)
+{
+    FILE *f = fopen(MIMI_CRON_STATE_FILE, "r");
+    if (!f) return;
+
+    char line[64];
+    int applied = 0;
+    while (fgets(line, sizeof(line), f)) {
+        char id[9];
+        long long last_run;
+        if (sscanf(line, "%8s %lld", id, &last_run) != 2) continue;
+        cron_job_t *job = find_job(id);
+        if (job && last_run > job->last_run) {
+            job->last_run = last_run;
+            applied++;
+        }
+    }
+    fclose(f);
+    ESP_LOGI(TAG, "Restored run state for %d jobs", applied);
+}
+
+static esp_err_t cron_save_state(void)
+{
+    char buf[MAX_CRON_JOBS * 32];
+    size_t off = 0;
+    for (int i = 0; i < s_job_count; i++) {
+        if (s_jobs[i].last_run <= 0) continue;
+        off += snprintf(buf + off, sizeof(buf) - off, "%s %lld\n",
+                        s_jobs[i].id, (long long)s_jobs[i].last_run);
+    }
+
+    esp_err_t err = storage_write_atomic(MIMI_CRON_STATE_FILE, buf, off);
+    if (err == ESP_OK) {
+        s_state_dirty = false;
+        ESP_LOGD(TAG, "Run state flushed (%d bytes)", (int)off);
+    }
+    return err;
+}
+
+static void cron_mark_state_dirty(void)
+{
+    if (!s_state_dirty) {
+        s_state_dirty = true;
+        s_state_dirty_tick = xTaskGetTickCount();
+    }
+}
+
 static esp_err_t cron_load_jobs(void)
 {
     FILE *f = fopen(MIMI_CRON_FILE, "r");
@@ -151,22 +235,38 @@ static esp_err_t cron_load_jobs(void)
             cJSON *at_epoch = cJSON_GetObjectItem(item, "at_epoch");
             job->at_epoch = (at_epoch && cJSON_IsNumber(at_epoch))
                             ? (int64_t)at_epoch->valuedouble : 0;
+        } else if (strcmp(kind_str, "cron") == 0) {
+            job->kind = CRON_KIND_CRON;
+            const char *expr = cJSON_GetStringValue(cJSON_GetObjectItem(item, "expr"));
+            if (!expr || cron_expr_parse(expr, &job->cron) != ESP_OK) {
+                ESP_LOGW(TAG, "Skipping job %s: bad cron expression", id);
+                continue;
+            }
+            strncpy(job->expr, expr, sizeof(job->expr) - 1);
         } else {
             continue; /* Unknown kind, skip */
         }
 
+        cJSON *created = cJSON_GetObjectItem(item, "created");
+        job->created = (created && cJSON_IsNumber(created))
+                       ? (int64_t)created->valuedouble : 0;
+
+        /* Files written before the state split carry run times inline */
         cJSON *last_run = cJSON_GetObjectItem(item, "last_run");
         job->last_run = (last_run && cJSON_IsNumber(last_run))
                         ? (int64_t)last_run->valuedouble : 0;
-
         cJSON *next_run = cJSON_GetObjectItem(item, "next_run");
-        job->next_run = (next_run && cJSON_IsNumber(next_run))
-                        ? (int64_t)next_run->valuedouble : 0;
+        if (!created && job->kind == CRON_KIND_EVERY &&
+            next_run && cJSON_IsNumber(next_run) && next_run->valuedouble > 0) {
+            job->created = (int64_t)next_run->valuedouble - job->interval_s;
+            repaired = true;
+        }
 
         s_job_count++;
     }
 
     cJSON_Delete(root);
+    cron_load_state();
     if (repaired) {
         cron_save_jobs();
     }
@@ -186,20 +286,20 @@ static esp_err_t cron_save_jobs(void)
         cJSON_AddStringToObject(item, "id", job->id);
         cJSON_AddStringToObject(item, "name", job->name);
         cJSON_AddBoolToObject(item, "enabled", job->enabled);
-        cJSON_AddStringToObject(item, "kind",
-            job->kind == CRON_KIND_EVERY ? "every" : "at");
+        cJSON_AddStringToObject(item, "kind", cron_kind_name(job->kind));
 
         if (job->kind == CRON_KIND_EVERY) {
             cJSON_AddNumberToObject(item, "interval_s", job->interval_s);
-        } else {
+        } else if (job->kind == CRON_KIND_AT) {
             cJSON_AddNumberToObject(item, "at_epoch", (double)job->at_epoch);
+        } else {
+            cJSON_AddStringToObject(item, "expr", job->expr);
         }
 
         cJSON_AddStringToObject(item, "message", job->message);
         cJSON_AddStringToObject(item, "channel", job->channel);
         cJSON_AddStringToObject(item, "chat_id", job->chat_id);
-        cJSON_AddNumberToObject(item, "last_run", (double)job->last_run);
-        cJSON_AddNumberToObject(item, "next_run", (double)job->next_run);
+        cJSON_AddNumberToObject(item, "created", (double)job->created);
         cJSON_AddBoolToObject(item, "delete_after_run", job->delete_after_run);
 
         cJSON_AddItemToArray(jobs_arr, item);
@@ -207,7 +307,7 @@ static esp_err_t cron_save_jobs(void)
 
     cJSON_AddItemToObject(root, "jobs", jobs_arr);
 
-    char *json_str = cJSON_Print(root);
+    char *json_str = cJSON_PrintUnformatted(root);
     cJSON_Delete(root);
 
     if (!json_str) {
@@ -215,115 +315,223 @@ static esp_err_t cron_save_jobs(void)
         return ESP_ERR_NO_MEM;
     }
 
-    FILE *f = fopen(MIMI_CRON_FILE, "w");
-    if (!f) {
-        ESP_LOGE(TAG, "Failed to open %s for writing", MIMI_CRON_FILE);
-        free(json_str);
-        return ESP_FAIL;
+    esp_err_t err = storage_write_atomic(MIMI_CRON_FILE, json_str, strlen(json_str));
+    cJSON_free(json_str);
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Saved %d cron jobs to %s", s_job_count, MIMI_CRON_FILE);
     }
+    return err;
+}
 
-    size_t len = strlen(json_str);
-    size_t written = fwrite(json_str, 1, len, f);
-    fclose(f);
-    free(json_str);
+/* ── Run times ────────────────────────────────────────────────── */
 
-    if (written != len) {
-        ESP_LOGE(TAG, "Cron save incomplete: %d/%d bytes", (int)written, (int)len);
-        return ESP_FAIL;
+/* First slot of an EVERY job strictly after 'after', in phase with created */
+static int64_t every_next(const cron_job_t *job, int64_t after)
+{
+    int64_t base = job->created;
+    if (after < base) return base + job->interval_s;
+    return after + job->interval_s - (after - base) % job->interval_s;
+}
+
+/* Derive next_run from the definition and last_run. A slot missed while
+ * the device was off fires once right away, as before. */
+static void derive_next_run(cron_job_t *job, int64_t now)
+{
+    job->next_run = 0;
+    if (!job->enabled) return;
+
+    switch (job->kind) {
+    case CRON_KIND_EVERY: {
+        if (job->interval_s == 0) return;
+        int64_t next = every_next(job, now);
+        int64_t missed = next - job->interval_s;
+        job->next_run = (missed > job->created && missed > job->last_run) ? missed : next;
+        break;
     }
+    case CRON_KIND_AT:
+        if (job->last_run >= job->at_epoch) {
+            job->enabled = false;       /* fired, but the disable was never saved */
+        } else {
+            job->next_run = job->at_epoch;
+        }
+        break;
+    case CRON_KIND_CRON: {
+        /* The first slot after the last run; if that has already passed,
+         * it was missed and is due now */
+        int64_t base = job->last_run > job->created ? job->last_run : job->created;
+        if (base > 0 && base < now) {
+            job->next_run = cron_expr_next(&job->cron, base);
+        }
+        if (job->next_run == 0) {
+            job->next_run = cron_expr_next(&job->cron, now);
+        }
+        break;
+    }
+    }
+}
 
-    ESP_LOGI(TAG, "Saved %d cron jobs to %s", s_job_count, MIMI_CRON_FILE);
-    return ESP_OK;
+/* ── Schedule heap (s_lock held) ──────────────────────────────── */
+
+static bool heap_before(int a, int b)
+{
+    return s_jobs[s_heap[a]].next_run < s_jobs[s_heap[b]].next_run;
 }
 
-/* ── Due-job processing ───────────────────────────────────────── */
+static void heap_swap(int a, int b)
+{
+    uint8_t t = s_heap[a];
+    s_heap[a] = s_heap[b];
+    s_heap[b] = t;
+}
 
-static void cron_process_due_jobs(void)
+static void heap_sift_down(int i)
 {
-    time_t now = time(NULL);
+    while (1) {
+        int l = 2 * i + 1, r = l + 1, min = i;
+        if (l < s_heap_len && heap_before(l, min)) min = l;
+        if (r < s_heap_len && heap_before(r, min)) min = r;
+        if (min == i) return;
+        heap_swap(i, min);
+        i = min;
+    }
+}
 
-    bool changed = false;
+static void heap_pop(void)
+{
+    s_heap[0] = s_heap[--s_heap_len];
+    heap_sift_down(0);
+}
 
+/* Rebuild after jobs are added, removed or reordered in s_jobs */
+static void heap_rebuild(void)
+{
+    s_heap_len = 0;
     for (int i = 0; i < s_job_count; i++) {
-        cron_job_t *job = &s_jobs[i];
-        if (!job->enabled) continue;
-        if (job->next_run <= 0) continue;
-        if (job->next_run > now) continue;
-
-        /* Job is due — fire it */
-        ESP_LOGI(TAG, "Cron job firing: %s (%s)", job->name, job->id);
-
-        /* Push message to inbound queue */
-        mimi_msg_t msg;
-        memset(&msg, 0, sizeof(msg));
-        strncpy(msg.channel, job->channel, sizeof(msg.channel) - 1);
-        strncpy(msg.chat_id, job->chat_id, sizeof(msg.chat_id) - 1);
-        msg.content = strdup(job->message);
-
-        if (msg.content) {
-            esp_err_t err = message_bus_push_inbound(&msg);
-            if (err != ESP_OK) {
-                ESP_LOGW(TAG, "Failed to push cron message: %s", esp_err_to_name(err));
-                free(msg.content);
-            }
+        if (s_jobs[i].enabled && s_jobs[i].next_run > 0) {
+            s_heap[s_heap_len++] = (uint8_t)i;
         }
+    }
+    for (int i = s_heap_len / 2 - 1; i >= 0; i--) {
+        heap_sift_down(i);
+    }
+}
+
+static void cron_wake(void)
+{
+    if (s_cron_task) xTaskNotifyGive(s_cron_task);
+}
+
+/* ── Due-job processing ───────────────────────────────────────── */
 
-        /* Update state */
+static void cron_fire(const cron_job_t *job)
+{
+    ESP_LOGI(TAG, "Cron job firing: %s (%s)", job->name, job->id);
+
+    mimi_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    strncpy(msg.channel, job->channel, sizeof(msg.channel) - 1);
+    strncpy(msg.chat_id, job->chat_id, sizeof(msg.chat_id) - 1);
+    msg.flags = MIMI_MSG_NO_COALESCE;
+    msg.content = strdup(job->message);
+
+    if (msg.content) {
+        esp_err_t err = message_bus_push_inbound(&msg);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to push cron message: %s", esp_err_to_name(err));
+            free(msg.content);
+        }
+    }
+}
+
+/* Fire every job at the top of the heap that is due (s_lock held) */
+static void cron_process_due_jobs(time_t now)
+{
+    bool defs_changed = false;
+
+    while (s_heap_len > 0 && s_jobs[s_heap[0]].next_run <= now) {
+        int idx = s_heap[0];
+        cron_job_t *job = &s_jobs[idx];
+        cron_fire(job);
         job->last_run = now;
+        cron_mark_state_dirty();
 
-        if (job->kind == CRON_KIND_AT) {
-            /* One-shot: disable or delete */
-            if (job->delete_after_run) {
-                /* Remove by shifting array */
-                ESP_LOGI(TAG, "Deleting one-shot job: %s", job->name);
-                for (int j = i; j < s_job_count - 1; j++) {
-                    s_jobs[j] = s_jobs[j + 1];
-                }
-                s_job_count--;
-                i--; /* Re-check this index */
-            } else {
-                job->enabled = false;
-                job->next_run = 0;
+        if (job->kind == CRON_KIND_EVERY) {
+            job->next_run = every_next(job, now);
+            heap_sift_down(0);
+            continue;
+        }
+        if (job->kind == CRON_KIND_CRON) {
+            job->next_run = cron_expr_next(&job->cron, now);
+            if (job->next_run > 0) {
+                heap_sift_down(0);
+                continue;
             }
-        } else {
-            /* Recurring: compute next run */
-            job->next_run = now + job->interval_s;
+            ESP_LOGW(TAG, "Cron job %s has no future match, disabling", job->id);
         }
 
-        changed = true;
+        /* One-shot, or an expression that never matches again */
+        defs_changed = true;
+        heap_pop();
+        if (job->delete_after_run) {
+            ESP_LOGI(TAG, "Deleting one-shot job: %s", job->name);
+            for (int j = idx; j < s_job_count - 1; j++) {
+                s_jobs[j] = s_jobs[j + 1];
+            }
+            s_job_count--;
+            heap_rebuild();     /* indices above idx moved down */
+        } else {
+            job->enabled = false;
+            job->next_run = 0;
+        }
     }
 
-    if (changed) {
+    if (defs_changed) {
         cron_save_jobs();
     }
 }
 
-static void cron_task_main(void *arg)
+/* Ticks until the earliest job is due or run state must be flushed, capped
+ * so that wall-clock corrections (SNTP) are picked up (s_lock held) */
+static TickType_t cron_next_wait(void)
 {
-    (void)arg;
-
-    while (1) {
-        vTaskDelay(pdMS_TO_TICKS(MIMI_CRON_CHECK_INTERVAL_MS));
-        cron_process_due_jobs();
+    TickType_t cap = pdMS_TO_TICKS(MIMI_CRON_MAX_SLEEP_MS);
+    if (s_state_dirty) {
+        TickType_t flush_in = pdMS_TO_TICKS(MIMI_CRON_STATE_FLUSH_MS);
+        TickType_t age = xTaskGetTickCount() - s_state_dirty_tick;
+        flush_in = age < flush_in ? flush_in - age : 0;
+        if (flush_in < cap) cap = flush_in;
     }
+    if (s_heap_len == 0) return cap;
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t now_ms = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    int64_t wait_ms = s_jobs[s_heap[0]].next_run * 1000 - now_ms;
+
+    if (wait_ms <= 0) return 0;
+    if (wait_ms > MIMI_CRON_MAX_SLEEP_MS) wait_ms = MIMI_CRON_MAX_SLEEP_MS;
+    TickType_t ticks = pdMS_TO_TICKS(wait_ms);
+    if (ticks == 0) ticks = 1;
+    return ticks < cap ? ticks : cap;
 }
 
-/* ── Compute initial next_run for a new job ───────────────────── */
-
-static void compute_initial_next_run(cron_job_t *job)
+static void cron_task_main(void *arg)
 {
-    time_t now = time(NULL);
+    (void)arg;
 
-    if (job->kind == CRON_KIND_EVERY) {
-        job->next_run = now + job->interval_s;
-    } else if (job->kind == CRON_KIND_AT) {
-        if (job->at_epoch > now) {
-            job->next_run = job->at_epoch;
-        } else {
-            /* Already in the past */
-            job->next_run = 0;
-            job->enabled = false;
+    while (1) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        cron_process_due_jobs(time(NULL));
+        if (s_state_dirty && xTaskGetTickCount() - s_state_dirty_tick >=
+                             pdMS_TO_TICKS(MIMI_CRON_STATE_FLUSH_MS)) {
+            cron_save_state();
         }
+        TickType_t wait = cron_next_wait();
+        xSemaphoreGive(s_lock);
+
+        /* Woken early by cron_add_job()/cron_remove_job() */
+        ulTaskNotifyTake(pdTRUE, wait);
     }
 }
 
@@ -331,6 +539,8 @@ static void compute_initial_next_run(cron_job_t *job)
 
 esp_err_t cron_service_init(void)
 {
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
     return cron_load_jobs();
 }
 
@@ -341,18 +551,23 @@ esp_err_t cron_service_start(void)
         return ESP_OK;
     }
 
-    /* Recompute next_run for all enabled jobs that don't have one */
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    /* next_run is never stored: derive it now that the clock is set */
     time_t now = time(NULL);
+    bool defs_changed = false;
     for (int i = 0; i < s_job_count; i++) {
         cron_job_t *job = &s_jobs[i];
-        if (job->enabled && job->next_run <= 0) {
-            if (job->kind == CRON_KIND_EVERY) {
-                job->next_run = now + job->interval_s;
-            } else if (job->kind == CRON_KIND_AT && job->at_epoch > now) {
-                job->next_run = job->at_epoch;
-            }
+        if (job->created <= 0) {
+            job->created = now;
+            defs_changed = true;
         }
+        derive_next_run(job, now);
+    }
+    if (defs_changed) {
+        cron_save_jobs();
     }
+    heap_rebuild();
 
     BaseType_t ok = xTaskCreate(
         cron_task_main,
@@ -362,28 +577,49 @@ esp_err_t cron_service_start(void)
         4,
         &s_cron_task
     );
+    xSemaphoreGive(s_lock);
     if (ok != pdPASS || !s_cron_task) {
         ESP_LOGE(TAG, "Failed to create cron task");
+        s_cron_task = NULL;
         return ESP_FAIL;
     }
 
-    ESP_LOGI(TAG, "Cron service started (%d jobs, check every %ds)",
-             s_job_count, MIMI_CRON_CHECK_INTERVAL_MS / 1000);
+    ESP_LOGI(TAG, "Cron service started (%d jobs, %d scheduled)", s_job_count, s_heap_len);
     return ESP_OK;
 }
 
 void cron_service_stop(void)
 {
     if (s_cron_task) {
+        /* Take the lock so the task is never deleted while holding it */
+        xSemaphoreTake(s_lock, portMAX_DELAY);
         vTaskDelete(s_cron_task);
         s_cron_task = NULL;
+        if (s_state_dirty) cron_save_state();
+        xSemaphoreGive(s_lock);
         ESP_LOGI(TAG, "Cron service stopped");
     }
 }
 
+void cron_service_flush(void)
+{
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_state_dirty) cron_save_state();
+    xSemaphoreGive(s_lock);
+}
+
 esp_err_t cron_add_job(cron_job_t *job)
 {
+    if (job->kind == CRON_KIND_CRON && cron_expr_parse(job->expr, &job->cron) != ESP_OK) {
+        ESP_LOGW(TAG, "Invalid cron expression: %s", job->expr);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
     if (s_job_count >= MAX_CRON_JOBS) {
+        xSemaphoreGive(s_lock);
         ESP_LOGW(TAG, "Max cron jobs reached (%d)", MAX_CRON_JOBS);
         return ESP_ERR_NO_MEM;
     }
@@ -395,25 +631,35 @@ esp_err_t cron_add_job(cron_job_t *job)
     cron_sanitize_destination(job);
 
     /* Compute initial next_run */
+    time_t now = time(NULL);
     job->enabled = true;
+    job->created = now;
     job->last_run = 0;
-    compute_initial_next_run(job);
+    derive_next_run(job, now);
+    if (job->kind == CRON_KIND_AT && job->at_epoch <= now) {
+        job->enabled = false;           /* already in the past */
+        job->next_run = 0;
+    }
 
     /* Copy into static array */
     s_jobs[s_job_count] = *job;
     s_job_count++;
 
     cron_save_jobs();
+    heap_rebuild();
+    xSemaphoreGive(s_lock);
+    cron_wake();
 
     ESP_LOGI(TAG, "Added cron job: %s (%s) kind=%s next_run=%lld",
-             job->name, job->id,
-             job->kind == CRON_KIND_EVERY ? "every" : "at",
+             job->name, job->id, cron_kind_name(job->kind),
              (long long)job->next_run);
     return ESP_OK;
 }
 
 esp_err_t cron_remove_job(const char *job_id)
 {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
     for (int i = 0; i < s_job_count; i++) {
         if (strcmp(s_jobs[i].id, job_id) == 0) {
             ESP_LOGI(TAG, "Removing cron job: %s (%s)", s_jobs[i].name, job_id);
@@ -425,10 +671,14 @@ esp_err_t cron_remove_job(const char *job_id)
             s_job_count--;
 
             cron_save_jobs();
+            heap_rebuild();
+            xSemaphoreGive(s_lock);
+            cron_wake();
             return ESP_OK;
         }
     }
 
+    xSemaphoreGive(s_lock);
     ESP_LOGW(TAG, "Cron job not found: %s", job_id);
     return ESP_ERR_NOT_FOUND;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "esp_err.h"
+#include "cron/cron_expr.h"
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -8,6 +9,7 @@
 typedef enum {
     CRON_KIND_EVERY = 0,   /* Recurring interval in seconds */
     CRON_KIND_AT    = 1,   /* One-shot at unix timestamp */
+    CRON_KIND_CRON  = 2,   /* 5-field cron expression, local time */
 } cron_kind_t;
 
 /* A single cron job */
@@ -18,11 +20,14 @@ typedef struct {
     cron_kind_t kind;
     uint32_t interval_s;   /* For EVERY: interval in seconds */
     int64_t at_epoch;      /* For AT: unix timestamp */
+    char expr[64];         /* For CRON: expression text */
+    cron_expr_t cron;      /* For CRON: parsed expression */
     char message[256];     /* Message to inject into inbound queue */
     char channel[16];      /* Reply channel (default "system") */
     char chat_id[32];      /* Reply chat_id (default "cron") */
-    int64_t last_run;      /* Last run epoch */
-    int64_t next_run;      /* Next run epoch */
+    int64_t created;       /* Creation epoch; EVERY jobs stay in phase with it */
+    int64_t last_run;      /* Last run epoch (saved lazily, see cron_service_flush) */
+    int64_t next_run;      /* Next run epoch (derived, never saved) */
     bool delete_after_run; /* Remove job after firing (for AT jobs) */
 } cron_job_t;
 
@@ -32,19 +37,29 @@ typedef struct {
 esp_err_t cron_service_init(void);
 
 /**
- * Start the cron timer. Call after WiFi is connected and time is synced.
+ * Start the scheduler task. Call after WiFi is connected and time is synced.
+ * The task sleeps until the earliest due job and is woken early whenever
+ * jobs are added or removed.
  */
 esp_err_t cron_service_start(void);
 
 /**
- * Stop the cron timer.
+ * Stop the scheduler task.
  */
 void cron_service_stop(void);
 
+/**
+ * Write pending last_run updates to flash now. They are otherwise batched
+ * and written every MIMI_CRON_STATE_FLUSH_MS; call before a planned reboot.
+ */
+void cron_service_flush(void);
+
 /**
  * Add a new cron job.
- * @param job  Pointer to job struct (id will be generated)
- * @return ESP_OK on success, ESP_ERR_NO_MEM if max jobs reached
+ * @param job  Pointer to job struct (id will be generated; for CRON jobs
+ *             only expr needs to be set)
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if max jobs reached,
+ *         ESP_ERR_INVALID_ARG if a CRON expression does not parse
  */
 esp_err_t cron_add_job(cron_job_t *job);
 
@@ -0,0 +1,44 @@
+#include "deadline/deadline.h"
+
+#include <stddef.h>
+#include "esp_timer.h"
+
+/* Compiler TLS: each task sees its own binding */
+static __thread deadline_t *s_current = NULL;
+
+void deadline_start(deadline_t *d, uint32_t budget_ms)
+{
+    d->expires_us = esp_timer_get_time() + (int64_t)budget_ms * 1000;
+    d->cancelled = false;
+}
+
+void deadline_bind(deadline_t *d)
+{
+    s_current = d;
+}
+
+void deadline_cancel(deadline_t *d)
+{
+    if (d) d->cancelled = true;
+}
+
+deadline_t *deadline_current(void)
+{
+    return s_current;
+}
+
+bool deadline_expired(void)
+{
+    return deadline_clamp_ms(1) == 0;
+}
+
+int deadline_clamp_ms(int timeout_ms)
+{
+    const deadline_t *d = s_current;
+    if (!d) return timeout_ms;
+    if (d->cancelled) return 0;
+
+    int64_t left_ms = (d->expires_us - esp_timer_get_time()) / 1000;
+    if (left_ms <= 0) return 0;
+    return left_ms < timeout_ms ? (int)left_ms : timeout_ms;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Time budget for one unit of work (an agent turn, a background job).
+ *
+ * A deadline is bound to the task doing the work; network code anywhere below
+ * it (LLM calls, tools, the CONNECT proxy) clamps its timeouts to whatever is
+ * left, and stops early once it is exceeded or cancelled. Code running on a
+ * task without a bound deadline keeps its own timeouts.
+ */
+typedef struct {
+    int64_t expires_us;         /* esp_timer time */
+    volatile bool cancelled;
+} deadline_t;
+
+/** Start a deadline budget_ms from now. */
+void deadline_start(deadline_t *d, uint32_t budget_ms);
+
+/** Bind a deadline to the calling task; NULL unbinds. */
+void deadline_bind(deadline_t *d);
+
+/** Cancel a deadline (safe to call from another task). */
+void deadline_cancel(deadline_t *d);
+
+/** Deadline bound to the calling task, or NULL. */
+deadline_t *deadline_current(void);
+
+/** True when the calling task's deadline has passed or was cancelled. */
+bool deadline_expired(void);
+
+/**
+ * Clamp a timeout to the time left on the calling task's deadline.
+ * Returns timeout_ms unchanged when no deadline is bound, 0 when expired.
+ */
+int deadline_clamp_ms(int timeout_ms);
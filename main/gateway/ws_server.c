@@ -1,110 +1,352 @@
 #include "ws_server.h"
 #include "mimi_config.h"
 #include "bus/message_bus.h"
+#include "agent/agent_loop.h"
+#include "channels/channel.h"
 
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_http_server.h"
 #include "cJSON.h"
 
 static const char *TAG = "ws";
 
 static httpd_handle_t s_server = NULL;
+static TaskHandle_t s_tx_task = NULL;
 
-/* Simple client tracking */
+/* Extra HTTP handlers from other modules, added when the server starts */
+#define WS_MAX_EXTRA_URIS  4
+static httpd_uri_t s_extra_uris[WS_MAX_EXTRA_URIS];
+static int s_extra_uri_count = 0;
+
+#define WS_BUCKETS         16      /* power of two */
+#define WS_TX_BURST        4       /* frames per client per pass */
+#define WS_TX_RETRY_MS     50      /* recheck interval while a client is blocked */
+#define WS_SEND_FAIL_MAX   3
+
+/* One connected client. Slots are reused; the fd and chat_id indexes
+ * chain slots through next_fd / next_chat (-1 ends a chain). */
 typedef struct {
+    bool active;
     int fd;
     char chat_id[32];
-    bool active;
+    int16_t next_fd;
+    int16_t next_chat;
+
+    /* Serialised frames waiting for the tx task */
+    char *ring[MIMI_WS_CLIENT_RING];
+    uint8_t head;
+    uint8_t count;
+    size_t ring_bytes;
+    uint32_t dropped;
+    uint8_t send_failures;
+
+    /* Keepalive */
+    int64_t last_rx_us;
+    bool ping_due;
+    bool pinged;
 } ws_client_t;
 
+static SemaphoreHandle_t s_lock = NULL;
 static ws_client_t s_clients[MIMI_WS_MAX_CLIENTS];
+static int16_t s_by_fd[WS_BUCKETS];
+static int16_t s_by_chat[WS_BUCKETS];
+static int s_client_count = 0;
+static uint32_t s_dropped_total = 0;
+
+static const channel_driver_t s_channel_driver = {
+    .name = MIMI_CHAN_WEBSOCKET,
+    .caps = CHANNEL_CAP_STATUS | CHANNEL_CAP_RECALL,
+    .send = ws_server_send,
+};
 
-static ws_client_t *find_client_by_fd(int fd)
+/* ── Indexes (s_lock held) ────────────────────────────────────── */
+
+static uint32_t chat_hash(const char *s)
 {
-    for (int i = 0; i < MIMI_WS_MAX_CLIENTS; i++) {
-        if (s_clients[i].active && s_clients[i].fd == fd) {
-            return &s_clients[i];
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int16_t *fd_bucket(int fd)
+{
+    return &s_by_fd[(unsigned)fd & (WS_BUCKETS - 1)];
+}
+
+static int16_t *chat_bucket(const char *chat_id)
+{
+    return &s_by_chat[chat_hash(chat_id) & (WS_BUCKETS - 1)];
+}
+
+static void chat_link(int i)
+{
+    int16_t *head = chat_bucket(s_clients[i].chat_id);
+    s_clients[i].next_chat = *head;
+    *head = i;
+}
+
+static void chat_unlink(int i)
+{
+    for (int16_t *p = chat_bucket(s_clients[i].chat_id); *p >= 0; p = &s_clients[*p].next_chat) {
+        if (*p == i) {
+            *p = s_clients[i].next_chat;
+            return;
         }
     }
-    return NULL;
 }
 
-static ws_client_t *find_client_by_chat_id(const char *chat_id)
+static void fd_unlink(int i)
 {
-    for (int i = 0; i < MIMI_WS_MAX_CLIENTS; i++) {
-        if (s_clients[i].active && strcmp(s_clients[i].chat_id, chat_id) == 0) {
-            return &s_clients[i];
+    for (int16_t *p = fd_bucket(s_clients[i].fd); *p >= 0; p = &s_clients[*p].next_fd) {
+        if (*p == i) {
+            *p = s_clients[i].next_fd;
+            return;
         }
     }
-    return NULL;
 }
 
-static ws_client_t *add_client(int fd)
+static int find_by_fd(int fd)
 {
+    for (int i = *fd_bucket(fd); i >= 0; i = s_clients[i].next_fd) {
+        if (s_clients[i].fd == fd) return i;
+    }
+    return -1;
+}
+
+/* ── Client table (s_lock held) ───────────────────────────────── */
+
+static int add_client(int fd)
+{
+    int existing = find_by_fd(fd);
+    if (existing >= 0) return existing;
+
     for (int i = 0; i < MIMI_WS_MAX_CLIENTS; i++) {
-        if (!s_clients[i].active) {
-            s_clients[i].fd = fd;
-            snprintf(s_clients[i].chat_id, sizeof(s_clients[i].chat_id), "ws_%d", fd);
-            s_clients[i].active = true;
-            ESP_LOGI(TAG, "Client connected: %s (fd=%d)", s_clients[i].chat_id, fd);
-            return &s_clients[i];
-        }
+        ws_client_t *c = &s_clients[i];
+        if (c->active) continue;
+
+        memset(c, 0, sizeof(*c));
+        c->active = true;
+        c->fd = fd;
+        snprintf(c->chat_id, sizeof(c->chat_id), "ws_%d", fd);
+        c->last_rx_us = esp_timer_get_time();
+
+        int16_t *head = fd_bucket(fd);
+        c->next_fd = *head;
+        *head = i;
+        chat_link(i);
+        s_client_count++;
+        ESP_LOGI(TAG, "Client connected: %s (fd=%d, %d/%d)",
+                 c->chat_id, fd, s_client_count, MIMI_WS_MAX_CLIENTS);
+        return i;
     }
     ESP_LOGW(TAG, "Max clients reached, rejecting fd=%d", fd);
-    return NULL;
+    return -1;
 }
 
-static void remove_client(int fd)
+static void remove_client(int i)
 {
-    for (int i = 0; i < MIMI_WS_MAX_CLIENTS; i++) {
-        if (s_clients[i].active && s_clients[i].fd == fd) {
-            ESP_LOGI(TAG, "Client disconnected: %s", s_clients[i].chat_id);
-            s_clients[i].active = false;
-            return;
-        }
+    ws_client_t *c = &s_clients[i];
+    fd_unlink(i);
+    chat_unlink(i);
+    for (int n = 0; n < c->count; n++) {
+        free(c->ring[(c->head + n) % MIMI_WS_CLIENT_RING]);
     }
+    ESP_LOGI(TAG, "Client disconnected: %s (%u frames dropped)", c->chat_id, (unsigned)c->dropped);
+    memset(c, 0, sizeof(*c));
+    s_client_count--;
 }
 
-static esp_err_t ws_handler(httpd_req_t *req)
+static void set_chat_id(int i, const char *chat_id)
 {
-    if (req->method == HTTP_GET) {
-        /* WebSocket handshake — register client */
-        int fd = httpd_req_to_sockfd(req);
-        add_client(fd);
-        return ESP_OK;
+    ws_client_t *c = &s_clients[i];
+    if (strncmp(c->chat_id, chat_id, sizeof(c->chat_id) - 1) == 0) return;
+    chat_unlink(i);
+    strncpy(c->chat_id, chat_id, sizeof(c->chat_id) - 1);
+    c->chat_id[sizeof(c->chat_id) - 1] = '\0';
+    chat_link(i);
+}
+
+static char *ring_pop(ws_client_t *c)
+{
+    char *frame = c->ring[c->head];
+    c->ring[c->head] = NULL;
+    c->head = (c->head + 1) % MIMI_WS_CLIENT_RING;
+    c->count--;
+    c->ring_bytes -= strlen(frame);
+    return frame;
+}
+
+/* Queue a frame, applying the overflow policy when the ring is full.
+ * Takes ownership of frame. Returns false if the client must be closed. */
+static bool ring_push(ws_client_t *c, char *frame)
+{
+    size_t len = strlen(frame);
+
+    while (c->count > 0 &&
+           (c->count == MIMI_WS_CLIENT_RING || c->ring_bytes + len > MIMI_WS_CLIENT_RING_BYTES)) {
+#if MIMI_WS_OVERFLOW_POLICY == MIMI_WS_OVERFLOW_DROP_OLDEST
+        free(ring_pop(c));
+        c->dropped++;
+        s_dropped_total++;
+        ESP_LOGW(TAG, "%s is not keeping up, dropped oldest frame", c->chat_id);
+#elif MIMI_WS_OVERFLOW_POLICY == MIMI_WS_OVERFLOW_DROP_NEWEST
+        free(frame);
+        c->dropped++;
+        s_dropped_total++;
+        ESP_LOGW(TAG, "%s is not keeping up, dropped new frame", c->chat_id);
+        return true;
+#else
+        free(frame);
+        ESP_LOGW(TAG, "%s is not keeping up, closing", c->chat_id);
+        return false;
+#endif
     }
 
-    /* Receive WebSocket frame */
-    httpd_ws_frame_t ws_pkt = {0};
-    ws_pkt.type = HTTPD_WS_TYPE_TEXT;
+    c->ring[(c->head + c->count) % MIMI_WS_CLIENT_RING] = frame;
+    c->count++;
+    c->ring_bytes += len;
+    return true;
+}
 
-    /* Get frame length */
-    esp_err_t ret = httpd_ws_recv_frame(req, &ws_pkt, 0);
-    if (ret != ESP_OK) return ret;
+/* ── Sending ──────────────────────────────────────────────────── */
 
-    if (ws_pkt.len == 0) return ESP_OK;
+/* A socket that can't take more data is skipped rather than waited on */
+static bool socket_writable(int fd)
+{
+    fd_set wfds;
+    FD_ZERO(&wfds);
+    FD_SET(fd, &wfds);
+    struct timeval tv = { 0 };
+    return select(fd + 1, NULL, &wfds, NULL, &tv) > 0;
+}
 
-    ws_pkt.payload = calloc(1, ws_pkt.len + 1);
-    if (!ws_pkt.payload) return ESP_ERR_NO_MEM;
+static esp_err_t send_frame(int fd, httpd_ws_type_t type, char *payload, size_t len)
+{
+    httpd_ws_frame_t pkt = {
+        .final = true,
+        .type = type,
+        .payload = (uint8_t *)payload,
+        .len = len,
+    };
+    return httpd_ws_send_frame_async(s_server, fd, &pkt);
+}
 
-    ret = httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len);
-    if (ret != ESP_OK) {
-        free(ws_pkt.payload);
-        return ret;
+/* Mark idle clients for a ping; returns how many fds to close */
+static int keepalive_scan(int64_t now, int *close_fds)
+{
+    const int64_t ping_after = (int64_t)MIMI_WS_PING_INTERVAL_S * 1000000;
+    const int64_t dead_after = ping_after + (int64_t)MIMI_WS_PONG_TIMEOUT_S * 1000000;
+    int n = 0;
+
+    for (int i = 0; i < MIMI_WS_MAX_CLIENTS; i++) {
+        ws_client_t *c = &s_clients[i];
+        if (!c->active) continue;
+        int64_t idle = now - c->last_rx_us;
+        if (idle > dead_after) {
+            ESP_LOGW(TAG, "%s missed keepalive, closing", c->chat_id);
+            close_fds[n++] = c->fd;
+        } else if (idle > ping_after && !c->pinged) {
+            c->ping_due = true;
+        }
     }
+    return n;
+}
 
-    int fd = httpd_req_to_sockfd(req);
-    ws_client_t *client = find_client_by_fd(fd);
+static void ws_tx_task(void *arg)
+{
+    bool blocked = false;
+    int close_fds[MIMI_WS_MAX_CLIENTS];
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(blocked ? WS_TX_RETRY_MS : 1000));
+        blocked = false;
+        if (!s_server) continue;
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        int n_close = keepalive_scan(esp_timer_get_time(), close_fds);
+        xSemaphoreGive(s_lock);
+
+        for (int i = 0; i < MIMI_WS_MAX_CLIENTS; i++) {
+            ws_client_t *c = &s_clients[i];
+            for (int burst = 0; burst < WS_TX_BURST; burst++) {
+                xSemaphoreTake(s_lock, portMAX_DELAY);
+                if (!c->active || (!c->ping_due && c->count == 0)) {
+                    xSemaphoreGive(s_lock);
+                    break;
+                }
+                int fd = c->fd;
+                if (!socket_writable(fd)) {
+                    xSemaphoreGive(s_lock);
+                    blocked = true;
+                    break;
+                }
+                bool ping = c->ping_due;
+                char *frame = NULL;
+                if (ping) {
+                    c->ping_due = false;
+                    c->pinged = true;
+                } else {
+                    frame = ring_pop(c);
+                }
+                xSemaphoreGive(s_lock);
+
+                /* Sent outside the lock so the httpd task is never held up */
+                esp_err_t err = ping ? send_frame(fd, HTTPD_WS_TYPE_PING, NULL, 0)
+                                     : send_frame(fd, HTTPD_WS_TYPE_TEXT, frame, strlen(frame));
+                free(frame);
+                if (err == ESP_OK) {
+                    xSemaphoreTake(s_lock, portMAX_DELAY);
+                    if (c->active && c->fd == fd) c->send_failures = 0;
+                    xSemaphoreGive(s_lock);
+                    continue;
+                }
+
+                ESP_LOGW(TAG, "Send to fd=%d failed: %s", fd, esp_err_to_name(err));
+                xSemaphoreTake(s_lock, portMAX_DELAY);
+                bool give_up = c->active && c->fd == fd && ++c->send_failures >= WS_SEND_FAIL_MAX;
+                xSemaphoreGive(s_lock);
+                if (give_up && n_close < MIMI_WS_MAX_CLIENTS) {
+                    close_fds[n_close++] = fd;
+                }
+                break;
+            }
+        }
 
-    /* Parse JSON message */
-    cJSON *root = cJSON_Parse((char *)ws_pkt.payload);
-    free(ws_pkt.payload);
+        /* The close callback removes the client from the table */
+        for (int i = 0; i < n_close; i++) {
+            httpd_sess_trigger_close(s_server, close_fds[i]);
+        }
+    }
+}
+
+/* ── HTTP server callbacks ────────────────────────────────────── */
+
+static void ws_on_close(httpd_handle_t hd, int fd)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int i = find_by_fd(fd);
+    if (i >= 0) remove_client(i);
+    xSemaphoreGive(s_lock);
+    close(fd);
+}
 
+static void handle_text(int fd, const char *payload)
+{
+    cJSON *root = cJSON_Parse(payload);
     if (!root) {
         ESP_LOGW(TAG, "Invalid JSON from fd=%d", fd);
-        return ESP_OK;
+        return;
     }
 
     cJSON *type = cJSON_GetObjectItem(root, "type");
@@ -113,16 +355,18 @@ static esp_err_t ws_handler(httpd_req_t *req)
     if (type && cJSON_IsString(type) && strcmp(type->valuestring, "message") == 0
         && content && cJSON_IsString(content)) {
 
-        /* Determine chat_id */
-        const char *chat_id = client ? client->chat_id : "ws_unknown";
+        /* Determine chat_id; a client may rename itself with any message */
+        char chat_id[32] = "ws_unknown";
         cJSON *cid = cJSON_GetObjectItem(root, "chat_id");
-        if (cid && cJSON_IsString(cid)) {
-            chat_id = cid->valuestring;
-            /* Update client's chat_id if provided */
-            if (client) {
-                strncpy(client->chat_id, chat_id, sizeof(client->chat_id) - 1);
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        int i = find_by_fd(fd);
+        if (i >= 0) {
+            if (cid && cJSON_IsString(cid) && cid->valuestring[0]) {
+                set_chat_id(i, cid->valuestring);
             }
+            strncpy(chat_id, s_clients[i].chat_id, sizeof(chat_id) - 1);
         }
+        xSemaphoreGive(s_lock);
 
         ESP_LOGI(TAG, "WS message from %s: %.40s...", chat_id, content->valuestring);
 
@@ -132,22 +376,101 @@ static esp_err_t ws_handler(httpd_req_t *req)
         strncpy(msg.chat_id, chat_id, sizeof(msg.chat_id) - 1);
         msg.content = strdup(content->valuestring);
         if (msg.content) {
-            message_bus_push_inbound(&msg);
+            if (message_bus_push_inbound(&msg) == ESP_OK) {
+                agent_loop_supersede(MIMI_CHAN_WEBSOCKET, msg.chat_id);
+            } else {
+                free(msg.content);
+            }
         }
     }
 
     cJSON_Delete(root);
-    return ESP_OK;
+}
+
+static esp_err_t ws_handler(httpd_req_t *req)
+{
+    int fd = httpd_req_to_sockfd(req);
+
+    if (req->method == HTTP_GET) {
+        /* WebSocket handshake — register client, or refuse when full */
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        int i = add_client(fd);
+        xSemaphoreGive(s_lock);
+        return i >= 0 ? ESP_OK : ESP_FAIL;
+    }
+
+    /* Get frame type and length */
+    httpd_ws_frame_t ws_pkt = {0};
+    esp_err_t ret = httpd_ws_recv_frame(req, &ws_pkt, 0);
+    if (ret != ESP_OK) return ret;
+
+    if (ws_pkt.len > MIMI_WS_MAX_FRAME) {
+        ESP_LOGW(TAG, "Frame of %d bytes from fd=%d exceeds limit, closing", (int)ws_pkt.len, fd);
+        return ESP_FAIL;
+    }
+
+    /* Any frame from the client proves it is alive */
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int i = find_by_fd(fd);
+    if (i >= 0) {
+        s_clients[i].last_rx_us = esp_timer_get_time();
+        s_clients[i].pinged = false;
+        s_clients[i].ping_due = false;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (ws_pkt.len > 0) {
+        ws_pkt.payload = calloc(1, ws_pkt.len + 1);
+        if (!ws_pkt.payload) return ESP_ERR_NO_MEM;
+        ret = httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len);
+        if (ret != ESP_OK) {
+            free(ws_pkt.payload);
+            return ret;
+        }
+    }
+
+    switch (ws_pkt.type) {
+    case HTTPD_WS_TYPE_TEXT:
+        if (ws_pkt.payload) handle_text(fd, (char *)ws_pkt.payload);
+        break;
+    case HTTPD_WS_TYPE_PING:
+        /* Echo the payload back, as the protocol requires */
+        ws_pkt.type = HTTPD_WS_TYPE_PONG;
+        ret = httpd_ws_send_frame(req, &ws_pkt);
+        break;
+    case HTTPD_WS_TYPE_CLOSE:
+        ws_pkt.len = 0;
+        httpd_ws_send_frame(req, &ws_pkt);
+        break;
+    default:
+        break;      /* PONG and binary frames only refresh the keepalive */
+    }
+
+    free(ws_pkt.payload);
+    return ret;
 }
 
 esp_err_t ws_server_start(void)
 {
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_lock) return ESP_ERR_NO_MEM;
+    }
+
     memset(s_clients, 0, sizeof(s_clients));
+    memset(s_by_fd, 0xff, sizeof(s_by_fd));
+    memset(s_by_chat, 0xff, sizeof(s_by_chat));
+    s_client_count = 0;
 
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = MIMI_WS_PORT;
     config.ctrl_port = MIMI_WS_PORT + 1;
-    config.max_open_sockets = MIMI_WS_MAX_CLIENTS;
+    /* Spare sockets keep webhook and other HTTP requests from evicting clients */
+    config.max_open_sockets = MIMI_WS_MAX_CLIENTS + MIMI_WS_HTTP_SOCKETS;
+    config.lru_purge_enable = true;
+    config.send_wait_timeout = MIMI_WS_SEND_TIMEOUT_S;
+    config.stack_size = MIMI_WS_HTTPD_STACK;
+    config.close_fn = ws_on_close;
 
     esp_err_t ret = httpd_start(&s_server, &config);
     if (ret != ESP_OK) {
@@ -161,49 +484,102 @@ esp_err_t ws_server_start(void)
         .method = HTTP_GET,
         .handler = ws_handler,
         .is_websocket = true,
+        .handle_ws_control_frames = true,
     };
     httpd_register_uri_handler(s_server, &ws_uri);
 
-    ESP_LOGI(TAG, "WebSocket server started on port %d", MIMI_WS_PORT);
+    for (int i = 0; i < s_extra_uri_count; i++) {
+        httpd_register_uri_handler(s_server, &s_extra_uris[i]);
+    }
+
+    if (!s_tx_task &&
+        xTaskCreatePinnedToCore(ws_tx_task, "ws_tx", MIMI_WS_TX_STACK, NULL,
+                                MIMI_WS_TX_PRIO, &s_tx_task, MIMI_WS_TX_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start WS tx task");
+        httpd_stop(s_server);
+        s_server = NULL;
+        return ESP_FAIL;
+    }
+
+    if (channel_register(&s_channel_driver) == CHANNEL_ID_NONE) {
+        ESP_LOGW(TAG, "Replies to WebSocket clients will not be delivered");
+    }
+
+    ESP_LOGI(TAG, "WebSocket server started on port %d (max %d clients)",
+             MIMI_WS_PORT, MIMI_WS_MAX_CLIENTS);
     return ESP_OK;
 }
 
-esp_err_t ws_server_send(const char *chat_id, const char *text)
+esp_err_t ws_server_register_uri(const httpd_uri_t *uri)
 {
-    if (!s_server) return ESP_ERR_INVALID_STATE;
+    if (s_extra_uri_count >= WS_MAX_EXTRA_URIS) {
+        ESP_LOGE(TAG, "No room for handler %s", uri->uri);
+        return ESP_ERR_NO_MEM;
+    }
+    s_extra_uris[s_extra_uri_count++] = *uri;
+    if (s_server) {
+        return httpd_register_uri_handler(s_server, uri);
+    }
+    return ESP_OK;
+}
 
-    ws_client_t *client = find_client_by_chat_id(chat_id);
-    if (!client) {
+/* Queue a serialised frame for every client using this chat_id */
+static esp_err_t queue_json(const char *chat_id, cJSON *obj)
+{
+    char *json_str = cJSON_PrintUnformatted(obj);
+    cJSON_Delete(obj);
+    if (!json_str) return ESP_ERR_NO_MEM;
+
+    int delivered = 0;
+    int close_fds[MIMI_WS_MAX_CLIENTS];
+    int n_close = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = *chat_bucket(chat_id); i >= 0; i = s_clients[i].next_chat) {
+        ws_client_t *c = &s_clients[i];
+        if (strcmp(c->chat_id, chat_id) != 0) continue;
+        char *frame = strdup(json_str);
+        if (!frame) break;
+        if (!ring_push(c, frame)) {
+            close_fds[n_close++] = c->fd;
+        }
+        delivered++;
+    }
+    xSemaphoreGive(s_lock);
+    cJSON_free(json_str);
+
+    if (delivered == 0) {
         ESP_LOGW(TAG, "No WS client with chat_id=%s", chat_id);
         return ESP_ERR_NOT_FOUND;
     }
 
+    for (int i = 0; i < n_close; i++) {
+        httpd_sess_trigger_close(s_server, close_fds[i]);
+    }
+    xTaskNotifyGive(s_tx_task);
+    return ESP_OK;
+}
+
+esp_err_t ws_server_send(const char *chat_id, const char *text)
+{
+    if (!s_server) return ESP_ERR_INVALID_STATE;
+
     /* Build response JSON */
     cJSON *resp = cJSON_CreateObject();
     cJSON_AddStringToObject(resp, "type", "response");
     cJSON_AddStringToObject(resp, "content", text);
     cJSON_AddStringToObject(resp, "chat_id", chat_id);
+    return queue_json(chat_id, resp);
+}
 
-    char *json_str = cJSON_PrintUnformatted(resp);
-    cJSON_Delete(resp);
-
-    if (!json_str) return ESP_ERR_NO_MEM;
-
-    httpd_ws_frame_t ws_pkt = {
-        .type = HTTPD_WS_TYPE_TEXT,
-        .payload = (uint8_t *)json_str,
-        .len = strlen(json_str),
-    };
-
-    esp_err_t ret = httpd_ws_send_frame_async(s_server, client->fd, &ws_pkt);
-    free(json_str);
-
-    if (ret != ESP_OK) {
-        ESP_LOGW(TAG, "Failed to send to %s: %s", chat_id, esp_err_to_name(ret));
-        remove_client(client->fd);
-    }
-
-    return ret;
+void ws_server_get_stats(int *clients, uint32_t *dropped)
+{
+    *clients = 0;
+    *dropped = 0;
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *clients = s_client_count;
+    *dropped = s_dropped_total;
+    xSemaphoreGive(s_lock);
 }
 
 esp_err_t ws_server_stop(void)
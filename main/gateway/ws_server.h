@@ -1,6 +1,8 @@
 #pragma once
 
+#include <stdint.h>
 #include "esp_err.h"
+#include "esp_http_server.h"
 
 /**
  * Initialize and start the WebSocket server on MIMI_WS_PORT.
@@ -12,6 +14,13 @@
  */
 esp_err_t ws_server_start(void);
 
+/**
+ * Serve an extra HTTP endpoint (e.g. a webhook) on the same server.
+ * May be called before ws_server_start(); the handler is added when the
+ * server starts. The uri string must stay valid.
+ */
+esp_err_t ws_server_register_uri(const httpd_uri_t *uri);
+
 /**
  * Send a text message to a specific WebSocket client by chat_id.
  * @param chat_id  Client identifier (assigned on connection)
@@ -19,6 +28,11 @@ esp_err_t ws_server_start(void);
  */
 esp_err_t ws_server_send(const char *chat_id, const char *text);
 
+/**
+ * Connected clients, and frames dropped by backpressure since boot.
+ */
+void ws_server_get_stats(int *clients, uint32_t *dropped);
+
 /**
  * Stop the WebSocket server.
  */
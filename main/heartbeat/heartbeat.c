@@ -1,82 +1,269 @@
 #include "heartbeat/heartbeat.h"
 #include "mimi_config.h"
 #include "bus/message_bus.h"
+#include "storage/storage.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <time.h>
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "freertos/timers.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 
 static const char *TAG = "heartbeat";
 
-#define HEARTBEAT_PROMPT \
-    "Read " MIMI_HEARTBEAT_FILE " and follow any instructions or tasks listed there. " \
-    "If nothing needs attention, reply with just: HEARTBEAT_OK"
+#define HEARTBEAT_PROMPT_HEAD \
+    "Read " MIMI_HEARTBEAT_FILE " and work on the tasks listed below, which are new, " \
+    "changed or due now. Ignore the other tasks in the file. " \
+    "If nothing needs attention, reply with just: HEARTBEAT_OK\n\nTasks:\n"
+
+#define HB_LINE_MAX     256
+
+/* When a task was last handed to the agent, keyed by its line hash */
+typedef struct {
+    uint32_t hash;
+    int64_t last_run;
+} hb_state_t;
 
 static TimerHandle_t s_heartbeat_timer = NULL;
+static TaskHandle_t s_worker = NULL;
+static SemaphoreHandle_t s_lock = NULL;     /* worker tick vs. CLI trigger */
+static hb_state_t s_state[MIMI_HEARTBEAT_MAX_TASKS];
+static int s_state_count = 0;
+static bool s_state_loaded = false;
 
-/* ── Content check ────────────────────────────────────────────── */
+/* ── Task parsing ─────────────────────────────────────────────── */
 
 /**
- * Check if HEARTBEAT.md has actionable content.
- * Returns true if any line is NOT:
+ * A line is actionable unless it is:
  *   - empty / whitespace-only
  *   - a markdown header (starts with #)
  *   - a completed checkbox (- [x] or * [x])
+ * Returns the trimmed line, or NULL.
  */
-static bool heartbeat_has_tasks(void)
+static char *task_text(char *line)
 {
-    FILE *f = fopen(MIMI_HEARTBEAT_FILE, "r");
-    if (!f) {
-        return false;
+    char *p = line;
+    while (*p && isspace((unsigned char)*p)) {
+        p++;
     }
 
-    char line[256];
-    bool found_task = false;
+    size_t len = strlen(p);
+    while (len > 0 && isspace((unsigned char)p[len - 1])) {
+        p[--len] = '\0';
+    }
 
-    while (fgets(line, sizeof(line), f)) {
-        /* Skip leading whitespace */
-        const char *p = line;
-        while (*p && isspace((unsigned char)*p)) {
-            p++;
-        }
+    if (*p == '\0' || *p == '#') {
+        return NULL;
+    }
 
-        /* Skip empty lines */
-        if (*p == '\0') {
-            continue;
+    /* Skip completed checkboxes: "- [x]" or "* [x]" */
+    if ((*p == '-' || *p == '*') && *(p + 1) == ' ' && *(p + 2) == '[') {
+        char mark = *(p + 3);
+        if ((mark == 'x' || mark == 'X') && *(p + 4) == ']') {
+            return NULL;
         }
+    }
+    return p;
+}
 
-        /* Skip markdown headers */
-        if (*p == '#') {
-            continue;
-        }
+static uint32_t task_hash(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
 
-        /* Skip completed checkboxes: "- [x]" or "* [x]" */
-        if ((*p == '-' || *p == '*') && *(p + 1) == ' ' && *(p + 2) == '[') {
-            char mark = *(p + 3);
-            if ((mark == 'x' || mark == 'X') && *(p + 4) == ']') {
-                continue;
+/*
+ * Scheduling hint in a task line:
+ *   (every 2h) / (every 45m) / (every 1d) / (hourly) -> repeat interval
+ *   (daily 08:30)                                   -> once a day, local time
+ * A task without a hint runs once, and again whenever its line changes.
+ */
+typedef struct {
+    int64_t interval_s;     /* 0 = none */
+    int daily_min;          /* minute of day, -1 = none */
+} hb_hint_t;
+
+static hb_hint_t task_hint(const char *task)
+{
+    hb_hint_t hint = { 0, -1 };
+    const char *p;
+
+    if ((p = strcasestr(task, "(every ")) != NULL) {
+        char unit = 'm';
+        long n = 0;
+        if (sscanf(p + 7, "%ld%c", &n, &unit) >= 1 && n > 0) {
+            switch (tolower((unsigned char)unit)) {
+            case 'd': hint.interval_s = n * 86400; break;
+            case 'h': hint.interval_s = n * 3600;  break;
+            default:  hint.interval_s = n * 60;    break;
             }
         }
+    } else if (strcasestr(task, "(hourly)")) {
+        hint.interval_s = 3600;
+    } else if ((p = strcasestr(task, "(daily ")) != NULL) {
+        int hh, mm;
+        if (sscanf(p + 7, "%d:%d", &hh, &mm) == 2 &&
+            hh >= 0 && hh < 24 && mm >= 0 && mm < 60) {
+            hint.daily_min = hh * 60 + mm;
+        }
+    }
+    return hint;
+}
 
-        /* Found an actionable line */
-        found_task = true;
-        break;
+static bool task_due(const hb_hint_t *hint, const hb_state_t *st, time_t now)
+{
+    if (!st) {
+        return true;                            /* new or changed line */
+    }
+    if (hint->interval_s > 0) {
+        return now - st->last_run >= hint->interval_s;
     }
+    if (hint->daily_min >= 0) {
+        struct tm tm;
+        localtime_r(&now, &tm);
+        if (tm.tm_hour * 60 + tm.tm_min < hint->daily_min) {
+            return false;                       /* not yet time today */
+        }
+        tm.tm_hour = hint->daily_min / 60;
+        tm.tm_min = hint->daily_min % 60;
+        tm.tm_sec = 0;
+        return st->last_run < (int64_t)mktime(&tm);
+    }
+    return false;                               /* one-off, already handled */
+}
+
+/* ── Persisted state ──────────────────────────────────────────── */
+
+static const hb_state_t *state_find(uint32_t hash)
+{
+    for (int i = 0; i < s_state_count; i++) {
+        if (s_state[i].hash == hash) return &s_state[i];
+    }
+    return NULL;
+}
 
+static void state_load(void)
+{
+    s_state_loaded = true;
+    s_state_count = 0;
+
+    FILE *f = fopen(MIMI_HEARTBEAT_STATE_FILE, "r");
+    if (!f) return;
+
+    unsigned long hash;
+    long long last_run;
+    while (s_state_count < MIMI_HEARTBEAT_MAX_TASKS &&
+           fscanf(f, "%lx %lld", &hash, &last_run) == 2) {
+        s_state[s_state_count].hash = (uint32_t)hash;
+        s_state[s_state_count].last_run = last_run;
+        s_state_count++;
+    }
     fclose(f);
-    return found_task;
+}
+
+static void state_save(void)
+{
+    /* "%08lx %lld\n" is at most 30 bytes per task */
+    static char buf[MIMI_HEARTBEAT_MAX_TASKS * 32];     /* s_lock held */
+    size_t off = 0;
+    for (int i = 0; i < s_state_count; i++) {
+        off += snprintf(buf + off, sizeof(buf) - off, "%08lx %lld\n",
+                        (unsigned long)s_state[i].hash, (long long)s_state[i].last_run);
+    }
+    if (storage_write_atomic(MIMI_HEARTBEAT_STATE_FILE, buf, off) != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot save heartbeat state");
+    }
 }
 
 /* ── Send heartbeat to agent ──────────────────────────────────── */
 
-static bool heartbeat_send(void)
+/*
+ * Collect the tasks that need a turn into prompt (after the header) and
+ * rebuild the state table for the tasks now in the file. Returns the
+ * number of tasks listed. With force, every actionable task is listed.
+ */
+static int heartbeat_collect(bool force, char *prompt, size_t size, bool *state_changed)
 {
-    if (!heartbeat_has_tasks()) {
-        ESP_LOGD(TAG, "No actionable tasks in HEARTBEAT.md");
+    FILE *f = fopen(MIMI_HEARTBEAT_FILE, "r");
+    if (!f) {
+        *state_changed = s_state_count > 0;
+        s_state_count = 0;
+        return 0;
+    }
+
+    static hb_state_t next[MIMI_HEARTBEAT_MAX_TASKS];     /* s_lock held */
+    time_t now = time(NULL);
+    int next_count = 0;
+    int due = 0;
+    size_t off = strlen(prompt);
+    char line[HB_LINE_MAX];
+
+    while (fgets(line, sizeof(line), f) && next_count < MIMI_HEARTBEAT_MAX_TASKS) {
+        char *task = task_text(line);
+        if (!task) {
+            continue;
+        }
+
+        uint32_t hash = task_hash(task);
+        const hb_state_t *st = state_find(hash);
+        hb_hint_t hint = task_hint(task);
+
+        hb_state_t *ns = &next[next_count++];
+        ns->hash = hash;
+        ns->last_run = st ? st->last_run : 0;
+
+        /* A task that no longer fits in the prompt waits for the next tick */
+        if ((force || task_due(&hint, st, now)) && off + strlen(task) + 2 < size) {
+            off += snprintf(prompt + off, size - off, "%s\n", task);
+            ns->last_run = now;
+            due++;
+        }
+    }
+    fclose(f);
+
+    *state_changed = due > 0 || next_count != s_state_count;
+    memcpy(s_state, next, next_count * sizeof(hb_state_t));
+    s_state_count = next_count;
+    return due;
+}
+
+static bool heartbeat_send(bool force)
+{
+    if (!s_lock) {
+        return false;
+    }
+
+    char *prompt = malloc(MIMI_HEARTBEAT_PROMPT_SIZE);
+    if (!prompt) {
+        ESP_LOGE(TAG, "Failed to allocate heartbeat prompt");
+        return false;
+    }
+    strlcpy(prompt, HEARTBEAT_PROMPT_HEAD, MIMI_HEARTBEAT_PROMPT_SIZE);
+
+    bool state_changed = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (!s_state_loaded) {
+        state_load();
+    }
+    int due = heartbeat_collect(force, prompt, MIMI_HEARTBEAT_PROMPT_SIZE, &state_changed);
+    if (due == 0 && state_changed) {
+        state_save();
+    }
+    xSemaphoreGive(s_lock);
+
+    if (due == 0) {
+        ESP_LOGD(TAG, "No new, changed or due tasks in HEARTBEAT.md");
+        free(prompt);
         return false;
     }
 
@@ -84,36 +271,58 @@ static bool heartbeat_send(void)
     memset(&msg, 0, sizeof(msg));
     strncpy(msg.channel, MIMI_CHAN_SYSTEM, sizeof(msg.channel) - 1);
     strncpy(msg.chat_id, "heartbeat", sizeof(msg.chat_id) - 1);
-    msg.content = strdup(HEARTBEAT_PROMPT);
+    msg.content = prompt;
 
-    if (!msg.content) {
-        ESP_LOGE(TAG, "Failed to allocate heartbeat prompt");
-        return false;
+    /* Pushed without the lock: the bus may block while the agent is busy */
+    esp_err_t err = message_bus_push_inbound(&msg);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (err != ESP_OK) {
+        /* Back to the saved state so the tasks are retried next tick */
+        state_load();
+    } else {
+        state_save();
     }
+    xSemaphoreGive(s_lock);
 
-    esp_err_t err = message_bus_push_inbound(&msg);
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "Failed to push heartbeat message: %s", esp_err_to_name(err));
         free(msg.content);
         return false;
     }
 
-    ESP_LOGI(TAG, "Triggered agent check");
+    ESP_LOGI(TAG, "Triggered agent check (%d tasks)", due);
     return true;
 }
 
-/* ── Timer callback ───────────────────────────────────────────── */
+/* ── Timer and worker ─────────────────────────────────────────── */
+
+/* File I/O and the bus push don't belong on the timer service task, whose
+ * stack is small and which every other software timer shares */
+static void heartbeat_task(void *arg)
+{
+    (void)arg;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        heartbeat_send(false);
+    }
+}
 
 static void heartbeat_timer_callback(TimerHandle_t xTimer)
 {
     (void)xTimer;
-    heartbeat_send();
+    xTaskNotifyGive(s_worker);
 }
 
 /* ── Public API ───────────────────────────────────────────────── */
 
 esp_err_t heartbeat_init(void)
 {
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+
     ESP_LOGI(TAG, "Heartbeat service initialized (file: %s, interval: %ds)",
              MIMI_HEARTBEAT_FILE, MIMI_HEARTBEAT_INTERVAL_MS / 1000);
     return ESP_OK;
@@ -126,6 +335,13 @@ esp_err_t heartbeat_start(void)
         return ESP_OK;
     }
 
+    if (!s_worker &&
+        xTaskCreatePinnedToCore(heartbeat_task, "heartbeat", MIMI_HEARTBEAT_STACK, NULL,
+                                MIMI_HEARTBEAT_PRIO, &s_worker, MIMI_HEARTBEAT_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start heartbeat worker");
+        return ESP_FAIL;
+    }
+
     s_heartbeat_timer = xTimerCreate(
         "heartbeat",
         pdMS_TO_TICKS(MIMI_HEARTBEAT_INTERVAL_MS),
@@ -160,5 +376,5 @@ void heartbeat_stop(void)
 
 bool heartbeat_trigger(void)
 {
-    return heartbeat_send();
+    return heartbeat_send(true);
 }
@@ -9,8 +9,10 @@
 esp_err_t heartbeat_init(void);
 
 /**
- * Start the heartbeat timer. Checks HEARTBEAT.md periodically
- * and sends a prompt to the agent if actionable tasks are found.
+ * Start the heartbeat timer. Checks HEARTBEAT.md periodically and prompts
+ * the agent only for tasks that are new, changed since the last check, or
+ * due per a scheduling hint in the line: "(every 2h)", "(hourly)",
+ * "(daily 08:30)". Each task line is tracked by its hash.
  */
 esp_err_t heartbeat_start(void);
 
@@ -20,7 +22,8 @@ esp_err_t heartbeat_start(void);
 void heartbeat_stop(void);
 
 /**
- * Manually trigger a heartbeat check (for CLI testing).
+ * Manually trigger a heartbeat check (for CLI testing). Every actionable
+ * task is sent, whether due or not.
  * Returns true if the agent was prompted, false if no tasks found.
  */
 bool heartbeat_trigger(void);
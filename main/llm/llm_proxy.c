@@ -1,10 +1,17 @@
 #include "llm_proxy.h"
 #include "mimi_config.h"
 #include "proxy/http_proxy.h"
+#include "deadline/deadline.h"
+#include "metrics/metrics.h"
 
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
 #include "esp_http_client.h"
 #include "esp_crt_bundle.h"
 #include "esp_heap_caps.h"
@@ -21,10 +28,13 @@ static const char *TAG = "llm";
 static char s_api_key[LLM_API_KEY_MAX_LEN] = {0};
 static char s_model[LLM_MODEL_MAX_LEN] = MIMI_LLM_DEFAULT_MODEL;
 static char s_provider[16] = MIMI_LLM_PROVIDER_DEFAULT;
+static char s_fast_model[LLM_MODEL_MAX_LEN] = {0};
+static char s_ollama_model[LLM_MODEL_MAX_LEN] = {0};
 
 #define LLM_OLLAMA_BASE_URL_MAX_LEN 128
 static char s_ollama_base_url[LLM_OLLAMA_BASE_URL_MAX_LEN] = {0};
 static char s_ollama_api_url[LLM_OLLAMA_BASE_URL_MAX_LEN + 32] = {0};
+static char s_ollama_embed_url[LLM_OLLAMA_BASE_URL_MAX_LEN + 32] = {0};
 
 static void rebuild_ollama_api_url(void)
 {
@@ -35,6 +45,8 @@ static void rebuild_ollama_api_url(void)
     }
     snprintf(s_ollama_api_url, sizeof(s_ollama_api_url),
              "%s/v1/chat/completions", s_ollama_base_url);
+    snprintf(s_ollama_embed_url, sizeof(s_ollama_embed_url),
+             "%s/v1/embeddings", s_ollama_base_url);
 }
 
 static void llm_log_payload(const char *label, const char *payload)
@@ -136,13 +148,67 @@ static void resp_buf_free(resp_buf_t *rb)
     rb->cap = 0;
 }
 
+/* ── Retry-After ──────────────────────────────────────────────── */
+
+/* Milliseconds from a retry-after (seconds) or retry-after-ms header, or -1.
+ * The HTTP-date form of retry-after is not used by any LLM API and is ignored. */
+static int parse_retry_after(const char *key, const char *value)
+{
+    bool in_ms = strcasecmp(key, "retry-after-ms") == 0;
+    if (!in_ms && strcasecmp(key, "retry-after") != 0) return -1;
+
+    char *end = NULL;
+    double v = strtod(value, &end);
+    if (end == value || v < 0) return -1;
+    if (!in_ms) v *= 1000;
+    return v > 10 * 60 * 1000 ? 10 * 60 * 1000 : (int)v;
+}
+
+/* Same, scanning a raw "Name: value\r\n" header block */
+static int headers_retry_after(const char *hdr, size_t len)
+{
+    int ms = -1;
+    const char *p = hdr;
+    const char *end = hdr + len;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        const char *colon = memchr(p, ':', eol - p);
+        if (colon && (size_t)(colon - p) < 24) {
+            char key[24];
+            char val[24];
+            memcpy(key, p, colon - p);
+            key[colon - p] = '\0';
+            const char *v = colon + 1;
+            while (v < eol && *v == ' ') v++;
+            size_t vlen = eol - v;
+            if (vlen && v[vlen - 1] == '\r') vlen--;
+            if (vlen >= sizeof(val)) vlen = sizeof(val) - 1;
+            memcpy(val, v, vlen);
+            val[vlen] = '\0';
+            int r = parse_retry_after(key, val);
+            if (r >= 0) ms = r;
+        }
+        p = eol + 1;
+    }
+    return ms;
+}
+
 /* ── HTTP event handler (for esp_http_client direct path) ─────── */
 
+typedef struct {
+    resp_buf_t *rb;
+    int retry_after_ms;     /* -1 unless the server sent one */
+} http_ctx_t;
+
 static esp_err_t http_event_handler(esp_http_client_event_t *evt)
 {
-    resp_buf_t *rb = (resp_buf_t *)evt->user_data;
+    http_ctx_t *ctx = (http_ctx_t *)evt->user_data;
     if (evt->event_id == HTTP_EVENT_ON_DATA) {
-        resp_buf_append(rb, (const char *)evt->data, evt->data_len);
+        resp_buf_append(ctx->rb, (const char *)evt->data, evt->data_len);
+    } else if (evt->event_id == HTTP_EVENT_ON_HEADER) {
+        int ms = parse_retry_after(evt->header_key, evt->header_value);
+        if (ms >= 0) ctx->retry_after_ms = ms;
     }
     return ESP_OK;
 }
@@ -159,21 +225,60 @@ static bool provider_is_ollama(void)
     return strcmp(s_provider, "ollama") == 0;
 }
 
-static const char *llm_api_url(void)
-{
-    if (provider_is_openai()) return MIMI_OPENAI_API_URL;
-    if (provider_is_ollama()) return s_ollama_api_url;
-    return MIMI_LLM_API_URL;
-}
+/* Each backend host has its own circuit breaker */
+typedef enum {
+    LLM_BACKEND_ANTHROPIC,
+    LLM_BACKEND_OPENAI,
+    LLM_BACKEND_OLLAMA,
+    LLM_BACKEND_COUNT,
+} llm_backend_t;
+
+static const char *const s_backend_names[LLM_BACKEND_COUNT] = {
+    "anthropic", "openai", "ollama",
+};
 
-static const char *llm_api_host(void)
+/* Where a request goes and how it authenticates */
+typedef struct {
+    llm_backend_t backend;
+    const char *url;        /* full URL for the direct path */
+    const char *host;       /* host + path for the CONNECT proxy path */
+    const char *path;
+    bool anthropic_auth;    /* x-api-key + anthropic-version instead of Bearer */
+    bool local;             /* plain HTTP on the LAN: no TLS, never proxied */
+    bool no_key;            /* never send the API key (it belongs to another provider) */
+    int timeout_ms;
+    int retries;            /* after the first attempt */
+    bool best_effort;       /* optional request: its failures don't count against the backend */
+} llm_endpoint_t;
+
+static llm_backend_t provider_backend(void)
 {
-    return provider_is_openai() ? "api.openai.com" : "api.anthropic.com";
+    if (provider_is_openai()) return LLM_BACKEND_OPENAI;
+    if (provider_is_ollama()) return LLM_BACKEND_OLLAMA;
+    return LLM_BACKEND_ANTHROPIC;
 }
 
-static const char *llm_api_path(void)
+static void chat_endpoint(llm_endpoint_t *ep, llm_backend_t backend)
 {
-    return provider_is_openai() ? "/v1/chat/completions" : "/v1/messages";
+    memset(ep, 0, sizeof(*ep));
+    ep->backend = backend;
+    ep->timeout_ms = 120 * 1000;
+    ep->retries = MIMI_LLM_RETRY_MAX;
+    if (backend == LLM_BACKEND_OPENAI) {
+        ep->url = MIMI_OPENAI_API_URL;
+        ep->host = "api.openai.com";
+        ep->path = "/v1/chat/completions";
+    } else if (backend == LLM_BACKEND_OLLAMA) {
+        ep->url = s_ollama_api_url;
+        ep->local = true;
+        /* As a fallback for a cloud provider, the API key is not Ollama's */
+        ep->no_key = !provider_is_ollama();
+    } else {
+        ep->url = MIMI_LLM_API_URL;
+        ep->host = "api.anthropic.com";
+        ep->path = "/v1/messages";
+        ep->anthropic_auth = true;
+    }
 }
 
 /* ── Init ─────────────────────────────────────────────────────── */
@@ -194,6 +299,8 @@ esp_err_t llm_proxy_init(void)
         safe_copy(s_ollama_base_url, sizeof(s_ollama_base_url), MIMI_SECRET_OLLAMA_URL);
         rebuild_ollama_api_url();
     }
+    safe_copy(s_fast_model, sizeof(s_fast_model), MIMI_SECRET_FAST_MODEL);
+    safe_copy(s_ollama_model, sizeof(s_ollama_model), MIMI_SECRET_OLLAMA_MODEL);
 
     /* NVS overrides take highest priority (set via CLI) */
     nvs_handle_t nvs;
@@ -219,6 +326,14 @@ esp_err_t llm_proxy_init(void)
             safe_copy(s_ollama_base_url, sizeof(s_ollama_base_url), ollama_tmp);
             rebuild_ollama_api_url();
         }
+        len = sizeof(model_tmp);
+        if (nvs_get_str(nvs, MIMI_NVS_KEY_FAST_MODEL, model_tmp, &len) == ESP_OK) {
+            safe_copy(s_fast_model, sizeof(s_fast_model), model_tmp);
+        }
+        len = sizeof(model_tmp);
+        if (nvs_get_str(nvs, MIMI_NVS_KEY_OLLAMA_MODEL, model_tmp, &len) == ESP_OK) {
+            safe_copy(s_ollama_model, sizeof(s_ollama_model), model_tmp);
+        }
         nvs_close(nvs);
     }
 
@@ -234,23 +349,31 @@ esp_err_t llm_proxy_init(void)
     } else {
         ESP_LOGW(TAG, "No API key. Use CLI: set_api_key <KEY>");
     }
+    if (s_fast_model[0]) {
+        ESP_LOGI(TAG, "Fast model for tool steps: %s", s_fast_model);
+    }
+    if (!provider_is_ollama() && s_ollama_base_url[0] && s_ollama_model[0]) {
+        ESP_LOGI(TAG, "Local fallback: %s at %s", s_ollama_model, s_ollama_base_url);
+    }
     return ESP_OK;
 }
 
 /* ── Direct path: esp_http_client ───────────────────────────── */
 
-static esp_err_t llm_http_direct(const char *post_data, resp_buf_t *rb, int *out_status)
+static esp_err_t llm_http_direct(const llm_endpoint_t *ep, const char *post_data,
+                                 resp_buf_t *rb, int *out_status, int *retry_after_ms)
 {
+    http_ctx_t ctx = { .rb = rb, .retry_after_ms = -1 };
     esp_http_client_config_t config = {
-        .url = llm_api_url(),
+        .url = ep->url,
         .event_handler = http_event_handler,
-        .user_data = rb,
-        .timeout_ms = 120 * 1000,
+        .user_data = &ctx,
+        .timeout_ms = ep->timeout_ms,
         .buffer_size = 4096,
         .buffer_size_tx = 4096,
     };
     /* Ollama uses plain HTTP — no TLS certificate bundle needed */
-    if (!provider_is_ollama()) {
+    if (!ep->local) {
         config.crt_bundle_attach = esp_crt_bundle_attach;
     }
 
@@ -259,8 +382,8 @@ static esp_err_t llm_http_direct(const char *post_data, resp_buf_t *rb, int *out
 
     esp_http_client_set_method(client, HTTP_METHOD_POST);
     esp_http_client_set_header(client, "Content-Type", "application/json");
-    if (provider_is_openai() || provider_is_ollama()) {
-        if (s_api_key[0]) {
+    if (!ep->anthropic_auth) {
+        if (s_api_key[0] && !ep->no_key) {
             char auth[LLM_API_KEY_MAX_LEN + 16];
             snprintf(auth, sizeof(auth), "Bearer %s", s_api_key);
             esp_http_client_set_header(client, "Authorization", auth);
@@ -273,21 +396,27 @@ static esp_err_t llm_http_direct(const char *post_data, resp_buf_t *rb, int *out
 
     esp_err_t err = esp_http_client_perform(client);
     *out_status = esp_http_client_get_status_code(client);
+    *retry_after_ms = ctx.retry_after_ms;
     esp_http_client_cleanup(client);
+    /* A fresh client per call: every request that got an answer connected once */
+    if (!ep->local && *out_status > 0) {
+        metrics_inc(METRIC_TLS_LLM);
+    }
     return err;
 }
 
 /* ── Proxy path: manual HTTP over CONNECT tunnel ────────────── */
 
-static esp_err_t llm_http_via_proxy(const char *post_data, resp_buf_t *rb, int *out_status)
+static esp_err_t llm_http_via_proxy(const llm_endpoint_t *ep, const char *post_data,
+                                    resp_buf_t *rb, int *out_status, int *retry_after_ms)
 {
-    proxy_conn_t *conn = proxy_conn_open(llm_api_host(), 443, 30000);
+    proxy_conn_t *conn = proxy_conn_open(ep->host, 443, ep->timeout_ms < 30000 ? ep->timeout_ms : 30000);
     if (!conn) return ESP_ERR_HTTP_CONNECT;
 
     int body_len = strlen(post_data);
     char header[1024];
     int hlen = 0;
-    if (provider_is_openai()) {
+    if (!ep->anthropic_auth) {
         hlen = snprintf(header, sizeof(header),
             "POST %s HTTP/1.1\r\n"
             "Host: %s\r\n"
@@ -295,7 +424,7 @@ static esp_err_t llm_http_via_proxy(const char *post_data, resp_buf_t *rb, int *
             "Authorization: Bearer %s\r\n"
             "Content-Length: %d\r\n"
             "Connection: close\r\n\r\n",
-            llm_api_path(), llm_api_host(), s_api_key, body_len);
+            ep->path, ep->host, s_api_key, body_len);
     } else {
         hlen = snprintf(header, sizeof(header),
             "POST %s HTTP/1.1\r\n"
@@ -305,7 +434,7 @@ static esp_err_t llm_http_via_proxy(const char *post_data, resp_buf_t *rb, int *
             "anthropic-version: %s\r\n"
             "Content-Length: %d\r\n"
             "Connection: close\r\n\r\n",
-            llm_api_path(), llm_api_host(), s_api_key, MIMI_LLM_API_VERSION, body_len);
+            ep->path, ep->host, s_api_key, MIMI_LLM_API_VERSION, body_len);
     }
 
     if (proxy_conn_write(conn, header, hlen) < 0 ||
@@ -317,7 +446,7 @@ static esp_err_t llm_http_via_proxy(const char *post_data, resp_buf_t *rb, int *
     /* Read full response into buffer */
     char tmp[4096];
     while (1) {
-        int n = proxy_conn_read(conn, tmp, sizeof(tmp), 120000);
+        int n = proxy_conn_read(conn, tmp, sizeof(tmp), ep->timeout_ms);
         if (n <= 0) break;
         if (resp_buf_append(rb, tmp, n) != ESP_OK) break;
     }
@@ -333,6 +462,7 @@ static esp_err_t llm_http_via_proxy(const char *post_data, resp_buf_t *rb, int *
     /* Strip HTTP headers, keep body only */
     char *body = strstr(rb->data, "\r\n\r\n");
     if (body) {
+        *retry_after_ms = headers_retry_after(rb->data, body - rb->data);
         body += 4;
         size_t blen = rb->len - (body - rb->data);
         memmove(rb->data, body, blen);
@@ -343,15 +473,206 @@ static esp_err_t llm_http_via_proxy(const char *post_data, resp_buf_t *rb, int *
     return ESP_OK;
 }
 
+/* ── Circuit breaker ──────────────────────────────────────────── */
+
+/* Closed until MIMI_LLM_BREAKER_FAILURES attempts in a row fail, then open
+ * for MIMI_LLM_BREAKER_OPEN_MS (or as long as a retry-after asked). After
+ * that one request is let through as a probe; its result closes or reopens it. */
+typedef struct {
+    uint8_t failures;           /* consecutive failed attempts */
+    bool probing;               /* the half-open probe is in flight */
+    int64_t open_until_us;      /* 0 while closed */
+} llm_breaker_t;
+
+static portMUX_TYPE s_breaker_lock = portMUX_INITIALIZER_UNLOCKED;
+static llm_breaker_t s_breakers[LLM_BACKEND_COUNT];
+
+static bool breaker_allow(llm_backend_t backend)
+{
+    llm_breaker_t *b = &s_breakers[backend];
+    bool allow = true;
+    portENTER_CRITICAL(&s_breaker_lock);
+    if (b->open_until_us) {
+        if (b->probing || esp_timer_get_time() < b->open_until_us) {
+            allow = false;
+        } else {
+            b->probing = true;
+        }
+    }
+    portEXIT_CRITICAL(&s_breaker_lock);
+    return allow;
+}
+
+/* hold_ms > 0 opens the breaker for that long whatever the failure count */
+static void breaker_record(llm_backend_t backend, bool ok, int hold_ms)
+{
+    llm_breaker_t *b = &s_breakers[backend];
+    bool was_open;
+    bool opened = false;
+    int open_ms = hold_ms > 0 ? hold_ms : MIMI_LLM_BREAKER_OPEN_MS;
+
+    portENTER_CRITICAL(&s_breaker_lock);
+    was_open = b->open_until_us != 0;
+    if (ok) {
+        b->failures = 0;
+        b->open_until_us = 0;
+    } else {
+        if (b->failures < UINT8_MAX) b->failures++;
+        if (b->probing || hold_ms > 0 || b->failures >= MIMI_LLM_BREAKER_FAILURES) {
+            b->open_until_us = esp_timer_get_time() + (int64_t)open_ms * 1000;
+            opened = !was_open || b->probing;
+        }
+    }
+    b->probing = false;
+    portEXIT_CRITICAL(&s_breaker_lock);
+
+    if (opened) {
+        ESP_LOGW(TAG, "%s circuit open for %d s", s_backend_names[backend], open_ms / 1000);
+        metrics_inc(METRIC_LLM_CIRCUIT_OPEN);
+    } else if (ok && was_open) {
+        ESP_LOGI(TAG, "%s circuit closed", s_backend_names[backend]);
+    }
+}
+
+/* Open and still cooling down (a backend due a probe is not open here) */
+static bool breaker_is_open(llm_backend_t backend, int64_t now)
+{
+    portENTER_CRITICAL(&s_breaker_lock);
+    int64_t until = s_breakers[backend].open_until_us;
+    portEXIT_CRITICAL(&s_breaker_lock);
+    return until && now < until;
+}
+
+/* A request that proved nothing (cut short by the caller) returns the probe */
+static void breaker_release(llm_backend_t backend)
+{
+    portENTER_CRITICAL(&s_breaker_lock);
+    s_breakers[backend].probing = false;
+    portEXIT_CRITICAL(&s_breaker_lock);
+}
+
 /* ── Shared HTTP dispatch ─────────────────────────────────────── */
 
-static esp_err_t llm_http_call(const char *post_data, resp_buf_t *rb, int *out_status)
+static bool status_retryable(int status)
+{
+    /* 0: no usable response; 529: Anthropic "overloaded" */
+    return status == 0 || status == 408 || status == 429 || status == 529 ||
+           (status >= 500 && status <= 504);
+}
+
+/* Jittered exponential backoff, or the server's retry-after plus a little
+ * spread so callers that were refused together don't return together */
+static int backoff_ms(int attempt, int retry_after_ms)
+{
+    if (retry_after_ms >= 0) {
+        return retry_after_ms + (int)(esp_random() % (uint32_t)(retry_after_ms / 10 + 100));
+    }
+    int step = MIMI_LLM_RETRY_BASE_MS << attempt;
+    if (step > MIMI_LLM_RETRY_MAX_DELAY_MS) step = MIMI_LLM_RETRY_MAX_DELAY_MS;
+    return step / 2 + (int)(esp_random() % (uint32_t)(step / 2 + 1));
+}
+
+/* Wait in short steps so a cancelled turn stops waiting promptly */
+static bool backoff_sleep(int ms)
+{
+    while (ms > 0) {
+        if (deadline_expired()) return false;
+        int step = ms < 200 ? ms : 200;
+        vTaskDelay(pdMS_TO_TICKS(step));
+        ms -= step;
+    }
+    return !deadline_expired();
+}
+
+static esp_err_t llm_http_once(const llm_endpoint_t *ep, const char *post_data,
+                               resp_buf_t *rb, int *out_status, int *retry_after_ms)
 {
+    rb->len = 0;
+    rb->data[0] = '\0';
+    *out_status = 0;
+    *retry_after_ms = -1;
+
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t err;
     /* Ollama is local HTTP — never route through the HTTPS CONNECT proxy */
-    if (http_proxy_is_enabled() && !provider_is_ollama()) {
-        return llm_http_via_proxy(post_data, rb, out_status);
+    if (http_proxy_is_enabled() && !ep->local) {
+        err = llm_http_via_proxy(ep, post_data, rb, out_status, retry_after_ms);
     } else {
-        return llm_http_direct(post_data, rb, out_status);
+        err = llm_http_direct(ep, post_data, rb, out_status, retry_after_ms);
+    }
+
+    metrics_inc(METRIC_LLM_REQUESTS);
+    metrics_observe_ms(METRIC_HIST_LLM, (uint32_t)((esp_timer_get_time() - start_us) / 1000));
+    if (err != ESP_OK || *out_status != 200) {
+        metrics_inc(METRIC_LLM_ERRORS);
+    }
+    return err;
+}
+
+/*
+ * Send a request, retrying transport errors, 408/429/5xx/529 while the
+ * caller's deadline leaves room for the wait. Returns ESP_OK with the last
+ * status when a response arrived, ESP_ERR_INVALID_STATE when the backend's
+ * circuit is open, or the transport error.
+ */
+static esp_err_t llm_http_call(const llm_endpoint_t *ep, const char *post_data,
+                               resp_buf_t *rb, int *out_status)
+{
+    const char *name = s_backend_names[ep->backend];
+
+    for (int attempt = 0; ; attempt++) {
+        /* Never wait longer than the caller's turn has left */
+        llm_endpoint_t bounded = *ep;
+        bounded.timeout_ms = deadline_clamp_ms(ep->timeout_ms);
+        if (bounded.timeout_ms == 0) {
+            ESP_LOGW(TAG, "Deadline exceeded, skipping LLM request");
+            *out_status = 0;
+            return ESP_ERR_TIMEOUT;
+        }
+        if (!breaker_allow(ep->backend)) {
+            ESP_LOGW(TAG, "%s circuit open, failing fast", name);
+            *out_status = 0;
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        int retry_after_ms;
+        esp_err_t err = llm_http_once(&bounded, post_data, rb, out_status, &retry_after_ms);
+        if (err == ESP_OK && !status_retryable(*out_status)) {
+            breaker_record(ep->backend, true, 0);
+            return ESP_OK;
+        }
+        if (deadline_expired()) {
+            /* Cut short by our own budget: says nothing about the backend */
+            breaker_release(ep->backend);
+            return err;
+        }
+
+        if (ep->best_effort) {
+            /* Don't let a skippable request open the circuit others depend on */
+            breaker_release(ep->backend);
+            return err;
+        }
+
+        /* A wait longer than we'd ever sleep means the backend is out for now */
+        bool hold = retry_after_ms > MIMI_LLM_RETRY_MAX_DELAY_MS;
+        breaker_record(ep->backend, false, hold ? retry_after_ms : 0);
+        if (hold || attempt >= ep->retries) {
+            return err;
+        }
+
+        int delay_ms = backoff_ms(attempt, retry_after_ms);
+        if (deadline_clamp_ms(delay_ms) < delay_ms) {
+            ESP_LOGW(TAG, "%s failed (%s, HTTP %d); no time left to retry",
+                     name, esp_err_to_name(err), *out_status);
+            return err;
+        }
+        ESP_LOGW(TAG, "%s failed (%s, HTTP %d); retry %d/%d in %d ms",
+                 name, esp_err_to_name(err), *out_status,
+                 attempt + 1, ep->retries, delay_ms);
+        metrics_inc(METRIC_LLM_RETRIES);
+        if (!backoff_sleep(delay_ms)) {
+            return err;
+        }
     }
 }
 
@@ -393,40 +714,6 @@ static void extract_text_openai(cJSON *root, char *buf, size_t size)
     buf[size - 1] = '\0';
 }
 
-static cJSON *convert_tools_openai(const char *tools_json)
-{
-    if (!tools_json) return NULL;
-    cJSON *arr = cJSON_Parse(tools_json);
-    if (!arr || !cJSON_IsArray(arr)) {
-        cJSON_Delete(arr);
-        return NULL;
-    }
-    cJSON *out = cJSON_CreateArray();
-    cJSON *tool;
-    cJSON_ArrayForEach(tool, arr) {
-        cJSON *name = cJSON_GetObjectItem(tool, "name");
-        cJSON *desc = cJSON_GetObjectItem(tool, "description");
-        cJSON *schema = cJSON_GetObjectItem(tool, "input_schema");
-        if (!name || !cJSON_IsString(name)) continue;
-
-        cJSON *func = cJSON_CreateObject();
-        cJSON_AddStringToObject(func, "name", name->valuestring);
-        if (desc && cJSON_IsString(desc)) {
-            cJSON_AddStringToObject(func, "description", desc->valuestring);
-        }
-        if (schema) {
-            cJSON_AddItemToObject(func, "parameters", cJSON_Duplicate(schema, 1));
-        }
-
-        cJSON *wrap = cJSON_CreateObject();
-        cJSON_AddStringToObject(wrap, "type", "function");
-        cJSON_AddItemToObject(wrap, "function", func);
-        cJSON_AddItemToArray(out, wrap);
-    }
-    cJSON_Delete(arr);
-    return out;
-}
-
 static cJSON *convert_messages_openai(const char *system_prompt, cJSON *messages)
 {
     cJSON *out = cJSON_CreateArray();
@@ -496,7 +783,7 @@ static cJSON *convert_messages_openai(const char *system_prompt, cJSON *messages
                         char *args = cJSON_PrintUnformatted(input);
                         if (args) {
                             cJSON_AddStringToObject(func, "arguments", args);
-                            free(args);
+                            cJSON_free(args);
                         }
                     }
                     cJSON_AddItemToObject(tc, "function", func);
@@ -625,14 +912,16 @@ esp_err_t llm_chat(const char *system_prompt, const char *messages_json,
 
     resp_buf_t rb;
     if (resp_buf_init(&rb, MIMI_LLM_STREAM_BUF_SIZE) != ESP_OK) {
-        free(post_data);
+        cJSON_free(post_data);
         snprintf(response_buf, buf_size, "Error: Out of memory");
         return ESP_ERR_NO_MEM;
     }
 
+    llm_endpoint_t ep;
+    chat_endpoint(&ep, provider_backend());
     int status = 0;
-    esp_err_t err = llm_http_call(post_data, &rb, &status);
-    free(post_data);
+    esp_err_t err = llm_http_call(&ep, post_data, &rb, &status);
+    cJSON_free(post_data);
 
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "HTTP request failed: %s", esp_err_to_name(err));
@@ -686,106 +975,17 @@ void llm_response_free(llm_response_t *resp)
     resp->text = NULL;
     resp->text_len = 0;
     for (int i = 0; i < resp->call_count; i++) {
-        free(resp->calls[i].input);
+        cJSON_free(resp->calls[i].input);
         resp->calls[i].input = NULL;
     }
     resp->call_count = 0;
     resp->tool_use = false;
 }
 
-esp_err_t llm_chat_tools(const char *system_prompt,
-                         cJSON *messages,
-                         const char *tools_json,
-                         llm_response_t *resp)
+/* Fill resp from a parsed chat response in the backend's format */
+static void parse_tools_response(llm_backend_t backend, cJSON *root, llm_response_t *resp)
 {
-    memset(resp, 0, sizeof(*resp));
-
-    if (s_api_key[0] == '\0' && !provider_is_ollama()) return ESP_ERR_INVALID_STATE;
-
-    /* Build request body (non-streaming) */
-    cJSON *body = cJSON_CreateObject();
-    cJSON_AddStringToObject(body, "model", s_model);
-    cJSON_AddNumberToObject(body, "temperature", 0);
-    if (provider_is_openai()) {
-        cJSON_AddNumberToObject(body, "max_completion_tokens", MIMI_LLM_MAX_TOKENS);
-    } else {
-        cJSON_AddNumberToObject(body, "max_tokens", MIMI_LLM_MAX_TOKENS);
-    }
-
-    if (provider_is_openai() || provider_is_ollama()) {
-        cJSON *openai_msgs = convert_messages_openai(system_prompt, messages);
-        cJSON_AddItemToObject(body, "messages", openai_msgs);
-
-        if (tools_json) {
-            cJSON *tools = convert_tools_openai(tools_json);
-            if (tools) {
-                cJSON_AddItemToObject(body, "tools", tools);
-                cJSON_AddStringToObject(body, "tool_choice", "auto");
-            }
-        }
-        if (provider_is_ollama()) {
-            cJSON_AddFalseToObject(body, "stream");
-        }
-    } else {
-        cJSON_AddStringToObject(body, "system", system_prompt);
-
-        /* Deep-copy messages so caller keeps ownership */
-        cJSON *msgs_copy = cJSON_Duplicate(messages, 1);
-        cJSON_AddItemToObject(body, "messages", msgs_copy);
-
-        /* Add tools array if provided */
-        if (tools_json) {
-            cJSON *tools = cJSON_Parse(tools_json);
-            if (tools) {
-                cJSON_AddItemToObject(body, "tools", tools);
-            }
-        }
-    }
-
-    char *post_data = cJSON_PrintUnformatted(body);
-    cJSON_Delete(body);
-    if (!post_data) return ESP_ERR_NO_MEM;
-
-    ESP_LOGI(TAG, "Calling LLM API with tools (provider: %s, model: %s, body: %d bytes)",
-             s_provider, s_model, (int)strlen(post_data));
-    llm_log_payload("LLM tools request", post_data);
-
-    /* HTTP call */
-    resp_buf_t rb;
-    if (resp_buf_init(&rb, MIMI_LLM_STREAM_BUF_SIZE) != ESP_OK) {
-        free(post_data);
-        return ESP_ERR_NO_MEM;
-    }
-
-    int status = 0;
-    esp_err_t err = llm_http_call(post_data, &rb, &status);
-    free(post_data);
-
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "HTTP request failed: %s", esp_err_to_name(err));
-        llm_log_payload("LLM tools partial response", rb.data);
-        resp_buf_free(&rb);
-        return err;
-    }
-
-    llm_log_payload("LLM tools raw response", rb.data);
-
-    if (status != 200) {
-        ESP_LOGE(TAG, "API error %d: %.500s", status, rb.data ? rb.data : "");
-        resp_buf_free(&rb);
-        return ESP_FAIL;
-    }
-
-    /* Parse full JSON response */
-    cJSON *root = cJSON_Parse(rb.data);
-    resp_buf_free(&rb);
-
-    if (!root) {
-        ESP_LOGE(TAG, "Failed to parse API response JSON");
-        return ESP_FAIL;
-    }
-
-    if (provider_is_openai() || provider_is_ollama()) {
+    if (backend != LLM_BACKEND_ANTHROPIC) {
         cJSON *choices = cJSON_GetObjectItem(root, "choices");
         cJSON *choice0 = choices && cJSON_IsArray(choices) ? cJSON_GetArrayItem(choices, 0) : NULL;
         if (choice0) {
@@ -910,7 +1110,232 @@ esp_err_t llm_chat_tools(const char *system_prompt,
         }
     }
 
+}
+
+/* Request body for one backend/model; caller frees */
+static char *build_tools_body(llm_backend_t backend, const char *model,
+                              const char *system_prompt, cJSON *messages,
+                              const llm_tools_t *tools)
+{
+    cJSON *body = cJSON_CreateObject();
+    cJSON_AddStringToObject(body, "model", model);
+    cJSON_AddNumberToObject(body, "temperature", 0);
+    if (backend == LLM_BACKEND_OPENAI) {
+        cJSON_AddNumberToObject(body, "max_completion_tokens", MIMI_LLM_MAX_TOKENS);
+    } else {
+        cJSON_AddNumberToObject(body, "max_tokens", MIMI_LLM_MAX_TOKENS);
+    }
+
+    if (backend != LLM_BACKEND_ANTHROPIC) {
+        cJSON *openai_msgs = convert_messages_openai(system_prompt, messages);
+        cJSON_AddItemToObject(body, "messages", openai_msgs);
+
+        if (tools && tools->openai_json) {
+            cJSON_AddRawToObject(body, "tools", tools->openai_json);
+            cJSON_AddStringToObject(body, "tool_choice", "auto");
+        }
+        if (backend == LLM_BACKEND_OLLAMA) {
+            cJSON_AddFalseToObject(body, "stream");
+        }
+    } else {
+        cJSON_AddStringToObject(body, "system", system_prompt);
+
+        /* Deep-copy messages so caller keeps ownership */
+        cJSON *msgs_copy = cJSON_Duplicate(messages, 1);
+        cJSON_AddItemToObject(body, "messages", msgs_copy);
+
+        /* Add tools array if provided */
+        if (tools && tools->anthropic_json) {
+            cJSON_AddRawToObject(body, "tools", tools->anthropic_json);
+        }
+    }
+
+    char *post_data = cJSON_PrintUnformatted(body);
+    cJSON_Delete(body);
+    return post_data;
+}
+
+/* ── Router ───────────────────────────────────────────────────── */
+
+/*
+ * Up to three routes: the configured provider/model, an optional fast model
+ * on the same provider for tool steps, and an optional LAN Ollama model that
+ * takes over when the cloud is unreachable or slow. Each keeps a smoothed
+ * latency; a route whose average goes over MIMI_LLM_ROUTER_SLOW_MS, or
+ * whose backend circuit is open, is tried after the others until
+ * MIMI_LLM_ROUTER_RECHECK_MS has passed.
+ */
+typedef enum {
+    ROUTE_PRIMARY,
+    ROUTE_FAST,
+    ROUTE_LOCAL,
+    ROUTE_COUNT,
+} llm_route_id_t;
+
+typedef struct {
+    uint32_t ewma_ms;           /* successful requests only; 0 until the first */
+    uint32_t ok;
+    uint32_t failed;
+    int64_t slow_until_us;
+} llm_route_stats_t;
+
+static const char *const s_route_names[ROUTE_COUNT] = { "primary", "fast", "local" };
+static portMUX_TYPE s_route_lock = portMUX_INITIALIZER_UNLOCKED;
+static llm_route_stats_t s_route_stats[ROUTE_COUNT];
+
+static bool route_configured(llm_route_id_t r)
+{
+    switch (r) {
+    case ROUTE_PRIMARY:
+        return provider_is_ollama() ? s_ollama_base_url[0] != '\0' : s_api_key[0] != '\0';
+    case ROUTE_FAST:
+        return s_fast_model[0] && strcmp(s_fast_model, s_model) != 0 &&
+               route_configured(ROUTE_PRIMARY);
+    case ROUTE_LOCAL:
+        return !provider_is_ollama() && s_ollama_base_url[0] && s_ollama_model[0];
+    default:
+        return false;
+    }
+}
+
+static llm_backend_t route_backend(llm_route_id_t r)
+{
+    return r == ROUTE_LOCAL ? LLM_BACKEND_OLLAMA : provider_backend();
+}
+
+static const char *route_model(llm_route_id_t r)
+{
+    switch (r) {
+    case ROUTE_FAST:  return s_fast_model;
+    case ROUTE_LOCAL: return s_ollama_model;
+    default:          return s_model;
+    }
+}
+
+static bool route_degraded(llm_route_id_t r, int64_t now)
+{
+    portENTER_CRITICAL(&s_route_lock);
+    bool slow = now < s_route_stats[r].slow_until_us;
+    portEXIT_CRITICAL(&s_route_lock);
+    return slow || breaker_is_open(route_backend(r), now);
+}
+
+static void route_record(llm_route_id_t r, bool ok, uint32_t ms)
+{
+    bool went_slow = false;
+    uint32_t ewma_ms;
+    portENTER_CRITICAL(&s_route_lock);
+    llm_route_stats_t *st = &s_route_stats[r];
+    if (ok) {
+        int64_t now = esp_timer_get_time();
+        st->ok++;
+        if (!st->ewma_ms || (st->slow_until_us && now >= st->slow_until_us)) {
+            /* First sample, or the recheck after a slow spell: start afresh */
+            st->ewma_ms = ms;
+            st->slow_until_us = 0;
+        } else {
+            st->ewma_ms = (st->ewma_ms * 3 + ms) / 4;
+        }
+        /* The local route is the last resort; it never steps aside */
+        if (r != ROUTE_LOCAL && st->ewma_ms > MIMI_LLM_ROUTER_SLOW_MS && !st->slow_until_us) {
+            st->slow_until_us = now + (int64_t)MIMI_LLM_ROUTER_RECHECK_MS * 1000;
+            went_slow = true;
+        }
+    } else {
+        st->failed++;
+    }
+    ewma_ms = st->ewma_ms;
+    portEXIT_CRITICAL(&s_route_lock);
+
+    if (went_slow && route_configured(ROUTE_LOCAL)) {
+        ESP_LOGW(TAG, "Route %s averaging %u ms, preferring others for %d s",
+                 s_route_names[r], (unsigned)ewma_ms,
+                 MIMI_LLM_ROUTER_RECHECK_MS / 1000);
+    }
+}
+
+/* Routes to try for a tier, best first; returns the count */
+static int route_plan(llm_tier_t tier, llm_route_id_t *order)
+{
+    llm_route_id_t wanted[ROUTE_COUNT];
+    int n = 0;
+    if (tier == LLM_TIER_FAST && route_configured(ROUTE_FAST)) wanted[n++] = ROUTE_FAST;
+    if (route_configured(ROUTE_PRIMARY)) wanted[n++] = ROUTE_PRIMARY;
+    if (route_configured(ROUTE_LOCAL)) wanted[n++] = ROUTE_LOCAL;
+
+    /* Healthy routes keep their order ahead of degraded ones */
+    int64_t now = esp_timer_get_time();
+    bool degraded[ROUTE_COUNT];
+    for (int i = 0; i < n; i++) degraded[i] = route_degraded(wanted[i], now);
+    int out = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < n; i++) {
+            if (degraded[i] == (pass == 1)) order[out++] = wanted[i];
+        }
+    }
+    return out;
+}
+
+static esp_err_t chat_tools_route(llm_route_id_t route, int retries,
+                                  const char *system_prompt, cJSON *messages,
+                                  const llm_tools_t *tools, llm_response_t *resp)
+{
+    llm_backend_t backend = route_backend(route);
+    const char *model = route_model(route);
+
+    char *post_data = build_tools_body(backend, model, system_prompt, messages, tools);
+    if (!post_data) return ESP_ERR_NO_MEM;
+
+    ESP_LOGI(TAG, "Calling LLM API with tools (route: %s, %s/%s, body: %d bytes)",
+             s_route_names[route], s_backend_names[backend], model, (int)strlen(post_data));
+    llm_log_payload("LLM tools request", post_data);
+
+    /* HTTP call */
+    resp_buf_t rb;
+    if (resp_buf_init(&rb, MIMI_LLM_STREAM_BUF_SIZE) != ESP_OK) {
+        cJSON_free(post_data);
+        return ESP_ERR_NO_MEM;
+    }
+
+    llm_endpoint_t ep;
+    chat_endpoint(&ep, backend);
+    ep.retries = retries;
+    int status = 0;
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t err = llm_http_call(&ep, post_data, &rb, &status);
+    uint32_t elapsed_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    cJSON_free(post_data);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "HTTP request failed: %s", esp_err_to_name(err));
+        llm_log_payload("LLM tools partial response", rb.data);
+        resp_buf_free(&rb);
+        if (!deadline_expired()) route_record(route, false, 0);
+        return err;
+    }
+
+    llm_log_payload("LLM tools raw response", rb.data);
+
+    if (status != 200) {
+        ESP_LOGE(TAG, "API error %d: %.500s", status, rb.data ? rb.data : "");
+        resp_buf_free(&rb);
+        route_record(route, false, 0);
+        return ESP_FAIL;
+    }
+    route_record(route, true, elapsed_ms);
+
+    /* Parse full JSON response */
+    cJSON *root = cJSON_Parse(rb.data);
+    resp_buf_free(&rb);
+
+    if (!root) {
+        ESP_LOGE(TAG, "Failed to parse API response JSON");
+        return ESP_FAIL;
+    }
+
+    parse_tools_response(backend, root, resp);
     cJSON_Delete(root);
+    resp->fast_model = route == ROUTE_FAST;
 
     ESP_LOGI(TAG, "Response: %d bytes text, %d tool calls, stop=%s",
              (int)resp->text_len, resp->call_count,
@@ -919,6 +1344,173 @@ esp_err_t llm_chat_tools(const char *system_prompt,
     return ESP_OK;
 }
 
+esp_err_t llm_chat_tools(const char *system_prompt,
+                         cJSON *messages,
+                         const llm_tools_t *tools,
+                         llm_tier_t tier,
+                         llm_response_t *resp)
+{
+    memset(resp, 0, sizeof(*resp));
+
+    llm_route_id_t order[ROUTE_COUNT];
+    int n = route_plan(tier, order);
+    if (n == 0) return ESP_ERR_INVALID_STATE;
+
+    esp_err_t err = ESP_FAIL;
+    for (int i = 0; i < n; i++) {
+        if (i > 0) {
+            if (deadline_expired()) break;
+            ESP_LOGW(TAG, "Route %s failed (%s), failing over to %s",
+                     s_route_names[order[i - 1]], esp_err_to_name(err), s_route_names[order[i]]);
+            metrics_inc(METRIC_LLM_FAILOVERS);
+        }
+        /* With somewhere else to go, don't spend the turn retrying here */
+        int retries = i + 1 < n ? MIMI_LLM_FAILOVER_RETRIES : MIMI_LLM_RETRY_MAX;
+        err = chat_tools_route(order[i], retries, system_prompt, messages, tools, resp);
+        if (err == ESP_OK || err == ESP_ERR_NO_MEM) return err;
+    }
+    return err;
+}
+
+int llm_router_info(llm_route_info_t *out, int max)
+{
+    int64_t now = esp_timer_get_time();
+    int n = 0;
+    for (int r = 0; r < ROUTE_COUNT && n < max; r++) {
+        if (!route_configured(r)) continue;
+        llm_route_info_t *info = &out[n++];
+        info->name = s_route_names[r];
+        info->backend = s_backend_names[route_backend(r)];
+        info->model = route_model(r);
+        info->degraded = route_degraded(r, now);
+        portENTER_CRITICAL(&s_route_lock);
+        info->ewma_ms = s_route_stats[r].ewma_ms;
+        info->ok = s_route_stats[r].ok;
+        info->failed = s_route_stats[r].failed;
+        portEXIT_CRITICAL(&s_route_lock);
+    }
+    return n;
+}
+
+/* ── Public: embeddings ───────────────────────────────────────── */
+
+/* A query embeds the user's message for recall on the turn's critical path:
+ * one short attempt, since the turn goes ahead without it */
+static bool embed_endpoint(llm_endpoint_t *ep, const char **model, bool query)
+{
+    memset(ep, 0, sizeof(*ep));
+    ep->timeout_ms = query ? MIMI_EMBED_QUERY_TIMEOUT_MS : MIMI_EMBED_TIMEOUT_MS;
+    ep->retries = query ? 0 : MIMI_LLM_RETRY_MAX;
+    ep->best_effort = query;
+    if (provider_is_openai() && s_api_key[0]) {
+        ep->backend = LLM_BACKEND_OPENAI;
+        ep->url = MIMI_OPENAI_EMBED_URL;
+        ep->host = "api.openai.com";
+        ep->path = "/v1/embeddings";
+        *model = MIMI_EMBED_MODEL_OPENAI;
+        return true;
+    }
+    /* Anthropic has no embeddings API — a configured Ollama server stands in */
+    if (s_ollama_base_url[0]) {
+        ep->backend = LLM_BACKEND_OLLAMA;
+        ep->url = s_ollama_embed_url;
+        ep->local = true;
+        ep->no_key = !provider_is_ollama();
+        *model = MIMI_EMBED_MODEL_OLLAMA;
+        return true;
+    }
+    return false;
+}
+
+bool llm_embed_available(void)
+{
+    llm_endpoint_t ep;
+    const char *model;
+    return embed_endpoint(&ep, &model, false);
+}
+
+static esp_err_t embed_request(const char *const *texts, int count, float *out, int dims,
+                               bool query)
+{
+    llm_endpoint_t ep;
+    const char *model = NULL;
+    if (!embed_endpoint(&ep, &model, query)) return ESP_ERR_NOT_SUPPORTED;
+    if (count <= 0) return ESP_ERR_INVALID_ARG;
+
+    cJSON *body = cJSON_CreateObject();
+    cJSON_AddStringToObject(body, "model", model);
+    cJSON *input = cJSON_AddArrayToObject(body, "input");
+    for (int i = 0; i < count; i++) {
+        cJSON_AddItemToArray(input, cJSON_CreateString(texts[i]));
+    }
+    if (!ep.local) {
+        /* text-embedding-3 models can shorten vectors server-side */
+        cJSON_AddNumberToObject(body, "dimensions", dims);
+    }
+
+    char *post_data = cJSON_PrintUnformatted(body);
+    cJSON_Delete(body);
+    if (!post_data) return ESP_ERR_NO_MEM;
+
+    resp_buf_t rb;
+    if (resp_buf_init(&rb, MIMI_LLM_STREAM_BUF_SIZE) != ESP_OK) {
+        cJSON_free(post_data);
+        return ESP_ERR_NO_MEM;
+    }
+
+    int status = 0;
+    esp_err_t err = llm_http_call(&ep, post_data, &rb, &status);
+    cJSON_free(post_data);
+
+    if (err != ESP_OK || status != 200) {
+        ESP_LOGE(TAG, "Embeddings request failed: %s (HTTP %d) %.200s",
+                 esp_err_to_name(err), status, rb.data ? rb.data : "");
+        resp_buf_free(&rb);
+        return err != ESP_OK ? err : ESP_FAIL;
+    }
+
+    cJSON *root = cJSON_Parse(rb.data);
+    resp_buf_free(&rb);
+    if (!root) return ESP_FAIL;
+
+    memset(out, 0, (size_t)count * dims * sizeof(float));
+    int filled = 0;
+    cJSON *item;
+    cJSON_ArrayForEach(item, cJSON_GetObjectItem(root, "data")) {
+        cJSON *idx = cJSON_GetObjectItem(item, "index");
+        int i = cJSON_IsNumber(idx) ? idx->valueint : filled;
+        if (i < 0 || i >= count) continue;
+
+        /* Longer vectors are truncated; renormalisation is left to the caller */
+        float *dst = out + (size_t)i * dims;
+        int d = 0;
+        cJSON *v;
+        cJSON_ArrayForEach(v, cJSON_GetObjectItem(item, "embedding")) {
+            if (d >= dims) break;
+            dst[d++] = (float)v->valuedouble;
+        }
+        filled++;
+    }
+    cJSON_Delete(root);
+
+    if (filled != count) {
+        ESP_LOGE(TAG, "Embeddings response had %d of %d vectors", filled, count);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t llm_embed(const char *const *texts, int count, float *out, int dims)
+{
+    return embed_request(texts, count, out, dims, false);
+}
+
+esp_err_t llm_embed_query(const char *text, float *out, int dims)
+{
+    const char *texts[1] = { text };
+    return embed_request(texts, 1, out, dims, true);
+}
+
 /* ── NVS helpers ──────────────────────────────────────────────── */
 
 esp_err_t llm_set_api_key(const char *api_key)
@@ -974,3 +1566,29 @@ esp_err_t llm_set_ollama_url(const char *url)
     ESP_LOGI(TAG, "Ollama URL set to: %s", s_ollama_base_url);
     return ESP_OK;
 }
+
+esp_err_t llm_set_fast_model(const char *model)
+{
+    nvs_handle_t nvs;
+    ESP_ERROR_CHECK(nvs_open(MIMI_NVS_LLM, NVS_READWRITE, &nvs));
+    ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_FAST_MODEL, model));
+    ESP_ERROR_CHECK(nvs_commit(nvs));
+    nvs_close(nvs);
+
+    safe_copy(s_fast_model, sizeof(s_fast_model), model);
+    ESP_LOGI(TAG, "Fast model set to: %s", s_fast_model[0] ? s_fast_model : "(none)");
+    return ESP_OK;
+}
+
+esp_err_t llm_set_ollama_model(const char *model)
+{
+    nvs_handle_t nvs;
+    ESP_ERROR_CHECK(nvs_open(MIMI_NVS_LLM, NVS_READWRITE, &nvs));
+    ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_OLLAMA_MODEL, model));
+    ESP_ERROR_CHECK(nvs_commit(nvs));
+    nvs_close(nvs);
+
+    safe_copy(s_ollama_model, sizeof(s_ollama_model), model);
+    ESP_LOGI(TAG, "Ollama fallback model set to: %s", s_ollama_model[0] ? s_ollama_model : "(none)");
+    return ESP_OK;
+}
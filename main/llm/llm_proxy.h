@@ -4,6 +4,7 @@
 #include "cJSON.h"
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "mimi_config.h"
 
@@ -32,6 +33,17 @@ esp_err_t llm_set_ollama_url(const char *url);
  */
 esp_err_t llm_set_model(const char *model);
 
+/**
+ * Save a faster/cheaper model on the same provider for tool steps ("" disables).
+ */
+esp_err_t llm_set_fast_model(const char *model);
+
+/**
+ * Save the Ollama model used as a local fallback when the provider is a cloud
+ * API ("" disables). Needs the Ollama URL as well.
+ */
+esp_err_t llm_set_ollama_model(const char *model);
+
 /**
  * Send a chat completion request to the configured LLM API (non-streaming).
  *
@@ -59,20 +71,80 @@ typedef struct {
     llm_tool_call_t calls[MIMI_MAX_TOOL_CALLS];
     int call_count;
     bool tool_use;                               /* stop_reason == "tool_use" */
+    bool fast_model;                             /* answered by the fast model */
 } llm_response_t;
 
 void llm_response_free(llm_response_t *resp);
 
+/* Tools array pre-rendered for each request format; embedded verbatim */
+typedef struct {
+    const char *anthropic_json;     /* [{"name","description","input_schema"}, ...] */
+    const char *openai_json;        /* [{"type":"function","function":{...}}, ...] */
+} llm_tools_t;
+
+/* Which model a request wants; the router maps it onto configured routes */
+typedef enum {
+    LLM_TIER_STRONG,        /* the configured model: answers the user */
+    LLM_TIER_FAST,          /* intermediate tool steps; the fast model if set */
+} llm_tier_t;
+
 /**
- * Send a chat completion request with tools to the configured LLM API (non-streaming).
+ * Send a chat completion request with tools (non-streaming).
+ *
+ * The router tries the routes for the tier in order of health: the fast model
+ * (LLM_TIER_FAST only), the configured model, then the local Ollama fallback.
+ * A route that fails, is slow on average or whose circuit is open is passed
+ * over for the next one.
  *
  * @param system_prompt  System prompt string
  * @param messages       cJSON array of messages (caller owns)
- * @param tools_json     Pre-built JSON string of tools array, or NULL for no tools
+ * @param tools          Pre-rendered tools arrays, or NULL for no tools
+ * @param tier           Which model the step is for
  * @param resp           Output: structured response with text and tool calls
- * @return ESP_OK on success
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE when nothing is configured
+ *         or every backend's circuit is open
  */
 esp_err_t llm_chat_tools(const char *system_prompt,
                          cJSON *messages,
-                         const char *tools_json,
+                         const llm_tools_t *tools,
+                         llm_tier_t tier,
                          llm_response_t *resp);
+
+/* Health and latency of one configured route, for diagnostics */
+typedef struct {
+    const char *name;       /* "primary", "fast", "local" */
+    const char *backend;
+    const char *model;
+    uint32_t ewma_ms;       /* smoothed latency of successful requests */
+    uint32_t ok;
+    uint32_t failed;
+    bool degraded;          /* slow or circuit open: tried after the others */
+} llm_route_info_t;
+
+/** Fill up to max entries, one per configured route; returns the count. */
+int llm_router_info(llm_route_info_t *out, int max);
+
+/* ── Embeddings ────────────────────────────────────────────────── */
+
+/**
+ * True when an embeddings backend is configured: the OpenAI API when the
+ * provider is "openai", otherwise an Ollama server if its URL is set.
+ */
+bool llm_embed_available(void);
+
+/**
+ * Embed a batch of texts.
+ *
+ * @param texts  Array of count strings
+ * @param count  Number of texts
+ * @param out    Output: count * dims floats (row per text, zero-padded/truncated to dims)
+ * @param dims   Vector dimension to produce
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED when no backend is configured
+ */
+esp_err_t llm_embed(const char *const *texts, int count, float *out, int dims);
+
+/**
+ * Embed one query on a latency-sensitive path: a single attempt limited to
+ * MIMI_EMBED_QUERY_TIMEOUT_MS, whose failure doesn't trip the circuit breaker.
+ */
+esp_err_t llm_embed_query(const char *text, float *out, int dims);
@@ -0,0 +1,867 @@
+#include "memory/memory_index.h"
+#include "mimi_config.h"
+#include "storage/storage.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+static const char *TAG = "mem_index";
+
+#define MI_MAGIC            0x5844494DU   /* "MIDX" little-endian */
+#define MI_VERSION          1
+#define MI_MAX_TOKEN_LEN    32
+#define MI_DOC_TERMS_CAP    2048          /* unique terms tracked per file, power of 2 */
+#define MI_MAX_QUERY_TERMS  8
+#define MI_MAX_RESULTS      10
+#define MI_SNIPPET_LINES    2
+#define MI_SNIPPET_LEN      160
+#define MI_BM25_K1          1.2f
+#define MI_BM25_B           0.75f
+
+typedef struct {
+    char path[64];          /* empty = free slot */
+    uint32_t size;
+    uint32_t mtime;
+    uint32_t length;        /* indexed token count, for BM25 length normalisation */
+} mi_doc_t;
+
+/* One (term, file) pair. The table is kept sorted by term, then doc. */
+typedef struct {
+    uint32_t term;
+    uint16_t doc;
+    uint16_t tf;
+} mi_posting_t;
+
+static mi_doc_t *s_docs = NULL;
+static int s_doc_slots = 0;             /* high-water mark of used slots */
+static mi_posting_t *s_postings = NULL;
+static size_t s_posting_count = 0;
+static bool s_dirty = false;
+static SemaphoreHandle_t s_lock = NULL;
+
+/* ── Tokenizer ────────────────────────────────────────────────── */
+
+static const char *const s_stopwords[] = {
+    "an", "as", "at", "be", "by", "do", "if", "in", "is", "it", "me", "my",
+    "no", "of", "on", "or", "so", "to", "we",
+    "and", "are", "but", "can", "for", "has", "her", "his", "its", "not",
+    "our", "the", "was", "you",
+    "also", "been", "from", "have", "into", "just", "than", "that", "them",
+    "then", "they", "this", "what", "when", "will", "with", "your",
+    "about", "there", "where", "which", "would", "could", "should",
+};
+
+typedef void (*mi_token_fn)(uint32_t term, void *ctx);
+
+static uint32_t mi_hash(const char *s, size_t len)
+{
+    uint32_t h = 2166136261U;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619U;
+    }
+    return h ? h : 1;   /* 0 marks an empty term-table slot */
+}
+
+static bool is_stopword(const char *tok)
+{
+    for (size_t i = 0; i < sizeof(s_stopwords) / sizeof(s_stopwords[0]); i++) {
+        if (strcmp(tok, s_stopwords[i]) == 0) return true;
+    }
+    return false;
+}
+
+/**
+ * Split text into lowercase words (ASCII alnum runs; UTF-8 bytes are kept
+ * as word characters) and report the hash of each non-stopword token.
+ */
+static void tokenize(const char *text, mi_token_fn fn, void *ctx)
+{
+    char tok[MI_MAX_TOKEN_LEN + 1];
+    size_t len = 0;
+
+    for (const unsigned char *p = (const unsigned char *)text; ; p++) {
+        unsigned char c = *p;
+        if (c && (isalnum(c) || c >= 0x80)) {
+            if (len < MI_MAX_TOKEN_LEN) tok[len++] = (char)tolower(c);
+            continue;
+        }
+        if (len >= 2) {
+            tok[len] = '\0';
+            if (!is_stopword(tok)) fn(mi_hash(tok, len), ctx);
+        }
+        len = 0;
+        if (!c) break;
+    }
+}
+
+/* ── Per-file term counting ───────────────────────────────────── */
+
+typedef struct {
+    uint32_t *terms;
+    uint16_t *tfs;
+    int unique;
+    uint32_t total;
+} mi_termset_t;
+
+static void termset_add(uint32_t term, void *ctx)
+{
+    mi_termset_t *ts = (mi_termset_t *)ctx;
+    ts->total++;
+
+    uint32_t i = term & (MI_DOC_TERMS_CAP - 1);
+    for (int probe = 0; probe < MI_DOC_TERMS_CAP; probe++) {
+        if (ts->terms[i] == term) {
+            if (ts->tfs[i] < UINT16_MAX) ts->tfs[i]++;
+            return;
+        }
+        if (ts->terms[i] == 0) {
+            /* Keep probe chains short; extra unique words in huge files are dropped */
+            if (ts->unique >= MI_DOC_TERMS_CAP * 3 / 4) return;
+            ts->terms[i] = term;
+            ts->tfs[i] = 1;
+            ts->unique++;
+            return;
+        }
+        i = (i + 1) & (MI_DOC_TERMS_CAP - 1);
+    }
+}
+
+static int posting_cmp(const void *a, const void *b)
+{
+    const mi_posting_t *pa = (const mi_posting_t *)a;
+    const mi_posting_t *pb = (const mi_posting_t *)b;
+    if (pa->term != pb->term) return pa->term < pb->term ? -1 : 1;
+    if (pa->doc != pb->doc) return pa->doc < pb->doc ? -1 : 1;
+    return 0;
+}
+
+/* ── Document table ───────────────────────────────────────────── */
+
+static bool is_memory_path(const char *path)
+{
+    static const char prefix[] = MIMI_SPIFFS_MEMORY_DIR "/";
+    if (!path || strncmp(path, prefix, sizeof(prefix) - 1) != 0) return false;
+    size_t len = strlen(path);
+    return len > 3 && strcmp(path + len - 3, ".md") == 0;
+}
+
+static int find_doc(const char *path)
+{
+    for (int i = 0; i < s_doc_slots; i++) {
+        if (s_docs[i].path[0] && strcmp(s_docs[i].path, path) == 0) return i;
+    }
+    return -1;
+}
+
+static int alloc_doc(const char *path)
+{
+    if (strlen(path) >= sizeof(s_docs[0].path)) return -1;
+
+    int slot = -1;
+    for (int i = 0; i < s_doc_slots; i++) {
+        if (!s_docs[i].path[0]) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        if (s_doc_slots >= MIMI_MEMORY_INDEX_MAX_DOCS) return -1;
+        slot = s_doc_slots++;
+    }
+
+    memset(&s_docs[slot], 0, sizeof(s_docs[slot]));
+    strlcpy(s_docs[slot].path, path, sizeof(s_docs[slot].path));
+    return slot;
+}
+
+/**
+ * Replace every posting of one doc with a new sorted run, in a single merge pass.
+ */
+static esp_err_t replace_doc_postings(uint16_t doc, const mi_posting_t *fresh, size_t n)
+{
+    size_t keep = 0;
+    for (size_t i = 0; i < s_posting_count; i++) {
+        if (s_postings[i].doc != doc) keep++;
+    }
+
+    size_t total = keep + n;
+    mi_posting_t *merged = NULL;
+    if (total > 0) {
+        merged = heap_caps_malloc(total * sizeof(mi_posting_t), MALLOC_CAP_SPIRAM);
+        if (!merged) return ESP_ERR_NO_MEM;
+    }
+
+    size_t i = 0, j = 0, k = 0;
+    while (i < s_posting_count || j < n) {
+        if (i < s_posting_count && s_postings[i].doc == doc) {
+            i++;
+            continue;
+        }
+        if (j >= n || (i < s_posting_count && posting_cmp(&s_postings[i], &fresh[j]) < 0)) {
+            merged[k++] = s_postings[i++];
+        } else {
+            merged[k++] = fresh[j++];
+        }
+    }
+
+    free(s_postings);
+    s_postings = merged;
+    s_posting_count = total;
+    return ESP_OK;
+}
+
+static int live_doc_count(void)
+{
+    int live = 0;
+    for (int i = 0; i < s_doc_slots; i++) {
+        if (s_docs[i].path[0]) live++;
+    }
+    return live;
+}
+
+static void remove_doc(int doc)
+{
+    replace_doc_postings((uint16_t)doc, NULL, 0);
+    memset(&s_docs[doc], 0, sizeof(s_docs[doc]));
+    while (s_doc_slots > 0 && !s_docs[s_doc_slots - 1].path[0]) {
+        s_doc_slots--;
+    }
+    s_dirty = true;
+}
+
+static esp_err_t index_doc(int doc, const struct stat *st)
+{
+    const char *path = s_docs[doc].path;
+    FILE *f = fopen(path, "r");
+    if (!f) return ESP_ERR_NOT_FOUND;
+
+    mi_termset_t ts = {0};
+    ts.terms = heap_caps_calloc(MI_DOC_TERMS_CAP, sizeof(uint32_t), MALLOC_CAP_SPIRAM);
+    ts.tfs = heap_caps_calloc(MI_DOC_TERMS_CAP, sizeof(uint16_t), MALLOC_CAP_SPIRAM);
+    if (!ts.terms || !ts.tfs) {
+        free(ts.terms);
+        free(ts.tfs);
+        fclose(f);
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* Whole lines, so no token is split at a buffer boundary */
+    char *line = NULL;
+    size_t cap = 0, len;
+    esp_err_t rerr;
+    while ((rerr = storage_read_line(f, &line, &cap, &len)) != ESP_ERR_NOT_FOUND) {
+        if (rerr == ESP_ERR_NO_MEM) break;
+        if (rerr == ESP_OK) tokenize(line, termset_add, &ts);
+    }
+    free(line);
+    fclose(f);
+    if (rerr == ESP_ERR_NO_MEM) {
+        free(ts.terms);
+        free(ts.tfs);
+        return ESP_ERR_NO_MEM;
+    }
+
+    mi_posting_t *fresh = NULL;
+    size_t n = 0;
+    if (ts.unique > 0) {
+        fresh = heap_caps_malloc(ts.unique * sizeof(mi_posting_t), MALLOC_CAP_SPIRAM);
+        if (!fresh) {
+            free(ts.terms);
+            free(ts.tfs);
+            return ESP_ERR_NO_MEM;
+        }
+        for (int i = 0; i < MI_DOC_TERMS_CAP; i++) {
+            if (ts.terms[i]) {
+                fresh[n].term = ts.terms[i];
+                fresh[n].doc = (uint16_t)doc;
+                fresh[n].tf = ts.tfs[i];
+                n++;
+            }
+        }
+        qsort(fresh, n, sizeof(mi_posting_t), posting_cmp);
+    }
+    free(ts.terms);
+    free(ts.tfs);
+
+    esp_err_t err = replace_doc_postings((uint16_t)doc, fresh, n);
+    free(fresh);
+    if (err != ESP_OK) return err;
+
+    s_docs[doc].size = (uint32_t)st->st_size;
+    s_docs[doc].mtime = (uint32_t)st->st_mtime;
+    s_docs[doc].length = ts.total;
+    s_dirty = true;
+    return ESP_OK;
+}
+
+/* ── Flash persistence ────────────────────────────────────────── */
+
+/*
+ * File layout (little-endian):
+ *   u32 magic, u16 version, u16 doc_slots, u32 posting_count, u32 group_count
+ *   doc_slots × { u8 path_len (0 = free), path, u32 size, u32 mtime, u32 length }
+ *   group_count × { u32 term, varint n, n × { varint doc_delta, varint tf } }
+ *   u32 FNV-1a checksum of everything above
+ */
+
+typedef struct {
+    FILE *f;
+    uint32_t sum;
+    bool failed;
+} mi_writer_t;
+
+static void put_bytes(mi_writer_t *w, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; i++) {
+        w->sum ^= p[i];
+        w->sum *= 16777619U;
+    }
+    if (!w->failed && fwrite(data, 1, len, w->f) != len) w->failed = true;
+}
+
+static void put_u32(mi_writer_t *w, uint32_t v)
+{
+    put_bytes(w, &v, sizeof(v));
+}
+
+static void put_varint(mi_writer_t *w, uint32_t v)
+{
+    uint8_t buf[5];
+    size_t n = 0;
+    while (v >= 0x80) {
+        buf[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    buf[n++] = (uint8_t)v;
+    put_bytes(w, buf, n);
+}
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    bool failed;
+} mi_reader_t;
+
+static bool get_bytes(mi_reader_t *r, void *out, size_t len)
+{
+    if (r->failed || (size_t)(r->end - r->p) < len) {
+        r->failed = true;
+        return false;
+    }
+    memcpy(out, r->p, len);
+    r->p += len;
+    return true;
+}
+
+static uint32_t get_u32(mi_reader_t *r)
+{
+    uint32_t v = 0;
+    get_bytes(r, &v, sizeof(v));
+    return v;
+}
+
+static uint32_t get_varint(mi_reader_t *r)
+{
+    uint32_t v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t b;
+        if (!get_bytes(r, &b, 1)) return 0;
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return v;
+    }
+    r->failed = true;
+    return 0;
+}
+
+static esp_err_t save_index(void)
+{
+    const char *tmp_path = MIMI_MEMORY_INDEX_FILE ".tmp";
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) {
+        ESP_LOGE(TAG, "Cannot write %s", tmp_path);
+        return ESP_FAIL;
+    }
+
+    size_t groups = 0;
+    for (size_t i = 0; i < s_posting_count; i++) {
+        if (i == 0 || s_postings[i].term != s_postings[i - 1].term) groups++;
+    }
+
+    mi_writer_t w = { .f = f, .sum = 2166136261U, .failed = false };
+    uint16_t version = MI_VERSION;
+    uint16_t slots = (uint16_t)s_doc_slots;
+    put_u32(&w, MI_MAGIC);
+    put_bytes(&w, &version, sizeof(version));
+    put_bytes(&w, &slots, sizeof(slots));
+    put_u32(&w, (uint32_t)s_posting_count);
+    put_u32(&w, (uint32_t)groups);
+
+    for (int i = 0; i < s_doc_slots; i++) {
+        uint8_t len = (uint8_t)strlen(s_docs[i].path);
+        put_bytes(&w, &len, 1);
+        put_bytes(&w, s_docs[i].path, len);
+        put_u32(&w, s_docs[i].size);
+        put_u32(&w, s_docs[i].mtime);
+        put_u32(&w, s_docs[i].length);
+    }
+
+    size_t i = 0;
+    while (i < s_posting_count) {
+        size_t j = i;
+        while (j < s_posting_count && s_postings[j].term == s_postings[i].term) j++;
+
+        put_u32(&w, s_postings[i].term);
+        put_varint(&w, (uint32_t)(j - i));
+        uint16_t prev_doc = 0;
+        for (size_t k = i; k < j; k++) {
+            put_varint(&w, (uint32_t)(s_postings[k].doc - prev_doc));
+            put_varint(&w, s_postings[k].tf);
+            prev_doc = s_postings[k].doc;
+        }
+        i = j;
+    }
+
+    uint32_t sum = w.sum;
+    put_bytes(&w, &sum, sizeof(sum));
+    long file_size = ftell(f);
+    fclose(f);
+
+    if (w.failed) {
+        ESP_LOGE(TAG, "Index write failed, keeping previous index");
+        remove(tmp_path);
+        return ESP_FAIL;
+    }
+
+    if (storage_replace(tmp_path, MIMI_MEMORY_INDEX_FILE) != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot rename %s", tmp_path);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Index saved: %d files, %d postings, %ld bytes",
+             live_doc_count(), (int)s_posting_count, file_size);
+    return ESP_OK;
+}
+
+static esp_err_t load_index(void)
+{
+    struct stat st;
+    if (stat(MIMI_MEMORY_INDEX_FILE, &st) != 0 || st.st_size < 20) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint8_t *buf = heap_caps_malloc(st.st_size, MALLOC_CAP_SPIRAM);
+    if (!buf) return ESP_ERR_NO_MEM;
+
+    FILE *f = fopen(MIMI_MEMORY_INDEX_FILE, "rb");
+    if (!f) {
+        free(buf);
+        return ESP_ERR_NOT_FOUND;
+    }
+    size_t n = fread(buf, 1, st.st_size, f);
+    fclose(f);
+
+    esp_err_t err = ESP_ERR_INVALID_CRC;
+    mi_posting_t *postings = NULL;
+
+    if (n == (size_t)st.st_size) {
+        uint32_t sum = 2166136261U;
+        for (size_t i = 0; i < n - 4; i++) {
+            sum ^= buf[i];
+            sum *= 16777619U;
+        }
+        uint32_t stored;
+        memcpy(&stored, buf + n - 4, sizeof(stored));
+        if (sum == stored) err = ESP_OK;
+    }
+
+    mi_reader_t r = { .p = buf, .end = buf + n - 4, .failed = false };
+    uint16_t version = 0, slots = 0;
+    uint32_t posting_count = 0, groups = 0;
+
+    if (err == ESP_OK) {
+        uint32_t magic = get_u32(&r);
+        get_bytes(&r, &version, sizeof(version));
+        get_bytes(&r, &slots, sizeof(slots));
+        posting_count = get_u32(&r);
+        groups = get_u32(&r);
+        if (r.failed || magic != MI_MAGIC || version != MI_VERSION ||
+            slots > MIMI_MEMORY_INDEX_MAX_DOCS) {
+            err = ESP_ERR_INVALID_VERSION;
+        }
+    }
+
+    if (err == ESP_OK) {
+        memset(s_docs, 0, MIMI_MEMORY_INDEX_MAX_DOCS * sizeof(mi_doc_t));
+        for (int i = 0; i < slots && !r.failed; i++) {
+            uint8_t len = 0;
+            get_bytes(&r, &len, 1);
+            if (len >= sizeof(s_docs[i].path)) {
+                r.failed = true;
+                break;
+            }
+            get_bytes(&r, s_docs[i].path, len);
+            s_docs[i].path[len] = '\0';
+            s_docs[i].size = get_u32(&r);
+            s_docs[i].mtime = get_u32(&r);
+            s_docs[i].length = get_u32(&r);
+        }
+
+        if (posting_count > 0) {
+            postings = heap_caps_malloc(posting_count * sizeof(mi_posting_t), MALLOC_CAP_SPIRAM);
+            if (!postings) r.failed = true;
+        }
+
+        size_t k = 0;
+        for (uint32_t g = 0; g < groups && !r.failed; g++) {
+            uint32_t term = get_u32(&r);
+            uint32_t count = get_varint(&r);
+            uint32_t doc = 0;
+            for (uint32_t c = 0; c < count && !r.failed; c++) {
+                doc += get_varint(&r);
+                uint32_t tf = get_varint(&r);
+                if (k >= posting_count || doc >= slots) {
+                    r.failed = true;
+                    break;
+                }
+                postings[k].term = term;
+                postings[k].doc = (uint16_t)doc;
+                postings[k].tf = (uint16_t)tf;
+                k++;
+            }
+        }
+        if (r.failed || k != posting_count) {
+            err = ESP_ERR_INVALID_SIZE;
+        }
+    }
+    free(buf);
+
+    if (err != ESP_OK) {
+        free(postings);
+        memset(s_docs, 0, MIMI_MEMORY_INDEX_MAX_DOCS * sizeof(mi_doc_t));
+        ESP_LOGW(TAG, "Discarding unreadable index: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    free(s_postings);
+    s_postings = postings;
+    s_posting_count = posting_count;
+    s_doc_slots = slots;
+    return ESP_OK;
+}
+
+/* ── Reconcile with the filesystem ────────────────────────────── */
+
+typedef struct {
+    bool force;
+    bool *seen;
+    int reindexed;
+} mi_reconcile_t;
+
+static bool reconcile_file(const char *path, const struct stat *st, void *ctx)
+{
+    mi_reconcile_t *rc = (mi_reconcile_t *)ctx;
+    if (!is_memory_path(path)) return true;
+
+    int doc = find_doc(path);
+    if (doc >= 0 && !rc->force &&
+        s_docs[doc].size == (uint32_t)st->st_size &&
+        s_docs[doc].mtime == (uint32_t)st->st_mtime) {
+        rc->seen[doc] = true;
+        return true;
+    }
+
+    if (doc < 0) doc = alloc_doc(path);
+    if (doc < 0) {
+        ESP_LOGW(TAG, "Index full or path too long, skipping %s", path);
+        return true;
+    }
+    rc->seen[doc] = true;
+    if (index_doc(doc, st) == ESP_OK) rc->reindexed++;
+    return true;
+}
+
+/**
+ * Walk every memory file, re-index new or changed ones (all of them when
+ * force is set) and drop entries for files that no longer exist.
+ */
+static int reconcile(bool force)
+{
+    mi_reconcile_t rc = { .force = force, .reindexed = 0 };
+    rc.seen = calloc(MIMI_MEMORY_INDEX_MAX_DOCS, sizeof(bool));
+    if (!rc.seen) return 0;
+
+    if (storage_walk(MIMI_SPIFFS_MEMORY_DIR, true, reconcile_file, &rc) != ESP_OK) {
+        /* Keep the existing entries rather than dropping everything */
+        ESP_LOGW(TAG, "Cannot open %s for indexing", MIMI_SPIFFS_MEMORY_DIR);
+        free(rc.seen);
+        return 0;
+    }
+
+    for (int i = 0; i < s_doc_slots; i++) {
+        if (s_docs[i].path[0] && !rc.seen[i]) {
+            ESP_LOGI(TAG, "Dropping deleted file from index: %s", s_docs[i].path);
+            remove_doc(i);
+        }
+    }
+    free(rc.seen);
+    return rc.reindexed;
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+esp_err_t memory_index_init(void)
+{
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_lock) return ESP_ERR_NO_MEM;
+    }
+    if (!s_docs) {
+        s_docs = heap_caps_calloc(MIMI_MEMORY_INDEX_MAX_DOCS, sizeof(mi_doc_t), MALLOC_CAP_SPIRAM);
+        if (!s_docs) return ESP_ERR_NO_MEM;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool loaded = (load_index() == ESP_OK);
+    int reindexed = reconcile(!loaded);
+    if (s_dirty) save_index();
+    s_dirty = false;
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TAG, "Memory index ready: %d files, %d postings (%s, %d re-indexed)",
+             live_doc_count(), (int)s_posting_count, loaded ? "loaded" : "rebuilt", reindexed);
+    return ESP_OK;
+}
+
+esp_err_t memory_index_update_file(const char *path)
+{
+    if (!is_memory_path(path)) return ESP_OK;
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    esp_err_t err = ESP_OK;
+    int doc = find_doc(path);
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        if (doc >= 0) remove_doc(doc);
+    } else {
+        if (doc < 0) doc = alloc_doc(path);
+        if (doc < 0) {
+            ESP_LOGW(TAG, "Index full or path too long, not indexing %s", path);
+            err = ESP_ERR_NO_MEM;
+        } else {
+            err = index_doc(doc, &st);
+        }
+    }
+
+    xSemaphoreGive(s_lock);
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Re-indexed %s", path);
+    }
+    return err;
+}
+
+esp_err_t memory_index_flush(void)
+{
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = ESP_OK;
+    if (s_dirty) {
+        err = save_index();
+        if (err == ESP_OK) s_dirty = false;
+    }
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+esp_err_t memory_index_rebuild(void)
+{
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int reindexed = reconcile(true);
+    esp_err_t err = save_index();
+    if (err == ESP_OK) s_dirty = false;
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TAG, "Memory index rebuilt: %d files", reindexed);
+    return err;
+}
+
+/* ── Search ───────────────────────────────────────────────────── */
+
+typedef struct {
+    uint32_t terms[MI_MAX_QUERY_TERMS];
+    int count;
+    uint32_t matched;   /* bitmask of query terms seen, used for snippets */
+} mi_query_t;
+
+static void query_add(uint32_t term, void *ctx)
+{
+    mi_query_t *q = (mi_query_t *)ctx;
+    for (int i = 0; i < q->count; i++) {
+        if (q->terms[i] == term) return;
+    }
+    if (q->count < MI_MAX_QUERY_TERMS) q->terms[q->count++] = term;
+}
+
+static void query_match(uint32_t term, void *ctx)
+{
+    mi_query_t *q = (mi_query_t *)ctx;
+    for (int i = 0; i < q->count; i++) {
+        if (q->terms[i] == term) q->matched |= (1U << i);
+    }
+}
+
+static size_t lower_bound(uint32_t term)
+{
+    size_t lo = 0, hi = s_posting_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (s_postings[mid].term < term) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * Append the lines of one file that match the most query terms.
+ */
+static size_t append_snippets(const char *path, mi_query_t *q, char *out, size_t size, size_t off)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) return off;
+
+    struct { int line_no; int hits; char text[MI_SNIPPET_LEN + 1]; } best[MI_SNIPPET_LINES] = {0};
+    char *line = NULL;
+    size_t cap = 0, len;
+    int line_no = 0;
+    esp_err_t rerr;
+
+    while ((rerr = storage_read_line(f, &line, &cap, &len)) != ESP_ERR_NOT_FOUND) {
+        if (rerr == ESP_ERR_NO_MEM) break;
+        line_no++;
+        if (rerr != ESP_OK) continue;
+        q->matched = 0;
+        tokenize(line, query_match, q);
+        int hits = __builtin_popcount(q->matched);
+        if (hits == 0) continue;
+
+        for (int i = 0; i < MI_SNIPPET_LINES; i++) {
+            if (hits <= best[i].hits) continue;
+            memmove(&best[i + 1], &best[i], (MI_SNIPPET_LINES - i - 1) * sizeof(best[0]));
+            best[i].line_no = line_no;
+            best[i].hits = hits;
+            size_t n = strcspn(line, "\r");
+            if (n > MI_SNIPPET_LEN) n = MI_SNIPPET_LEN;
+            memcpy(best[i].text, line, n);
+            best[i].text[n] = '\0';
+            break;
+        }
+    }
+    free(line);
+    fclose(f);
+
+    for (int i = 0; i < MI_SNIPPET_LINES && best[i].hits > 0 && off < size - 1; i++) {
+        off += snprintf(out + off, size - off, "   L%d: %s\n", best[i].line_no, best[i].text);
+    }
+    return off;
+}
+
+esp_err_t memory_index_search(const char *query, int max_results, char *out, size_t out_size)
+{
+    if (!s_lock) {
+        snprintf(out, out_size, "Error: memory index not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    mi_query_t q = {0};
+    tokenize(query ? query : "", query_add, &q);
+    if (q.count == 0) {
+        snprintf(out, out_size, "Error: query has no searchable words");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (max_results < 1) max_results = 1;
+    if (max_results > MI_MAX_RESULTS) max_results = MI_MAX_RESULTS;
+
+    struct { int doc; float score; char path[64]; } top[MI_MAX_RESULTS];
+    int top_count = 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    int live = live_doc_count();
+    uint64_t total_len = 0;
+    for (int i = 0; i < s_doc_slots; i++) {
+        total_len += s_docs[i].length;
+    }
+
+    float *scores = (s_doc_slots > 0) ? calloc(s_doc_slots, sizeof(float)) : NULL;
+    if (live > 0 && scores) {
+        float avgdl = (float)total_len / (float)live;
+        if (avgdl < 1.0f) avgdl = 1.0f;
+
+        for (int t = 0; t < q.count; t++) {
+            size_t start = lower_bound(q.terms[t]);
+            size_t end = start;
+            while (end < s_posting_count && s_postings[end].term == q.terms[t]) end++;
+            size_t df = end - start;
+            if (df == 0) continue;
+
+            float idf = logf(1.0f + ((float)live - (float)df + 0.5f) / ((float)df + 0.5f));
+            for (size_t p = start; p < end; p++) {
+                const mi_posting_t *post = &s_postings[p];
+                float tf = (float)post->tf;
+                float dl = (float)s_docs[post->doc].length;
+                scores[post->doc] += idf * (tf * (MI_BM25_K1 + 1.0f)) /
+                    (tf + MI_BM25_K1 * (1.0f - MI_BM25_B + MI_BM25_B * dl / avgdl));
+            }
+        }
+
+        /* Keep the best max_results docs, ordered by descending score */
+        for (int d = 0; d < s_doc_slots; d++) {
+            if (scores[d] <= 0.0f) continue;
+            int pos = top_count;
+            while (pos > 0 && top[pos - 1].score < scores[d]) pos--;
+            if (pos >= max_results) continue;
+            int last = (top_count < max_results) ? top_count : max_results - 1;
+            memmove(&top[pos + 1], &top[pos], (last - pos) * sizeof(top[0]));
+            top[pos].doc = d;
+            top[pos].score = scores[d];
+            strlcpy(top[pos].path, s_docs[d].path, sizeof(top[pos].path));
+            if (top_count < max_results) top_count++;
+        }
+    }
+    free(scores);
+
+    xSemaphoreGive(s_lock);
+
+    if (top_count == 0) {
+        snprintf(out, out_size, "No memory notes matched \"%s\".", query);
+        return ESP_OK;
+    }
+
+    size_t off = snprintf(out, out_size, "Top %d memory matches for \"%s\":\n", top_count, query);
+    for (int i = 0; i < top_count && off < out_size - 1; i++) {
+        off += snprintf(out + off, out_size - off, "%d. %s (score %.2f)\n",
+                        i + 1, top[i].path, (double)top[i].score);
+        if (off >= out_size - 1) break;
+        off = append_snippets(top[i].path, &q, out, out_size, off);
+    }
+    out[out_size - 1] = '\0';
+
+    ESP_LOGI(TAG, "Search \"%s\": %d terms, %d results", query, q.count, top_count);
+    return ESP_OK;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+
+/**
+ * Initialize the memory search index.
+ * Loads the on-flash index (MIMI_MEMORY_INDEX_FILE) and re-indexes any
+ * memory file whose size or mtime changed since the index was saved.
+ */
+esp_err_t memory_index_init(void);
+
+/**
+ * Re-index a single file after it was written.
+ * Paths outside MIMI_SPIFFS_MEMORY_DIR are ignored. A missing file is
+ * removed from the index. Changes stay in RAM until memory_index_flush().
+ */
+esp_err_t memory_index_update_file(const char *path);
+
+/**
+ * Persist the index to flash if it changed since the last flush.
+ */
+esp_err_t memory_index_flush(void);
+
+/**
+ * Drop the index and rebuild it from every file under MIMI_SPIFFS_MEMORY_DIR.
+ */
+esp_err_t memory_index_rebuild(void);
+
+/**
+ * Keyword search over MEMORY.md and daily notes (BM25 ranking).
+ * Writes up to max_results ranked files with their best-matching lines.
+ *
+ * @param query        Free-text query
+ * @param max_results  Maximum number of files to return
+ * @param out          Output buffer for the formatted results
+ * @param out_size     Output buffer size
+ * @return ESP_OK on success (including no matches), ESP_ERR_INVALID_ARG on empty query
+ */
+esp_err_t memory_index_search(const char *query, int max_results, char *out, size_t out_size);
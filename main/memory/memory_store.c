@@ -1,4 +1,6 @@
 #include "memory_store.h"
+#include "memory_index.h"
+#include "memory_vec.h"
 #include "mimi_config.h"
 
 #include <stdio.h>
@@ -21,8 +23,7 @@ static void get_date_str(char *buf, size_t size, int days_ago)
 
 esp_err_t memory_store_init(void)
 {
-    /* SPIFFS is flat — no real directory creation needed.
-       Just verify we can open the base path. */
+    /* Directories are created by storage_init() */
     ESP_LOGI(TAG, "Memory store initialized at %s", MIMI_SPIFFS_BASE);
     return ESP_OK;
 }
@@ -50,6 +51,8 @@ esp_err_t memory_write_long_term(const char *content)
     }
     fputs(content, f);
     fclose(f);
+    memory_index_update_file(MIMI_MEMORY_FILE);
+    memory_vec_queue_file(MIMI_MEMORY_FILE);
     ESP_LOGI(TAG, "Long-term memory updated (%d bytes)", (int)strlen(content));
     return ESP_OK;
 }
@@ -75,6 +78,8 @@ esp_err_t memory_append_today(const char *note)
 
     fprintf(f, "%s\n", note);
     fclose(f);
+    memory_index_update_file(path);
+    memory_vec_queue_file(path);
     return ESP_OK;
 }
 
@@ -0,0 +1,603 @@
+#include "memory/memory_vec.h"
+#include "memory/vec_kernel.h"
+#include "mimi_config.h"
+#include "llm/llm_proxy.h"
+#include "storage/storage.h"
+#include "arena/arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+static const char *TAG = "mem_vec";
+
+#define MV_MAGIC            0x4345564DU   /* "MVEC" little-endian */
+#define MV_VERSION          1
+#define MV_TEXT_MAX         240
+#define MV_MIN_LINE_LEN     8
+#define MV_FILE_CHUNKS_MAX  128
+#define MV_QUEUE_LEN        16
+
+enum {
+    MV_KIND_NOTE = 1,   /* one line of a memory file */
+    MV_KIND_TURN = 2,   /* one user/assistant exchange */
+};
+
+enum {
+    MV_JOB_FILE,
+    MV_JOB_TURN,
+    MV_JOB_SYNC_ALL,
+};
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t dims;
+    uint32_t capacity;
+    uint32_t next;          /* eviction cursor once the store is full */
+} mv_header_t;
+
+/* Fixed-size on-flash record; 512 bytes with the default dimensions */
+typedef struct {
+    uint32_t text_hash;     /* 0 = empty slot */
+    uint32_t source;        /* hash of the file path or "chat:<id>" */
+    float scale;
+    uint16_t text_len;
+    uint8_t kind;
+    uint8_t reserved;
+    int8_t vec[MIMI_EMBED_DIMS];
+    char text[MV_TEXT_MAX];
+} mv_record_t;
+
+/* In-PSRAM copy of everything search needs; text stays on flash */
+typedef struct {
+    uint32_t text_hash;
+    uint32_t source;
+    float scale;
+    uint8_t kind;
+} mv_meta_t;
+
+typedef struct {
+    uint8_t kind;
+    uint32_t source;
+    char *text;             /* MV_JOB_FILE: path, MV_JOB_TURN: chunk text */
+} mv_job_t;
+
+static int8_t *s_vecs = NULL;           /* MIMI_MEMORY_VEC_MAX * MIMI_EMBED_DIMS, 16-byte aligned */
+static mv_meta_t *s_meta = NULL;
+static uint32_t s_file_records = 0;     /* records physically present in the file */
+static uint32_t s_next = 0;
+static SemaphoreHandle_t s_lock = NULL;
+static QueueHandle_t s_queue = NULL;
+static arena_t s_embed_arena;          /* embed task only */
+
+static uint32_t mv_hash(const char *s)
+{
+    uint32_t h = 2166136261U;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 16777619U;
+    }
+    return h ? h : 1;
+}
+
+static long record_offset(uint32_t slot)
+{
+    return (long)sizeof(mv_header_t) + (long)slot * (long)sizeof(mv_record_t);
+}
+
+/* ── File I/O (caller holds s_lock) ───────────────────────────── */
+
+static esp_err_t write_header(FILE *f)
+{
+    mv_header_t hdr = {
+        .magic = MV_MAGIC,
+        .version = MV_VERSION,
+        .dims = MIMI_EMBED_DIMS,
+        .capacity = MIMI_MEMORY_VEC_MAX,
+        .next = s_next,
+    };
+    fseek(f, 0, SEEK_SET);
+    return fwrite(&hdr, sizeof(hdr), 1, f) == 1 ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t create_store(void)
+{
+    FILE *f = fopen(MIMI_MEMORY_VEC_FILE, "wb");
+    if (!f) {
+        ESP_LOGE(TAG, "Cannot create %s", MIMI_MEMORY_VEC_FILE);
+        return ESP_FAIL;
+    }
+    s_next = 0;
+    s_file_records = 0;
+    esp_err_t err = write_header(f);
+    fclose(f);
+    return err;
+}
+
+static esp_err_t load_store(void)
+{
+    FILE *f = fopen(MIMI_MEMORY_VEC_FILE, "rb");
+    if (!f) return ESP_ERR_NOT_FOUND;
+
+    mv_header_t hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != MV_MAGIC ||
+        hdr.version != MV_VERSION || hdr.dims != MIMI_EMBED_DIMS ||
+        hdr.capacity != MIMI_MEMORY_VEC_MAX) {
+        fclose(f);
+        ESP_LOGW(TAG, "Vector store format changed, starting fresh");
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    mv_record_t rec;
+    uint32_t slot = 0;
+    int live = 0;
+    while (slot < MIMI_MEMORY_VEC_MAX && fread(&rec, sizeof(rec), 1, f) == 1) {
+        s_meta[slot].text_hash = rec.text_hash;
+        s_meta[slot].source = rec.source;
+        s_meta[slot].scale = rec.scale;
+        s_meta[slot].kind = rec.kind;
+        memcpy(s_vecs + (size_t)slot * MIMI_EMBED_DIMS, rec.vec, MIMI_EMBED_DIMS);
+        if (rec.text_hash) live++;
+        slot++;
+    }
+    fclose(f);
+
+    s_file_records = slot;
+    s_next = hdr.next % MIMI_MEMORY_VEC_MAX;
+    ESP_LOGI(TAG, "Vector store loaded: %d memories in %d slots", live, (int)slot);
+    return ESP_OK;
+}
+
+/**
+ * Choose where a new record goes: a freed slot, the end of the file, or —
+ * when full — the next slot at the eviction cursor, preferring old chat
+ * turns over memory notes.
+ */
+static uint32_t pick_slot(bool *advanced_cursor)
+{
+    *advanced_cursor = false;
+    for (uint32_t i = 0; i < s_file_records; i++) {
+        if (!s_meta[i].text_hash) return i;
+    }
+    if (s_file_records < MIMI_MEMORY_VEC_MAX) return s_file_records;
+
+    uint32_t slot = s_next;
+    for (uint32_t n = 0; n < MIMI_MEMORY_VEC_MAX; n++) {
+        uint32_t i = (s_next + n) % MIMI_MEMORY_VEC_MAX;
+        if (s_meta[i].kind == MV_KIND_TURN) {
+            slot = i;
+            break;
+        }
+    }
+    s_next = (slot + 1) % MIMI_MEMORY_VEC_MAX;
+    *advanced_cursor = true;
+    return slot;
+}
+
+static esp_err_t store_record(const mv_record_t *rec)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    bool advanced = false;
+    uint32_t slot = pick_slot(&advanced);
+
+    esp_err_t err = ESP_FAIL;
+    FILE *f = fopen(MIMI_MEMORY_VEC_FILE, "r+b");
+    if (f) {
+        if (advanced) write_header(f);
+        if (fseek(f, record_offset(slot), SEEK_SET) == 0 &&
+            fwrite(rec, sizeof(*rec), 1, f) == 1) {
+            err = ESP_OK;
+        }
+        fclose(f);
+    }
+
+    if (err == ESP_OK) {
+        s_meta[slot].text_hash = rec->text_hash;
+        s_meta[slot].source = rec->source;
+        s_meta[slot].scale = rec->scale;
+        s_meta[slot].kind = rec->kind;
+        memcpy(s_vecs + (size_t)slot * MIMI_EMBED_DIMS, rec->vec, MIMI_EMBED_DIMS);
+        if (slot >= s_file_records) s_file_records = slot + 1;
+    } else {
+        ESP_LOGE(TAG, "Failed to write vector slot %d", (int)slot);
+    }
+
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+/* Mark every record of a source as empty unless its hash is in keep[] */
+static void drop_stale(uint32_t source, const uint32_t *keep, int keep_count)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    FILE *f = NULL;
+    int dropped = 0;
+    for (uint32_t i = 0; i < s_file_records; i++) {
+        if (!s_meta[i].text_hash || s_meta[i].source != source) continue;
+
+        bool wanted = false;
+        for (int k = 0; k < keep_count; k++) {
+            if (keep[k] == s_meta[i].text_hash) {
+                wanted = true;
+                break;
+            }
+        }
+        if (wanted) continue;
+
+        if (!f) f = fopen(MIMI_MEMORY_VEC_FILE, "r+b");
+        if (!f) break;
+        uint32_t zero = 0;
+        fseek(f, record_offset(i), SEEK_SET);
+        fwrite(&zero, sizeof(zero), 1, f);
+        s_meta[i].text_hash = 0;
+        dropped++;
+    }
+    if (f) fclose(f);
+
+    xSemaphoreGive(s_lock);
+    if (dropped) ESP_LOGI(TAG, "Dropped %d stale memories", dropped);
+}
+
+static bool has_record(uint32_t source, uint32_t text_hash)
+{
+    bool found = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (uint32_t i = 0; i < s_file_records; i++) {
+        if (s_meta[i].text_hash == text_hash && s_meta[i].source == source) {
+            found = true;
+            break;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return found;
+}
+
+/* ── Embedding worker ─────────────────────────────────────────── */
+
+/**
+ * Embed a batch of texts and store one record per text.
+ */
+static esp_err_t embed_and_store(uint8_t kind, uint32_t source,
+                                 const char *const *texts, int count)
+{
+    float *emb = heap_caps_malloc((size_t)count * MIMI_EMBED_DIMS * sizeof(float),
+                                  MALLOC_CAP_SPIRAM);
+    if (!emb) return ESP_ERR_NO_MEM;
+
+    /* The request/response JSON for a batch of vectors is large and short-lived */
+    arena_bind(&s_embed_arena);
+    esp_err_t err = llm_embed(texts, count, emb, MIMI_EMBED_DIMS);
+    arena_bind(NULL);
+    arena_reset(&s_embed_arena);
+    if (err != ESP_OK) {
+        free(emb);
+        return err;
+    }
+
+    mv_record_t rec;
+    for (int i = 0; i < count && err == ESP_OK; i++) {
+        memset(&rec, 0, sizeof(rec));
+        rec.scale = vec_quantize_i8(emb + (size_t)i * MIMI_EMBED_DIMS, rec.vec, MIMI_EMBED_DIMS);
+        if (rec.scale <= 0.0f) continue;
+        rec.text_hash = mv_hash(texts[i]);
+        rec.source = source;
+        rec.kind = kind;
+        strlcpy(rec.text, texts[i], sizeof(rec.text));
+        rec.text_len = (uint16_t)strlen(rec.text);
+        err = store_record(&rec);
+    }
+
+    free(emb);
+    return err;
+}
+
+/**
+ * Split a memory file into one chunk per content line (headings and short
+ * lines are skipped), embed the ones not stored yet and drop the ones that
+ * no longer exist.
+ */
+static void sync_file(const char *path)
+{
+    uint32_t source = mv_hash(path);
+
+    char (*chunks)[MV_TEXT_MAX] = heap_caps_calloc(MV_FILE_CHUNKS_MAX, MV_TEXT_MAX, MALLOC_CAP_SPIRAM);
+    uint32_t *hashes = calloc(MV_FILE_CHUNKS_MAX, sizeof(uint32_t));
+    if (!chunks || !hashes) {
+        free(chunks);
+        free(hashes);
+        return;
+    }
+
+    /* "MEMORY.md" → "MEMORY", "2026-03-02.md" → "2026-03-02" */
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    char label[32];
+    strlcpy(label, base, sizeof(label));
+    char *dot = strrchr(label, '.');
+    if (dot) *dot = '\0';
+
+    int count = 0;
+    FILE *f = fopen(path, "r");
+    if (f) {
+        char line[512];
+        while (count < MV_FILE_CHUNKS_MAX && fgets(line, sizeof(line), f)) {
+            line[strcspn(line, "\r\n")] = '\0';
+            char *p = line;
+            while (*p == ' ' || *p == '\t') p++;
+            if (*p == '#') continue;
+            if ((p[0] == '-' || p[0] == '*') && p[1] == ' ') p += 2;
+            if (strlen(p) < MV_MIN_LINE_LEN) continue;
+
+            snprintf(chunks[count], MV_TEXT_MAX, "%s: %s", label, p);
+            hashes[count] = mv_hash(chunks[count]);
+            count++;
+        }
+        fclose(f);
+    }
+
+    /* Embed new chunks in batches */
+    const char *batch[MIMI_EMBED_BATCH];
+    int batch_count = 0;
+    int added = 0;
+    bool failed = false;
+    for (int i = 0; i < count && !failed; i++) {
+        if (has_record(source, hashes[i])) continue;
+        batch[batch_count++] = chunks[i];
+        if (batch_count == MIMI_EMBED_BATCH) {
+            if (embed_and_store(MV_KIND_NOTE, source, batch, batch_count) != ESP_OK) {
+                failed = true;
+            } else {
+                added += batch_count;
+            }
+            batch_count = 0;
+        }
+    }
+    if (!failed && batch_count > 0) {
+        if (embed_and_store(MV_KIND_NOTE, source, batch, batch_count) == ESP_OK) {
+            added += batch_count;
+        } else {
+            failed = true;
+        }
+    }
+
+    /* Only prune when the file was fully embedded, so a network error does
+     * not lose memories that still exist on disk */
+    if (!failed) drop_stale(source, hashes, count);
+
+    if (added || failed) {
+        ESP_LOGI(TAG, "Synced %s: %d new chunks%s", path, added, failed ? " (incomplete)" : "");
+    }
+
+    free(chunks);
+    free(hashes);
+}
+
+typedef struct {
+    char (*paths)[64];
+    int count;
+} mv_file_list_t;
+
+static bool collect_memory_file(const char *path, const struct stat *st, void *ctx)
+{
+    mv_file_list_t *list = (mv_file_list_t *)ctx;
+    size_t len = strlen(path);
+    if (len < 3 || strcmp(path + len - 3, ".md") != 0 || len >= 64) return true;
+    strlcpy(list->paths[list->count++], path, 64);
+    return list->count < MIMI_MEMORY_INDEX_MAX_DOCS;
+}
+
+static void sync_all_files(void)
+{
+    /* Collect names first: syncing writes to the filesystem being walked */
+    mv_file_list_t list = { .count = 0 };
+    list.paths = heap_caps_calloc(MIMI_MEMORY_INDEX_MAX_DOCS, 64, MALLOC_CAP_SPIRAM);
+    if (!list.paths) return;
+
+    storage_walk(MIMI_SPIFFS_MEMORY_DIR, true, collect_memory_file, &list);
+    for (int i = 0; i < list.count; i++) {
+        sync_file(list.paths[i]);
+    }
+    free(list.paths);
+}
+
+static void embed_task(void *arg)
+{
+    ESP_LOGI(TAG, "Embedding worker started");
+    mv_job_t job;
+    arena_init(&s_embed_arena, "mem_embed");
+
+    while (1) {
+        if (xQueueReceive(s_queue, &job, portMAX_DELAY) != pdTRUE) continue;
+
+        if (!llm_embed_available()) {
+            free(job.text);
+            continue;
+        }
+
+        switch (job.kind) {
+        case MV_JOB_FILE:
+            sync_file(job.text);
+            break;
+        case MV_JOB_TURN: {
+            const char *texts[1] = { job.text };
+            if (!has_record(job.source, mv_hash(job.text))) {
+                embed_and_store(MV_KIND_TURN, job.source, texts, 1);
+            }
+            break;
+        }
+        case MV_JOB_SYNC_ALL:
+            sync_all_files();
+            break;
+        }
+        free(job.text);
+    }
+}
+
+static esp_err_t queue_job(uint8_t kind, uint32_t source, char *text)
+{
+    if (!s_queue) {
+        free(text);
+        return ESP_ERR_INVALID_STATE;
+    }
+    mv_job_t job = { .kind = kind, .source = source, .text = text };
+    if (xQueueSend(s_queue, &job, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Embedding queue full, dropping job");
+        free(text);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+esp_err_t memory_vec_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    s_queue = xQueueCreate(MV_QUEUE_LEN, sizeof(mv_job_t));
+    s_vecs = heap_caps_aligned_calloc(16, MIMI_MEMORY_VEC_MAX, MIMI_EMBED_DIMS, MALLOC_CAP_SPIRAM);
+    s_meta = heap_caps_calloc(MIMI_MEMORY_VEC_MAX, sizeof(mv_meta_t), MALLOC_CAP_SPIRAM);
+    if (!s_lock || !s_queue || !s_vecs || !s_meta) {
+        ESP_LOGE(TAG, "Out of memory for vector store");
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (load_store() != ESP_OK) {
+        memset(s_meta, 0, MIMI_MEMORY_VEC_MAX * sizeof(mv_meta_t));
+        return create_store();
+    }
+    return ESP_OK;
+}
+
+esp_err_t memory_vec_start(void)
+{
+    BaseType_t ret = xTaskCreatePinnedToCore(
+        embed_task, "mem_embed",
+        MIMI_MEMORY_VEC_STACK, NULL,
+        MIMI_MEMORY_VEC_PRIO, NULL, MIMI_MEMORY_VEC_CORE);
+    if (ret != pdPASS) return ESP_FAIL;
+
+    if (!llm_embed_available()) {
+        ESP_LOGW(TAG, "No embeddings backend (set provider openai or an Ollama URL); "
+                      "falling back to recent notes");
+        return ESP_OK;
+    }
+    return queue_job(MV_JOB_SYNC_ALL, 0, NULL);
+}
+
+esp_err_t memory_vec_queue_file(const char *path)
+{
+    static const char prefix[] = MIMI_SPIFFS_MEMORY_DIR "/";
+    if (!path || strncmp(path, prefix, sizeof(prefix) - 1) != 0) return ESP_OK;
+
+    char *copy = strdup(path);
+    if (!copy) return ESP_ERR_NO_MEM;
+    return queue_job(MV_JOB_FILE, 0, copy);
+}
+
+esp_err_t memory_vec_queue_turn(const char *chat_id, const char *user_text,
+                                const char *assistant_text)
+{
+    if (!user_text || !assistant_text) return ESP_ERR_INVALID_ARG;
+    if (strlen(user_text) + strlen(assistant_text) < 2 * MV_MIN_LINE_LEN) return ESP_OK;
+
+    char date[16] = "chat";
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    if (tm.tm_year >= (2024 - 1900)) {
+        strftime(date, sizeof(date), "%Y-%m-%d", &tm);
+    }
+
+    char *text = malloc(MV_TEXT_MAX);
+    if (!text) return ESP_ERR_NO_MEM;
+    snprintf(text, MV_TEXT_MAX, "%s chat: User: %.100s / Assistant: %s",
+             date, user_text, assistant_text);
+
+    char source_key[48];
+    snprintf(source_key, sizeof(source_key), "chat:%s", chat_id ? chat_id : "");
+    return queue_job(MV_JOB_TURN, mv_hash(source_key), text);
+}
+
+esp_err_t memory_vec_recall(const char *query, int top_k, char *out, size_t out_size)
+{
+    out[0] = '\0';
+    if (!s_meta) return ESP_ERR_INVALID_STATE;
+    if (!query || !query[0] || top_k <= 0) return ESP_ERR_INVALID_ARG;
+    if (!llm_embed_available()) return ESP_ERR_NOT_SUPPORTED;
+
+    int live = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (uint32_t i = 0; i < s_file_records; i++) {
+        if (s_meta[i].text_hash) live++;
+    }
+    xSemaphoreGive(s_lock);
+    if (live == 0) return ESP_ERR_NOT_FOUND;
+
+    float *emb = heap_caps_malloc(MIMI_EMBED_DIMS * sizeof(float), MALLOC_CAP_SPIRAM);
+    if (!emb) return ESP_ERR_NO_MEM;
+    esp_err_t err = llm_embed_query(query, emb, MIMI_EMBED_DIMS);
+    if (err != ESP_OK) {
+        free(emb);
+        return err;
+    }
+
+    int8_t q[MIMI_EMBED_DIMS] __attribute__((aligned(16)));
+    float q_scale = vec_quantize_i8(emb, q, MIMI_EMBED_DIMS);
+    free(emb);
+    if (q_scale <= 0.0f) return ESP_OK;
+
+    if (top_k > MIMI_MEMORY_RECALL_TOP_K) top_k = MIMI_MEMORY_RECALL_TOP_K;
+    struct { uint32_t slot; float score; } top[MIMI_MEMORY_RECALL_TOP_K];
+    int top_count = 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    for (uint32_t i = 0; i < s_file_records; i++) {
+        if (!s_meta[i].text_hash) continue;
+        int32_t dot = vec_dot_i8(q, s_vecs + (size_t)i * MIMI_EMBED_DIMS, MIMI_EMBED_DIMS);
+        float score = (float)dot * q_scale * s_meta[i].scale;
+        if (score < MIMI_MEMORY_RECALL_MIN_SCORE) continue;
+
+        int pos = top_count;
+        while (pos > 0 && top[pos - 1].score < score) pos--;
+        if (pos >= top_k) continue;
+        int last = (top_count < top_k) ? top_count : top_k - 1;
+        memmove(&top[pos + 1], &top[pos], (last - pos) * sizeof(top[0]));
+        top[pos].slot = i;
+        top[pos].score = score;
+        if (top_count < top_k) top_count++;
+    }
+
+    size_t off = 0;
+    FILE *f = top_count ? fopen(MIMI_MEMORY_VEC_FILE, "rb") : NULL;
+    if (f) {
+        mv_record_t rec;
+        for (int i = 0; i < top_count && off < out_size - 1; i++) {
+            if (fseek(f, record_offset(top[i].slot), SEEK_SET) != 0 ||
+                fread(&rec, sizeof(rec), 1, f) != 1) {
+                continue;
+            }
+            rec.text[MV_TEXT_MAX - 1] = '\0';
+            off += snprintf(out + off, out_size - off, "- %s\n", rec.text);
+        }
+        fclose(f);
+    }
+
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TAG, "Recall: %d of %d memories above %.2f", top_count, live,
+             (double)MIMI_MEMORY_RECALL_MIN_SCORE);
+    return ESP_OK;
+}
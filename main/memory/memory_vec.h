@@ -0,0 +1,42 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+
+/**
+ * Initialize the semantic memory store.
+ * Loads the int8 vector file (MIMI_MEMORY_VEC_FILE) into PSRAM. Creates an
+ * empty store if the file is missing or was built with different dimensions.
+ */
+esp_err_t memory_vec_init(void);
+
+/**
+ * Start the background embedding worker (needs WiFi) and queue a sync of
+ * every memory file, so notes edited while offline get embedded.
+ */
+esp_err_t memory_vec_start(void);
+
+/**
+ * Queue a memory file for re-embedding after it was written.
+ * New or changed lines are embedded; lines that disappeared are dropped.
+ * Paths outside MIMI_SPIFFS_MEMORY_DIR are ignored.
+ */
+esp_err_t memory_vec_queue_file(const char *path);
+
+/**
+ * Queue a finished conversation turn for embedding.
+ */
+esp_err_t memory_vec_queue_turn(const char *chat_id, const char *user_text,
+                                const char *assistant_text);
+
+/**
+ * Embed the query and write the most similar stored memories as a bullet list.
+ *
+ * @param query     Text to match (usually the incoming user message)
+ * @param top_k     Maximum number of memories to return
+ * @param out       Output buffer, empty string when nothing is relevant
+ * @param out_size  Output buffer size
+ * @return ESP_OK on success (even with no matches), ESP_ERR_NOT_SUPPORTED when
+ *         no embeddings backend is configured, ESP_ERR_NOT_FOUND when the store is empty
+ */
+esp_err_t memory_vec_recall(const char *query, int top_k, char *out, size_t out_size);
@@ -1,16 +1,44 @@
 #include "session_mgr.h"
 #include "mimi_config.h"
+#include "storage/storage.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <dirent.h>
 #include <time.h>
+#include <unistd.h>
 #include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
 #include "cJSON.h"
 
 static const char *TAG = "session";
 
+#define SESSION_BATCH_INIT_CAP   4096
+#define SESSION_TURN_MAX_RECORDS 32
+
+/*
+ * On-flash format: one JSON object per line. Records written by a batch carry
+ * a "turn" id and are followed by a commit marker:
+ *   {"role":"user","content":"...","ts":1738764800,"turn":123}
+ *   ...
+ *   {"commit":123,"n":3,"crc":4051392113}
+ * where crc is the CRC32 of the n record lines (without newlines). Lines
+ * without "turn" predate batching and are accepted as-is.
+ */
+struct session_batch {
+    char chat_id[32];
+    uint32_t turn_id;
+    int count;
+    uint32_t crc;
+    char *buf;
+    size_t len;
+    size_t cap;
+};
+
 static void session_path(const char *chat_id, char *buf, size_t size)
 {
     snprintf(buf, size, "%s/tg_%s.jsonl", MIMI_SPIFFS_SESSION_DIR, chat_id);
@@ -22,32 +50,126 @@ esp_err_t session_mgr_init(void)
     return ESP_OK;
 }
 
-esp_err_t session_append(const char *chat_id, const char *role, const char *content)
+/* ── Turn batches ─────────────────────────────────────────────── */
+
+static esp_err_t batch_append_line(session_batch_t *b, const char *line)
 {
-    char path[64];
-    session_path(chat_id, path, sizeof(path));
+    size_t len = strlen(line);
+    if (b->len + len + 2 > b->cap) {
+        size_t new_cap = b->cap;
+        while (b->len + len + 2 > new_cap) new_cap *= 2;
+        char *tmp = heap_caps_realloc(b->buf, new_cap, MALLOC_CAP_SPIRAM);
+        if (!tmp) return ESP_ERR_NO_MEM;
+        b->buf = tmp;
+        b->cap = new_cap;
+    }
+    memcpy(b->buf + b->len, line, len);
+    b->len += len;
+    b->buf[b->len++] = '\n';
+    b->buf[b->len] = '\0';
+    return ESP_OK;
+}
 
-    FILE *f = fopen(path, "a");
-    if (!f) {
-        ESP_LOGE(TAG, "Cannot open session file %s", path);
-        return ESP_FAIL;
+session_batch_t *session_batch_begin(const char *chat_id)
+{
+    session_batch_t *b = calloc(1, sizeof(*b));
+    if (!b) return NULL;
+    b->buf = heap_caps_malloc(SESSION_BATCH_INIT_CAP, MALLOC_CAP_SPIRAM);
+    if (!b->buf) {
+        free(b);
+        return NULL;
+    }
+    b->cap = SESSION_BATCH_INIT_CAP;
+    strncpy(b->chat_id, chat_id, sizeof(b->chat_id) - 1);
+    b->turn_id = esp_random() & 0x7FFFFFFF;
+    return b;
+}
+
+esp_err_t session_batch_add(session_batch_t *b, const char *role, const char *content)
+{
+    if (!b || !role || !content) return ESP_ERR_INVALID_ARG;
+    if (b->count >= SESSION_TURN_MAX_RECORDS) {
+        ESP_LOGW(TAG, "Turn has more than %d records, dropping extra", SESSION_TURN_MAX_RECORDS);
+        return ESP_ERR_INVALID_SIZE;
     }
 
     cJSON *obj = cJSON_CreateObject();
     cJSON_AddStringToObject(obj, "role", role);
     cJSON_AddStringToObject(obj, "content", content);
     cJSON_AddNumberToObject(obj, "ts", (double)time(NULL));
+    cJSON_AddNumberToObject(obj, "turn", (double)b->turn_id);
 
     char *line = cJSON_PrintUnformatted(obj);
     cJSON_Delete(obj);
+    if (!line) return ESP_ERR_NO_MEM;
+
+    esp_err_t err = batch_append_line(b, line);
+    if (err == ESP_OK) {
+        b->crc = esp_rom_crc32_le(b->crc, (const uint8_t *)line, strlen(line));
+        b->count++;
+    }
+    cJSON_free(line);
+    return err;
+}
 
-    if (line) {
-        fprintf(f, "%s\n", line);
-        free(line);
+esp_err_t session_batch_commit(session_batch_t *b)
+{
+    if (!b) return ESP_ERR_INVALID_ARG;
+    if (b->count == 0) {
+        session_batch_discard(b);
+        return ESP_OK;
+    }
+
+    char marker[80];
+    snprintf(marker, sizeof(marker), "{\"commit\":%lu,\"n\":%d,\"crc\":%lu}",
+             (unsigned long)b->turn_id, b->count, (unsigned long)b->crc);
+    esp_err_t err = batch_append_line(b, marker);
+    if (err != ESP_OK) {
+        session_batch_discard(b);
+        return err;
+    }
+
+    char path[64];
+    session_path(b->chat_id, path, sizeof(path));
+
+    FILE *f = fopen(path, "a");
+    if (!f) {
+        ESP_LOGE(TAG, "Cannot open session file %s", path);
+        session_batch_discard(b);
+        return ESP_FAIL;
     }
 
+    size_t written = fwrite(b->buf, 1, b->len, f);
+    fflush(f);
+    fsync(fileno(f));
     fclose(f);
-    return ESP_OK;
+
+    if (written != b->len) {
+        ESP_LOGE(TAG, "Short write to %s (%d of %d bytes)", path, (int)written, (int)b->len);
+        err = ESP_FAIL;
+    }
+    session_batch_discard(b);
+    return err;
+}
+
+void session_batch_discard(session_batch_t *b)
+{
+    if (!b) return;
+    free(b->buf);
+    free(b);
+}
+
+esp_err_t session_append(const char *chat_id, const char *role, const char *content)
+{
+    session_batch_t *b = session_batch_begin(chat_id);
+    if (!b) return ESP_ERR_NO_MEM;
+
+    esp_err_t err = session_batch_add(b, role, content);
+    if (err != ESP_OK) {
+        session_batch_discard(b);
+        return err;
+    }
+    return session_batch_commit(b);
 }
 
 esp_err_t session_get_history_json(const char *chat_id, char *buf, size_t size, int max_msgs)
@@ -66,26 +188,103 @@ esp_err_t session_get_history_json(const char *chat_id, char *buf, size_t size,
     cJSON *messages[MIMI_SESSION_MAX_MSGS];
     int count = 0;
     int write_idx = 0;
+    if (max_msgs > MIMI_SESSION_MAX_MSGS) max_msgs = MIMI_SESSION_MAX_MSGS;
+
+    /* Records of the current turn are held back until its commit marker
+     * confirms the whole turn reached flash */
+    cJSON *pending[SESSION_TURN_MAX_RECORDS];
+    int pending_count = 0;
+    uint32_t pending_turn = 0;
+    uint32_t pending_crc = 0;
+    int dropped_turns = 0;
+
+#define RING_PUSH(obj) do {                                   \
+        if (count >= max_msgs) cJSON_Delete(messages[write_idx]); \
+        messages[write_idx] = (obj);                          \
+        write_idx = (write_idx + 1) % max_msgs;               \
+        if (count < max_msgs) count++;                        \
+    } while (0)
 
-    char line[4096];
-    while (fgets(line, sizeof(line), f)) {
-        /* Strip newline */
-        size_t len = strlen(line);
-        if (len > 0 && line[len - 1] == '\n') line[len - 1] = '\0';
+#define DROP_PENDING() do {                                   \
+        for (int p = 0; p < pending_count; p++) cJSON_Delete(pending[p]); \
+        if (pending_count) dropped_turns++;                   \
+        pending_count = 0;                                    \
+        pending_crc = 0;                                      \
+    } while (0)
+
+    /* Records are read whole: a tool result can be several KB once escaped */
+    char *line = NULL;
+    size_t line_cap = 0, len;
+    esp_err_t rerr;
+    while ((rerr = storage_read_line(f, &line, &line_cap, &len)) != ESP_ERR_NOT_FOUND) {
+        if (rerr == ESP_ERR_NO_MEM) {
+            ESP_LOGW(TAG, "Out of memory reading %s, history truncated", path);
+            break;
+        }
+        if (rerr != ESP_OK) {
+            /* Over the line limit: corrupt, so its turn is incomplete */
+            DROP_PENDING();
+            continue;
+        }
         if (line[0] == '\0') continue;
 
         cJSON *obj = cJSON_Parse(line);
-        if (!obj) continue;
+        if (!obj) {
+            /* Torn line: the turn it belongs to is incomplete */
+            DROP_PENDING();
+            continue;
+        }
+
+        cJSON *commit = cJSON_GetObjectItem(obj, "commit");
+        if (cJSON_IsNumber(commit)) {
+            cJSON *n = cJSON_GetObjectItem(obj, "n");
+            cJSON *crc = cJSON_GetObjectItem(obj, "crc");
+            bool ok = pending_count > 0 &&
+                      (uint32_t)commit->valuedouble == pending_turn &&
+                      cJSON_IsNumber(n) && n->valueint == pending_count &&
+                      cJSON_IsNumber(crc) && (uint32_t)crc->valuedouble == pending_crc;
+            cJSON_Delete(obj);
+            if (ok) {
+                for (int p = 0; p < pending_count; p++) RING_PUSH(pending[p]);
+                pending_count = 0;
+                pending_crc = 0;
+            } else {
+                DROP_PENDING();
+            }
+            continue;
+        }
 
-        /* Ring buffer: overwrite oldest if full */
-        if (count >= max_msgs) {
-            cJSON_Delete(messages[write_idx]);
+        cJSON *turn = cJSON_GetObjectItem(obj, "turn");
+        if (!cJSON_IsNumber(turn)) {
+            /* Legacy record written before batching */
+            DROP_PENDING();
+            RING_PUSH(obj);
+            continue;
         }
-        messages[write_idx] = obj;
-        write_idx = (write_idx + 1) % max_msgs;
-        if (count < max_msgs) count++;
+
+        uint32_t turn_id = (uint32_t)turn->valuedouble;
+        if (pending_count > 0 && turn_id != pending_turn) {
+            DROP_PENDING();
+        }
+        if (pending_count >= SESSION_TURN_MAX_RECORDS) {
+            DROP_PENDING();
+            cJSON_Delete(obj);
+            continue;
+        }
+        pending_turn = turn_id;
+        pending[pending_count++] = obj;
+        pending_crc = esp_rom_crc32_le(pending_crc, (const uint8_t *)line, len);
     }
+    free(line);
     fclose(f);
+    DROP_PENDING();
+
+#undef RING_PUSH
+#undef DROP_PENDING
+
+    if (dropped_turns) {
+        ESP_LOGW(TAG, "Skipped %d incomplete turn(s) in %s", dropped_turns, path);
+    }
 
     /* Build JSON array with only role + content */
     cJSON *arr = cJSON_CreateArray();
@@ -187,7 +386,7 @@ esp_err_t session_get_history_json(const char *chat_id, char *buf, size_t size,
     if (json_str) {
         strncpy(buf, json_str, size - 1);
         buf[size - 1] = '\0';
-        free(json_str);
+        cJSON_free(json_str);
     } else {
         snprintf(buf, size, "[]");
     }
@@ -211,18 +410,14 @@ void session_list(void)
 {
     DIR *dir = opendir(MIMI_SPIFFS_SESSION_DIR);
     if (!dir) {
-        /* SPIFFS is flat, so list all files matching pattern */
-        dir = opendir(MIMI_SPIFFS_BASE);
-        if (!dir) {
-            ESP_LOGW(TAG, "Cannot open SPIFFS directory");
-            return;
-        }
+        ESP_LOGW(TAG, "Cannot open %s", MIMI_SPIFFS_SESSION_DIR);
+        return;
     }
 
     struct dirent *entry;
     int count = 0;
     while ((entry = readdir(dir)) != NULL) {
-        if (strstr(entry->d_name, "tg_") && strstr(entry->d_name, ".jsonl")) {
+        if (strncmp(entry->d_name, "tg_", 3) == 0 && strstr(entry->d_name, ".jsonl")) {
             ESP_LOGI(TAG, "  Session: %s", entry->d_name);
             count++;
         }
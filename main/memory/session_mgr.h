@@ -10,12 +10,40 @@ esp_err_t session_mgr_init(void);
 
 /**
  * Append a message to a session file (JSONL format).
+ * Equivalent to a batch with a single record.
  * @param chat_id   Session identifier (e.g., "12345")
  * @param role      "user" or "assistant"
  * @param content   Message text
  */
 esp_err_t session_append(const char *chat_id, const char *role, const char *content);
 
+/* ── Turn batches ──────────────────────────────────────────────── */
+
+typedef struct session_batch session_batch_t;
+
+/**
+ * Start staging the records of one turn in RAM.
+ * @return batch handle, or NULL if out of memory
+ */
+session_batch_t *session_batch_begin(const char *chat_id);
+
+/**
+ * Stage one record. Nothing touches flash until session_batch_commit().
+ */
+esp_err_t session_batch_add(session_batch_t *batch, const char *role, const char *content);
+
+/**
+ * Write all staged records plus a commit marker (record count + CRC32) in a
+ * single append, then free the batch. A turn whose marker is missing or does
+ * not match — e.g. after a crash mid-write — is skipped when history is loaded.
+ */
+esp_err_t session_batch_commit(session_batch_t *batch);
+
+/**
+ * Drop a batch without writing anything.
+ */
+void session_batch_discard(session_batch_t *batch);
+
 /**
  * Load session history as a JSON array string suitable for LLM messages.
  * Returns the last max_msgs messages as:
@@ -0,0 +1,60 @@
+#include "memory/vec_kernel.h"
+
+#include <math.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+int32_t vec_dot_i8_scalar(const int8_t *a, const int8_t *b, size_t n)
+{
+    int32_t acc = 0;
+    for (size_t i = 0; i < n; i++) {
+        acc += (int32_t)a[i] * (int32_t)b[i];
+    }
+    return acc;
+}
+
+#if defined(CONFIG_IDF_TARGET_ESP32S3)
+/* vec_kernel_pie.S */
+int32_t vec_dot_i8_pie(const int8_t *a, const int8_t *b, size_t blocks);
+#endif
+
+int32_t vec_dot_i8(const int8_t *a, const int8_t *b, size_t n)
+{
+#if defined(CONFIG_IDF_TARGET_ESP32S3)
+    if ((((uintptr_t)a | (uintptr_t)b) & 0xF) == 0 && n >= 16) {
+        size_t blocks = n / 16;
+        size_t done = blocks * 16;
+        return vec_dot_i8_pie(a, b, blocks) + vec_dot_i8_scalar(a + done, b + done, n - done);
+    }
+#endif
+    return vec_dot_i8_scalar(a, b, n);
+}
+
+float vec_quantize_i8(const float *in, int8_t *out, size_t n)
+{
+    float norm = 0.0f;
+    float max_abs = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        norm += in[i] * in[i];
+        float v = fabsf(in[i]);
+        if (v > max_abs) max_abs = v;
+    }
+    if (norm <= 0.0f || max_abs <= 0.0f) {
+        for (size_t i = 0; i < n; i++) out[i] = 0;
+        return 0.0f;
+    }
+
+    norm = sqrtf(norm);
+    /* Map the largest normalised component onto +/-127 */
+    float scale = (max_abs / norm) / 127.0f;
+    float inv = 1.0f / (norm * scale);
+    for (size_t i = 0; i < n; i++) {
+        float q = roundf(in[i] * inv);
+        if (q > 127.0f) q = 127.0f;
+        if (q < -127.0f) q = -127.0f;
+        out[i] = (int8_t)q;
+    }
+    return scale;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Small vector kernels for the semantic memory store.
+ * Plain C with no ESP-IDF dependencies, so it also builds on a Linux host.
+ */
+
+/**
+ * Dot product of two int8 vectors.
+ * On ESP32-S3 the bulk runs on the PIE 128-bit SIMD unit when both pointers
+ * are 16-byte aligned; other targets and unaligned inputs use the scalar loop.
+ * n must be <= 65536 so the sum fits in 32 bits.
+ */
+int32_t vec_dot_i8(const int8_t *a, const int8_t *b, size_t n);
+
+/**
+ * Reference scalar dot product (always available, used as the fallback).
+ */
+int32_t vec_dot_i8_scalar(const int8_t *a, const int8_t *b, size_t n);
+
+/**
+ * L2-normalise a float vector and quantise it to int8 with one symmetric scale.
+ * Afterwards in[i] / |in| ~= out[i] * scale, so the cosine similarity of two
+ * quantised vectors is vec_dot_i8(a, b) * scale_a * scale_b.
+ *
+ * @return the scale, or 0 for an all-zero vector
+ */
+float vec_quantize_i8(const float *in, int8_t *out, size_t n);
@@ -0,0 +1,378 @@
+#include "metrics/metrics.h"
+#include "mimi_config.h"
+#include "bus/message_bus.h"
+#include "gateway/ws_server.h"
+#include "storage/storage.h"
+#include "wifi/wifi_manager.h"
+#include "channels/channel.h"
+#include "llm/llm_proxy.h"
+#include "arena/arena.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_http_server.h"
+
+static const char *TAG = "metrics";
+
+#define HIST_BUCKETS  10
+
+typedef struct {
+    uint32_t buckets[HIST_BUCKETS];     /* non-cumulative; +Inf is count */
+    uint32_t count;
+    uint64_t sum_ms;
+} hist_t;
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_counters[METRIC_COUNTER_COUNT];
+static hist_t s_hists[METRIC_HIST_COUNT];
+
+/* Upper bounds in ms; wide enough for a multi-tool turn */
+static const uint32_t s_bounds_ms[HIST_BUCKETS] = {
+    250, 500, 1000, 2000, 5000, 10000, 20000, 40000, 80000, 160000,
+};
+
+/* Counters sharing a name are one family, split by label */
+static const struct {
+    const char *name;
+    const char *labels;
+    const char *help;
+} s_counter_info[METRIC_COUNTER_COUNT] = {
+    [METRIC_TURNS_OK]         = { "mimi_turns_total", "result=\"ok\"", "Agent turns by outcome" },
+    [METRIC_TURNS_FAILED]     = { "mimi_turns_total", "result=\"error\"", NULL },
+    [METRIC_TURNS_TIMED_OUT]  = { "mimi_turns_total", "result=\"timeout\"", NULL },
+    [METRIC_TURNS_SUPERSEDED] = { "mimi_turns_total", "result=\"superseded\"", NULL },
+    [METRIC_LLM_REQUESTS]     = { "mimi_llm_requests_total", NULL, "LLM HTTP requests" },
+    [METRIC_LLM_ERRORS]       = { "mimi_llm_errors_total", NULL, "LLM requests that failed or returned non-200" },
+    [METRIC_LLM_RETRIES]      = { "mimi_llm_retries_total", NULL, "LLM requests retried after a transient failure" },
+    [METRIC_LLM_CIRCUIT_OPEN] = { "mimi_llm_circuit_open_total", NULL, "Times an LLM backend circuit breaker opened" },
+    [METRIC_LLM_FAILOVERS]    = { "mimi_llm_failovers_total", NULL, "LLM requests passed on to another route" },
+    [METRIC_TOOL_CALLS]       = { "mimi_tool_calls_total", NULL, "Tool executions" },
+    [METRIC_TOOL_ERRORS]      = { "mimi_tool_errors_total", NULL, "Tool executions that returned an error" },
+    [METRIC_TLS_LLM]          = { "mimi_tls_handshakes_total", "client=\"llm\"", "TLS connections opened" },
+    [METRIC_TLS_TELEGRAM]     = { "mimi_tls_handshakes_total", "client=\"telegram\"", NULL },
+    [METRIC_TLS_PROXY]        = { "mimi_tls_handshakes_total", "client=\"proxy\"", NULL },
+};
+
+static const struct {
+    const char *name;
+    const char *help;
+} s_hist_info[METRIC_HIST_COUNT] = {
+    [METRIC_HIST_TURN] = { "mimi_turn_duration_seconds", "Agent turn wall time" },
+    [METRIC_HIST_LLM]  = { "mimi_llm_request_duration_seconds", "LLM HTTP request wall time" },
+};
+
+/* Tasks whose stack headroom is reported, if they exist */
+static const char *const s_tasks[] = {
+    "agent_loop", "outbound", "tg_poll", "tg_send0", "tg_send1",
+    "ws_tx", "tool_jobs", "cron", "mem_embed", "heartbeat",
+};
+
+void metrics_inc(metric_counter_t counter)
+{
+    if (counter >= METRIC_COUNTER_COUNT) return;
+    portENTER_CRITICAL(&s_lock);
+    s_counters[counter]++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void metrics_observe_ms(metric_hist_t hist, uint32_t ms)
+{
+    if (hist >= METRIC_HIST_COUNT) return;
+    int b = 0;
+    while (b < HIST_BUCKETS && ms > s_bounds_ms[b]) b++;
+
+    portENTER_CRITICAL(&s_lock);
+    hist_t *h = &s_hists[hist];
+    if (b < HIST_BUCKETS) h->buckets[b]++;
+    h->count++;
+    h->sum_ms += ms;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+/* ── Rendering ────────────────────────────────────────────────── */
+
+/* Output is built in one fixed buffer and sent as chunks, so a scrape
+ * costs the same memory however many series there are. Only the httpd
+ * task renders, so the buffer is not shared. */
+#define OUT_BUF_SIZE  1024
+#define OUT_LINE_MAX  256
+
+typedef struct {
+    httpd_req_t *req;
+    char buf[OUT_BUF_SIZE];
+    size_t len;
+    esp_err_t err;
+} out_t;
+
+static out_t s_out;
+
+static void out_flush(out_t *o)
+{
+    if (o->len && o->err == ESP_OK) {
+        o->err = httpd_resp_send_chunk(o->req, o->buf, o->len);
+    }
+    o->len = 0;
+}
+
+static void out_printf(out_t *o, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void out_printf(out_t *o, const char *fmt, ...)
+{
+    if (OUT_BUF_SIZE - o->len < OUT_LINE_MAX) out_flush(o);
+
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(o->buf + o->len, OUT_BUF_SIZE - o->len, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n >= OUT_BUF_SIZE - o->len) n = OUT_BUF_SIZE - o->len - 1;
+    o->len += n;
+}
+
+static void out_family(out_t *o, const char *name, const char *type, const char *help)
+{
+    out_printf(o, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/* One unlabelled gauge */
+static void out_gauge(out_t *o, const char *name, const char *help, uint64_t value)
+{
+    out_family(o, name, "gauge", help);
+    out_printf(o, "%s %llu\n", name, (unsigned long long)value);
+}
+
+static void render_counters(out_t *o, const uint32_t *counters)
+{
+    for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        if (s_counter_info[i].help) {
+            out_family(o, s_counter_info[i].name, "counter", s_counter_info[i].help);
+        }
+        if (s_counter_info[i].labels) {
+            out_printf(o, "%s{%s} %u\n", s_counter_info[i].name, s_counter_info[i].labels,
+                       (unsigned)counters[i]);
+        } else {
+            out_printf(o, "%s %u\n", s_counter_info[i].name, (unsigned)counters[i]);
+        }
+    }
+}
+
+static void render_hists(out_t *o, const hist_t *hists)
+{
+    for (int i = 0; i < METRIC_HIST_COUNT; i++) {
+        const char *name = s_hist_info[i].name;
+        const hist_t *h = &hists[i];
+        out_family(o, name, "histogram", s_hist_info[i].help);
+
+        uint32_t cumulative = 0;
+        for (int b = 0; b < HIST_BUCKETS; b++) {
+            cumulative += h->buckets[b];
+            out_printf(o, "%s_bucket{le=\"%u.%03u\"} %u\n", name,
+                       (unsigned)(s_bounds_ms[b] / 1000), (unsigned)(s_bounds_ms[b] % 1000),
+                       (unsigned)cumulative);
+        }
+        out_printf(o, "%s_bucket{le=\"+Inf\"} %u\n", name, (unsigned)h->count);
+        out_printf(o, "%s_sum %llu.%03u\n", name,
+                   (unsigned long long)(h->sum_ms / 1000), (unsigned)(h->sum_ms % 1000));
+        out_printf(o, "%s_count %u\n", name, (unsigned)h->count);
+    }
+}
+
+static void render_heap(out_t *o)
+{
+    static const struct { const char *region; uint32_t caps; } regions[] = {
+        { "internal", MALLOC_CAP_INTERNAL },
+        { "psram",    MALLOC_CAP_SPIRAM },
+    };
+
+    out_family(o, "mimi_heap_free_bytes", "gauge", "Free heap");
+    for (size_t i = 0; i < 2; i++) {
+        out_printf(o, "mimi_heap_free_bytes{region=\"%s\"} %u\n", regions[i].region,
+                   (unsigned)heap_caps_get_free_size(regions[i].caps));
+    }
+    out_family(o, "mimi_heap_min_free_bytes", "gauge", "Lowest free heap since boot");
+    for (size_t i = 0; i < 2; i++) {
+        out_printf(o, "mimi_heap_min_free_bytes{region=\"%s\"} %u\n", regions[i].region,
+                   (unsigned)heap_caps_get_minimum_free_size(regions[i].caps));
+    }
+    out_family(o, "mimi_heap_largest_free_block_bytes", "gauge", "Largest allocatable block");
+    for (size_t i = 0; i < 2; i++) {
+        out_printf(o, "mimi_heap_largest_free_block_bytes{region=\"%s\"} %u\n", regions[i].region,
+                   (unsigned)heap_caps_get_largest_free_block(regions[i].caps));
+    }
+}
+
+static void render_tasks(out_t *o)
+{
+    out_family(o, "mimi_task_stack_free_bytes", "gauge", "Lowest free stack since the task started");
+    for (size_t i = 0; i < sizeof(s_tasks) / sizeof(s_tasks[0]); i++) {
+        TaskHandle_t t = xTaskGetHandle(s_tasks[i]);
+        if (!t) continue;
+        /* ESP-IDF reports the high-water mark in bytes */
+        out_printf(o, "mimi_task_stack_free_bytes{task=\"%s\"} %u\n", s_tasks[i],
+                   (unsigned)uxTaskGetStackHighWaterMark(t));
+    }
+    for (int i = 0; i < channel_count(); i++) {
+        TaskHandle_t t = channel_task(i);
+        if (!t) continue;
+        out_printf(o, "mimi_task_stack_free_bytes{task=\"out_%s\"} %u\n", channel_name(i),
+                   (unsigned)uxTaskGetStackHighWaterMark(t));
+    }
+}
+
+static void render_channels(out_t *o)
+{
+    out_family(o, "mimi_channel_dropped_total", "counter", "Outbound messages dropped on a full channel queue");
+    for (int i = 0; i < channel_count(); i++) {
+        out_printf(o, "mimi_channel_dropped_total{channel=\"%s\"} %u\n", channel_name(i),
+                   (unsigned)channel_dropped(i));
+    }
+}
+
+static void render_routes(out_t *o)
+{
+    llm_route_info_t routes[4];
+    int n = llm_router_info(routes, 4);
+    out_family(o, "mimi_llm_route_latency_ms", "gauge", "Smoothed latency of successful requests per LLM route");
+    for (int i = 0; i < n; i++) {
+        out_printf(o, "mimi_llm_route_latency_ms{route=\"%s\"} %u\n", routes[i].name,
+                   (unsigned)routes[i].ewma_ms);
+    }
+    out_family(o, "mimi_llm_route_degraded", "gauge", "1 while a route is slow or its circuit is open");
+    for (int i = 0; i < n; i++) {
+        out_printf(o, "mimi_llm_route_degraded{route=\"%s\"} %d\n", routes[i].name,
+                   routes[i].degraded ? 1 : 0);
+    }
+}
+
+static void render_arenas(out_t *o)
+{
+    int n = arena_count();
+    out_family(o, "mimi_arena_peak_bytes", "gauge", "Largest arena use seen at a reset");
+    for (int i = 0; i < n; i++) {
+        const arena_t *a = arena_get(i);
+        out_printf(o, "mimi_arena_peak_bytes{arena=\"%s\"} %u\n", a->name, (unsigned)a->peak);
+    }
+    out_family(o, "mimi_arena_reserved_bytes", "gauge", "PSRAM held by an arena's chunks");
+    for (int i = 0; i < n; i++) {
+        const arena_t *a = arena_get(i);
+        out_printf(o, "mimi_arena_reserved_bytes{arena=\"%s\"} %u\n", a->name, (unsigned)a->reserved);
+    }
+    out_family(o, "mimi_arena_heap_fallbacks_total", "counter", "Arena allocations that fell back to the heap");
+    for (int i = 0; i < n; i++) {
+        const arena_t *a = arena_get(i);
+        out_printf(o, "mimi_arena_heap_fallbacks_total{arena=\"%s\"} %u\n", a->name, (unsigned)a->fallbacks);
+    }
+}
+
+static esp_err_t metrics_handler(httpd_req_t *req)
+{
+    uint32_t counters[METRIC_COUNTER_COUNT];
+    hist_t hists[METRIC_HIST_COUNT];
+    portENTER_CRITICAL(&s_lock);
+    memcpy(counters, s_counters, sizeof(counters));
+    memcpy(hists, s_hists, sizeof(hists));
+    portEXIT_CRITICAL(&s_lock);
+
+    out_t *o = &s_out;
+    o->req = req;
+    o->len = 0;
+    o->err = ESP_OK;
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+    out_gauge(o, "mimi_uptime_seconds", "Seconds since boot",
+              (uint64_t)(esp_timer_get_time() / 1000000));
+    out_gauge(o, "mimi_wifi_connected", "1 if WiFi has an IP", wifi_manager_is_connected() ? 1 : 0);
+
+    int inbound = 0, outbound = 0;
+    message_bus_depths(&inbound, &outbound);
+    out_family(o, "mimi_bus_queue_depth", "gauge", "Messages waiting on the bus");
+    out_printf(o, "mimi_bus_queue_depth{queue=\"inbound\"} %d\n", inbound);
+    out_printf(o, "mimi_bus_queue_depth{queue=\"outbound\"} %d\n", outbound);
+    out_gauge(o, "mimi_bus_queue_capacity", "Slots per bus queue", MIMI_BUS_QUEUE_LEN);
+
+    int ws_clients = 0;
+    uint32_t ws_dropped = 0;
+    ws_server_get_stats(&ws_clients, &ws_dropped);
+    out_gauge(o, "mimi_ws_clients", "Connected WebSocket clients", ws_clients);
+    out_family(o, "mimi_ws_frames_dropped_total", "counter", "WebSocket frames dropped by backpressure");
+    out_printf(o, "mimi_ws_frames_dropped_total %u\n", (unsigned)ws_dropped);
+
+    render_counters(o, counters);
+    render_hists(o, hists);
+    render_routes(o);
+    render_channels(o);
+    render_arenas(o);
+    render_heap(o);
+
+    size_t total = 0, used = 0;
+    if (storage_info(&total, &used) == ESP_OK) {
+        out_gauge(o, "mimi_storage_total_bytes", "Filesystem size", total);
+        out_gauge(o, "mimi_storage_used_bytes", "Filesystem bytes in use", used);
+    }
+
+    render_tasks(o);
+
+    out_flush(o);
+    if (o->err == ESP_OK) {
+        o->err = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return o->err;
+}
+
+/* 200 when the device can take and answer messages, 503 with the reasons otherwise */
+static esp_err_t healthz_handler(httpd_req_t *req)
+{
+    char body[160];
+    size_t off = 0;
+    int inbound = 0, outbound = 0;
+    message_bus_depths(&inbound, &outbound);
+
+    if (!wifi_manager_is_connected()) {
+        off += snprintf(body + off, sizeof(body) - off, "wifi down\n");
+    }
+    if (!xTaskGetHandle("agent_loop")) {
+        off += snprintf(body + off, sizeof(body) - off, "agent not running\n");
+    }
+    if (inbound >= MIMI_BUS_QUEUE_LEN) {
+        off += snprintf(body + off, sizeof(body) - off, "inbound queue full\n");
+    }
+    if (heap_caps_get_free_size(MALLOC_CAP_INTERNAL) < MIMI_HEALTH_MIN_INTERNAL_HEAP) {
+        off += snprintf(body + off, sizeof(body) - off, "internal heap low\n");
+    }
+
+    httpd_resp_set_type(req, "text/plain");
+    if (off > 0) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, body, off);
+    }
+    return httpd_resp_sendstr(req, "ok\n");
+}
+
+esp_err_t metrics_init(void)
+{
+    httpd_uri_t metrics_uri = {
+        .uri = MIMI_METRICS_PATH,
+        .method = HTTP_GET,
+        .handler = metrics_handler,
+    };
+    httpd_uri_t healthz_uri = {
+        .uri = MIMI_HEALTHZ_PATH,
+        .method = HTTP_GET,
+        .handler = healthz_handler,
+    };
+
+    esp_err_t err = ws_server_register_uri(&metrics_uri);
+    if (err == ESP_OK) err = ws_server_register_uri(&healthz_uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register endpoints: %s", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "Serving %s and %s on port %d", MIMI_METRICS_PATH, MIMI_HEALTHZ_PATH, MIMI_WS_PORT);
+    return ESP_OK;
+}
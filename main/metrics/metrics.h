@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/* Event counters, exported as *_total */
+typedef enum {
+    METRIC_TURNS_OK,
+    METRIC_TURNS_FAILED,
+    METRIC_TURNS_TIMED_OUT,
+    METRIC_TURNS_SUPERSEDED,
+    METRIC_LLM_REQUESTS,
+    METRIC_LLM_ERRORS,
+    METRIC_LLM_RETRIES,
+    METRIC_LLM_CIRCUIT_OPEN,
+    METRIC_LLM_FAILOVERS,
+    METRIC_TOOL_CALLS,
+    METRIC_TOOL_ERRORS,
+    METRIC_TLS_LLM,
+    METRIC_TLS_TELEGRAM,
+    METRIC_TLS_PROXY,
+    METRIC_COUNTER_COUNT,
+} metric_counter_t;
+
+/* Latency histograms */
+typedef enum {
+    METRIC_HIST_TURN,
+    METRIC_HIST_LLM,
+    METRIC_HIST_COUNT,
+} metric_hist_t;
+
+/** Count one event. Safe from any task. */
+void metrics_inc(metric_counter_t counter);
+
+/** Record a duration in milliseconds. Safe from any task. */
+void metrics_observe_ms(metric_hist_t hist, uint32_t ms);
+
+/**
+ * Serve GET /metrics (Prometheus text format) and GET /healthz on the
+ * gateway httpd. Call before or after ws_server_start().
+ */
+esp_err_t metrics_init(void);
@@ -16,6 +16,12 @@
 #ifndef MIMI_SECRET_TG_TOKEN
 #define MIMI_SECRET_TG_TOKEN        ""
 #endif
+#ifndef MIMI_SECRET_TG_WEBHOOK_URL
+#define MIMI_SECRET_TG_WEBHOOK_URL  ""
+#endif
+#ifndef MIMI_SECRET_TG_WEBHOOK_SECRET
+#define MIMI_SECRET_TG_WEBHOOK_SECRET ""
+#endif
 #ifndef MIMI_SECRET_API_KEY
 #define MIMI_SECRET_API_KEY         ""
 #endif
@@ -49,6 +55,12 @@
 #ifndef MIMI_SECRET_OLLAMA_URL
 #define MIMI_SECRET_OLLAMA_URL      ""
 #endif
+#ifndef MIMI_SECRET_FAST_MODEL
+#define MIMI_SECRET_FAST_MODEL      ""
+#endif
+#ifndef MIMI_SECRET_OLLAMA_MODEL
+#define MIMI_SECRET_OLLAMA_MODEL    ""
+#endif
 
 /* WiFi */
 #define MIMI_WIFI_MAX_RETRY          10
@@ -57,12 +69,31 @@
 
 /* Telegram Bot */
 #define MIMI_TG_POLL_TIMEOUT_S       30
-#define MIMI_TG_MAX_MSG_LEN          4096
+#define MIMI_TG_MAX_MSG_LEN          4096    /* UTF-16 units of text per message */
+#define MIMI_TG_HTML_BUF_SIZE        (12 * 1024)  /* one converted chunk, in PSRAM */
+#define MIMI_TG_TEXT_MAX             (16 * 1024)  /* longest inbound text kept */
+#define MIMI_TG_POLL_LIMIT           20      /* updates per getUpdates batch */
 #define MIMI_TG_POLL_STACK           (12 * 1024)
 #define MIMI_TG_POLL_PRIO            5
 #define MIMI_TG_POLL_CORE            0
 #define MIMI_TG_CARD_SHOW_MS         3000
 #define MIMI_TG_CARD_BODY_SCALE      3
+#define MIMI_TG_SEND_WORKERS         2
+#define MIMI_TG_SEND_STACK           (10 * 1024)
+#define MIMI_TG_SEND_PRIO            5
+#define MIMI_TG_SEND_CORE            0
+#define MIMI_TG_SEND_LANES           8       /* chats with queued messages at once */
+#define MIMI_TG_SEND_LANE_DEPTH      8       /* queued messages per chat */
+#define MIMI_TG_SEND_TIMEOUT_MS      15000
+#define MIMI_TG_SEND_RETRIES         4
+#define MIMI_TG_SEND_IDLE_CLOSE_MS   (60 * 1000)
+#define MIMI_TG_GLOBAL_RATE_PER_S    30      /* Bot API: ~30 messages/s overall */
+#define MIMI_TG_CHAT_RATE_PER_S      1       /* ~1 message/s per private chat */
+#define MIMI_TG_GROUP_RATE_PER_MIN   20      /* ~20 messages/min per group */
+#define MIMI_TG_CHAT_BURST           3
+#define MIMI_TG_WEBHOOK_PATH         "/telegram"
+#define MIMI_TG_WEBHOOK_MAX_BODY     (16 * 1024)
+#define MIMI_TG_WEBHOOK_MAX_CONN     1       /* Telegram delivers one update at a time */
 
 /* Agent Loop */
 #define MIMI_AGENT_STACK             (24 * 1024)
@@ -72,6 +103,36 @@
 #define MIMI_AGENT_MAX_TOOL_ITER     10
 #define MIMI_MAX_TOOL_CALLS          4
 #define MIMI_AGENT_SEND_WORKING_STATUS 1
+#define MIMI_AGENT_TURN_BUDGET_MS    (180 * 1000)
+#define MIMI_AGENT_SUPERSEDE         1       /* a newer message stops the chat's turn in flight */
+#define MIMI_AGENT_CARRY_TTL_MS      (60 * 1000)
+
+/* Per-turn tool selection */
+#define MIMI_TOOL_ROUTE_BUF_SIZE     (8 * 1024)
+#define MIMI_TOOL_ROUTE_HISTORY_BYTES 1024
+
+/* Tool result cache */
+#define MIMI_TOOL_CACHE_SLOTS        24
+#define MIMI_TOOL_CACHE_BUDGET       (96 * 1024)
+#define MIMI_TOOL_CACHE_MAX_WAITERS  4
+#define MIMI_TOOL_CACHE_WAIT_MS      (60 * 1000)
+#define MIMI_TOOL_CACHE_TTL_SEARCH_S (10 * 60)
+#define MIMI_TOOL_CACHE_TTL_HTTP_S   30
+#define MIMI_TOOL_CACHE_TTL_DOCKER_S 60
+
+/* Background tool jobs */
+#define MIMI_TOOL_JOBS_MAX           4
+#define MIMI_TOOL_JOBS_STACK         (12 * 1024)
+#define MIMI_TOOL_JOBS_PRIO          4
+#define MIMI_TOOL_JOBS_CORE          0
+#define MIMI_TOOL_JOBS_OUTPUT_SIZE   (8 * 1024)
+#define MIMI_TOOL_JOBS_BUDGET_MS     (5 * 60 * 1000)
+
+/* Per-task JSON arenas (PSRAM): cJSON work in a turn or job is freed in one go */
+#define MIMI_JSON_ARENA              1
+#define MIMI_ARENA_CHUNK_SIZE        (64 * 1024)
+#define MIMI_ARENA_MAX_SIZE          (512 * 1024)  /* per arena; past this cJSON uses the heap */
+#define MIMI_ARENA_MAX_COUNT         4
 
 /* Timezone (POSIX TZ format) */
 #define MIMI_TIMEZONE                "PST8PDT,M3.2.0,M11.1.0"
@@ -86,14 +147,47 @@
 #define MIMI_LLM_STREAM_BUF_SIZE     (32 * 1024)
 #define MIMI_LLM_LOG_VERBOSE_PAYLOAD 0
 #define MIMI_LLM_LOG_PREVIEW_BYTES   160
+#define MIMI_LLM_RETRY_MAX           3            /* retries after the first attempt */
+#define MIMI_LLM_RETRY_BASE_MS       1000         /* backoff doubles from here */
+#define MIMI_LLM_RETRY_MAX_DELAY_MS  (20 * 1000)  /* longer retry-after opens the circuit */
+#define MIMI_LLM_BREAKER_FAILURES    5            /* consecutive failed attempts */
+#define MIMI_LLM_BREAKER_OPEN_MS     (60 * 1000)
+#define MIMI_LLM_FAILOVER_RETRIES    1            /* per route when another can take over */
+#define MIMI_LLM_ROUTER_SLOW_MS      (20 * 1000)  /* average latency that counts as slow */
+#define MIMI_LLM_ROUTER_RECHECK_MS   (2 * 60 * 1000)
+
+/* Embeddings (semantic memory) */
+#define MIMI_OPENAI_EMBED_URL        "https://api.openai.com/v1/embeddings"
+#define MIMI_EMBED_MODEL_OPENAI      "text-embedding-3-small"
+#define MIMI_EMBED_MODEL_OLLAMA      "nomic-embed-text"
+#define MIMI_EMBED_DIMS              256
+#define MIMI_EMBED_BATCH             8
+#define MIMI_EMBED_TIMEOUT_MS        (20 * 1000)
+#define MIMI_EMBED_QUERY_TIMEOUT_MS  (3 * 1000)
 
 /* Message Bus */
 #define MIMI_BUS_QUEUE_LEN           16
-#define MIMI_OUTBOUND_STACK          (12 * 1024)
+
+/* Inbound coalescing: bursts from one chat become one agent turn */
+#define MIMI_COALESCE_TG_WINDOW_MS   1500    /* quiet time that ends a burst */
+#define MIMI_COALESCE_WS_WINDOW_MS   0       /* WS clients are mostly scripts */
+#define MIMI_COALESCE_MAX_WAIT_MS    6000    /* release a burst at most this late */
+#define MIMI_COALESCE_MAX_BYTES      (8 * 1024)
+#define MIMI_COALESCE_SLOTS          8       /* chats collecting a burst at once */
+#define MIMI_OUTBOUND_STACK          (4 * 1024)     /* router only; sends run per channel */
 #define MIMI_OUTBOUND_PRIO           5
 #define MIMI_OUTBOUND_CORE           0
 
-/* Memory / SPIFFS */
+/* Outbound channels: one queue and worker per registered driver */
+#define MIMI_CHANNEL_MAX             6
+#define MIMI_CHANNEL_QUEUE_LEN       32
+#define MIMI_CHANNEL_STACK           (6 * 1024)
+#define MIMI_CHANNEL_PRIO            5
+#define MIMI_CHANNEL_CORE            0
+
+/* Storage: LittleFS on the "spiffs" partition. The label and mount point keep
+ * their historical names so existing paths, skills and OTA'd devices stay valid. */
+#define MIMI_STORAGE_PARTITION       "spiffs"
 #define MIMI_SPIFFS_BASE             "/spiffs"
 #define MIMI_SPIFFS_CONFIG_DIR       "/spiffs/config"
 #define MIMI_SPIFFS_MEMORY_DIR       "/spiffs/memory"
@@ -103,20 +197,59 @@
 #define MIMI_USER_FILE               "/spiffs/config/USER.md"
 #define MIMI_CONTEXT_BUF_SIZE        (32 * 1024)
 #define MIMI_SESSION_MAX_MSGS        40
+#define MIMI_MEMORY_INDEX_FILE       "/spiffs/memidx.bin"
+#define MIMI_MEMORY_INDEX_MAX_DOCS   512
+#define MIMI_MEMORY_SEARCH_MAX_RESULTS 5
+#define MIMI_MEMORY_VEC_FILE         "/spiffs/memvec.bin"
+#define MIMI_MEMORY_VEC_MAX          1024
+#define MIMI_MEMORY_VEC_STACK        (8 * 1024)
+#define MIMI_MEMORY_VEC_PRIO         3
+#define MIMI_MEMORY_VEC_CORE         0
+#define MIMI_MEMORY_RECALL_TOP_K     6
+#define MIMI_MEMORY_RECALL_MIN_SCORE 0.30f
 
 /* Cron / Heartbeat */
 #define MIMI_CRON_FILE               "/spiffs/cron.json"
+#define MIMI_CRON_STATE_FILE         "/spiffs/cron_state.txt"
+#define MIMI_CRON_STATE_FLUSH_MS     (5 * 60 * 1000)
 #define MIMI_CRON_MAX_JOBS           16
-#define MIMI_CRON_CHECK_INTERVAL_MS  (60 * 1000)
+#define MIMI_CRON_MAX_SLEEP_MS       (15 * 60 * 1000)
 #define MIMI_HEARTBEAT_FILE          "/spiffs/HEARTBEAT.md"
 #define MIMI_HEARTBEAT_INTERVAL_MS   (30 * 60 * 1000)
+#define MIMI_HEARTBEAT_STATE_FILE    "/spiffs/heartbeat_state.txt"
+#define MIMI_HEARTBEAT_MAX_TASKS     32
+#define MIMI_HEARTBEAT_PROMPT_SIZE   2048
+#define MIMI_HEARTBEAT_STACK         (4 * 1024)
+#define MIMI_HEARTBEAT_PRIO          3
+#define MIMI_HEARTBEAT_CORE          0
 
 /* Skills */
+#define MIMI_SKILLS_DIR              "/spiffs/skills"
 #define MIMI_SKILLS_PREFIX           "/spiffs/skills/"
 
 /* WebSocket Gateway */
 #define MIMI_WS_PORT                 18789
-#define MIMI_WS_MAX_CLIENTS          4
+#define MIMI_WS_MAX_CLIENTS          12
+#define MIMI_WS_HTTP_SOCKETS         2       /* kept free for webhook and other HTTP requests */
+#define MIMI_WS_MAX_FRAME            (16 * 1024)
+#define MIMI_WS_CLIENT_RING          8       /* queued frames per client */
+#define MIMI_WS_CLIENT_RING_BYTES    (32 * 1024)
+#define MIMI_WS_OVERFLOW_DROP_OLDEST 0       /* keep the newest frames */
+#define MIMI_WS_OVERFLOW_DROP_NEWEST 1       /* keep what is queued, refuse new frames */
+#define MIMI_WS_OVERFLOW_CLOSE       2       /* disconnect the slow client */
+#define MIMI_WS_OVERFLOW_POLICY      MIMI_WS_OVERFLOW_DROP_OLDEST
+#define MIMI_WS_PING_INTERVAL_S      30      /* ping a client idle this long */
+#define MIMI_WS_PONG_TIMEOUT_S       15      /* then close it if still silent */
+#define MIMI_WS_SEND_TIMEOUT_S       2
+#define MIMI_WS_TX_STACK             (4 * 1024)
+#define MIMI_WS_TX_PRIO              5
+#define MIMI_WS_TX_CORE              0
+#define MIMI_WS_HTTPD_STACK          (6 * 1024)
+
+/* Metrics */
+#define MIMI_METRICS_PATH            "/metrics"
+#define MIMI_HEALTHZ_PATH            "/healthz"
+#define MIMI_HEALTH_MIN_INTERNAL_HEAP (16 * 1024)
 
 /* Serial CLI */
 #define MIMI_CLI_STACK               (4 * 1024)
@@ -140,3 +273,5 @@
 #define MIMI_NVS_KEY_PROXY_HOST      "host"
 #define MIMI_NVS_KEY_PROXY_PORT      "port"
 #define MIMI_NVS_KEY_OLLAMA_URL      "ollama_url"
+#define MIMI_NVS_KEY_FAST_MODEL      "fast_model"
+#define MIMI_NVS_KEY_OLLAMA_MODEL    "ollama_model"
@@ -1,4 +1,6 @@
 #include "ota_manager.h"
+#include "cron/cron_service.h"
+#include "telegram/telegram_bot.h"
 
 #include "esp_log.h"
 #include "esp_ota_ops.h"
@@ -78,6 +80,8 @@ esp_err_t ota_update_from_url(const char *url)
 
     if (args.result == ESP_OK) {
         ESP_LOGI(TAG, "OTA successful, restarting in 5 seconds...");
+        cron_service_flush();
+        telegram_bot_flush();
         esp_timer_handle_t t;
         const esp_timer_create_args_t targs = {
             .callback = ota_restart_cb,
@@ -1,5 +1,7 @@
 #include "http_proxy.h"
 #include "mimi_config.h"
+#include "deadline/deadline.h"
+#include "metrics/metrics.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -172,6 +174,12 @@ proxy_conn_t *proxy_conn_open(const char *host, int port, int timeout_ms)
         return NULL;
     }
 
+    timeout_ms = deadline_clamp_ms(timeout_ms);
+    if (timeout_ms == 0) {
+        ESP_LOGW(TAG, "Deadline exceeded before connecting to %s", host);
+        return NULL;
+    }
+
     int sock = open_connect_tunnel(host, port, timeout_ms);
     if (sock < 0) return NULL;
 
@@ -205,6 +213,7 @@ proxy_conn_t *proxy_conn_open(const char *host, int port, int timeout_ms)
     }
 
     ESP_LOGI(TAG, "TLS handshake OK with %s:%d via proxy", host, port);
+    metrics_inc(METRIC_TLS_PROXY);
     return conn;
 }
 
@@ -227,6 +236,9 @@ int proxy_conn_write(proxy_conn_t *conn, const char *data, int len)
 
 int proxy_conn_read(proxy_conn_t *conn, char *buf, int len, int timeout_ms)
 {
+    timeout_ms = deadline_clamp_ms(timeout_ms);
+    if (timeout_ms == 0) return -1;
+
     struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
     setsockopt(conn->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
 
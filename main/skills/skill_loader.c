@@ -1,8 +1,10 @@
 #include "skills/skill_loader.h"
 #include "mimi_config.h"
+#include "util/text_match.h"
 
 #include <stdio.h>
 #include <string.h>
+#include <stdbool.h>
 #include <dirent.h>
 #include "esp_log.h"
 
@@ -329,33 +331,27 @@ static void extract_description(FILE *f, char *out, size_t out_size)
 
 size_t skill_loader_build_summary(char *buf, size_t size)
 {
-    DIR *dir = opendir(MIMI_SPIFFS_BASE);
+    DIR *dir = opendir(MIMI_SKILLS_DIR);
     if (!dir) {
-        ESP_LOGW(TAG, "Cannot open SPIFFS for skill enumeration");
+        ESP_LOGW(TAG, "Cannot open %s for skill enumeration", MIMI_SKILLS_DIR);
         buf[0] = '\0';
         return 0;
     }
 
     size_t off = 0;
     struct dirent *ent;
-    /* SPIFFS readdir returns filenames relative to the mount point (e.g. "skills/weather.md").
-       We match entries that start with "skills/" and end with ".md". */
-    const char *skills_subdir = "skills/";
-    const size_t subdir_len = strlen(skills_subdir);
 
     while ((ent = readdir(dir)) != NULL && off < size - 1) {
         const char *name = ent->d_name;
 
-        /* Match files under skills/ with .md extension */
-        if (strncmp(name, skills_subdir, subdir_len) != 0) continue;
-
+        /* Match .md files only (at least "x.md") */
         size_t name_len = strlen(name);
-        if (name_len < subdir_len + 4) continue;  /* at least "skills/x.md" */
+        if (name_len < 4) continue;
         if (strcmp(name + name_len - 3, ".md") != 0) continue;
 
         /* Build full path */
         char full_path[296];
-        snprintf(full_path, sizeof(full_path), "%s/%s", MIMI_SPIFFS_BASE, name);
+        snprintf(full_path, sizeof(full_path), "%s%s", MIMI_SKILLS_PREFIX, name);
 
         FILE *f = fopen(full_path, "r");
         if (!f) continue;
@@ -392,7 +388,7 @@ size_t skill_loader_build_summary(char *buf, size_t size)
 
 size_t skill_loader_build_full(char *buf, size_t size)
 {
-    DIR *dir = opendir(MIMI_SPIFFS_BASE);
+    DIR *dir = opendir(MIMI_SKILLS_DIR);
     if (!dir) {
         buf[0] = '\0';
         return 0;
@@ -400,19 +396,16 @@ size_t skill_loader_build_full(char *buf, size_t size)
 
     size_t off = 0;
     struct dirent *ent;
-    const char *skills_subdir = "skills/";
-    const size_t subdir_len = strlen(skills_subdir);
 
     while ((ent = readdir(dir)) != NULL && off < size - 1) {
         const char *name = ent->d_name;
 
-        if (strncmp(name, skills_subdir, subdir_len) != 0) continue;
         size_t name_len = strlen(name);
-        if (name_len < subdir_len + 4) continue;
+        if (name_len < 4) continue;
         if (strcmp(name + name_len - 3, ".md") != 0) continue;
 
         char full_path[296];
-        snprintf(full_path, sizeof(full_path), "%s/%s", MIMI_SPIFFS_BASE, name);
+        snprintf(full_path, sizeof(full_path), "%s%s", MIMI_SKILLS_PREFIX, name);
 
         FILE *f = fopen(full_path, "r");
         if (!f) continue;
@@ -432,3 +425,56 @@ size_t skill_loader_build_full(char *buf, size_t size)
     ESP_LOGI(TAG, "Skills full content: %d bytes", (int)off);
     return off;
 }
+
+/* ── Match skills to a message ───────────────────────────────── */
+
+/* A skill matches when any part of its file name ("ota-update.md" ->
+ * "ota", "update") of 3+ characters starts a word in text */
+static bool skill_name_matches(const char *name, size_t stem_len, const char *text)
+{
+    size_t i = 0;
+    while (i < stem_len) {
+        size_t len = strcspn(name + i, "-_.");
+        if (len > stem_len - i) len = stem_len - i;
+        if (len >= 3 && text_has_word_prefix(text, name + i, len)) return true;
+        i += len + 1;
+    }
+    return false;
+}
+
+size_t skill_loader_match(const char *text, char *buf, size_t size)
+{
+    buf[0] = '\0';
+    DIR *dir = opendir(MIMI_SKILLS_DIR);
+    if (!dir) return 0;
+
+    size_t off = 0;
+    struct dirent *ent;
+
+    while ((ent = readdir(dir)) != NULL && off < size - 1) {
+        const char *name = ent->d_name;
+
+        size_t name_len = strlen(name);
+        if (name_len < 4) continue;
+        if (strcmp(name + name_len - 3, ".md") != 0) continue;
+        if (!skill_name_matches(name, name_len - 3, text)) continue;
+
+        char full_path[296];
+        snprintf(full_path, sizeof(full_path), "%s%s", MIMI_SKILLS_PREFIX, name);
+
+        FILE *f = fopen(full_path, "r");
+        if (!f) continue;
+
+        size_t n = fread(buf + off, 1, size - off - 1, f);
+        off += n;
+        buf[off] = '\0';
+        if (off < size - 1 && off > 0 && buf[off - 1] != '\n') {
+            buf[off++] = '\n';
+            buf[off] = '\0';
+        }
+        fclose(f);
+    }
+
+    closedir(dir);
+    return off;
+}
@@ -29,3 +29,15 @@ size_t skill_loader_build_summary(char *buf, size_t size);
  * @return Number of bytes written (0 if no skills found)
  */
 size_t skill_loader_build_full(char *buf, size_t size);
+
+/**
+ * Collect the full text of the skills relevant to a message: a skill
+ * matches when a part of its file name starts a word in text (e.g.
+ * "docker" selects docker.md). Used to route the tools a skill calls.
+ *
+ * @param text  Message text
+ * @param buf   Output buffer
+ * @param size  Buffer size
+ * @return Number of bytes written (0 if no skill matches)
+ */
+size_t skill_loader_match(const char *text, char *buf, size_t size);
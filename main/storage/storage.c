@@ -0,0 +1,369 @@
+#include "storage/storage.h"
+#include "mimi_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_littlefs.h"
+#include "esp_spiffs.h"
+
+static const char *TAG = "storage";
+
+#define STORAGE_MAX_DEPTH       4
+#define STORAGE_MIGRATE_MAX     512
+#define STORAGE_PSRAM_RESERVE   (512 * 1024)
+#define STORAGE_LINE_INIT       256
+#define STORAGE_LINE_MAX        (64 * 1024)
+
+static bool s_legacy_spiffs = false;    /* migration could not run; still on flat SPIFFS */
+
+static const char *const s_dirs[] = {
+    MIMI_SPIFFS_CONFIG_DIR,
+    MIMI_SPIFFS_MEMORY_DIR,
+    MIMI_SPIFFS_SESSION_DIR,
+    MIMI_SKILLS_DIR,
+};
+
+static esp_err_t mount_littlefs(bool format_if_failed)
+{
+    esp_vfs_littlefs_conf_t conf = {
+        .base_path = MIMI_SPIFFS_BASE,
+        .partition_label = MIMI_STORAGE_PARTITION,
+        .format_if_mount_failed = format_if_failed,
+        .dont_mount = false,
+    };
+    return esp_vfs_littlefs_register(&conf);
+}
+
+/* ── One-time SPIFFS → LittleFS migration ─────────────────────── */
+
+typedef struct {
+    char name[64];          /* flat SPIFFS name, e.g. "memory/MEMORY.md" */
+    uint8_t *data;
+    size_t len;
+} staged_file_t;
+
+static void free_staged(staged_file_t *files, int count)
+{
+    for (int i = 0; i < count; i++) {
+        free(files[i].data);
+    }
+    free(files);
+}
+
+/**
+ * Returns ESP_ERR_NOT_FOUND when the partition does not hold SPIFFS, or
+ * ESP_OK after a successful migration (LittleFS mounted). Any other error
+ * leaves one of: SPIFFS mounted with s_legacy_spiffs set, LittleFS mounted
+ * with some files not restored, or nothing mounted.
+ */
+static esp_err_t migrate_from_spiffs(void)
+{
+    esp_vfs_spiffs_conf_t conf = {
+        .base_path = MIMI_SPIFFS_BASE,
+        .partition_label = MIMI_STORAGE_PARTITION,
+        .max_files = 4,
+        .format_if_mount_failed = false,
+    };
+    if (esp_vfs_spiffs_register(&conf) != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    size_t total = 0, used = 0;
+    esp_spiffs_info(MIMI_STORAGE_PARTITION, &total, &used);
+    ESP_LOGW(TAG, "Legacy SPIFFS found (%d bytes used), migrating to LittleFS", (int)used);
+
+    if (used + STORAGE_PSRAM_RESERVE > heap_caps_get_free_size(MALLOC_CAP_SPIRAM)) {
+        ESP_LOGE(TAG, "Not enough PSRAM to stage %d bytes, staying on SPIFFS", (int)used);
+        s_legacy_spiffs = true;
+        return ESP_ERR_NO_MEM;
+    }
+
+    staged_file_t *files = heap_caps_calloc(STORAGE_MIGRATE_MAX, sizeof(staged_file_t), MALLOC_CAP_SPIRAM);
+    DIR *dir = opendir(MIMI_SPIFFS_BASE);
+    if (!files || !dir) {
+        if (dir) closedir(dir);
+        free(files);
+        s_legacy_spiffs = true;
+        return ESP_FAIL;
+    }
+
+    /* Stage every file in PSRAM before touching the partition */
+    int count = 0;
+    esp_err_t err = ESP_OK;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (count >= STORAGE_MIGRATE_MAX) {
+            err = ESP_ERR_NO_MEM;
+            break;
+        }
+        staged_file_t *sf = &files[count];
+        strlcpy(sf->name, ent->d_name, sizeof(sf->name));
+
+        char path[96];
+        snprintf(path, sizeof(path), "%s/%s", MIMI_SPIFFS_BASE, sf->name);
+        struct stat st;
+        if (stat(path, &st) != 0) continue;
+
+        sf->len = (size_t)st.st_size;
+        sf->data = heap_caps_malloc(sf->len ? sf->len : 1, MALLOC_CAP_SPIRAM);
+        FILE *f = fopen(path, "rb");
+        if (!sf->data || !f || fread(sf->data, 1, sf->len, f) != sf->len) {
+            if (f) fclose(f);
+            free(sf->data);
+            sf->data = NULL;
+            err = ESP_FAIL;
+            break;
+        }
+        fclose(f);
+        count++;
+    }
+    closedir(dir);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Staging failed after %d files, staying on SPIFFS", count);
+        free_staged(files, count);
+        s_legacy_spiffs = true;
+        return err;
+    }
+
+    /* Point of no return: a power loss before write-back completes loses
+     * whatever has not been written yet */
+    esp_vfs_spiffs_unregister(MIMI_STORAGE_PARTITION);
+    err = esp_littlefs_format(MIMI_STORAGE_PARTITION);
+    if (err == ESP_OK) err = mount_littlefs(false);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "LittleFS format/mount failed: %s", esp_err_to_name(err));
+        if (esp_vfs_spiffs_register(&conf) == ESP_OK) {
+            /* The format never reached the SPIFFS data */
+            ESP_LOGW(TAG, "Remounted legacy SPIFFS");
+            free_staged(files, count);
+            s_legacy_spiffs = true;
+            return err;
+        }
+        /* SPIFFS is gone as well: restore the staged copies onto a fresh LittleFS */
+        err = mount_littlefs(true);
+        if (err != ESP_OK) {
+            free_staged(files, count);
+            return err;
+        }
+    }
+
+    int written = 0;
+    for (int i = 0; i < count; i++) {
+        char path[96];
+        snprintf(path, sizeof(path), "%s/%s", MIMI_SPIFFS_BASE, files[i].name);
+        storage_ensure_parent(path);
+        FILE *f = fopen(path, "wb");
+        bool ok = f && fwrite(files[i].data, 1, files[i].len, f) == files[i].len;
+        if (f && fclose(f) != 0) ok = false;
+        if (ok) {
+            written++;
+        } else {
+            ESP_LOGE(TAG, "Cannot restore %s (%d bytes lost)", path, (int)files[i].len);
+        }
+    }
+    free_staged(files, count);
+
+    if (written < count) {
+        ESP_LOGE(TAG, "Migration incomplete: %d of %d files restored", written, count);
+        return ESP_FAIL;
+    }
+    ESP_LOGW(TAG, "Migration done: %d files restored", count);
+    return ESP_OK;
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+esp_err_t storage_init(void)
+{
+    esp_err_t err = mount_littlefs(false);
+    if (err != ESP_OK) {
+        err = migrate_from_spiffs();
+        if (err == ESP_ERR_NOT_FOUND) {
+            ESP_LOGW(TAG, "No filesystem found, formatting LittleFS");
+            err = mount_littlefs(true);
+        } else if (err != ESP_OK &&
+                   (s_legacy_spiffs || esp_littlefs_mounted(MIMI_STORAGE_PARTITION))) {
+            /* Already reported; a mounted filesystem is enough to boot */
+            err = ESP_OK;
+        }
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Storage mount failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    if (!s_legacy_spiffs) {
+        for (size_t i = 0; i < sizeof(s_dirs) / sizeof(s_dirs[0]); i++) {
+            if (mkdir(s_dirs[i], 0775) != 0 && errno != EEXIST) {
+                ESP_LOGW(TAG, "Cannot create %s (errno %d)", s_dirs[i], errno);
+            }
+        }
+    }
+
+    size_t total = 0, used = 0;
+    storage_info(&total, &used);
+    ESP_LOGI(TAG, "%s: total=%d, used=%d", s_legacy_spiffs ? "SPIFFS" : "LittleFS",
+             (int)total, (int)used);
+    return ESP_OK;
+}
+
+esp_err_t storage_info(size_t *total, size_t *used)
+{
+    if (s_legacy_spiffs) {
+        return esp_spiffs_info(MIMI_STORAGE_PARTITION, total, used);
+    }
+    return esp_littlefs_info(MIMI_STORAGE_PARTITION, total, used);
+}
+
+esp_err_t storage_ensure_parent(const char *path)
+{
+    if (s_legacy_spiffs) return ESP_OK;   /* flat filesystem, nothing to create */
+
+    const size_t base_len = strlen(MIMI_SPIFFS_BASE);
+    if (strncmp(path, MIMI_SPIFFS_BASE "/", base_len + 1) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char buf[256];
+    if (strlcpy(buf, path, sizeof(buf)) >= sizeof(buf)) return ESP_ERR_INVALID_SIZE;
+    char *last = strrchr(buf, '/');
+    if (!last || last <= buf + base_len) return ESP_OK;
+    *last = '\0';
+
+    /* Create each component below the mount point in turn */
+    for (char *p = buf + base_len + 1; ; p++) {
+        if (*p != '/' && *p != '\0') continue;
+        char saved = *p;
+        *p = '\0';
+        if (mkdir(buf, 0775) != 0 && errno != EEXIST) {
+            ESP_LOGW(TAG, "mkdir %s failed (errno %d)", buf, errno);
+            return ESP_FAIL;
+        }
+        if (saved == '\0') break;
+        *p = saved;
+    }
+    return ESP_OK;
+}
+
+esp_err_t storage_replace(const char *tmp, const char *path)
+{
+    if (s_legacy_spiffs) remove(path);
+    if (rename(tmp, path) != 0) {
+        ESP_LOGW(TAG, "rename %s -> %s failed (errno %d)", tmp, path, errno);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t storage_write_atomic(const char *path, const char *data, size_t len)
+{
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open %s for writing", tmp);
+        return ESP_FAIL;
+    }
+
+    bool ok = fwrite(data, 1, len, f) == len;
+    ok = ok && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    if (fclose(f) != 0) ok = false;
+
+    if (!ok || storage_replace(tmp, path) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write %s", path);
+        remove(tmp);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t storage_read_line(FILE *f, char **buf, size_t *cap, size_t *len)
+{
+    size_t n = 0;
+    bool any = false;
+    bool too_long = false;
+
+    while (1) {
+        if (*cap - n < 2) {
+            size_t new_cap = *cap ? *cap * 2 : STORAGE_LINE_INIT;
+            if (new_cap > STORAGE_LINE_MAX) new_cap = STORAGE_LINE_MAX;
+            if (new_cap <= *cap) {
+                /* Keep consuming the line, but only to find its end */
+                too_long = true;
+                n = 0;
+            } else {
+                char *tmp = heap_caps_realloc(*buf, new_cap, MALLOC_CAP_SPIRAM);
+                if (!tmp) return ESP_ERR_NO_MEM;
+                *buf = tmp;
+                *cap = new_cap;
+            }
+        }
+        if (!fgets(*buf + n, *cap - n, f)) break;
+        any = true;
+        n += strlen(*buf + n);
+        if (n > 0 && (*buf)[n - 1] == '\n') {
+            (*buf)[--n] = '\0';
+            break;
+        }
+    }
+
+    if (!any) return ESP_ERR_NOT_FOUND;
+    if (too_long) {
+        (*buf)[0] = '\0';
+        *len = 0;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *len = n;
+    return ESP_OK;
+}
+
+static esp_err_t walk_dir(char *path, size_t len, size_t cap, int depth, bool recursive,
+                          storage_walk_cb_t cb, void *ctx, bool *stop)
+{
+    DIR *dir = opendir(path);
+    if (!dir) return ESP_ERR_NOT_FOUND;
+
+    struct dirent *ent;
+    while (!*stop && (ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+
+        int n = snprintf(path + len, cap - len, "/%s", ent->d_name);
+        if (n < 0 || len + n >= cap) {
+            path[len] = '\0';
+            continue;
+        }
+
+        struct stat st;
+        if (stat(path, &st) == 0) {
+            if (S_ISDIR(st.st_mode)) {
+                if (recursive && depth < STORAGE_MAX_DEPTH) {
+                    walk_dir(path, len + n, cap, depth + 1, recursive, cb, ctx, stop);
+                }
+            } else if (!cb(path, &st, ctx)) {
+                *stop = true;
+            }
+        }
+        path[len] = '\0';
+    }
+    closedir(dir);
+    return ESP_OK;
+}
+
+esp_err_t storage_walk(const char *dir, bool recursive, storage_walk_cb_t cb, void *ctx)
+{
+    char path[256];
+    size_t len = strlcpy(path, dir, sizeof(path));
+    if (len >= sizeof(path)) return ESP_ERR_INVALID_SIZE;
+    while (len > 1 && path[len - 1] == '/') path[--len] = '\0';
+
+    bool stop = false;
+    return walk_dir(path, len, sizeof(path), 0, recursive, cb, ctx, &stop);
+}
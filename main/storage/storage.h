@@ -0,0 +1,66 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+/**
+ * Mount the data partition as LittleFS at MIMI_SPIFFS_BASE and create the
+ * standard directories (config, memory, sessions, skills).
+ *
+ * A partition that still holds the legacy flat SPIFFS filesystem is migrated
+ * once: its files are staged in PSRAM, the partition is reformatted as
+ * LittleFS and the files are written back under real directories.
+ */
+esp_err_t storage_init(void);
+
+/**
+ * Get total and used bytes of the data partition.
+ */
+esp_err_t storage_info(size_t *total, size_t *used);
+
+/**
+ * Create any missing parent directories of a file path under MIMI_SPIFFS_BASE
+ * (like "mkdir -p $(dirname path)").
+ */
+esp_err_t storage_ensure_parent(const char *path);
+
+/**
+ * Move a finished temp file over path. On LittleFS the rename replaces the
+ * target atomically. Legacy SPIFFS cannot rename onto an existing file, so
+ * there the target is removed first and a reset in between loses it.
+ */
+esp_err_t storage_replace(const char *tmp, const char *path);
+
+/**
+ * Write data to path through "<path>.tmp": the temp file is flushed and
+ * fsync'ed before storage_replace() moves it into place, so a power loss
+ * leaves either the old contents or the new ones, never a truncated file.
+ */
+esp_err_t storage_write_atomic(const char *path, const char *data, size_t len);
+
+/**
+ * Walk callback: full path and stat of one regular file.
+ * Return false to stop the walk.
+ */
+typedef bool (*storage_walk_cb_t)(const char *path, const struct stat *st, void *ctx);
+
+/**
+ * Call cb for every regular file in dir, descending into subdirectories
+ * when recursive is set. Cost is proportional to the size of dir only.
+ *
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND if dir cannot be opened
+ */
+esp_err_t storage_walk(const char *dir, bool recursive, storage_walk_cb_t cb, void *ctx);
+
+/**
+ * Read one whole line, however long, into *buf (like getline). The buffer
+ * is grown in PSRAM as needed and reused across calls; free it when done.
+ * The trailing newline is stripped.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND at end of file, ESP_ERR_INVALID_SIZE
+ *         for a line over 64 KB (skipped), or ESP_ERR_NO_MEM
+ */
+esp_err_t storage_read_line(FILE *f, char **buf, size_t *cap, size_t *len);
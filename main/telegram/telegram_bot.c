@@ -1,14 +1,24 @@
 #include "telegram_bot.h"
 #include "mimi_config.h"
 #include "bus/message_bus.h"
+#include "agent/agent_loop.h"
+#include "telegram/telegram_sender.h"
+#include "telegram/telegram_updates.h"
+#include "gateway/ws_server.h"
 #include "proxy/http_proxy.h"
+#include "metrics/metrics.h"
+#include "channels/channel.h"
 
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_attr.h"
 #include "esp_timer.h"
 #include "esp_http_client.h"
+#include "esp_http_server.h"
 #include "esp_crt_bundle.h"
 #include "nvs.h"
 #include "cJSON.h"
@@ -16,14 +26,27 @@
 static const char *TAG = "telegram";
 
 static char s_bot_token[128] = MIMI_SECRET_TG_TOKEN;
+static const char *s_webhook_url = MIMI_SECRET_TG_WEBHOOK_URL;
+static const char *s_webhook_secret = MIMI_SECRET_TG_WEBHOOK_SECRET;
+/* 64-bit values shared by the poll task, the webhook handler and flushes
+ * from the CLI/OTA: a 32-bit core can't read them in one go, so they are
+ * only touched under s_offset_lock */
+static portMUX_TYPE s_offset_lock = portMUX_INITIALIZER_UNLOCKED;
 static int64_t s_update_offset = 0;
-static int64_t s_last_saved_offset = -1;
-static int64_t s_last_offset_save_us = 0;
+static int64_t s_saved_offset = 0;          /* last value written to NVS */
+static int64_t s_offset_flush_us = 0;
+static SemaphoreHandle_t s_flush_lock = NULL;   /* one NVS write at a time */
+static esp_http_client_handle_t s_poll_client = NULL;
 
 #define TG_OFFSET_NVS_KEY            "update_offset"
 #define TG_DEDUP_CACHE_SIZE          64
-#define TG_OFFSET_SAVE_INTERVAL_US   (5LL * 1000 * 1000)
-#define TG_OFFSET_SAVE_STEP          10
+#define TG_OFFSET_FLUSH_US           (10LL * 60 * 1000 * 1000)
+#define TG_OFFSET_RTC_MAGIC          0x5447u
+
+/* The offset is mirrored in RTC slow memory, which survives a software
+ * reset, so NVS only needs the occasional write */
+static RTC_NOINIT_ATTR uint32_t s_rtc_magic;
+static RTC_NOINIT_ATTR int64_t s_rtc_offset;
 
 static uint64_t s_seen_msg_keys[TG_DEDUP_CACHE_SIZE] = {0};
 static size_t s_seen_msg_idx = 0;
@@ -70,46 +93,70 @@ static void seen_msg_insert(uint64_t key)
     s_seen_msg_idx = (s_seen_msg_idx + 1) % TG_DEDUP_CACHE_SIZE;
 }
 
-static void save_update_offset_if_needed(bool force)
+static int64_t get_update_offset(void)
 {
-    if (s_update_offset <= 0) {
-        return;
-    }
+    portENTER_CRITICAL(&s_offset_lock);
+    int64_t offset = s_update_offset;
+    portEXIT_CRITICAL(&s_offset_lock);
+    return offset;
+}
 
+static void set_update_offset(int64_t offset)
+{
+    portENTER_CRITICAL(&s_offset_lock);
+    s_update_offset = offset;
+    s_rtc_offset = offset;
+    s_rtc_magic = TG_OFFSET_RTC_MAGIC;
+    portEXIT_CRITICAL(&s_offset_lock);
+}
+
+/* Move past update uid. False if it was already seen. Sets *flush when the
+ * offset hasn't been saved for TG_OFFSET_FLUSH_US. */
+static bool advance_update_offset(int64_t uid, bool *flush)
+{
     int64_t now = esp_timer_get_time();
-    bool should_save = force;
-    if (!should_save && s_last_saved_offset >= 0) {
-        if ((s_update_offset - s_last_saved_offset) >= TG_OFFSET_SAVE_STEP) {
-            should_save = true;
-        } else if ((now - s_last_offset_save_us) >= TG_OFFSET_SAVE_INTERVAL_US) {
-            should_save = true;
-        }
-    } else if (!should_save) {
-        should_save = true;
+    portENTER_CRITICAL(&s_offset_lock);
+    bool fresh = uid >= s_update_offset;
+    if (fresh) {
+        s_update_offset = uid + 1;
+        s_rtc_offset = uid + 1;
+        s_rtc_magic = TG_OFFSET_RTC_MAGIC;
     }
+    *flush = fresh && now - s_offset_flush_us >= TG_OFFSET_FLUSH_US;
+    portEXIT_CRITICAL(&s_offset_lock);
+    return fresh;
+}
 
-    if (!should_save) {
-        return;
-    }
+void telegram_bot_flush(void)
+{
+    if (!s_flush_lock) return;
+    xSemaphoreTake(s_flush_lock, portMAX_DELAY);
 
-    nvs_handle_t nvs;
-    if (nvs_open(MIMI_NVS_TG, NVS_READWRITE, &nvs) != ESP_OK) {
-        return;
-    }
+    portENTER_CRITICAL(&s_offset_lock);
+    s_offset_flush_us = esp_timer_get_time();
+    int64_t offset = s_update_offset;
+    bool stale = offset > s_saved_offset;
+    portEXIT_CRITICAL(&s_offset_lock);
 
-    if (nvs_set_i64(nvs, TG_OFFSET_NVS_KEY, s_update_offset) == ESP_OK) {
-        if (nvs_commit(nvs) == ESP_OK) {
-            s_last_saved_offset = s_update_offset;
-            s_last_offset_save_us = now;
+    nvs_handle_t nvs;
+    if (stale && nvs_open(MIMI_NVS_TG, NVS_READWRITE, &nvs) == ESP_OK) {
+        if (nvs_set_i64(nvs, TG_OFFSET_NVS_KEY, offset) == ESP_OK &&
+            nvs_commit(nvs) == ESP_OK) {
+            portENTER_CRITICAL(&s_offset_lock);
+            s_saved_offset = offset;
+            portEXIT_CRITICAL(&s_offset_lock);
         }
+        nvs_close(nvs);
     }
-    nvs_close(nvs);
+    xSemaphoreGive(s_flush_lock);
 }
 
 static esp_err_t http_event_handler(esp_http_client_event_t *evt)
 {
     http_resp_t *resp = (http_resp_t *)evt->user_data;
-    if (evt->event_id == HTTP_EVENT_ON_DATA) {
+    if (evt->event_id == HTTP_EVENT_ON_CONNECTED) {
+        metrics_inc(METRIC_TLS_TELEGRAM);
+    } else if (evt->event_id == HTTP_EVENT_ON_DATA) {
         if (resp->len + evt->data_len >= resp->cap) {
             size_t new_cap = resp->cap * 2;
             if (new_cap < resp->len + evt->data_len + 1) {
@@ -242,7 +289,7 @@ static char *tg_api_call_direct(const char *method, const char *post_data)
     return resp.buf;
 }
 
-static char *tg_api_call(const char *method, const char *post_data)
+char *telegram_api_call(const char *method, const char *post_data)
 {
     if (http_proxy_is_enabled()) {
         return tg_api_call_via_proxy(method, post_data);
@@ -250,132 +297,231 @@ static char *tg_api_call(const char *method, const char *post_data)
     return tg_api_call_direct(method, post_data);
 }
 
-static bool tg_response_is_ok(const char *resp, const char **out_desc)
+/* Handle one update, from getUpdates or a webhook POST */
+static void process_update(const tg_update_t *update, void *ctx)
 {
-    if (out_desc) {
-        *out_desc = NULL;
-    }
-    if (!resp) {
-        return false;
+    /* Track offset and skip stale/duplicate updates */
+    int64_t uid = update->update_id;
+    if (uid >= 0) {
+        bool flush;
+        if (!advance_update_offset(uid, &flush)) {
+            return;
+        }
+        if (flush) {
+            telegram_bot_flush();
+        }
     }
 
-    cJSON *root = cJSON_Parse(resp);
-    if (root) {
-        cJSON *ok_field = cJSON_GetObjectItem(root, "ok");
-        bool ok = cJSON_IsTrue(ok_field);
-        if (!ok && out_desc) {
-            cJSON *desc = cJSON_GetObjectItem(root, "description");
-            if (desc && cJSON_IsString(desc)) {
-                *out_desc = desc->valuestring;
-            }
+    if (!update->text || !update->chat_id[0]) return;
+
+    const char *chat_id_str = update->chat_id;
+    int msg_id_val = update->message_id;
+
+    if (msg_id_val >= 0) {
+        uint64_t msg_key = make_msg_key(chat_id_str, msg_id_val);
+        if (seen_msg_contains(msg_key)) {
+            ESP_LOGW(TAG, "Drop duplicate message update_id=%" PRId64 " chat=%s message_id=%d",
+                     uid, chat_id_str, msg_id_val);
+            return;
         }
-        cJSON_Delete(root);
-        return ok;
+        seen_msg_insert(msg_key);
     }
 
-    /* Proxy or gateway can occasionally return non-standard payload framing. */
-    if (strstr(resp, "\"ok\":true") != NULL) {
-        return true;
+    ESP_LOGI(TAG, "Message update_id=%" PRId64 " message_id=%d from chat %s: %.40s...",
+             uid, msg_id_val, chat_id_str, update->text);
+
+    /* Push to inbound bus */
+    mimi_msg_t msg = {0};
+    strncpy(msg.channel, MIMI_CHAN_TELEGRAM, sizeof(msg.channel) - 1);
+    strncpy(msg.chat_id, chat_id_str, sizeof(msg.chat_id) - 1);
+    if (chat_id_str[0] == '-') {
+        /* Group chats have negative ids; name the author of each message */
+        strlcpy(msg.sender, update->sender, sizeof(msg.sender));
     }
+    msg.content = strdup(update->text);
+    if (msg.content) {
+        if (message_bus_push_inbound(&msg) != ESP_OK) {
+            ESP_LOGW(TAG, "Inbound queue full, drop telegram message");
+            free(msg.content);
+        } else {
+            agent_loop_supersede(MIMI_CHAN_TELEGRAM, chat_id_str);
+        }
+    }
+}
 
-    return false;
+/* ── Webhook mode ─────────────────────────────────────────────── */
+
+static bool webhook_enabled(void)
+{
+    return s_webhook_url[0] && s_webhook_secret[0];
 }
 
-static void process_updates(const char *json_str)
+/* Compare without an early exit so timing doesn't reveal the secret */
+static bool secret_matches(const char *given, const char *expected)
 {
-    cJSON *root = cJSON_Parse(json_str);
-    if (!root) return;
+    size_t len = strlen(expected);
+    if (strlen(given) != len) return false;
+    unsigned char diff = 0;
+    for (size_t i = 0; i < len; i++) {
+        diff |= (unsigned char)given[i] ^ (unsigned char)expected[i];
+    }
+    return diff == 0;
+}
 
-    cJSON *ok = cJSON_GetObjectItem(root, "ok");
-    if (!cJSON_IsTrue(ok)) {
-        cJSON_Delete(root);
-        return;
+static esp_err_t webhook_handler(httpd_req_t *req)
+{
+    char secret[260] = {0};     /* Telegram allows up to 256 chars */
+    if (httpd_req_get_hdr_value_str(req, "X-Telegram-Bot-Api-Secret-Token",
+                                    secret, sizeof(secret)) != ESP_OK ||
+        !secret_matches(secret, s_webhook_secret)) {
+        ESP_LOGW(TAG, "Webhook request with missing or wrong secret token");
+        httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "Forbidden");
+        return ESP_OK;
     }
 
-    cJSON *result = cJSON_GetObjectItem(root, "result");
-    if (!cJSON_IsArray(result)) {
-        cJSON_Delete(root);
-        return;
+    if (req->content_len == 0 || req->content_len > MIMI_TG_WEBHOOK_MAX_BODY) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad body size");
+        return ESP_OK;
     }
 
-    cJSON *update;
-    cJSON_ArrayForEach(update, result) {
-        /* Track offset and skip stale/duplicate updates */
-        cJSON *update_id = cJSON_GetObjectItem(update, "update_id");
-        int64_t uid = -1;
-        if (cJSON_IsNumber(update_id)) {
-            uid = (int64_t)update_id->valuedouble;
-        }
-        if (uid >= 0) {
-            if (uid < s_update_offset) {
-                continue;
-            }
-            s_update_offset = uid + 1;
-            save_update_offset_if_needed(false);
+    tg_updates_parser_t *parser = calloc(1, sizeof(tg_updates_parser_t));
+    if (!parser) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No memory");
+        return ESP_OK;
+    }
+    tg_updates_init(parser, true, process_update, NULL);
+
+    /* Parse while receiving; the body is never held whole */
+    char buf[512];
+    size_t left = req->content_len;
+    while (left > 0) {
+        int n = httpd_req_recv(req, buf, left < sizeof(buf) ? left : sizeof(buf));
+        if (n == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (n <= 0) {
+            tg_updates_free(parser);
+            free(parser);
+            return ESP_FAIL;
         }
+        tg_updates_feed(parser, buf, n);
+        left -= n;
+    }
+    bool done = tg_updates_done(parser);
+    tg_updates_free(parser);
+    free(parser);
 
-        /* Extract message */
-        cJSON *message = cJSON_GetObjectItem(update, "message");
-        if (!message) continue;
+    if (!done) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_OK;
+    }
 
-        cJSON *text = cJSON_GetObjectItem(message, "text");
-        if (!text || !cJSON_IsString(text)) continue;
+    /* Any 2xx tells Telegram the update was delivered */
+    httpd_resp_send(req, NULL, 0);
+    return ESP_OK;
+}
 
-        cJSON *chat = cJSON_GetObjectItem(message, "chat");
-        if (!chat) continue;
+/* Point Telegram at our webhook, retrying until it accepts */
+static void telegram_webhook_setup_task(void *arg)
+{
+    cJSON *req = cJSON_CreateObject();
+    cJSON_AddStringToObject(req, "url", s_webhook_url);
+    cJSON_AddStringToObject(req, "secret_token", s_webhook_secret);
+    cJSON_AddNumberToObject(req, "max_connections", MIMI_TG_WEBHOOK_MAX_CONN);
+    cJSON *allowed = cJSON_AddArrayToObject(req, "allowed_updates");
+    cJSON_AddItemToArray(allowed, cJSON_CreateString("message"));
+    char *body = cJSON_PrintUnformatted(req);
+    cJSON_Delete(req);
+
+    int delay_ms = 3000;
+    while (body) {
+        char *resp = telegram_api_call("setWebhook", body);
+        bool ok = resp && strstr(resp, "\"ok\":true");
+        if (ok) {
+            ESP_LOGI(TAG, "Webhook registered: %s", s_webhook_url);
+            free(resp);
+            break;
+        }
+        ESP_LOGW(TAG, "setWebhook failed: %s, retry in %ds",
+                 resp ? resp : "no response", delay_ms / 1000);
+        free(resp);
+        vTaskDelay(pdMS_TO_TICKS(delay_ms));
+        if (delay_ms < 60000) delay_ms *= 2;
+    }
+    cJSON_free(body);
+    vTaskDelete(NULL);
+}
 
-        cJSON *chat_id = cJSON_GetObjectItem(chat, "id");
-        if (!chat_id) continue;
+/* ── Polling mode ─────────────────────────────────────────────── */
 
-        int msg_id_val = -1;
-        cJSON *message_id = cJSON_GetObjectItem(message, "message_id");
-        if (cJSON_IsNumber(message_id)) {
-            msg_id_val = (int)message_id->valuedouble;
-        }
+static esp_err_t poll_http_event(esp_http_client_event_t *evt)
+{
+    /* The client is kept alive, so this fires only on reconnect */
+    if (evt->event_id == HTTP_EVENT_ON_CONNECTED) {
+        metrics_inc(METRIC_TLS_TELEGRAM);
+    } else if (evt->event_id == HTTP_EVENT_ON_DATA) {
+        tg_updates_feed((tg_updates_parser_t *)evt->user_data, evt->data, evt->data_len);
+    }
+    return ESP_OK;
+}
 
-        char chat_id_str[32];
-        if (cJSON_IsString(chat_id) && chat_id->valuestring) {
-            strncpy(chat_id_str, chat_id->valuestring, sizeof(chat_id_str) - 1);
-            chat_id_str[sizeof(chat_id_str) - 1] = '\0';
-        } else if (cJSON_IsNumber(chat_id)) {
-            snprintf(chat_id_str, sizeof(chat_id_str), "%.0f", chat_id->valuedouble);
-        } else {
-            continue;
-        }
+/* One getUpdates round trip. Updates are handled as the response streams
+ * in, and the direct path keeps its TLS connection open between polls. */
+static esp_err_t poll_updates(tg_updates_parser_t *parser)
+{
+    char path[192];
+    snprintf(path, sizeof(path),
+             "getUpdates?offset=%" PRId64 "&timeout=%d&limit=%d"
+             "&allowed_updates=%%5B%%22message%%22%%5D",
+             get_update_offset(), MIMI_TG_POLL_TIMEOUT_S, MIMI_TG_POLL_LIMIT);
+    tg_updates_reset(parser);
 
-        if (msg_id_val >= 0) {
-            uint64_t msg_key = make_msg_key(chat_id_str, msg_id_val);
-            if (seen_msg_contains(msg_key)) {
-                ESP_LOGW(TAG, "Drop duplicate message update_id=%" PRId64 " chat=%s message_id=%d",
-                         uid, chat_id_str, msg_id_val);
-                continue;
-            }
-            seen_msg_insert(msg_key);
-        }
+    if (http_proxy_is_enabled()) {
+        char *resp = telegram_api_call(path, NULL);
+        if (!resp) return ESP_FAIL;
+        tg_updates_feed(parser, resp, strlen(resp));
+        free(resp);
+        return ESP_OK;
+    }
 
-        ESP_LOGI(TAG, "Message update_id=%" PRId64 " message_id=%d from chat %s: %.40s...",
-                 uid, msg_id_val, chat_id_str, text->valuestring);
-
-        /* Push to inbound bus */
-        mimi_msg_t msg = {0};
-        strncpy(msg.channel, MIMI_CHAN_TELEGRAM, sizeof(msg.channel) - 1);
-        strncpy(msg.chat_id, chat_id_str, sizeof(msg.chat_id) - 1);
-        msg.content = strdup(text->valuestring);
-        if (msg.content) {
-            if (message_bus_push_inbound(&msg) != ESP_OK) {
-                ESP_LOGW(TAG, "Inbound queue full, drop telegram message");
-                free(msg.content);
-            }
-        }
+    char url[320];
+    snprintf(url, sizeof(url), "https://api.telegram.org/bot%s/%s", s_bot_token, path);
+    if (!s_poll_client) {
+        esp_http_client_config_t config = {
+            .url = url,
+            .event_handler = poll_http_event,
+            .user_data = parser,
+            .timeout_ms = (MIMI_TG_POLL_TIMEOUT_S + 5) * 1000,
+            .buffer_size = 2048,
+            .buffer_size_tx = 1024,
+            .keep_alive_enable = true,
+            .crt_bundle_attach = esp_crt_bundle_attach,
+        };
+        s_poll_client = esp_http_client_init(&config);
+        if (!s_poll_client) return ESP_ERR_NO_MEM;
+    } else {
+        esp_http_client_set_url(s_poll_client, url);
     }
 
-    cJSON_Delete(root);
+    esp_err_t err = esp_http_client_perform(s_poll_client);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "getUpdates failed: %s", esp_err_to_name(err));
+        esp_http_client_cleanup(s_poll_client);
+        s_poll_client = NULL;
+    }
+    return err;
 }
 
 static void telegram_poll_task(void *arg)
 {
     ESP_LOGI(TAG, "Telegram polling task started");
 
+    tg_updates_parser_t *parser = calloc(1, sizeof(tg_updates_parser_t));
+    if (!parser) {
+        ESP_LOGE(TAG, "No memory for update parser");
+        vTaskDelete(NULL);
+        return;
+    }
+    tg_updates_init(parser, false, process_update, NULL);
+
     while (1) {
         if (s_bot_token[0] == '\0') {
             ESP_LOGW(TAG, "No bot token configured, waiting...");
@@ -383,26 +529,40 @@ static void telegram_poll_task(void *arg)
             continue;
         }
 
-        char params[128];
-        snprintf(params, sizeof(params),
-                 "getUpdates?offset=%" PRId64 "&timeout=%d",
-                 s_update_offset, MIMI_TG_POLL_TIMEOUT_S);
+        if (poll_updates(parser) == ESP_OK && parser->ok) {
+            if (!tg_updates_done(parser)) {
+                ESP_LOGW(TAG, "getUpdates response incomplete or malformed");
+            }
+            continue;
+        }
 
-        char *resp = tg_api_call(params, NULL);
-        if (resp) {
-            process_updates(resp);
+        if (parser->error_code == 409) {
+            /* A webhook is still registered from webhook mode; polling
+             * can't work until it is removed */
+            ESP_LOGW(TAG, "getUpdates conflicts with an active webhook, deleting it");
+            char *resp = telegram_api_call("deleteWebhook", NULL);
             free(resp);
-        } else {
-            /* Back off on error */
-            vTaskDelay(pdMS_TO_TICKS(3000));
+            continue;
         }
+
+        /* Back off on error */
+        vTaskDelay(pdMS_TO_TICKS(3000));
     }
 }
 
 /* --- Public API --- */
 
+static const channel_driver_t s_channel_driver = {
+    .name = MIMI_CHAN_TELEGRAM,
+    .caps = CHANNEL_CAP_STATUS | CHANNEL_CAP_RECALL,
+    .send = telegram_send_message,
+};
+
 esp_err_t telegram_bot_init(void)
 {
+    s_flush_lock = xSemaphoreCreateMutex();
+    if (!s_flush_lock) return ESP_ERR_NO_MEM;
+
     /* NVS overrides take highest priority (set via CLI) */
     nvs_handle_t nvs;
     if (nvs_open(MIMI_NVS_TG, NVS_READONLY, &nvs) == ESP_OK) {
@@ -415,14 +575,31 @@ esp_err_t telegram_bot_init(void)
         int64_t offset = 0;
         if (nvs_get_i64(nvs, TG_OFFSET_NVS_KEY, &offset) == ESP_OK && offset > 0) {
             s_update_offset = offset;
-            s_last_saved_offset = offset;
-            ESP_LOGI(TAG, "Loaded Telegram update offset: %" PRId64, s_update_offset);
+            s_saved_offset = offset;
         }
         nvs_close(nvs);
     }
 
+    /* After a software reset RTC memory may hold a newer offset than NVS */
+    if (s_rtc_magic == TG_OFFSET_RTC_MAGIC && s_rtc_offset > s_update_offset) {
+        s_update_offset = s_rtc_offset;
+    }
+    set_update_offset(s_update_offset);
+    s_offset_flush_us = esp_timer_get_time();
+    if (s_update_offset > 0) {
+        ESP_LOGI(TAG, "Loaded Telegram update offset: %" PRId64, s_update_offset);
+    }
+
     /* s_bot_token is already initialized from MIMI_SECRET_TG_TOKEN as fallback */
 
+    esp_err_t err = telegram_sender_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (channel_register(&s_channel_driver) == CHANNEL_ID_NONE) {
+        return ESP_FAIL;
+    }
+
     if (s_bot_token[0]) {
         ESP_LOGI(TAG, "Telegram bot token loaded (len=%d)", (int)strlen(s_bot_token));
     } else {
@@ -433,10 +610,37 @@ esp_err_t telegram_bot_init(void)
 
 esp_err_t telegram_bot_start(void)
 {
-    BaseType_t ret = xTaskCreatePinnedToCore(
-        telegram_poll_task, "tg_poll",
-        MIMI_TG_POLL_STACK, NULL,
-        MIMI_TG_POLL_PRIO, NULL, MIMI_TG_POLL_CORE);
+    esp_err_t err = telegram_sender_start();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (s_webhook_url[0] && !s_webhook_secret[0]) {
+        ESP_LOGW(TAG, "Webhook URL set without MIMI_SECRET_TG_WEBHOOK_SECRET, using polling");
+    }
+
+    BaseType_t ret;
+    if (webhook_enabled()) {
+        /* Updates arrive as POSTs on the gateway server; no poll task */
+        httpd_uri_t uri = {
+            .uri = MIMI_TG_WEBHOOK_PATH,
+            .method = HTTP_POST,
+            .handler = webhook_handler,
+        };
+        err = ws_server_register_uri(&uri);
+        if (err != ESP_OK) {
+            return err;
+        }
+        ret = xTaskCreatePinnedToCore(
+            telegram_webhook_setup_task, "tg_hook",
+            MIMI_TG_POLL_STACK, NULL,
+            MIMI_TG_POLL_PRIO, NULL, MIMI_TG_POLL_CORE);
+    } else {
+        ret = xTaskCreatePinnedToCore(
+            telegram_poll_task, "tg_poll",
+            MIMI_TG_POLL_STACK, NULL,
+            MIMI_TG_POLL_PRIO, NULL, MIMI_TG_POLL_CORE);
+    }
 
     return (ret == pdPASS) ? ESP_OK : ESP_FAIL;
 }
@@ -448,105 +652,20 @@ esp_err_t telegram_send_message(const char *chat_id, const char *text)
         return ESP_ERR_INVALID_STATE;
     }
 
-    /* Split long messages at 4096-char boundary */
-    size_t text_len = strlen(text);
-    size_t offset = 0;
-    int all_ok = 1;
-
-    while (offset < text_len) {
-        size_t chunk = text_len - offset;
-        if (chunk > MIMI_TG_MAX_MSG_LEN) {
-            chunk = MIMI_TG_MAX_MSG_LEN;
-        }
-
-        /* Build JSON body */
-        cJSON *body = cJSON_CreateObject();
-        cJSON_AddStringToObject(body, "chat_id", chat_id);
-
-        /* Create null-terminated chunk */
-        char *segment = malloc(chunk + 1);
-        if (!segment) {
-            cJSON_Delete(body);
-            return ESP_ERR_NO_MEM;
-        }
-        memcpy(segment, text + offset, chunk);
-        segment[chunk] = '\0';
-
-        cJSON_AddStringToObject(body, "text", segment);
-        cJSON_AddStringToObject(body, "parse_mode", "Markdown");
-
-        char *json_str = cJSON_PrintUnformatted(body);
-        cJSON_Delete(body);
-        free(segment);
-
-        if (!json_str) {
-            all_ok = 0;
-            offset += chunk;
-            continue;
-        }
-
-        ESP_LOGI(TAG, "Sending telegram chunk to %s (%d bytes)", chat_id, (int)chunk);
-        char *resp = tg_api_call("sendMessage", json_str);
-        free(json_str);
-
-        int sent_ok = 0;
-        bool markdown_failed = false;
-        if (resp) {
-            const char *desc = NULL;
-            sent_ok = tg_response_is_ok(resp, &desc);
-            if (!sent_ok) {
-                markdown_failed = true;
-                ESP_LOGI(TAG, "Markdown rejected by Telegram for %s: %s",
-                         chat_id, desc ? desc : "unknown");
-            }
-        }
-
-        if (!sent_ok) {
-            /* Retry without parse_mode */
-            cJSON *body2 = cJSON_CreateObject();
-            cJSON_AddStringToObject(body2, "chat_id", chat_id);
-            char *seg2 = malloc(chunk + 1);
-            if (seg2) {
-                memcpy(seg2, text + offset, chunk);
-                seg2[chunk] = '\0';
-                cJSON_AddStringToObject(body2, "text", seg2);
-                free(seg2);
-            }
-            char *json2 = cJSON_PrintUnformatted(body2);
-            cJSON_Delete(body2);
-            if (json2) {
-                char *resp2 = tg_api_call("sendMessage", json2);
-                free(json2);
-                if (resp2) {
-                    const char *desc2 = NULL;
-                    sent_ok = tg_response_is_ok(resp2, &desc2);
-                    if (!sent_ok) {
-                        ESP_LOGE(TAG, "Plain send failed: %s", desc2 ? desc2 : "unknown");
-                        ESP_LOGE(TAG, "Telegram raw response: %.300s", resp2);
-                    }
-                    free(resp2);
-                } else {
-                    ESP_LOGE(TAG, "Plain send failed: no HTTP response");
-                }
-            } else {
-                ESP_LOGE(TAG, "Plain send failed: no JSON body");
-            }
-        }
-
-        if (!sent_ok) {
-            all_ok = 0;
-        } else {
-            if (markdown_failed) {
-                ESP_LOGI(TAG, "Plain-text fallback succeeded for %s", chat_id);
-            }
-            ESP_LOGI(TAG, "Telegram send success to %s (%d bytes)", chat_id, (int)chunk);
-        }
-
-        free(resp);
-        offset += chunk;
+    char *copy = strdup(text);
+    if (!copy) {
+        return ESP_ERR_NO_MEM;
     }
+    esp_err_t err = telegram_sender_enqueue(chat_id, copy);
+    if (err != ESP_OK) {
+        free(copy);
+    }
+    return err;
+}
 
-    return all_ok ? ESP_OK : ESP_FAIL;
+const char *telegram_bot_token(void)
+{
+    return s_bot_token;
 }
 
 esp_err_t telegram_set_token(const char *token)
@@ -13,15 +13,37 @@ esp_err_t telegram_bot_init(void);
 esp_err_t telegram_bot_start(void);
 
 /**
- * Send a text message to a Telegram chat.
- * Automatically splits messages longer than 4096 chars.
+ * Queue a text message for a Telegram chat (the text is copied).
+ * Delivery is asynchronous: see telegram_sender_enqueue().
+ * Markdown is converted to Telegram HTML, and long messages are split
+ * into chunks of at most 4096 characters.
  * @param chat_id  Telegram chat ID (numeric string)
  * @param text     Message text (supports Markdown)
+ * @return ESP_OK when queued
  */
 esp_err_t telegram_send_message(const char *chat_id, const char *text);
 
+/**
+ * Write the update offset to NVS if it moved. It is otherwise kept in RTC
+ * memory and flushed every few minutes; call before a planned restart.
+ */
+void telegram_bot_flush(void);
+
 /**
  * Save the Telegram bot token to NVS.
  */
 esp_err_t telegram_set_token(const char *token);
 
+
+/**
+ * Current bot token (for the send workers).
+ */
+const char *telegram_bot_token(void);
+
+/**
+ * Call a Bot API method over a fresh connection (direct or via the proxy).
+ * @param method     Method with query string, e.g. "getUpdates?offset=1"
+ * @param post_data  JSON body to POST, or NULL for GET
+ * @return Response body (caller frees), or NULL on transport error
+ */
+char *telegram_api_call(const char *method, const char *post_data);
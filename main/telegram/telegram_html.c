@@ -0,0 +1,528 @@
+#include "telegram/telegram_html.h"
+
+#include <string.h>
+#include <ctype.h>
+
+#define TG_SCAN_MAX    2048     /* how far ahead to look for a closing marker */
+#define TG_SPAN_MAX    512      /* longest inline code span or link part */
+
+enum {
+    TAG_B = 0,
+    TAG_I,
+    TAG_S,
+    TAG_HEAD,                   /* bold heading, closed at end of line */
+    TAG_PRE,
+};
+
+#define PUT_ATTR   0x01         /* escape quotes, don't count as text */
+
+typedef struct {
+    char *out;
+    size_t size;
+    size_t len;
+    size_t units;               /* UTF-16 units of visible text */
+    bool visible;               /* any non-space text yet */
+    bool overflow;
+} writer_t;
+
+/* Converter and writer state at a token boundary */
+typedef struct {
+    tg_html_t conv;
+    size_t len;
+    size_t units;
+    bool visible;
+    bool valid;
+} mark_t;
+
+/* ── Output ───────────────────────────────────────────────────── */
+
+static void put(writer_t *w, const char *s, size_t n)
+{
+    if (w->len + n >= w->size) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->out + w->len, s, n);
+    w->len += n;
+}
+
+static void put_str(writer_t *w, const char *s)
+{
+    put(w, s, strlen(s));
+}
+
+/* Length of a valid UTF-8 sequence at s, 0 if invalid */
+static size_t utf8_len(const unsigned char *s)
+{
+    size_t n;
+    if (s[0] < 0x80) return 1;
+    if (s[0] >= 0xC2 && s[0] <= 0xDF) n = 2;
+    else if ((s[0] & 0xF0) == 0xE0) n = 3;
+    else if (s[0] >= 0xF0 && s[0] <= 0xF4) n = 4;
+    else return 0;
+
+    for (size_t i = 1; i < n; i++) {
+        if ((s[i] & 0xC0) != 0x80) return 0;
+    }
+    return n;
+}
+
+/* Append one character from *p, escaped, and advance *p. Invalid UTF-8
+ * becomes U+FFFD, since Telegram rejects the whole message otherwise. */
+static void put_char(writer_t *w, const char **p, int flags)
+{
+    const unsigned char *s = (const unsigned char *)*p;
+    size_t n = utf8_len(s);
+
+    if (n == 0) {
+        put(w, "\xEF\xBF\xBD", 3);
+        n = 1;
+    } else if (*s == '&') {
+        put(w, "&amp;", 5);
+    } else if (*s == '<') {
+        put(w, "&lt;", 4);
+    } else if (*s == '>') {
+        put(w, "&gt;", 4);
+    } else if (*s == '"' && (flags & PUT_ATTR)) {
+        put(w, "&quot;", 6);
+    } else {
+        put(w, *p, n);
+    }
+    *p += n;
+
+    if (!(flags & PUT_ATTR)) {
+        w->units += n == 4 ? 2 : 1;
+        if (!isspace(*s)) w->visible = true;
+    }
+}
+
+static void put_text(writer_t *w, const char *s, const char *end, int flags)
+{
+    while (s < end && !w->overflow) {
+        put_char(w, &s, flags);
+    }
+}
+
+/* ── Tag stack ────────────────────────────────────────────────── */
+
+static void put_open(const tg_html_t *c, writer_t *w, uint8_t tag)
+{
+    switch (tag) {
+    case TAG_B:
+    case TAG_HEAD:
+        put_str(w, "<b>");
+        break;
+    case TAG_I:
+        put_str(w, "<i>");
+        break;
+    case TAG_S:
+        put_str(w, "<s>");
+        break;
+    case TAG_PRE:
+        if (c->lang[0]) {
+            put_str(w, "<pre><code class=\"language-");
+            put_str(w, c->lang);
+            put_str(w, "\">");
+        } else {
+            put_str(w, "<pre>");
+        }
+        break;
+    }
+}
+
+static const char *close_str(const tg_html_t *c, uint8_t tag)
+{
+    switch (tag) {
+    case TAG_I:   return "</i>";
+    case TAG_S:   return "</s>";
+    case TAG_PRE: return c->lang[0] ? "</code></pre>" : "</pre>";
+    default:      return "</b>";
+    }
+}
+
+static size_t closing_len(const tg_html_t *c)
+{
+    size_t n = 0;
+    for (int i = 0; i < c->depth; i++) {
+        n += strlen(close_str(c, c->stack[i]));
+    }
+    return n;
+}
+
+static void put_open_all(const tg_html_t *c, writer_t *w)
+{
+    for (int i = 0; i < c->depth; i++) {
+        put_open(c, w, c->stack[i]);
+    }
+}
+
+static void put_close_all(const tg_html_t *c, writer_t *w)
+{
+    for (int i = c->depth - 1; i >= 0; i--) {
+        put_str(w, close_str(c, c->stack[i]));
+    }
+}
+
+static int find_tag(const tg_html_t *c, uint8_t tag)
+{
+    for (int i = 0; i < c->depth; i++) {
+        if (c->stack[i] == tag) return i;
+    }
+    return -1;
+}
+
+static void push_tag(tg_html_t *c, writer_t *w, uint8_t tag)
+{
+    c->stack[c->depth++] = tag;
+    put_open(c, w, tag);
+}
+
+/* Close the tag at idx; tags opened inside it are closed and reopened so
+ * that mis-nested markers still give well-formed HTML */
+static void close_tag(tg_html_t *c, writer_t *w, int idx)
+{
+    for (int i = c->depth - 1; i >= idx; i--) {
+        put_str(w, close_str(c, c->stack[i]));
+    }
+    memmove(&c->stack[idx], &c->stack[idx + 1], c->depth - idx - 1);
+    c->depth--;
+    for (int i = idx; i < c->depth; i++) {
+        put_open(c, w, c->stack[i]);
+    }
+}
+
+/* ── Markdown tokens ──────────────────────────────────────────── */
+
+static bool is_fence(const char *p)
+{
+    return strncmp(p, "```", 3) == 0;
+}
+
+static bool in_pre(const tg_html_t *c)
+{
+    return c->depth > 0 && c->stack[0] == TAG_PRE;
+}
+
+/* "```lang" at line start: code blocks can't sit inside other entities,
+ * so inline tags are closed first */
+static void open_fence(tg_html_t *c, writer_t *w)
+{
+    const char *p = c->src + 3;
+    size_t n = 0;
+    while (*p && (isalnum((unsigned char)*p) || strchr("+#_-", *p))) {
+        if (n < sizeof(c->lang) - 1) c->lang[n++] = *p;
+        p++;
+    }
+    c->lang[n] = '\0';
+    while (*p && *p != '\n') p++;
+    if (*p == '\n') p++;
+
+    put_close_all(c, w);
+    c->depth = 0;
+    push_tag(c, w, TAG_PRE);
+    c->src = p;
+    c->line_start = true;
+}
+
+/* Whether a closing run of n 'm' markers follows in this paragraph */
+static bool find_closer(const char *q, char m, int n)
+{
+    for (const char *s = q; *s && s - q < TG_SCAN_MAX; s++) {
+        if (s[0] == '\n' && s[1] == '\n') return false;
+        if (s == q || *s != m || isspace((unsigned char)s[-1])) continue;
+        if (n == 2 ? s[1] != m : (s[1] == m || s[-1] == m)) continue;
+        if (m == '_' && isalnum((unsigned char)s[n])) continue;
+        return true;
+    }
+    return false;
+}
+
+/* **bold**, __bold__, *italic*, _italic_, ~~strike~~ */
+static bool try_emphasis(tg_html_t *c, writer_t *w)
+{
+    const char *p = c->src;
+    char m = *p;
+    int n = p[1] == m ? 2 : 1;
+    if (m == '~' && n != 2) return false;
+
+    uint8_t tag = m == '~' ? TAG_S : (n == 2 ? TAG_B : TAG_I);
+    char prev = p > c->start ? p[-1] : ' ';
+    char next = p[n];
+
+    int idx = find_tag(c, tag);
+    if (idx >= 0) {
+        if (isspace((unsigned char)prev) || (m == '_' && isalnum((unsigned char)next))) {
+            return false;
+        }
+        close_tag(c, w, idx);
+    } else {
+        if (next == '\0' || isspace((unsigned char)next)) return false;
+        if (m == '_' && isalnum((unsigned char)prev)) return false;   /* snake_case */
+        if (c->depth >= TG_HTML_MAX_DEPTH || !find_closer(p + n, m, n)) return false;
+        push_tag(c, w, tag);
+    }
+    c->src = p + n;
+    return true;
+}
+
+/* `code` on one line; code can't be nested in other entities */
+static bool try_code(tg_html_t *c, writer_t *w)
+{
+    const char *s = c->src + 1;
+    const char *e = s;
+    while (*e && *e != '`' && *e != '\n' && e - s < TG_SPAN_MAX) e++;
+    if (*e != '`' || e == s) return false;
+
+    put_close_all(c, w);
+    put_str(w, "<code>");
+    put_text(w, s, e, 0);
+    put_str(w, "</code>");
+    put_open_all(c, w);
+    c->src = e + 1;
+    return true;
+}
+
+/* [text](url) with an http(s) or tg URL; the text is taken literally */
+static bool try_link(tg_html_t *c, writer_t *w)
+{
+    const char *text = c->src + 1;
+    const char *end = text;
+    while (*end && *end != ']' && *end != '\n' && end - text < TG_SPAN_MAX) end++;
+    if (*end != ']' || end == text || end[1] != '(') return false;
+
+    const char *url = end + 2;
+    if (strncmp(url, "https://", 8) != 0 && strncmp(url, "http://", 7) != 0 &&
+        strncmp(url, "tg://", 5) != 0) {
+        return false;
+    }
+    const char *url_end = url;
+    while (*url_end && *url_end != ')' && !isspace((unsigned char)*url_end) &&
+           url_end - url < TG_SPAN_MAX) {
+        url_end++;
+    }
+    if (*url_end != ')') return false;
+
+    put_str(w, "<a href=\"");
+    put_text(w, url, url_end, PUT_ATTR);
+    put_str(w, "\">");
+    put_text(w, text, end, 0);
+    put_str(w, "</a>");
+    c->src = url_end + 1;
+    return true;
+}
+
+/* Convert one token: a character, a marker, or a whole code span or link.
+ * With atomic false, spans and links are taken character by character. */
+static void convert_token(tg_html_t *c, writer_t *w, bool atomic)
+{
+    const char *p = c->src;
+    bool at_line = c->line_start;
+    c->line_start = false;
+
+    if (in_pre(c)) {
+        if (at_line) {
+            const char *q = p;
+            while (*q == ' ') q++;
+            if (is_fence(q)) {
+                put_close_all(c, w);
+                c->depth = 0;
+                q += 3;
+                while (*q && *q != '\n') q++;
+                c->src = q;
+                return;
+            }
+        }
+        c->line_start = *p == '\n';
+        put_char(w, &c->src, 0);
+        return;
+    }
+
+    if (at_line) {
+        if (*p == ' ') {
+            put_char(w, &c->src, 0);
+            c->line_start = true;
+            return;
+        }
+        if (is_fence(p)) {
+            open_fence(c, w);
+            return;
+        }
+        if (*p == '#') {
+            int n = 0;
+            while (p[n] == '#') n++;
+            if (n <= 6 && p[n] == ' ' && c->depth < TG_HTML_MAX_DEPTH) {
+                p += n;
+                while (*p == ' ') p++;
+                push_tag(c, w, TAG_HEAD);
+                c->src = p;
+                return;
+            }
+        }
+        if ((*p == '-' || *p == '*' || *p == '+') && p[1] == ' ') {
+            const char *bullet = "\xE2\x80\xA2 ";
+            put_text(w, bullet, bullet + strlen(bullet), 0);
+            c->src = p + 2;
+            return;
+        }
+        if (*p == '\n') {
+            /* Blank line: nothing carries over into the next paragraph */
+            put_close_all(c, w);
+            c->depth = 0;
+        }
+    }
+
+    switch (*p) {
+    case '\n': {
+        int idx = find_tag(c, TAG_HEAD);
+        if (idx >= 0) close_tag(c, w, idx);
+        put_char(w, &c->src, 0);
+        c->line_start = true;
+        return;
+    }
+    case '\\':
+        if (ispunct((unsigned char)p[1])) {
+            c->src++;
+            put_char(w, &c->src, 0);
+            return;
+        }
+        break;
+    case '`':
+        if (atomic && try_code(c, w)) return;
+        break;
+    case '[':
+        if (atomic && try_link(c, w)) return;
+        break;
+    case '*':
+    case '_':
+    case '~':
+        if (try_emphasis(c, w)) return;
+        break;
+    }
+    put_char(w, &c->src, 0);
+}
+
+/* ── Chunking ─────────────────────────────────────────────────── */
+
+static void mark_save(mark_t *m, const tg_html_t *c, const writer_t *w)
+{
+    m->conv = *c;
+    m->len = w->len;
+    m->units = w->units;
+    m->visible = w->visible;
+    m->valid = true;
+}
+
+static void mark_restore(const mark_t *m, tg_html_t *c, writer_t *w)
+{
+    *c = m->conv;
+    w->len = m->len;
+    w->units = m->units;
+    w->visible = m->visible;
+    w->overflow = false;
+}
+
+void tg_html_init(tg_html_t *conv, const char *markdown)
+{
+    memset(conv, 0, sizeof(*conv));
+    conv->src = markdown ? markdown : "";
+    conv->start = conv->src;
+    conv->line_start = true;
+}
+
+size_t tg_html_next(tg_html_t *conv, char *out, size_t size, size_t max_units)
+{
+    while (*conv->src) {
+        writer_t w = { .out = out, .size = size };
+        put_open_all(conv, &w);
+        size_t base = w.len;
+        mark_t line = {0}, space = {0}, before;
+
+        while (*conv->src) {
+            mark_save(&before, conv, &w);
+            convert_token(conv, &w, true);
+            if (!w.overflow && w.units <= max_units && w.len + closing_len(conv) < size) {
+                if (w.len > base && w.out[w.len - 1] == '\n') mark_save(&line, conv, &w);
+                else if (w.len > base && w.out[w.len - 1] == ' ') mark_save(&space, conv, &w);
+                continue;
+            }
+
+            /* Full. A span that doesn't fit even an empty chunk goes
+             * character by character instead. */
+            mark_restore(&before, conv, &w);
+            if (w.len == base) {
+                convert_token(conv, &w, false);
+                continue;
+            }
+            /* Prefer ending at a line break, then a space, unless that
+             * would leave the chunk less than half full */
+            if (line.valid && line.len * 2 >= w.len) {
+                mark_restore(&line, conv, &w);
+            } else if (space.valid && space.len * 2 >= w.len) {
+                mark_restore(&space, conv, &w);
+            }
+            break;
+        }
+
+        put_close_all(conv, &w);
+        w.out[w.len] = '\0';
+        if (w.visible) return w.len;
+        /* Only markup or whitespace: Telegram rejects empty messages */
+    }
+    out[0] = '\0';
+    return 0;
+}
+
+size_t tg_html_escape(const char *text, char *out, size_t size, size_t max_units)
+{
+    writer_t w = { .out = out, .size = size };
+    const char *p = text ? text : "";
+
+    while (*p) {
+        writer_t before = w;
+        const char *next = p;
+        put_char(&w, &next, 0);
+        if (w.overflow || w.units > max_units) {
+            w = before;
+            break;
+        }
+        p = next;
+    }
+    out[w.len] = '\0';
+    return w.visible ? w.len : 0;
+}
+
+void tg_html_to_plain(char *html)
+{
+    static const struct {
+        const char *entity;
+        char c;
+    } s_entities[] = {
+        { "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' }, { "&quot;", '"' },
+    };
+
+    char *dst = html;
+    for (const char *s = html; *s; ) {
+        if (*s == '<') {
+            const char *end = strchr(s, '>');
+            if (end) {
+                s = end + 1;
+                continue;
+            }
+        }
+        if (*s == '&') {
+            bool decoded = false;
+            for (size_t i = 0; i < sizeof(s_entities) / sizeof(s_entities[0]); i++) {
+                size_t n = strlen(s_entities[i].entity);
+                if (strncmp(s, s_entities[i].entity, n) == 0) {
+                    *dst++ = s_entities[i].c;
+                    s += n;
+                    decoded = true;
+                    break;
+                }
+            }
+            if (decoded) continue;
+        }
+        *dst++ = *s++;
+    }
+    *dst = '\0';
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TG_HTML_MAX_DEPTH  8
+
+/*
+ * Markdown to Telegram HTML, one message-sized chunk at a time.
+ *
+ * Handles what LLM replies use: **bold**, __bold__, *italic*, _italic_,
+ * ~~strike~~, `code`, ``` fenced blocks ```, [links](url), # headings and
+ * "- " bullets. Markers without a partner are kept as literal text, and
+ * everything else is HTML-escaped, so Telegram always accepts the result.
+ * Chunks end at a line break or space when possible, never inside a tag
+ * or a UTF-8 sequence; tags still open at the end of a chunk are closed
+ * there and reopened at the start of the next one.
+ */
+typedef struct {
+    const char *src;                    /* unconverted Markdown */
+    const char *start;                  /* beginning of the whole text */
+    uint8_t stack[TG_HTML_MAX_DEPTH];   /* open tags, outermost first */
+    int depth;
+    bool line_start;
+    char lang[16];                      /* language of the open code block */
+} tg_html_t;
+
+/**
+ * Start converting a NUL-terminated Markdown string. The string must stay
+ * valid until conversion is done.
+ */
+void tg_html_init(tg_html_t *conv, const char *markdown);
+
+/**
+ * Produce the next chunk.
+ *
+ * @param out        Output buffer (NUL-terminated on return)
+ * @param size       Output buffer size; at least 256 bytes
+ * @param max_units  Text length limit in UTF-16 units, as Telegram counts it
+ * @return Bytes written, 0 when the input is exhausted
+ */
+size_t tg_html_next(tg_html_t *conv, char *out, size_t size, size_t max_units);
+
+/**
+ * HTML-escape text as-is, without Markdown, cut at the same limits as
+ * tg_html_next(). For replies the converter turns into nothing, such as a
+ * lone code fence.
+ *
+ * @return Bytes written, 0 if the text has nothing visible
+ */
+size_t tg_html_escape(const char *text, char *out, size_t size, size_t max_units);
+
+/**
+ * Turn converter output back into plain text in place: drop tags and
+ * decode the entities. Used only if Telegram rejects a chunk anyway.
+ */
+void tg_html_to_plain(char *html);
@@ -0,0 +1,435 @@
+#include "telegram/telegram_sender.h"
+#include "telegram/telegram_bot.h"
+#include "telegram/telegram_html.h"
+#include "mimi_config.h"
+#include "proxy/http_proxy.h"
+#include "metrics/metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_http_client.h"
+#include "esp_crt_bundle.h"
+#include "cJSON.h"
+
+static const char *TAG = "tg_send";
+
+#define TG_RESP_KEEP     1024    /* error bodies are short; success only needs "ok" */
+
+/* Token bucket: 'tokens' refills at rate per second up to burst */
+typedef struct {
+    float tokens;
+    int64_t last_us;
+} tg_bucket_t;
+
+/* One chat's queue. A lane is served by at most one worker at a time,
+ * which keeps that chat's messages in order. */
+typedef struct {
+    char chat_id[32];
+    bool busy;
+    uint8_t head;
+    uint8_t count;
+    char *pending[MIMI_TG_SEND_LANE_DEPTH];
+    tg_bucket_t bucket;
+    int64_t last_used_us;
+} tg_lane_t;
+
+/* Per-worker connection and response buffer */
+typedef struct {
+    esp_http_client_handle_t client;
+    char resp[TG_RESP_KEEP + 1];
+    size_t resp_len;
+    char *html;                 /* current chunk, MIMI_TG_HTML_BUF_SIZE bytes */
+} tg_worker_t;
+
+static tg_lane_t s_lanes[MIMI_TG_SEND_LANES];
+static tg_bucket_t s_global;
+static SemaphoreHandle_t s_lock = NULL;
+static SemaphoreHandle_t s_work = NULL;     /* counts enqueues, wakes workers */
+static int s_next_lane = 0;                 /* round-robin start */
+static bool s_started = false;
+
+/* ── Rate limiting (s_lock held) ──────────────────────────────── */
+
+static void bucket_refill(tg_bucket_t *b, float rate, float burst, int64_t now)
+{
+    b->tokens += (float)(now - b->last_us) * rate / 1e6f;
+    if (b->tokens > burst) b->tokens = burst;
+    b->last_us = now;
+}
+
+/* Microseconds until the bucket holds a whole token */
+static int64_t bucket_wait_us(const tg_bucket_t *b, float rate)
+{
+    if (b->tokens >= 1.0f) return 0;
+    return (int64_t)((1.0f - b->tokens) / rate * 1e6f) + 1;
+}
+
+static bool chat_is_group(const char *chat_id)
+{
+    return chat_id[0] == '-';
+}
+
+/* Take one global and one per-chat token, sleeping until both are there */
+static void rate_acquire(tg_lane_t *lane)
+{
+    bool group = chat_is_group(lane->chat_id);
+    float chat_rate = group ? MIMI_TG_GROUP_RATE_PER_MIN / 60.0f : MIMI_TG_CHAT_RATE_PER_S;
+
+    while (1) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        int64_t now = esp_timer_get_time();
+        bucket_refill(&s_global, MIMI_TG_GLOBAL_RATE_PER_S, MIMI_TG_GLOBAL_RATE_PER_S, now);
+        bucket_refill(&lane->bucket, chat_rate, MIMI_TG_CHAT_BURST, now);
+
+        int64_t wait = bucket_wait_us(&s_global, MIMI_TG_GLOBAL_RATE_PER_S);
+        int64_t chat_wait = bucket_wait_us(&lane->bucket, chat_rate);
+        if (chat_wait > wait) wait = chat_wait;
+        if (wait == 0) {
+            s_global.tokens -= 1.0f;
+            lane->bucket.tokens -= 1.0f;
+            xSemaphoreGive(s_lock);
+            return;
+        }
+        xSemaphoreGive(s_lock);
+
+        TickType_t ticks = pdMS_TO_TICKS(wait / 1000);
+        vTaskDelay(ticks ? ticks : 1);
+    }
+}
+
+/* ── HTTP ─────────────────────────────────────────────────────── */
+
+static esp_err_t worker_http_event(esp_http_client_event_t *evt)
+{
+    tg_worker_t *w = (tg_worker_t *)evt->user_data;
+    if (evt->event_id == HTTP_EVENT_ON_CONNECTED) {
+        metrics_inc(METRIC_TLS_TELEGRAM);
+    } else if (evt->event_id == HTTP_EVENT_ON_DATA && w->resp_len < TG_RESP_KEEP) {
+        size_t n = evt->data_len;
+        if (n > TG_RESP_KEEP - w->resp_len) n = TG_RESP_KEEP - w->resp_len;
+        memcpy(w->resp + w->resp_len, evt->data, n);
+        w->resp_len += n;
+        w->resp[w->resp_len] = '\0';
+    }
+    return ESP_OK;
+}
+
+static void worker_close(tg_worker_t *w)
+{
+    if (w->client) {
+        esp_http_client_cleanup(w->client);
+        w->client = NULL;
+    }
+}
+
+/* POST sendMessage on the worker's kept-alive connection. On a transport
+ * error the connection is rebuilt and the request retried once, since the
+ * server may have closed an idle connection. */
+static esp_err_t worker_post(tg_worker_t *w, const char *body, int *status)
+{
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (!w->client) {
+            char url[192];
+            snprintf(url, sizeof(url), "https://api.telegram.org/bot%s/sendMessage",
+                     telegram_bot_token());
+            esp_http_client_config_t config = {
+                .url = url,
+                .method = HTTP_METHOD_POST,
+                .event_handler = worker_http_event,
+                .user_data = w,
+                .timeout_ms = MIMI_TG_SEND_TIMEOUT_MS,
+                .buffer_size = 2048,
+                .buffer_size_tx = 2048,
+                .keep_alive_enable = true,
+                .crt_bundle_attach = esp_crt_bundle_attach,
+            };
+            w->client = esp_http_client_init(&config);
+            if (!w->client) return ESP_ERR_NO_MEM;
+            esp_http_client_set_header(w->client, "Content-Type", "application/json");
+        }
+
+        w->resp_len = 0;
+        w->resp[0] = '\0';
+        esp_http_client_set_post_field(w->client, body, strlen(body));
+        esp_err_t err = esp_http_client_perform(w->client);
+        if (err == ESP_OK) {
+            *status = esp_http_client_get_status_code(w->client);
+            return ESP_OK;
+        }
+        ESP_LOGW(TAG, "sendMessage transport error: %s", esp_err_to_name(err));
+        worker_close(w);
+    }
+    return ESP_FAIL;
+}
+
+/* Send one request body; the proxy path opens a tunnel per request */
+static esp_err_t send_request(tg_worker_t *w, const char *body)
+{
+    if (http_proxy_is_enabled()) {
+        char *resp = telegram_api_call("sendMessage", body);
+        if (!resp) return ESP_FAIL;
+        strlcpy(w->resp, resp, sizeof(w->resp));
+        w->resp_len = strlen(w->resp);
+        free(resp);
+        return ESP_OK;
+    }
+    int status = 0;
+    return worker_post(w, body, &status);
+}
+
+typedef enum {
+    TG_SENT = 0,
+    TG_RETRY,           /* 429: wait retry_after and send again */
+    TG_REJECTED,        /* 4xx such as bad entities: do not retry as-is */
+} tg_result_t;
+
+static tg_result_t parse_result(const char *resp, int *retry_after, char *desc, size_t desc_size)
+{
+    *retry_after = 0;
+    desc[0] = '\0';
+    if (strstr(resp, "\"ok\":true")) {
+        return TG_SENT;
+    }
+
+    cJSON *root = cJSON_Parse(resp);
+    if (!root) {
+        strlcpy(desc, "unparseable response", desc_size);
+        return TG_REJECTED;
+    }
+    const char *d = cJSON_GetStringValue(cJSON_GetObjectItem(root, "description"));
+    if (d) strlcpy(desc, d, desc_size);
+    cJSON *code = cJSON_GetObjectItem(root, "error_code");
+    cJSON *params = cJSON_GetObjectItem(root, "parameters");
+    cJSON *ra = params ? cJSON_GetObjectItem(params, "retry_after") : NULL;
+    if (cJSON_IsNumber(ra)) *retry_after = (int)ra->valuedouble;
+    bool too_many = cJSON_IsNumber(code) && (int)code->valuedouble == 429;
+    cJSON_Delete(root);
+
+    return too_many ? TG_RETRY : TG_REJECTED;
+}
+
+static char *build_body(const char *chat_id, const char *text, bool html)
+{
+    cJSON *body = cJSON_CreateObject();
+    cJSON_AddStringToObject(body, "chat_id", chat_id);
+    cJSON_AddStringToObject(body, "text", text);
+    if (html) {
+        cJSON_AddStringToObject(body, "parse_mode", "HTML");
+    }
+    char *json_str = cJSON_PrintUnformatted(body);
+    cJSON_Delete(body);
+    return json_str;
+}
+
+/* Send one converted chunk. The converter only emits markup Telegram
+ * accepts, so a rejection means a converter bug; the chunk is then sent
+ * once more as plain text rather than lost. */
+static bool send_chunk(tg_worker_t *w, tg_lane_t *lane, char *html)
+{
+    bool as_html = true;
+
+    for (int attempt = 0; attempt < MIMI_TG_SEND_RETRIES; attempt++) {
+        char *body = build_body(lane->chat_id, html, as_html);
+        if (!body) return false;
+
+        rate_acquire(lane);
+        esp_err_t err = send_request(w, body);
+        cJSON_free(body);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Send to %s failed: no HTTP response", lane->chat_id);
+            return false;
+        }
+
+        int retry_after;
+        char desc[128];
+        tg_result_t res = parse_result(w->resp, &retry_after, desc, sizeof(desc));
+        if (res == TG_SENT) {
+            ESP_LOGI(TAG, "Telegram send success to %s (%d bytes%s)", lane->chat_id,
+                     (int)strlen(html), as_html ? "" : ", plain");
+            return true;
+        }
+        if (res == TG_RETRY) {
+            if (retry_after <= 0) retry_after = 1;
+            ESP_LOGW(TAG, "Rate limited by Telegram for %s, retry in %ds", lane->chat_id, retry_after);
+            vTaskDelay(pdMS_TO_TICKS(retry_after * 1000));
+            continue;
+        }
+        if (as_html) {
+            ESP_LOGE(TAG, "HTML rejected by Telegram for %s: %s", lane->chat_id, desc);
+            tg_html_to_plain(html);
+            as_html = false;
+            continue;
+        }
+        ESP_LOGE(TAG, "Plain send failed for %s: %s", lane->chat_id, desc);
+        return false;
+    }
+    return false;
+}
+
+/* Convert the reply chunk by chunk into the worker's buffer; each chunk is
+ * one sendMessage request */
+static void send_text(tg_worker_t *w, tg_lane_t *lane, const char *text)
+{
+    tg_html_t conv;
+    tg_html_init(&conv, text);
+    bool sent_any = false;
+
+    while (tg_html_next(&conv, w->html, MIMI_TG_HTML_BUF_SIZE, MIMI_TG_MAX_MSG_LEN) > 0) {
+        sent_any = true;
+        if (!send_chunk(w, lane, w->html)) {
+            ESP_LOGE(TAG, "Dropping rest of message to %s", lane->chat_id);
+            return;
+        }
+    }
+
+    /* Markdown that converts to nothing ("```" alone): send the raw text */
+    if (!sent_any && tg_html_escape(text, w->html, MIMI_TG_HTML_BUF_SIZE, MIMI_TG_MAX_MSG_LEN) > 0) {
+        send_chunk(w, lane, w->html);
+    }
+}
+
+/* ── Workers ──────────────────────────────────────────────────── */
+
+/* Claim the next idle lane with pending messages (s_lock held) */
+static tg_lane_t *claim_lane(char **text)
+{
+    for (int n = 0; n < MIMI_TG_SEND_LANES; n++) {
+        int i = (s_next_lane + n) % MIMI_TG_SEND_LANES;
+        tg_lane_t *lane = &s_lanes[i];
+        if (lane->busy || lane->count == 0) continue;
+
+        *text = lane->pending[lane->head];
+        lane->pending[lane->head] = NULL;
+        lane->head = (lane->head + 1) % MIMI_TG_SEND_LANE_DEPTH;
+        lane->count--;
+        lane->busy = true;
+        s_next_lane = (i + 1) % MIMI_TG_SEND_LANES;
+        return lane;
+    }
+    return NULL;
+}
+
+static void send_worker_task(void *arg)
+{
+    tg_worker_t *w = calloc(1, sizeof(tg_worker_t));
+    if (w) {
+        w->html = heap_caps_malloc(MIMI_TG_HTML_BUF_SIZE, MALLOC_CAP_SPIRAM);
+        if (!w->html) {
+            free(w);
+            w = NULL;
+        }
+    }
+    if (!w) {
+        ESP_LOGE(TAG, "No memory for send worker");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    while (1) {
+        char *text = NULL;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        tg_lane_t *lane = claim_lane(&text);
+        xSemaphoreGive(s_lock);
+
+        if (!lane) {
+            /* Idle: drop the connection if nothing arrives for a while */
+            if (xSemaphoreTake(s_work, pdMS_TO_TICKS(MIMI_TG_SEND_IDLE_CLOSE_MS)) != pdTRUE) {
+                worker_close(w);
+                xSemaphoreTake(s_work, portMAX_DELAY);
+            }
+            continue;
+        }
+
+        send_text(w, lane, text);
+        free(text);
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        lane->busy = false;
+        lane->last_used_us = esp_timer_get_time();
+        xSemaphoreGive(s_lock);
+    }
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+/* Lane for chat_id: its own, else a free one, least recently used first */
+static tg_lane_t *find_lane(const char *chat_id)
+{
+    tg_lane_t *free_lane = NULL;
+    for (int i = 0; i < MIMI_TG_SEND_LANES; i++) {
+        tg_lane_t *lane = &s_lanes[i];
+        if (lane->chat_id[0] && strcmp(lane->chat_id, chat_id) == 0) {
+            return lane;
+        }
+        if (!lane->busy && lane->count == 0 &&
+            (!free_lane || lane->last_used_us < free_lane->last_used_us)) {
+            free_lane = lane;
+        }
+    }
+    if (free_lane) {
+        strlcpy(free_lane->chat_id, chat_id, sizeof(free_lane->chat_id));
+        free_lane->bucket.tokens = MIMI_TG_CHAT_BURST;
+        free_lane->bucket.last_us = esp_timer_get_time();
+    }
+    return free_lane;
+}
+
+esp_err_t telegram_sender_enqueue(const char *chat_id, char *text)
+{
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    tg_lane_t *lane = find_lane(chat_id);
+    if (!lane || lane->count == MIMI_TG_SEND_LANE_DEPTH) {
+        xSemaphoreGive(s_lock);
+        ESP_LOGW(TAG, "Send queue full for %s", chat_id);
+        return ESP_ERR_NO_MEM;
+    }
+    lane->pending[(lane->head + lane->count) % MIMI_TG_SEND_LANE_DEPTH] = text;
+    lane->count++;
+    xSemaphoreGive(s_lock);
+
+    xSemaphoreGive(s_work);
+    return ESP_OK;
+}
+
+esp_err_t telegram_sender_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    s_work = xSemaphoreCreateCounting(MIMI_TG_SEND_LANES * MIMI_TG_SEND_LANE_DEPTH, 0);
+    if (!s_lock || !s_work) return ESP_ERR_NO_MEM;
+
+    s_global.tokens = MIMI_TG_GLOBAL_RATE_PER_S;
+    s_global.last_us = esp_timer_get_time();
+    return ESP_OK;
+}
+
+esp_err_t telegram_sender_start(void)
+{
+    if (s_started) return ESP_OK;
+
+    for (int i = 0; i < MIMI_TG_SEND_WORKERS; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "tg_send%d", i);
+        BaseType_t ret = xTaskCreatePinnedToCore(
+            send_worker_task, name,
+            MIMI_TG_SEND_STACK, NULL,
+            MIMI_TG_SEND_PRIO, NULL, MIMI_TG_SEND_CORE);
+        if (ret != pdPASS) {
+            ESP_LOGE(TAG, "Failed to start send worker %d", i);
+            return i > 0 ? ESP_OK : ESP_FAIL;
+        }
+    }
+    s_started = true;
+    ESP_LOGI(TAG, "Telegram sender started (%d workers, %d chat lanes)",
+             MIMI_TG_SEND_WORKERS, MIMI_TG_SEND_LANES);
+    return ESP_OK;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "esp_err.h"
+
+/**
+ * Initialize the send queues. Called from telegram_bot_init().
+ */
+esp_err_t telegram_sender_init(void);
+
+/**
+ * Start the send workers. Called from telegram_bot_start().
+ */
+esp_err_t telegram_sender_start(void);
+
+/**
+ * Queue a message for a chat. Messages to one chat go out in order; different
+ * chats are served in parallel by MIMI_TG_SEND_WORKERS workers, each reusing
+ * one HTTPS connection. Sends are paced by token buckets for Telegram's
+ * global and per-chat limits, and a 429 is retried after retry_after.
+ *
+ * @param chat_id  Telegram chat ID (numeric string)
+ * @param text     Message text; ownership passes to the sender on ESP_OK
+ * @return ESP_OK when queued, ESP_ERR_NO_MEM when the chat's queue is full
+ *         or no queue is free
+ */
+esp_err_t telegram_sender_enqueue(const char *chat_id, char *text);
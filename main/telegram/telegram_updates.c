@@ -0,0 +1,520 @@
+#include "telegram/telegram_updates.h"
+#include "mimi_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+enum {
+    S_VALUE = 0,
+    S_AFTER,            /* after a value: ',' or a closing bracket */
+    S_KEY,
+    S_COLON,
+    S_STRING,
+    S_ESCAPE,
+    S_UNICODE,
+    S_SCALAR,           /* number, true, false or null */
+    S_DONE,
+    S_ERROR,
+};
+
+/* Where string contents go */
+enum {
+    T_SKIP = 0,
+    T_KEY,
+    T_TEXT,
+    T_CHAT_ID,
+    T_SENDER,
+};
+
+enum {
+    K_OTHER = 0,
+    K_OK,
+    K_ERROR_CODE,
+    K_RESULT,
+    K_UPDATE_ID,
+    K_MESSAGE,
+    K_MESSAGE_ID,
+    K_TEXT,
+    K_CHAT,
+    K_ID,
+    K_FROM,
+    K_FIRST_NAME,
+};
+
+static const char *const s_key_names[] = {
+    [K_OK] = "ok",
+    [K_ERROR_CODE] = "error_code",
+    [K_RESULT] = "result",
+    [K_UPDATE_ID] = "update_id",
+    [K_MESSAGE] = "message",
+    [K_MESSAGE_ID] = "message_id",
+    [K_TEXT] = "text",
+    [K_CHAT] = "chat",
+    [K_ID] = "id",
+    [K_FROM] = "from",
+    [K_FIRST_NAME] = "first_name",
+};
+
+enum {
+    F_NONE = 0,
+    F_OK,
+    F_ERROR_CODE,
+    F_UPDATE_ID,
+    F_MESSAGE_ID,
+    F_TEXT,
+    F_CHAT_ID,
+    F_SENDER,
+};
+
+/* ── Path tracking ────────────────────────────────────────────── */
+
+/* Depth of the update objects: the root of a webhook body, or the
+ * elements of getUpdates' "result" array */
+static int update_level(const tg_updates_parser_t *p)
+{
+    return p->single ? 0 : 2;
+}
+
+static bool in_update(const tg_updates_parser_t *p)
+{
+    int u = update_level(p);
+    if (p->depth <= u || p->kinds[u] != '{') return false;
+    return p->single ||
+           (p->kinds[0] == '{' && p->keys[0] == K_RESULT && p->kinds[1] == '[');
+}
+
+/* The field a value starting at the current position belongs to */
+static uint8_t value_field(const tg_updates_parser_t *p)
+{
+    int d = p->depth;
+    if (d == 0 || p->kinds[d - 1] != '{') return F_NONE;
+    uint8_t key = p->keys[d - 1];
+
+    if (!p->single && d == 1) {
+        if (key == K_OK) return F_OK;
+        if (key == K_ERROR_CODE) return F_ERROR_CODE;
+        return F_NONE;
+    }
+    if (!in_update(p)) return F_NONE;
+
+    int u = update_level(p);
+    if (d == u + 1) return key == K_UPDATE_ID ? F_UPDATE_ID : F_NONE;
+    if (p->keys[u] != K_MESSAGE) return F_NONE;
+    if (d == u + 2) {
+        if (key == K_MESSAGE_ID) return F_MESSAGE_ID;
+        if (key == K_TEXT) return F_TEXT;
+        return F_NONE;
+    }
+    if (d == u + 3 && p->keys[u + 1] == K_CHAT && key == K_ID) return F_CHAT_ID;
+    if (d == u + 3 && p->keys[u + 1] == K_FROM && key == K_FIRST_NAME) return F_SENDER;
+    return F_NONE;
+}
+
+/* ── Values ───────────────────────────────────────────────────── */
+
+static void value_done(tg_updates_parser_t *p)
+{
+    p->state = p->depth == 0 ? S_DONE : S_AFTER;
+}
+
+static void text_append(tg_updates_parser_t *p, const char *s, size_t n)
+{
+    /* Telegram caps messages well below this; keep the start of the text
+     * however it was split, and let end_string() trim a cut character */
+    if (p->text_len + n + 1 > MIMI_TG_TEXT_MAX) {
+        n = MIMI_TG_TEXT_MAX - 1 - p->text_len;
+    }
+    size_t need = p->text_len + n + 1;
+    if (need > p->text_cap) {
+        size_t cap = p->text_cap ? p->text_cap : 256;
+        while (cap < need) cap *= 2;
+        if (cap > MIMI_TG_TEXT_MAX) cap = MIMI_TG_TEXT_MAX;
+        char *tmp = realloc(p->text, cap);
+        if (!tmp) return;
+        p->text = tmp;
+        p->text_cap = cap;
+    }
+    memcpy(p->text + p->text_len, s, n);
+    p->text_len += n;
+}
+
+static void str_put(tg_updates_parser_t *p, const char *s, size_t n)
+{
+    switch (p->str_target) {
+    case T_KEY:
+        if (p->key_len + n < sizeof(p->key)) {
+            memcpy(p->key + p->key_len, s, n);
+            p->key_len += n;
+        } else {
+            p->key_len = sizeof(p->key);    /* too long to be a key we use */
+        }
+        break;
+    case T_TEXT:
+        text_append(p, s, n);
+        break;
+    case T_CHAT_ID: {
+        size_t len = strlen(p->cur.chat_id);
+        if (len + n < sizeof(p->cur.chat_id)) {
+            memcpy(p->cur.chat_id + len, s, n);
+            p->cur.chat_id[len + n] = '\0';
+        }
+        break;
+    }
+    case T_SENDER: {
+        /* Keep the start of a long name; end_string() trims a cut character */
+        size_t len = strlen(p->cur.sender);
+        size_t room = sizeof(p->cur.sender) - 1 - len;
+        if (n > room) n = room;
+        memcpy(p->cur.sender + len, s, n);
+        p->cur.sender[len + n] = '\0';
+        break;
+    }
+    }
+}
+
+static void put_codepoint(tg_updates_parser_t *p, uint32_t cp)
+{
+    char buf[4];
+    size_t n;
+    if (cp < 0x80) {
+        buf[0] = (char)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        buf[0] = (char)(0xC0 | (cp >> 6));
+        buf[1] = (char)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        buf[0] = (char)(0xE0 | (cp >> 12));
+        buf[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        buf[2] = (char)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        buf[0] = (char)(0xF0 | (cp >> 18));
+        buf[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        buf[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        buf[3] = (char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    str_put(p, buf, n);
+}
+
+/* A high surrogate not followed by a low one becomes U+FFFD */
+static void flush_surrogate(tg_updates_parser_t *p)
+{
+    if (p->high_surrogate) {
+        p->high_surrogate = 0;
+        put_codepoint(p, 0xFFFD);
+    }
+}
+
+static void escaped_codepoint(tg_updates_parser_t *p, uint32_t cp)
+{
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+        flush_surrogate(p);
+        p->high_surrogate = cp;
+        return;
+    }
+    if (cp >= 0xDC00 && cp <= 0xDFFF) {
+        if (!p->high_surrogate) {
+            put_codepoint(p, 0xFFFD);
+            return;
+        }
+        cp = 0x10000 + ((p->high_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+        p->high_surrogate = 0;
+    } else {
+        flush_surrogate(p);
+    }
+    put_codepoint(p, cp);
+}
+
+static void begin_string(tg_updates_parser_t *p, uint8_t target)
+{
+    p->str_target = target;
+    p->high_surrogate = 0;
+    if (target == T_KEY) {
+        p->key_len = 0;
+    } else if (target == T_TEXT) {
+        p->has_text = true;
+        p->text_len = 0;
+        text_append(p, "", 0);      /* make sure the buffer exists */
+    } else if (target == T_CHAT_ID) {
+        p->cur.chat_id[0] = '\0';
+    } else if (target == T_SENDER) {
+        p->cur.sender[0] = '\0';
+    }
+    p->state = S_STRING;
+}
+
+/* Length of s without a UTF-8 sequence cut short by truncation */
+static size_t trim_utf8(const char *s, size_t len)
+{
+    size_t i = len;
+    while (i > 0 && ((unsigned char)s[i - 1] & 0xC0) == 0x80) i--;
+    if (i == 0) return len;
+    unsigned char lead = (unsigned char)s[i - 1];
+    size_t want = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+    return len - (i - 1) < want ? i - 1 : len;
+}
+
+static void end_string(tg_updates_parser_t *p)
+{
+    flush_surrogate(p);
+    if (p->str_target == T_SENDER) {
+        p->cur.sender[trim_utf8(p->cur.sender, strlen(p->cur.sender))] = '\0';
+    } else if (p->str_target == T_TEXT && p->text) {
+        p->text_len = trim_utf8(p->text, p->text_len);
+    }
+    if (p->str_target != T_KEY) {
+        value_done(p);
+        return;
+    }
+
+    uint8_t id = K_OTHER;
+    if (p->key_len < sizeof(p->key)) {
+        p->key[p->key_len] = '\0';
+        for (size_t i = 1; i < sizeof(s_key_names) / sizeof(s_key_names[0]); i++) {
+            if (strcmp(p->key, s_key_names[i]) == 0) {
+                id = (uint8_t)i;
+                break;
+            }
+        }
+    }
+    p->keys[p->depth - 1] = id;
+    p->state = S_COLON;
+}
+
+static void escape_char(tg_updates_parser_t *p, char c)
+{
+    p->state = S_STRING;
+    switch (c) {
+    case 'n': c = '\n'; break;
+    case 't': c = '\t'; break;
+    case 'r': c = '\r'; break;
+    case 'b': c = '\b'; break;
+    case 'f': c = '\f'; break;
+    case 'u':
+        p->uchar = 0;
+        p->uchar_digits = 0;
+        p->state = S_UNICODE;
+        return;
+    default: break;             /* '"', '\\', '/' stand for themselves */
+    }
+    flush_surrogate(p);
+    str_put(p, &c, 1);
+}
+
+static void unicode_digit(tg_updates_parser_t *p, char c)
+{
+    int v;
+    if (c >= '0' && c <= '9') v = c - '0';
+    else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+    else {
+        p->state = S_ERROR;
+        return;
+    }
+    p->uchar = (p->uchar << 4) | (uint32_t)v;
+    if (++p->uchar_digits == 4) {
+        escaped_codepoint(p, p->uchar);
+        p->state = S_STRING;
+    }
+}
+
+static void finish_scalar(tg_updates_parser_t *p)
+{
+    p->scalar[p->scalar_len] = '\0';
+    switch (p->scalar_field) {
+    case F_OK:
+        p->ok = strcmp(p->scalar, "true") == 0;
+        break;
+    case F_ERROR_CODE:
+        p->error_code = atoi(p->scalar);
+        break;
+    case F_UPDATE_ID:
+        p->cur.update_id = strtoll(p->scalar, NULL, 10);
+        break;
+    case F_MESSAGE_ID:
+        p->cur.message_id = atoi(p->scalar);
+        break;
+    case F_CHAT_ID:
+        strlcpy(p->cur.chat_id, p->scalar, sizeof(p->cur.chat_id));
+        break;
+    }
+    value_done(p);
+}
+
+/* ── Containers ───────────────────────────────────────────────── */
+
+static void start_update(tg_updates_parser_t *p)
+{
+    p->cur.update_id = -1;
+    p->cur.message_id = -1;
+    p->cur.chat_id[0] = '\0';
+    p->cur.sender[0] = '\0';
+    p->cur.text = NULL;
+    p->has_text = false;
+    p->text_len = 0;
+}
+
+static void emit_update(tg_updates_parser_t *p)
+{
+    p->cur.text = NULL;
+    if (p->has_text && p->text) {
+        p->text[p->text_len] = '\0';
+        p->cur.text = p->text;
+    }
+    if (p->cb) {
+        p->cb(&p->cur, p->ctx);
+    }
+}
+
+static void open_container(tg_updates_parser_t *p, char kind)
+{
+    if (p->depth == TG_UPDATES_MAX_DEPTH) {
+        p->state = S_ERROR;
+        return;
+    }
+    p->kinds[p->depth] = (uint8_t)kind;
+    p->keys[p->depth] = K_OTHER;
+    p->depth++;
+    if (p->depth == update_level(p) + 1 && in_update(p)) {
+        start_update(p);
+    }
+    p->state = kind == '{' ? S_KEY : S_VALUE;
+}
+
+static void close_container(tg_updates_parser_t *p, char kind)
+{
+    if (p->depth == 0 || p->kinds[p->depth - 1] != (uint8_t)kind) {
+        p->state = S_ERROR;
+        return;
+    }
+    if (p->depth == update_level(p) + 1 && in_update(p)) {
+        emit_update(p);
+    }
+    p->depth--;
+    value_done(p);
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+void tg_updates_init(tg_updates_parser_t *p, bool single, tg_update_cb_t cb, void *ctx)
+{
+    memset(p, 0, sizeof(*p));
+    p->single = single;
+    p->cb = cb;
+    p->ctx = ctx;
+    tg_updates_reset(p);
+}
+
+void tg_updates_reset(tg_updates_parser_t *p)
+{
+    p->state = S_VALUE;
+    p->depth = 0;
+    p->ok = false;
+    p->error_code = 0;
+    p->high_surrogate = 0;
+    start_update(p);
+}
+
+void tg_updates_feed(tg_updates_parser_t *p, const char *data, size_t len)
+{
+    size_t i = 0;
+    while (i < len && p->state != S_DONE && p->state != S_ERROR) {
+        char c = data[i];
+
+        switch (p->state) {
+        case S_STRING: {
+            /* Copy plain runs in one go */
+            size_t j = i;
+            while (j < len && data[j] != '"' && data[j] != '\\') j++;
+            if (j > i) {
+                flush_surrogate(p);
+                str_put(p, data + i, j - i);
+                i = j;
+                continue;
+            }
+            i++;
+            if (c == '"') end_string(p);
+            else p->state = S_ESCAPE;
+            continue;
+        }
+        case S_ESCAPE:
+            i++;
+            escape_char(p, c);
+            continue;
+        case S_UNICODE:
+            i++;
+            unicode_digit(p, c);
+            continue;
+        case S_SCALAR:
+            if (isalnum((unsigned char)c) || c == '-' || c == '+' || c == '.') {
+                if (p->scalar_len < sizeof(p->scalar) - 1) {
+                    p->scalar[p->scalar_len++] = c;
+                }
+                i++;
+            } else {
+                finish_scalar(p);   /* c is looked at again in the new state */
+            }
+            continue;
+        default:
+            break;
+        }
+
+        i++;
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') continue;
+
+        switch (p->state) {
+        case S_VALUE:
+            if (c == '{' || c == '[') {
+                open_container(p, c);
+            } else if (c == '"') {
+                uint8_t field = value_field(p);
+                begin_string(p, field == F_TEXT ? T_TEXT :
+                                field == F_CHAT_ID ? T_CHAT_ID :
+                                field == F_SENDER ? T_SENDER : T_SKIP);
+            } else if (c == ']') {
+                close_container(p, '[');    /* empty array */
+            } else if (c == '-' || isdigit((unsigned char)c) || c == 't' || c == 'f' || c == 'n') {
+                p->scalar_field = value_field(p);
+                p->scalar[0] = c;
+                p->scalar_len = 1;
+                p->state = S_SCALAR;
+            } else {
+                p->state = S_ERROR;
+            }
+            break;
+        case S_KEY:
+            if (c == '"') begin_string(p, T_KEY);
+            else if (c == '}') close_container(p, '{');
+            else p->state = S_ERROR;
+            break;
+        case S_COLON:
+            p->state = c == ':' ? S_VALUE : S_ERROR;
+            break;
+        case S_AFTER:
+            if (c == ',') {
+                p->state = p->kinds[p->depth - 1] == '{' ? S_KEY : S_VALUE;
+            } else if (c == '}' || c == ']') {
+                close_container(p, c == '}' ? '{' : '[');
+            } else {
+                p->state = S_ERROR;
+            }
+            break;
+        }
+    }
+}
+
+bool tg_updates_done(const tg_updates_parser_t *p)
+{
+    return p->state == S_DONE;
+}
+
+void tg_updates_free(tg_updates_parser_t *p)
+{
+    free(p->text);
+    p->text = NULL;
+    p->text_len = 0;
+    p->text_cap = 0;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TG_UPDATES_MAX_DEPTH  16
+
+/* The fields of one Update that the bot uses */
+typedef struct {
+    int64_t update_id;          /* -1 if absent */
+    int message_id;             /* -1 if absent */
+    char chat_id[32];           /* empty if absent */
+    char sender[24];            /* from.first_name, truncated; empty if absent */
+    const char *text;           /* message text, NULL if none */
+} tg_update_t;
+
+typedef void (*tg_update_cb_t)(const tg_update_t *update, void *ctx);
+
+/*
+ * Incremental parser for getUpdates responses and webhook bodies. Data is
+ * fed as it arrives and each update is reported as soon as its object
+ * closes; only the current update's text is held in memory, and every
+ * other field is skipped without being stored.
+ */
+typedef struct {
+    /* Tokenizer */
+    uint8_t state;
+    uint8_t str_target;
+    int depth;
+    uint8_t kinds[TG_UPDATES_MAX_DEPTH];
+    uint8_t keys[TG_UPDATES_MAX_DEPTH]; /* current key in each object */
+    char key[16];
+    uint8_t key_len;
+    char scalar[24];                    /* number or literal being read */
+    uint8_t scalar_len;
+    uint8_t scalar_field;
+    uint32_t uchar;                     /* \uXXXX escape being read */
+    uint8_t uchar_digits;
+    uint32_t high_surrogate;
+
+    /* Current update */
+    bool single;                        /* the root object is the update */
+    tg_update_t cur;
+    bool has_text;
+    char *text;
+    size_t text_len;
+    size_t text_cap;
+
+    /* Response envelope */
+    bool ok;
+    int error_code;
+
+    tg_update_cb_t cb;
+    void *ctx;
+} tg_updates_parser_t;
+
+/**
+ * Prepare a parser.
+ * @param single  true for a webhook body (one Update object), false for a
+ *                getUpdates response ({"ok":..,"result":[Update, ..]})
+ */
+void tg_updates_init(tg_updates_parser_t *p, bool single, tg_update_cb_t cb, void *ctx);
+
+/** Start a new document, keeping the text buffer for reuse. */
+void tg_updates_reset(tg_updates_parser_t *p);
+
+/** Feed the next piece of the document. */
+void tg_updates_feed(tg_updates_parser_t *p, const char *data, size_t len);
+
+/** Whether the document was complete and well-formed. */
+bool tg_updates_done(const tg_updates_parser_t *p);
+
+/** Release the text buffer. */
+void tg_updates_free(tg_updates_parser_t *p);
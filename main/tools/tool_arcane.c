@@ -1,5 +1,6 @@
 #include "tool_arcane.h"
 #include "mimi_config.h"
+#include "deadline/deadline.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -43,6 +44,12 @@ static int arcane_request(const char *url, esp_http_client_method_t method,
     arcane_body_t body = { .buf = out, .len = 0, .max = (int)out_size };
     out[0] = '\0';
 
+    timeout_ms = deadline_clamp_ms(timeout_ms);
+    if (timeout_ms == 0) {
+        snprintf(out, out_size, "Error: time budget for this request is used up");
+        return -1;
+    }
+
     esp_http_client_config_t cfg = {
         .url           = url,
         .method        = method,
@@ -0,0 +1,379 @@
+#include "tools/tool_cache.h"
+#include "mimi_config.h"
+#include "deadline/deadline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "cJSON.h"
+
+static const char *TAG = "tool_cache";
+
+#define CACHE_MAX_KEY_ITEMS  16     /* object members sorted per level */
+
+/* Which calls may be served from the cache. action == NULL matches any input;
+ * otherwise the input's "action" must equal it. */
+typedef struct {
+    const char *tool;
+    const char *action;
+    uint32_t ttl_s;
+} cache_policy_t;
+
+static const cache_policy_t s_policies[] = {
+    { "web_search",    NULL,         MIMI_TOOL_CACHE_TTL_SEARCH_S },
+    { "http_get",      NULL,         MIMI_TOOL_CACHE_TTL_HTTP_S },
+    { "docker_status", "counts",     MIMI_TOOL_CACHE_TTL_DOCKER_S },
+    { "docker_status", "status",     MIMI_TOOL_CACHE_TTL_DOCKER_S },
+    { "docker_status", "containers", MIMI_TOOL_CACHE_TTL_DOCKER_S },
+    { "docker_status", "stacks",     MIMI_TOOL_CACHE_TTL_DOCKER_S },
+};
+
+typedef enum {
+    SLOT_EMPTY = 0,
+    SLOT_PENDING,       /* owner is executing the call */
+    SLOT_READY,
+} slot_state_t;
+
+typedef struct {
+    slot_state_t state;
+    uint32_t gen;
+    uint32_t hash;
+    uint32_t ttl_s;
+    char *key;          /* "<tool>\n<canonical input>" */
+    char *value;
+    size_t bytes;       /* key + value, counted against the budget when READY */
+    int64_t expires_us;
+    int64_t last_used_us;
+    bool stale;         /* invalidated while PENDING, do not store the result */
+    int waiters;
+    SemaphoreHandle_t done;
+} cache_slot_t;
+
+static cache_slot_t s_slots[MIMI_TOOL_CACHE_SLOTS];
+static SemaphoreHandle_t s_lock = NULL;
+static size_t s_bytes = 0;
+
+static char *psram_strdup(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *p = heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+    if (p) memcpy(p, s, len);
+    return p;
+}
+
+static uint32_t fnv1a(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* ── Key normalisation ─────────────────────────────────────── */
+
+static void collapse_ws(char *s)
+{
+    char *w = s;
+    bool space = true;      /* drops leading whitespace */
+    for (char *r = s; *r; r++) {
+        if (isspace((unsigned char)*r)) {
+            if (!space) *w++ = ' ';
+            space = true;
+        } else {
+            *w++ = *r;
+            space = false;
+        }
+    }
+    if (w > s && w[-1] == ' ') w--;
+    *w = '\0';
+}
+
+static int cmp_member(const void *a, const void *b)
+{
+    const cJSON *x = *(const cJSON *const *)a;
+    const cJSON *y = *(const cJSON *const *)b;
+    return strcmp(x->string ? x->string : "", y->string ? y->string : "");
+}
+
+static void canonicalise(cJSON *item)
+{
+    if (cJSON_IsString(item) && item->valuestring) {
+        collapse_ws(item->valuestring);
+        return;
+    }
+    if (!cJSON_IsObject(item) && !cJSON_IsArray(item)) return;
+
+    for (cJSON *c = item->child; c; c = c->next) {
+        canonicalise(c);
+    }
+    if (!cJSON_IsObject(item)) return;
+
+    cJSON *members[CACHE_MAX_KEY_ITEMS];
+    int n = 0;
+    for (cJSON *c = item->child; c; c = c->next) {
+        if (n == CACHE_MAX_KEY_ITEMS) return;   /* leave oversized objects as-is */
+        members[n++] = c;
+    }
+    if (n < 2) return;
+
+    qsort(members, n, sizeof(members[0]), cmp_member);
+    item->child = members[0];
+    for (int i = 0; i < n; i++) {
+        members[i]->prev = (i == 0) ? members[n - 1] : members[i - 1];
+        members[i]->next = (i == n - 1) ? NULL : members[i + 1];
+    }
+}
+
+/* Returns the TTL for this call, 0 if it is not cacheable. *has_policy tells
+ * whether the tool has any cacheable calls at all. */
+static uint32_t policy_ttl(const char *tool, cJSON *input, bool *has_policy)
+{
+    const char *action = cJSON_GetStringValue(cJSON_GetObjectItem(input, "action"));
+    *has_policy = false;
+    for (size_t i = 0; i < sizeof(s_policies) / sizeof(s_policies[0]); i++) {
+        const cache_policy_t *p = &s_policies[i];
+        if (strcmp(p->tool, tool) != 0) continue;
+        *has_policy = true;
+        if (!p->action || (action && strcmp(p->action, action) == 0)) {
+            return p->ttl_s;
+        }
+    }
+    return 0;
+}
+
+/* ── Slot management (s_lock held) ─────────────────────────── */
+
+static void slot_clear(cache_slot_t *s)
+{
+    if (s->state == SLOT_READY) s_bytes -= s->bytes;
+    free(s->key);
+    free(s->value);
+    s->key = NULL;
+    s->value = NULL;
+    s->bytes = 0;
+    s->state = SLOT_EMPTY;
+}
+
+static cache_slot_t *slot_find(uint32_t hash, const char *key)
+{
+    for (int i = 0; i < MIMI_TOOL_CACHE_SLOTS; i++) {
+        cache_slot_t *s = &s_slots[i];
+        if (s->state != SLOT_EMPTY && s->hash == hash && strcmp(s->key, key) == 0) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+/* Least recently used READY slot other than `keep`, preferring expired ones */
+static cache_slot_t *slot_victim(const cache_slot_t *keep)
+{
+    int64_t now = esp_timer_get_time();
+    cache_slot_t *victim = NULL;
+    for (int i = 0; i < MIMI_TOOL_CACHE_SLOTS; i++) {
+        cache_slot_t *s = &s_slots[i];
+        if (s == keep || s->state != SLOT_READY || s->waiters > 0) continue;
+        if (s->expires_us <= now) return s;
+        if (!victim || s->last_used_us < victim->last_used_us) victim = s;
+    }
+    return victim;
+}
+
+static cache_slot_t *slot_claim(void)
+{
+    for (int i = 0; i < MIMI_TOOL_CACHE_SLOTS; i++) {
+        /* Waiters of a just-finished call still hold on to the slot */
+        if (s_slots[i].state == SLOT_EMPTY && s_slots[i].waiters == 0) return &s_slots[i];
+    }
+    cache_slot_t *victim = slot_victim(NULL);
+    if (victim) slot_clear(victim);
+    return victim;
+}
+
+/* ── Public API ───────────────────────────────────────────── */
+
+esp_err_t tool_cache_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+
+    for (int i = 0; i < MIMI_TOOL_CACHE_SLOTS; i++) {
+        s_slots[i].done = xSemaphoreCreateCounting(MIMI_TOOL_CACHE_MAX_WAITERS, 0);
+        if (!s_slots[i].done) return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Tool cache: %d slots, %d KB budget",
+             MIMI_TOOL_CACHE_SLOTS, MIMI_TOOL_CACHE_BUDGET / 1024);
+    return ESP_OK;
+}
+
+tool_cache_result_t tool_cache_begin(const char *tool, const char *input_json,
+                                     char *output, size_t output_size,
+                                     tool_cache_ticket_t *ticket)
+{
+    if (!s_lock) return TOOL_CACHE_BYPASS;
+
+    cJSON *input = cJSON_Parse(input_json ? input_json : "{}");
+    if (!input) return TOOL_CACHE_BYPASS;
+
+    bool has_policy = false;
+    uint32_t ttl_s = policy_ttl(tool, input, &has_policy);
+    if (ttl_s == 0) {
+        cJSON_Delete(input);
+        if (has_policy) tool_cache_invalidate(tool);
+        return TOOL_CACHE_BYPASS;
+    }
+
+    canonicalise(input);
+    char *canon = cJSON_PrintUnformatted(input);
+    cJSON_Delete(input);
+    if (!canon) return TOOL_CACHE_BYPASS;
+
+    size_t key_len = strlen(tool) + 1 + strlen(canon) + 1;
+    char *key = heap_caps_malloc(key_len, MALLOC_CAP_SPIRAM);
+    if (!key) {
+        cJSON_free(canon);
+        return TOOL_CACHE_BYPASS;
+    }
+    snprintf(key, key_len, "%s\n%s", tool, canon);
+    cJSON_free(canon);
+    uint32_t hash = fnv1a(key);
+
+    tool_cache_result_t result = TOOL_CACHE_BYPASS;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    cache_slot_t *s = slot_find(hash, key);
+    if (s && s->state == SLOT_PENDING) {
+        /* Identical call in flight: wait for its owner to finish */
+        if (s->waiters < MIMI_TOOL_CACHE_MAX_WAITERS) {
+            s->waiters++;
+            xSemaphoreGive(s_lock);
+            int wait_ms = deadline_clamp_ms(MIMI_TOOL_CACHE_WAIT_MS);
+            bool woke = xSemaphoreTake(s->done, pdMS_TO_TICKS(wait_ms)) == pdTRUE;
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            s->waiters--;
+            if (!woke) {
+                ESP_LOGW(TAG, "Timed out waiting for in-flight %s", tool);
+            }
+        }
+        /* The slot may now hold the result, be empty (owner failed) or
+         * belong to another key entirely */
+        s = slot_find(hash, key);
+        if (!s || s->state == SLOT_PENDING) goto claim_or_bypass;
+    }
+
+    if (s && s->state == SLOT_READY) {
+        int64_t now = esp_timer_get_time();
+        if (s->expires_us > now) {
+            strlcpy(output, s->value, output_size);
+            s->last_used_us = now;
+            ESP_LOGI(TAG, "Hit: %s (%d bytes, expires in %ds)", tool, (int)strlen(s->value),
+                     (int)((s->expires_us - now) / 1000000));
+            result = TOOL_CACHE_HIT;
+            goto out;
+        }
+        slot_clear(s);
+    }
+
+claim_or_bypass:
+    if (slot_find(hash, key)) goto out;     /* someone else claimed it meanwhile */
+    s = slot_claim();
+    if (!s) goto out;                       /* every slot is in flight */
+
+    while (xSemaphoreTake(s->done, 0) == pdTRUE) {
+        /* drain wake-ups left over from waiters that timed out */
+    }
+    s->state = SLOT_PENDING;
+    s->stale = false;
+    s->gen++;
+    s->hash = hash;
+    s->ttl_s = ttl_s;
+    s->key = key;
+    key = NULL;
+    ticket->slot = s - s_slots;
+    ticket->gen = s->gen;
+    result = TOOL_CACHE_MISS;
+
+out:
+    xSemaphoreGive(s_lock);
+    free(key);
+    return result;
+}
+
+void tool_cache_end(const tool_cache_ticket_t *ticket, esp_err_t err, const char *output)
+{
+    if (!s_lock || !ticket || ticket->slot < 0 || ticket->slot >= MIMI_TOOL_CACHE_SLOTS) return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    cache_slot_t *s = &s_slots[ticket->slot];
+    if (s->state != SLOT_PENDING || s->gen != ticket->gen) {
+        xSemaphoreGive(s_lock);
+        return;
+    }
+
+    bool store = !s->stale && err == ESP_OK && output && strncmp(output, "Error", 5) != 0;
+    size_t bytes = store ? strlen(s->key) + strlen(output) + 2 : 0;
+    if (store && bytes > MIMI_TOOL_CACHE_BUDGET / 2) {
+        store = false;      /* one oversized result would flush everything else */
+    }
+    if (store) {
+        s->value = psram_strdup(output);
+        store = s->value != NULL;
+    }
+
+    if (store) {
+        while (s_bytes + bytes > MIMI_TOOL_CACHE_BUDGET) {
+            cache_slot_t *victim = slot_victim(s);
+            if (!victim) break;
+            slot_clear(victim);
+        }
+        int64_t now = esp_timer_get_time();
+        s->state = SLOT_READY;
+        s->bytes = bytes;
+        s->last_used_us = now;
+        s->expires_us = now + (int64_t)s->ttl_s * 1000000;
+        s_bytes += bytes;
+    } else {
+        slot_clear(s);
+    }
+
+    for (int i = 0; i < s->waiters; i++) {
+        xSemaphoreGive(s->done);
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void tool_cache_invalidate(const char *tool)
+{
+    if (!s_lock) return;
+
+    size_t len = strlen(tool);
+    int dropped = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < MIMI_TOOL_CACHE_SLOTS; i++) {
+        cache_slot_t *s = &s_slots[i];
+        if (s->state == SLOT_EMPTY || strncmp(s->key, tool, len) != 0 || s->key[len] != '\n') {
+            continue;
+        }
+        if (s->state == SLOT_PENDING) {
+            s->stale = true;    /* result of the in-flight call will not be stored */
+            continue;
+        }
+        slot_clear(s);
+        dropped++;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (dropped) {
+        ESP_LOGI(TAG, "Invalidated %d cached %s result(s)", dropped, tool);
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum {
+    TOOL_CACHE_BYPASS = 0,  /* call is not cacheable, execute normally */
+    TOOL_CACHE_HIT,         /* output filled from the cache */
+    TOOL_CACHE_MISS,        /* caller must execute, then call tool_cache_end() */
+} tool_cache_result_t;
+
+typedef struct {
+    int slot;
+    uint32_t gen;
+} tool_cache_ticket_t;
+
+/**
+ * Initialize the tool result cache (entries live in PSRAM).
+ */
+esp_err_t tool_cache_init(void);
+
+/**
+ * Look up a tool call in the cache.
+ *
+ * The key is (tool, input) with input normalised: object keys sorted and
+ * whitespace in string values collapsed. If an identical call is already
+ * running on another task, this waits for it and returns its result.
+ * A call to a cached tool that matches no cache policy (e.g. a container
+ * restart) is treated as a state change and drops that tool's entries.
+ *
+ * @param tool         Tool name
+ * @param input_json   Tool input JSON
+ * @param output       Receives the cached result on TOOL_CACHE_HIT
+ * @param output_size  Output buffer size
+ * @param ticket       Filled on TOOL_CACHE_MISS; pass to tool_cache_end()
+ */
+tool_cache_result_t tool_cache_begin(const char *tool, const char *input_json,
+                                     char *output, size_t output_size,
+                                     tool_cache_ticket_t *ticket);
+
+/**
+ * Finish a call that missed: store the result (only when err is ESP_OK)
+ * and wake any tasks waiting on the same call.
+ */
+void tool_cache_end(const tool_cache_ticket_t *ticket, esp_err_t err, const char *output);
+
+/**
+ * Drop all cached results for a tool, e.g. after a call that changes state.
+ */
+void tool_cache_invalidate(const char *tool);
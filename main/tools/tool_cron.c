@@ -86,8 +86,21 @@ esp_err_t tool_cron_add_execute(const char *input_json, char *output, size_t out
         /* Default: delete one-shot jobs after run */
         cJSON *delete_j = cJSON_GetObjectItem(root, "delete_after_run");
         job.delete_after_run = delete_j ? cJSON_IsTrue(delete_j) : true;
+    } else if (strcmp(schedule_type, "cron") == 0) {
+        job.kind = CRON_KIND_CRON;
+        const char *expr = cJSON_GetStringValue(cJSON_GetObjectItem(root, "expr"));
+        if (!expr || strlen(expr) >= sizeof(job.expr) ||
+            cron_expr_parse(expr, &job.cron) != ESP_OK) {
+            snprintf(output, output_size,
+                     "Error: 'cron' schedule requires a valid 5-field 'expr' "
+                     "(minute hour day-of-month month day-of-week, e.g. \"0 8 * * mon-fri\")");
+            cJSON_Delete(root);
+            return ESP_ERR_INVALID_ARG;
+        }
+        strncpy(job.expr, expr, sizeof(job.expr) - 1);
+        job.delete_after_run = false;
     } else {
-        snprintf(output, output_size, "Error: schedule_type must be 'every' or 'at'");
+        snprintf(output, output_size, "Error: schedule_type must be 'every', 'at' or 'cron'");
         cJSON_Delete(root);
         return ESP_ERR_INVALID_ARG;
     }
@@ -105,6 +118,10 @@ esp_err_t tool_cron_add_execute(const char *input_json, char *output, size_t out
         snprintf(output, output_size,
                  "OK: Added recurring job '%s' (id=%s), runs every %lu seconds. Next run at epoch %lld.",
                  job.name, job.id, (unsigned long)job.interval_s, (long long)job.next_run);
+    } else if (job.kind == CRON_KIND_CRON) {
+        snprintf(output, output_size,
+                 "OK: Added cron job '%s' (id=%s), schedule '%s' (local time). Next run at epoch %lld.",
+                 job.name, job.id, job.expr, (long long)job.next_run);
     } else {
         snprintf(output, output_size,
                  "OK: Added one-shot job '%s' (id=%s), fires at epoch %lld.%s",
@@ -146,6 +163,13 @@ esp_err_t tool_cron_list_execute(const char *input_json, char *output, size_t ou
                 j->enabled ? "enabled" : "disabled",
                 (long long)j->next_run, (long long)j->last_run,
                 j->channel, j->chat_id);
+        } else if (j->kind == CRON_KIND_CRON) {
+            off += snprintf(output + off, output_size - off,
+                "  %d. [%s] \"%s\" — cron '%s', %s, next=%lld, last=%lld, ch=%s:%s\n",
+                i + 1, j->id, j->name, j->expr,
+                j->enabled ? "enabled" : "disabled",
+                (long long)j->next_run, (long long)j->last_run,
+                j->channel, j->chat_id);
         } else {
             off += snprintf(output + off, output_size - off,
                 "  %d. [%s] \"%s\" — at %lld, %s, last=%lld, ch=%s:%s%s\n",
@@ -1,18 +1,23 @@
 #include "tools/tool_files.h"
 #include "mimi_config.h"
+#include "memory/memory_index.h"
+#include "memory/memory_vec.h"
+#include "storage/storage.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
-#include <dirent.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include "esp_log.h"
 #include "cJSON.h"
 
 static const char *TAG = "tool_files";
 
-#define MAX_FILE_SIZE (32 * 1024)
+#define FILE_CHUNK_SIZE   4096
+#define MAX_OLD_STRING    FILE_CHUNK_SIZE
+#define READ_FOOTER_MAX   160     /* room kept for the continuation hint */
 
 /**
  * Validate that a path starts with /spiffs/ and contains no ".." traversal.
@@ -25,8 +30,95 @@ static bool validate_path(const char *path)
     return true;
 }
 
+static long json_int(cJSON *root, const char *key, long def)
+{
+    cJSON *item = cJSON_GetObjectItem(root, key);
+    return cJSON_IsNumber(item) ? (long)item->valuedouble : def;
+}
+
+/* ── Atomic writes ─────────────────────────────────────────── */
+
+/* Writers fill "<path>.tmp" and rename it over the target once complete, so a
+ * reset mid-write leaves either the old file or the new one, never a stub. */
+static FILE *tmp_open(const char *path, char *tmp, size_t tmp_size)
+{
+    if (snprintf(tmp, tmp_size, "%s.tmp", path) >= (int)tmp_size) return NULL;
+    storage_ensure_parent(path);
+    return fopen(tmp, "w");
+}
+
+static esp_err_t tmp_commit(FILE *f, const char *tmp, const char *path, bool ok)
+{
+    if (ok) {
+        ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+    }
+    if (fclose(f) != 0) ok = false;
+    if (ok && storage_replace(tmp, path) == ESP_OK) {
+        return ESP_OK;
+    }
+    remove(tmp);
+    return ESP_FAIL;
+}
+
+static void file_changed(const char *path)
+{
+    memory_index_update_file(path);
+    memory_vec_queue_file(path);
+}
+
 /* ── read_file ─────────────────────────────────────────────── */
 
+/* Copy lines [first, last] (1-based, last <= 0 means to EOF) into out */
+static void read_lines(FILE *f, long first, long last, char *out, size_t cap,
+                       char *footer, size_t footer_size)
+{
+    size_t off = 0;
+    long line = 1;
+    long shown_last = 0;
+    bool at_line_start = true;
+    bool truncated = false;
+    char chunk[256];
+
+    size_t n;
+    while (!truncated && (n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            if (last > 0 && line > last) break;
+            if (line >= first) {
+                if (off + 1 >= cap) {
+                    truncated = true;
+                    break;
+                }
+                out[off++] = chunk[i];
+                shown_last = line;
+            }
+            at_line_start = chunk[i] == '\n';
+            if (at_line_start) line++;
+        }
+        if (last > 0 && line > last) break;
+    }
+    out[off] = '\0';
+
+    if (truncated) {
+        /* Drop the partial line so the hint can resume cleanly */
+        if (out[off - 1] != '\n') {
+            char *nl = strrchr(out, '\n');
+            if (!nl) {
+                snprintf(footer, footer_size,
+                         "\n[line %ld is longer than the output; read it with offset/length]", first);
+                return;
+            }
+            nl[1] = '\0';
+            shown_last--;
+        }
+        snprintf(footer, footer_size,
+                 "[truncated after line %ld; continue with start_line=%ld]",
+                 shown_last, shown_last + 1);
+    } else if (shown_last == 0) {
+        snprintf(footer, footer_size, "[no lines in range; file has %ld lines]",
+                 at_line_start ? line - 1 : line);
+    }
+}
+
 esp_err_t tool_read_file_execute(const char *input_json, char *output, size_t output_size)
 {
     cJSON *root = cJSON_Parse(input_json);
@@ -42,21 +134,64 @@ esp_err_t tool_read_file_execute(const char *input_json, char *output, size_t ou
         return ESP_ERR_INVALID_ARG;
     }
 
+    long offset = json_int(root, "offset", 0);
+    long length = json_int(root, "length", 0);
+    long start_line = json_int(root, "start_line", 0);
+    long end_line = json_int(root, "end_line", 0);
+    if (offset < 0 || length < 0 || start_line < 0 || end_line < 0 ||
+        (end_line > 0 && end_line < start_line)) {
+        snprintf(output, output_size, "Error: offset, length and line numbers must be non-negative");
+        cJSON_Delete(root);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct stat st;
     FILE *f = fopen(path, "r");
-    if (!f) {
+    if (!f || stat(path, &st) != 0) {
+        if (f) fclose(f);
         snprintf(output, output_size, "Error: file not found: %s", path);
         cJSON_Delete(root);
         return ESP_ERR_NOT_FOUND;
     }
+    long file_size = (long)st.st_size;
 
-    size_t max_read = output_size - 1;
-    if (max_read > MAX_FILE_SIZE) max_read = MAX_FILE_SIZE;
-
-    size_t n = fread(output, 1, max_read, f);
-    output[n] = '\0';
+    if (output_size <= READ_FOOTER_MAX + 1) {
+        fclose(f);
+        snprintf(output, output_size, "Error: output buffer too small");
+        cJSON_Delete(root);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    size_t cap = output_size - READ_FOOTER_MAX;
+    char footer[READ_FOOTER_MAX];
+    footer[0] = '\0';
+
+    if (start_line > 0 || end_line > 0) {
+        read_lines(f, start_line > 0 ? start_line : 1, end_line, output, cap,
+                   footer, sizeof(footer));
+    } else {
+        if (offset > file_size) offset = file_size;
+        long avail = file_size - offset;
+        size_t want = (length > 0 && length < avail) ? (size_t)length : (size_t)avail;
+        if (want > cap - 1) want = cap - 1;
+
+        fseek(f, offset, SEEK_SET);
+        size_t n = fread(output, 1, want, f);
+        output[n] = '\0';
+
+        long end = offset + (long)n;
+        if (end < file_size && (length == 0 || end < offset + length)) {
+            snprintf(footer, sizeof(footer),
+                     "\n[truncated: bytes %ld-%ld of %ld; continue with offset=%ld]",
+                     offset, end, file_size, end);
+        }
+    }
     fclose(f);
 
-    ESP_LOGI(TAG, "read_file: %s (%d bytes)", path, (int)n);
+    if (footer[0]) {
+        strlcat(output, footer, output_size);
+    }
+
+    ESP_LOGI(TAG, "read_file: %s (%d bytes returned, %ld total)", path, (int)strlen(output), file_size);
     cJSON_Delete(root);
     return ESP_OK;
 }
@@ -73,6 +208,7 @@ esp_err_t tool_write_file_execute(const char *input_json, char *output, size_t o
 
     const char *path = cJSON_GetStringValue(cJSON_GetObjectItem(root, "path"));
     const char *content = cJSON_GetStringValue(cJSON_GetObjectItem(root, "content"));
+    bool append = cJSON_IsTrue(cJSON_GetObjectItem(root, "append"));
 
     if (!validate_path(path)) {
         snprintf(output, output_size, "Error: path must start with /spiffs/ and must not contain '..'");
@@ -85,31 +221,110 @@ esp_err_t tool_write_file_execute(const char *input_json, char *output, size_t o
         return ESP_ERR_INVALID_ARG;
     }
 
-    FILE *f = fopen(path, "w");
-    if (!f) {
-        snprintf(output, output_size, "Error: cannot open file for writing: %s", path);
-        cJSON_Delete(root);
-        return ESP_FAIL;
-    }
-
     size_t len = strlen(content);
-    size_t written = fwrite(content, 1, len, f);
-    fclose(f);
+    size_t written = 0;
+    esp_err_t err;
+    if (append) {
+        /* Appends never rewrite existing data, so no temp file is needed */
+        storage_ensure_parent(path);
+        FILE *f = fopen(path, "a");
+        if (!f) {
+            snprintf(output, output_size, "Error: cannot open file for writing: %s", path);
+            cJSON_Delete(root);
+            return ESP_FAIL;
+        }
+        written = fwrite(content, 1, len, f);
+        err = (fclose(f) == 0 && written == len) ? ESP_OK : ESP_FAIL;
+    } else {
+        char tmp[136];
+        FILE *f = tmp_open(path, tmp, sizeof(tmp));
+        if (!f) {
+            snprintf(output, output_size, "Error: cannot open file for writing: %s", path);
+            cJSON_Delete(root);
+            return ESP_FAIL;
+        }
+        written = fwrite(content, 1, len, f);
+        err = tmp_commit(f, tmp, path, written == len);
+    }
 
-    if (written != len) {
-        snprintf(output, output_size, "Error: wrote %d of %d bytes to %s", (int)written, (int)len, path);
+    if (err != ESP_OK) {
+        snprintf(output, output_size, "Error: wrote %d of %d bytes to %s%s", (int)written, (int)len, path,
+                 append ? "" : " (original file left unchanged)");
         cJSON_Delete(root);
         return ESP_FAIL;
     }
 
-    snprintf(output, output_size, "OK: wrote %d bytes to %s", (int)written, path);
-    ESP_LOGI(TAG, "write_file: %s (%d bytes)", path, (int)written);
+    file_changed(path);
+
+    snprintf(output, output_size, "OK: %s %d bytes to %s", append ? "appended" : "wrote", (int)written, path);
+    ESP_LOGI(TAG, "write_file: %s (%d bytes%s)", path, (int)written, append ? ", append" : "");
     cJSON_Delete(root);
     return ESP_OK;
 }
 
 /* ── edit_file ─────────────────────────────────────────────── */
 
+static const char *find_bytes(const char *hay, size_t hay_len, const char *needle, size_t needle_len)
+{
+    if (needle_len == 0 || hay_len < needle_len) return NULL;
+    const char *end = hay + hay_len - needle_len;
+    for (const char *p = hay; p <= end; p++) {
+        p = memchr(p, needle[0], end - p + 1);
+        if (!p) return NULL;
+        if (memcmp(p, needle, needle_len) == 0) return p;
+    }
+    return NULL;
+}
+
+/**
+ * Stream src into dst, replacing the first occurrence of old_str.
+ * Works through a window of FILE_CHUNK_SIZE + old_len bytes, keeping the
+ * last old_len - 1 bytes between reads so matches spanning chunks are found.
+ */
+static esp_err_t stream_replace(FILE *src, FILE *dst, const char *old_str, size_t old_len,
+                                const char *new_str, size_t new_len)
+{
+    size_t cap = FILE_CHUNK_SIZE + old_len;
+    char *buf = malloc(cap);
+    if (!buf) return ESP_ERR_NO_MEM;
+
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    size_t have = 0;
+    for (;;) {
+        size_t n = fread(buf + have, 1, cap - have, src);
+        have += n;
+
+        const char *pos = find_bytes(buf, have, old_str, old_len);
+        if (pos) {
+            size_t prefix = pos - buf;
+            size_t rest = have - prefix - old_len;
+            bool ok = fwrite(buf, 1, prefix, dst) == prefix &&
+                      fwrite(new_str, 1, new_len, dst) == new_len &&
+                      fwrite(pos + old_len, 1, rest, dst) == rest;
+            /* Copy the remainder unchanged */
+            while (ok && (n = fread(buf, 1, cap, src)) > 0) {
+                ok = fwrite(buf, 1, n, dst) == n;
+            }
+            err = ok ? ESP_OK : ESP_FAIL;
+            break;
+        }
+        if (n == 0) break;      /* EOF without a match */
+
+        size_t keep = old_len - 1;
+        if (have <= keep) continue;
+        size_t flush = have - keep;
+        if (fwrite(buf, 1, flush, dst) != flush) {
+            err = ESP_FAIL;
+            break;
+        }
+        memmove(buf, buf + flush, keep);
+        have = keep;
+    }
+
+    free(buf);
+    return err;
+}
+
 esp_err_t tool_edit_file_execute(const char *input_json, char *output, size_t output_size)
 {
     cJSON *root = cJSON_Parse(input_json);
@@ -127,83 +342,55 @@ esp_err_t tool_edit_file_execute(const char *input_json, char *output, size_t ou
         cJSON_Delete(root);
         return ESP_ERR_INVALID_ARG;
     }
-    if (!old_str || !new_str) {
+    if (!old_str || !new_str || !old_str[0]) {
         snprintf(output, output_size, "Error: missing 'old_string' or 'new_string' field");
         cJSON_Delete(root);
         return ESP_ERR_INVALID_ARG;
     }
 
-    /* Read existing file */
-    FILE *f = fopen(path, "r");
-    if (!f) {
-        snprintf(output, output_size, "Error: file not found: %s", path);
+    size_t old_len = strlen(old_str);
+    size_t new_len = strlen(new_str);
+    if (old_len > MAX_OLD_STRING) {
+        snprintf(output, output_size, "Error: old_string longer than %d bytes", MAX_OLD_STRING);
         cJSON_Delete(root);
-        return ESP_ERR_NOT_FOUND;
+        return ESP_ERR_INVALID_SIZE;
     }
 
-    fseek(f, 0, SEEK_END);
-    long file_size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-
-    if (file_size <= 0 || file_size > MAX_FILE_SIZE) {
-        snprintf(output, output_size, "Error: file too large or empty (%ld bytes)", file_size);
-        fclose(f);
+    FILE *src = fopen(path, "r");
+    if (!src) {
+        snprintf(output, output_size, "Error: file not found: %s", path);
         cJSON_Delete(root);
-        return ESP_ERR_INVALID_SIZE;
+        return ESP_ERR_NOT_FOUND;
     }
 
-    /* Allocate buffer for the result (old content + possible expansion) */
-    size_t old_len = strlen(old_str);
-    size_t new_len = strlen(new_str);
-    size_t max_result = file_size + (new_len > old_len ? new_len - old_len : 0) + 1;
-    char *buf = malloc(file_size + 1);
-    char *result = malloc(max_result);
-    if (!buf || !result) {
-        free(buf);
-        free(result);
-        fclose(f);
-        snprintf(output, output_size, "Error: out of memory");
+    char tmp[136];
+    FILE *dst = tmp_open(path, tmp, sizeof(tmp));
+    if (!dst) {
+        fclose(src);
+        snprintf(output, output_size, "Error: cannot open file for writing: %s", path);
         cJSON_Delete(root);
-        return ESP_ERR_NO_MEM;
+        return ESP_FAIL;
     }
 
-    size_t n = fread(buf, 1, file_size, f);
-    buf[n] = '\0';
-    fclose(f);
+    esp_err_t err = stream_replace(src, dst, old_str, old_len, new_str, new_len);
+    fclose(src);
+    if (tmp_commit(dst, tmp, path, err == ESP_OK) != ESP_OK && err == ESP_OK) {
+        err = ESP_FAIL;
+    }
 
-    /* Find and replace first occurrence */
-    char *pos = strstr(buf, old_str);
-    if (!pos) {
+    if (err == ESP_ERR_NOT_FOUND) {
         snprintf(output, output_size, "Error: old_string not found in %s", path);
-        free(buf);
-        free(result);
-        cJSON_Delete(root);
-        return ESP_ERR_NOT_FOUND;
+    } else if (err == ESP_ERR_NO_MEM) {
+        snprintf(output, output_size, "Error: out of memory");
+    } else if (err != ESP_OK) {
+        snprintf(output, output_size, "Error: failed to write %s (original file left unchanged)", path);
     }
-
-    size_t prefix_len = pos - buf;
-    memcpy(result, buf, prefix_len);
-    memcpy(result + prefix_len, new_str, new_len);
-    size_t suffix_start = prefix_len + old_len;
-    size_t suffix_len = n - suffix_start;
-    memcpy(result + prefix_len + new_len, buf + suffix_start, suffix_len);
-    size_t total = prefix_len + new_len + suffix_len;
-    result[total] = '\0';
-
-    free(buf);
-
-    /* Write back */
-    f = fopen(path, "w");
-    if (!f) {
-        snprintf(output, output_size, "Error: cannot open file for writing: %s", path);
-        free(result);
+    if (err != ESP_OK) {
         cJSON_Delete(root);
-        return ESP_FAIL;
+        return err;
     }
 
-    fwrite(result, 1, total, f);
-    fclose(f);
-    free(result);
+    file_changed(path);
 
     snprintf(output, output_size, "OK: edited %s (replaced %d bytes with %d bytes)", path, (int)old_len, (int)new_len);
     ESP_LOGI(TAG, "edit_file: %s", path);
@@ -213,6 +400,25 @@ esp_err_t tool_edit_file_execute(const char *input_json, char *output, size_t ou
 
 /* ── list_dir ──────────────────────────────────────────────── */
 
+typedef struct {
+    const char *prefix;
+    char *output;
+    size_t size;
+    size_t off;
+    int count;
+} list_ctx_t;
+
+static bool list_file(const char *path, const struct stat *st, void *arg)
+{
+    list_ctx_t *ctx = (list_ctx_t *)arg;
+    if (ctx->prefix && strncmp(path, ctx->prefix, strlen(ctx->prefix)) != 0) {
+        return true;
+    }
+    ctx->off += snprintf(ctx->output + ctx->off, ctx->size - ctx->off, "%s\n", path);
+    ctx->count++;
+    return ctx->off < ctx->size - 1;
+}
+
 esp_err_t tool_list_dir_execute(const char *input_json, char *output, size_t output_size)
 {
     cJSON *root = cJSON_Parse(input_json);
@@ -224,37 +430,36 @@ esp_err_t tool_list_dir_execute(const char *input_json, char *output, size_t out
         }
     }
 
-    DIR *dir = opendir(MIMI_SPIFFS_BASE);
-    if (!dir) {
+    /* Walk only the deepest directory that contains the prefix,
+     * e.g. "/spiffs/memory/2026-" walks /spiffs/memory */
+    char start[128] = MIMI_SPIFFS_BASE;
+    if (prefix && validate_path(prefix)) {
+        strlcpy(start, prefix, sizeof(start));
+        char *slash = strrchr(start, '/');
+        if (slash && slash > start + strlen(MIMI_SPIFFS_BASE)) *slash = '\0';
+        else strlcpy(start, MIMI_SPIFFS_BASE, sizeof(start));
+    }
+
+    output[0] = '\0';
+    list_ctx_t ctx = {
+        .prefix = prefix,
+        .output = output,
+        .size = output_size,
+        .off = 0,
+        .count = 0,
+    };
+    if (storage_walk(start, true, list_file, &ctx) != ESP_OK &&
+        strcmp(start, MIMI_SPIFFS_BASE) == 0) {
         snprintf(output, output_size, "Error: cannot open /spiffs directory");
         cJSON_Delete(root);
         return ESP_FAIL;
     }
 
-    size_t off = 0;
-    struct dirent *ent;
-    int count = 0;
-
-    while ((ent = readdir(dir)) != NULL && off < output_size - 1) {
-        /* Build full path: SPIFFS entries are just filenames with embedded slashes */
-        char full_path[512];
-        snprintf(full_path, sizeof(full_path), "%s/%s", MIMI_SPIFFS_BASE, ent->d_name);
-
-        if (prefix && strncmp(full_path, prefix, strlen(prefix)) != 0) {
-            continue;
-        }
-
-        off += snprintf(output + off, output_size - off, "%s\n", full_path);
-        count++;
-    }
-
-    closedir(dir);
-
-    if (count == 0) {
+    if (ctx.count == 0) {
         snprintf(output, output_size, "(no files found)");
     }
 
-    ESP_LOGI(TAG, "list_dir: %d files (prefix=%s)", count, prefix ? prefix : "(none)");
+    ESP_LOGI(TAG, "list_dir: %d files (prefix=%s)", ctx.count, prefix ? prefix : "(none)");
     cJSON_Delete(root);
     return ESP_OK;
 }
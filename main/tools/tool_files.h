@@ -4,19 +4,22 @@
 #include <stddef.h>
 
 /**
- * Read a file from SPIFFS.
- * Input JSON: {"path": "/spiffs/..."}
+ * Read a file from SPIFFS, whole or by range.
+ * Input JSON: {"path": "/spiffs/...", "start_line": 1, "end_line": 50}
+ *         or: {"path": "/spiffs/...", "offset": 0, "length": 4096}
+ * Output that does not fit ends with a hint naming where to continue.
  */
 esp_err_t tool_read_file_execute(const char *input_json, char *output, size_t output_size);
 
 /**
- * Write/overwrite a file on SPIFFS.
- * Input JSON: {"path": "/spiffs/...", "content": "..."}
+ * Write/overwrite a file on SPIFFS (via temp file + rename), or append to it.
+ * Input JSON: {"path": "/spiffs/...", "content": "...", "append": false}
  */
 esp_err_t tool_write_file_execute(const char *input_json, char *output, size_t output_size);
 
 /**
  * Find-and-replace edit a file on SPIFFS.
+ * Streams the file through a bounded window, so any file size works.
  * Input JSON: {"path": "/spiffs/...", "old_string": "...", "new_string": "..."}
  */
 esp_err_t tool_edit_file_execute(const char *input_json, char *output, size_t output_size);
@@ -1,6 +1,7 @@
 #include "tool_get_time.h"
 #include "mimi_config.h"
 #include "proxy/http_proxy.h"
+#include "deadline/deadline.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -120,11 +121,13 @@ static esp_err_t time_http_event_handler(esp_http_client_event_t *evt)
 static esp_err_t fetch_time_direct(char *out, size_t out_size)
 {
     char date_copy[64] = {0};
+    int timeout_ms = deadline_clamp_ms(10000);
+    if (timeout_ms == 0) return ESP_ERR_TIMEOUT;
 
     esp_http_client_config_t config = {
         .url = "https://api.telegram.org/",
         .method = HTTP_METHOD_HEAD,
-        .timeout_ms = 10000,
+        .timeout_ms = timeout_ms,
         .crt_bundle_attach = esp_crt_bundle_attach,
         .event_handler = time_http_event_handler,
         .user_data = date_copy,
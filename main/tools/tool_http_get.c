@@ -1,4 +1,5 @@
 #include "tool_http_get.h"
+#include "deadline/deadline.h"
 
 #include <string.h>
 #include "esp_log.h"
@@ -50,6 +51,12 @@ esp_err_t tool_http_get_execute(const char *input_json, char *output, size_t out
     strlcpy(url, url_item->valuestring, sizeof(url));
     cJSON_Delete(root);
 
+    int timeout_ms = deadline_clamp_ms(5000);
+    if (timeout_ms == 0) {
+        snprintf(output, output_size, "Error: time budget for this request is used up");
+        return ESP_ERR_TIMEOUT;
+    }
+
     http_body_t body = {
         .buf     = output,
         .len     = 0,
@@ -60,7 +67,7 @@ esp_err_t tool_http_get_execute(const char *input_json, char *output, size_t out
     esp_http_client_config_t config = {
         .url             = url,
         .method          = HTTP_METHOD_GET,
-        .timeout_ms      = 5000,
+        .timeout_ms      = timeout_ms,
         .event_handler   = http_get_event_handler,
         .user_data       = &body,
         .crt_bundle_attach = esp_crt_bundle_attach,  /* no-op for plain HTTP */
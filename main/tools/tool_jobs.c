@@ -0,0 +1,234 @@
+#include "tools/tool_jobs.h"
+#include "tools/tool_registry.h"
+#include "bus/message_bus.h"
+#include "mimi_config.h"
+#include "deadline/deadline.h"
+#include "arena/arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "cJSON.h"
+
+static const char *TAG = "tool_jobs";
+
+/* Calls that run in the background. action == NULL matches any input;
+ * otherwise the input's "action" must equal it. */
+typedef struct {
+    const char *tool;
+    const char *action;
+} async_policy_t;
+
+static const async_policy_t s_async[] = {
+    { "ota_update",    NULL },
+    { "docker_status", "vuln_scan" },
+    { "docker_status", "redeploy" },
+    { "docker_status", "stack_redeploy" },
+};
+
+typedef enum {
+    JOB_FREE = 0,
+    JOB_QUEUED,
+    JOB_RUNNING,
+} job_state_t;
+
+typedef struct {
+    job_state_t state;
+    uint32_t id;
+    char tool[32];
+    char *input;
+    char channel[16];
+    char chat_id[32];
+} tool_job_t;
+
+static tool_job_t s_jobs[MIMI_TOOL_JOBS_MAX];
+static QueueHandle_t s_queue = NULL;
+static SemaphoreHandle_t s_lock = NULL;
+static uint32_t s_next_id = 1;
+
+bool tool_jobs_should_defer(const char *tool, const char *input_json)
+{
+    if (!s_queue || !tool) return false;
+
+    const char *action = NULL;
+    cJSON *root = NULL;
+    for (size_t i = 0; i < sizeof(s_async) / sizeof(s_async[0]); i++) {
+        if (strcmp(s_async[i].tool, tool) != 0) continue;
+        if (!s_async[i].action) {
+            cJSON_Delete(root);
+            return true;
+        }
+        if (!root) {
+            root = cJSON_Parse(input_json ? input_json : "{}");
+            action = cJSON_GetStringValue(cJSON_GetObjectItem(root, "action"));
+        }
+        if (action && strcmp(action, s_async[i].action) == 0) {
+            cJSON_Delete(root);
+            return true;
+        }
+    }
+    cJSON_Delete(root);
+    return false;
+}
+
+/* Post the result as a follow-up turn for the chat that started the job */
+static void post_result(const tool_job_t *job, esp_err_t err, const char *result, int64_t elapsed_ms)
+{
+    size_t len = strlen(result) + 256;
+    char *content = malloc(len);
+    if (!content) {
+        ESP_LOGE(TAG, "Job #%lu: no memory to post result", (unsigned long)job->id);
+        return;
+    }
+    snprintf(content, len,
+             "[Background job #%lu finished: %s %s after %llds]\n%s\n\n"
+             "This is an automatic follow-up, not a user message. "
+             "Report the result to the user.",
+             (unsigned long)job->id, job->tool, err == ESP_OK ? "succeeded" : "failed",
+             (long long)(elapsed_ms / 1000), result);
+
+    mimi_msg_t msg = {0};
+    strncpy(msg.channel, job->channel, sizeof(msg.channel) - 1);
+    strncpy(msg.chat_id, job->chat_id, sizeof(msg.chat_id) - 1);
+    msg.flags = MIMI_MSG_NO_COALESCE;     /* not part of the user's burst */
+    msg.content = content;
+    if (message_bus_push_inbound(&msg) != ESP_OK) {
+        ESP_LOGW(TAG, "Job #%lu: inbound queue full, result dropped", (unsigned long)job->id);
+        free(content);
+    }
+}
+
+static void job_worker_task(void *arg)
+{
+    char *output = heap_caps_calloc(1, MIMI_TOOL_JOBS_OUTPUT_SIZE, MALLOC_CAP_SPIRAM);
+    if (!output) {
+        ESP_LOGE(TAG, "Failed to allocate job output buffer");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    static arena_t job_arena;
+    arena_init(&job_arena, "tool_job");
+
+    while (1) {
+        int slot;
+        if (xQueueReceive(s_queue, &slot, portMAX_DELAY) != pdTRUE) continue;
+        tool_job_t *job = &s_jobs[slot];
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        job->state = JOB_RUNNING;
+        xSemaphoreGive(s_lock);
+
+        ESP_LOGI(TAG, "Job #%lu running: %s", (unsigned long)job->id, job->tool);
+        int64_t start = esp_timer_get_time();
+        deadline_t budget;
+        deadline_start(&budget, MIMI_TOOL_JOBS_BUDGET_MS);
+        deadline_bind(&budget);
+        arena_bind(&job_arena);
+        output[0] = '\0';
+        esp_err_t err = tool_registry_execute(job->tool, job->input, output,
+                                              MIMI_TOOL_JOBS_OUTPUT_SIZE);
+        arena_bind(NULL);
+        arena_reset(&job_arena);
+        deadline_bind(NULL);
+        int64_t elapsed_ms = (esp_timer_get_time() - start) / 1000;
+        ESP_LOGI(TAG, "Job #%lu done in %lld ms (%s)", (unsigned long)job->id,
+                 (long long)elapsed_ms, esp_err_to_name(err));
+
+        post_result(job, err, output[0] ? output : "(no output)", elapsed_ms);
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        free(job->input);
+        job->input = NULL;
+        job->state = JOB_FREE;
+        xSemaphoreGive(s_lock);
+    }
+}
+
+esp_err_t tool_jobs_submit(const char *tool, const char *input_json,
+                           const char *channel, const char *chat_id,
+                           char *output, size_t output_size)
+{
+    if (!s_queue) {
+        snprintf(output, output_size, "Error: background jobs not available");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!input_json) input_json = "{}";
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    tool_job_t *job = NULL;
+    for (int i = 0; i < MIMI_TOOL_JOBS_MAX; i++) {
+        tool_job_t *j = &s_jobs[i];
+        if (j->state != JOB_FREE && strcmp(j->tool, tool) == 0 &&
+            strcmp(j->input, input_json) == 0) {
+            snprintf(output, output_size,
+                     "Background job #%lu (%s) is already %s. Its result will be posted to this chat "
+                     "automatically when it finishes; tell the user it is still in progress.",
+                     (unsigned long)j->id, tool, j->state == JOB_RUNNING ? "running" : "queued");
+            xSemaphoreGive(s_lock);
+            return ESP_OK;
+        }
+        if (!job && j->state == JOB_FREE) job = j;
+    }
+
+    if (!job) {
+        xSemaphoreGive(s_lock);
+        snprintf(output, output_size,
+                 "Error: %d background jobs already pending, try again later", MIMI_TOOL_JOBS_MAX);
+        return ESP_FAIL;
+    }
+
+    job->input = strdup(input_json);
+    if (!job->input) {
+        xSemaphoreGive(s_lock);
+        snprintf(output, output_size, "Error: out of memory");
+        return ESP_ERR_NO_MEM;
+    }
+    uint32_t id = s_next_id++;
+    job->id = id;
+    strlcpy(job->tool, tool, sizeof(job->tool));
+    strlcpy(job->channel, channel ? channel : MIMI_CHAN_SYSTEM, sizeof(job->channel));
+    strlcpy(job->chat_id, chat_id ? chat_id : "", sizeof(job->chat_id));
+    job->state = JOB_QUEUED;
+
+    int slot = job - s_jobs;
+    xQueueSend(s_queue, &slot, 0);      /* cannot fail: queue holds every slot */
+    xSemaphoreGive(s_lock);
+
+    snprintf(output, output_size,
+             "Started background job #%lu (%s). It may take a few minutes; the result will be "
+             "posted to this chat automatically when it finishes. Tell the user it is running "
+             "and do not call this tool again for the same request.",
+             (unsigned long)id, tool);
+    ESP_LOGI(TAG, "Job #%lu queued: %s for %s:%s", (unsigned long)id, tool,
+             channel ? channel : MIMI_CHAN_SYSTEM, chat_id ? chat_id : "");
+    return ESP_OK;
+}
+
+esp_err_t tool_jobs_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    s_queue = xQueueCreate(MIMI_TOOL_JOBS_MAX, sizeof(int));
+    if (!s_lock || !s_queue) return ESP_ERR_NO_MEM;
+
+    BaseType_t ret = xTaskCreatePinnedToCore(
+        job_worker_task, "tool_jobs",
+        MIMI_TOOL_JOBS_STACK, NULL,
+        MIMI_TOOL_JOBS_PRIO, NULL, MIMI_TOOL_JOBS_CORE);
+    if (ret != pdPASS) {
+        vQueueDelete(s_queue);
+        s_queue = NULL;     /* tools run synchronously */
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Background job worker started (%d slots)", MIMI_TOOL_JOBS_MAX);
+    return ESP_OK;
+}
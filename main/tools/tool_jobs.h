@@ -0,0 +1,29 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Initialize the background job worker for long-running tools.
+ */
+esp_err_t tool_jobs_init(void);
+
+/**
+ * True when this call is slow enough to run in the background
+ * (e.g. ota_update, docker_status vuln_scan).
+ */
+bool tool_jobs_should_defer(const char *tool, const char *input_json);
+
+/**
+ * Queue a tool call on the background worker and write a job handle message
+ * to output. When the call finishes, its result is pushed to the inbound bus
+ * for (channel, chat_id), which starts a follow-up agent turn in that chat.
+ * An identical call that is already queued or running returns its handle.
+ *
+ * @return ESP_OK when queued (or already running), ESP_ERR_NO_MEM/ESP_FAIL
+ *         with an error message in output otherwise
+ */
+esp_err_t tool_jobs_submit(const char *tool, const char *input_json,
+                           const char *channel, const char *chat_id,
+                           char *output, size_t output_size);
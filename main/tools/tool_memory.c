@@ -0,0 +1,39 @@
+#include "tools/tool_memory.h"
+#include "memory/memory_index.h"
+#include "mimi_config.h"
+
+#include <stdio.h>
+#include "esp_log.h"
+#include "cJSON.h"
+
+static const char *TAG = "tool_memory";
+
+esp_err_t tool_memory_search_execute(const char *input_json, char *output, size_t output_size)
+{
+    cJSON *root = cJSON_Parse(input_json);
+    if (!root) {
+        snprintf(output, output_size, "Error: invalid JSON input");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const char *query = cJSON_GetStringValue(cJSON_GetObjectItem(root, "query"));
+    if (!query || query[0] == '\0') {
+        snprintf(output, output_size, "Error: missing 'query' field");
+        cJSON_Delete(root);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int limit = MIMI_MEMORY_SEARCH_MAX_RESULTS;
+    cJSON *limit_item = cJSON_GetObjectItem(root, "limit");
+    if (cJSON_IsNumber(limit_item)) {
+        limit = (int)limit_item->valuedouble;
+        if (limit < 1) limit = 1;
+        if (limit > 10) limit = 10;
+    }
+
+    ESP_LOGI(TAG, "memory_search: \"%s\" (limit %d)", query, limit);
+    esp_err_t err = memory_index_search(query, limit, output, output_size);
+
+    cJSON_Delete(root);
+    return err;
+}
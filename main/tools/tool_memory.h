@@ -0,0 +1,10 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+
+/**
+ * Search long-term memory and daily notes by keyword.
+ * Input JSON: { query, limit? }
+ */
+esp_err_t tool_memory_search_execute(const char *input_json, char *output, size_t output_size);
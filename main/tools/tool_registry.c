@@ -2,62 +2,294 @@
 #include "tools/tool_web_search.h"
 #include "tools/tool_get_time.h"
 #include "tools/tool_files.h"
+#include "tools/tool_memory.h"
 #include "tools/tool_cron.h"
 #include "tools/tool_ota.h"
 #include "tools/tool_http_get.h"
 #include "tools/tool_version.h"
 #include "tools/tool_wled.h"
 #include "tools/tool_arcane.h"
+#include "tools/tool_cache.h"
+#include "deadline/deadline.h"
+#include "metrics/metrics.h"
+#include "bus/message_bus.h"
+#include "util/text_match.h"
 
 #include <string.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 #include "cJSON.h"
 
 static const char *TAG = "tools";
 
-#define MAX_TOOLS 15
+#define TOOLS_INITIAL_CAP   16
 
-static mimi_tool_t s_tools[MAX_TOOLS];
+/* A registered tool with its schema pre-rendered for both request formats */
+typedef struct {
+    mimi_tool_t def;            /* strings owned by the registry */
+    uint32_t hash;
+    char *anthropic_json;       /* {"name","description","input_schema"} */
+    char *openai_json;          /* {"type":"function","function":{...}} */
+} tool_entry_t;
+
+static tool_entry_t *s_tools = NULL;
 static int s_tool_count = 0;
-static char *s_tools_json = NULL;  /* cached JSON array string */
+static int s_tool_cap = 0;
 
-static void register_tool(const mimi_tool_t *tool)
+/* Open-addressed name index: slot holds entry index + 1, 0 when empty */
+static uint16_t *s_index = NULL;
+static size_t s_index_size = 0;     /* power of two, at least 2x the tool count */
+
+/* Full tools arrays, rebuilt lazily after registration changes */
+static char *s_all_anthropic = NULL;
+static char *s_all_openai = NULL;
+static bool s_blobs_dirty = true;
+
+static SemaphoreHandle_t s_lock = NULL;
+
+static uint32_t name_hash(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static char *psram_strdup(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *p = heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+    if (p) memcpy(p, s, len);
+    return p;
+}
+
+static void entry_free(tool_entry_t *e)
 {
-    if (s_tool_count >= MAX_TOOLS) {
-        ESP_LOGE(TAG, "Tool registry full");
-        return;
+    free((char *)e->def.name);
+    free((char *)e->def.description);
+    free((char *)e->def.input_schema_json);
+    free((char *)e->def.keywords);
+    free(e->anthropic_json);
+    free(e->openai_json);
+    memset(e, 0, sizeof(*e));
+}
+
+/* ── Name index (s_lock held) ─────────────────────────────────── */
+
+static int index_find(const char *name, uint32_t hash)
+{
+    if (!s_index) return -1;
+    size_t mask = s_index_size - 1;
+    for (size_t i = hash & mask; s_index[i]; i = (i + 1) & mask) {
+        const tool_entry_t *e = &s_tools[s_index[i] - 1];
+        if (e->hash == hash && strcmp(e->def.name, name) == 0) {
+            return s_index[i] - 1;
+        }
     }
-    s_tools[s_tool_count++] = *tool;
-    ESP_LOGI(TAG, "Registered tool: %s", tool->name);
+    return -1;
 }
 
-static void build_tools_json(void)
+static esp_err_t index_rebuild(void)
 {
-    cJSON *arr = cJSON_CreateArray();
+    size_t size = 16;
+    while (size < (size_t)s_tool_count * 2) size <<= 1;
+
+    uint16_t *index = heap_caps_calloc(size, sizeof(uint16_t), MALLOC_CAP_SPIRAM);
+    if (!index) return ESP_ERR_NO_MEM;
 
+    for (int t = 0; t < s_tool_count; t++) {
+        size_t i = s_tools[t].hash & (size - 1);
+        while (index[i]) i = (i + 1) & (size - 1);
+        index[i] = (uint16_t)(t + 1);
+    }
+    free(s_index);
+    s_index = index;
+    s_index_size = size;
+    return ESP_OK;
+}
+
+/* ── Schema rendering ─────────────────────────────────────────── */
+
+static esp_err_t render_schemas(tool_entry_t *e)
+{
+    cJSON *schema = cJSON_Parse(e->def.input_schema_json);
+    if (!schema) return ESP_ERR_INVALID_ARG;
+
+    cJSON *anth = cJSON_CreateObject();
+    cJSON_AddStringToObject(anth, "name", e->def.name);
+    cJSON_AddStringToObject(anth, "description", e->def.description);
+    cJSON_AddItemToObject(anth, "input_schema", cJSON_Duplicate(schema, 1));
+
+    cJSON *func = cJSON_CreateObject();
+    cJSON_AddStringToObject(func, "name", e->def.name);
+    cJSON_AddStringToObject(func, "description", e->def.description);
+    cJSON_AddItemToObject(func, "parameters", schema);
+    cJSON *oai = cJSON_CreateObject();
+    cJSON_AddStringToObject(oai, "type", "function");
+    cJSON_AddItemToObject(oai, "function", func);
+
+    /* Copied out of cJSON so the rendering outlives any bound arena */
+    char *anth_json = cJSON_PrintUnformatted(anth);
+    char *oai_json = cJSON_PrintUnformatted(oai);
+    cJSON_Delete(anth);
+    cJSON_Delete(oai);
+    e->anthropic_json = anth_json ? psram_strdup(anth_json) : NULL;
+    e->openai_json = oai_json ? psram_strdup(oai_json) : NULL;
+    cJSON_free(anth_json);
+    cJSON_free(oai_json);
+
+    return (e->anthropic_json && e->openai_json) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+/* Join pre-rendered tool objects into a JSON array: no parsing involved */
+static char *join_array(bool openai, const bool *include)
+{
+    size_t len = 3;
+    for (int i = 0; i < s_tool_count; i++) {
+        if (include && !include[i]) continue;
+        len += strlen(openai ? s_tools[i].openai_json : s_tools[i].anthropic_json) + 1;
+    }
+
+    char *out = heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+    if (!out) return NULL;
+
+    size_t off = 0;
+    out[off++] = '[';
     for (int i = 0; i < s_tool_count; i++) {
-        cJSON *tool = cJSON_CreateObject();
-        cJSON_AddStringToObject(tool, "name", s_tools[i].name);
-        cJSON_AddStringToObject(tool, "description", s_tools[i].description);
+        if (include && !include[i]) continue;
+        const char *obj = openai ? s_tools[i].openai_json : s_tools[i].anthropic_json;
+        if (off > 1) out[off++] = ',';
+        size_t n = strlen(obj);
+        memcpy(out + off, obj, n);
+        off += n;
+    }
+    out[off++] = ']';
+    out[off] = '\0';
+    return out;
+}
+
+static void rebuild_blobs(void)
+{
+    free(s_all_anthropic);
+    free(s_all_openai);
+    s_all_anthropic = join_array(false, NULL);
+    s_all_openai = join_array(true, NULL);
+    s_blobs_dirty = false;
+    ESP_LOGI(TAG, "Tools JSON built (%d tools, %d bytes)", s_tool_count,
+             s_all_anthropic ? (int)strlen(s_all_anthropic) : 0);
+}
 
-        cJSON *schema = cJSON_Parse(s_tools[i].input_schema_json);
-        if (schema) {
-            cJSON_AddItemToObject(tool, "input_schema", schema);
+/* ── Registration ─────────────────────────────────────────────── */
+
+esp_err_t tool_registry_register(const mimi_tool_t *tool)
+{
+    if (!tool || !tool->name || !tool->description || !tool->input_schema_json || !tool->execute) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    tool_entry_t e = {0};
+    e.def.name = psram_strdup(tool->name);
+    e.def.description = psram_strdup(tool->description);
+    e.def.input_schema_json = psram_strdup(tool->input_schema_json);
+    e.def.keywords = tool->keywords ? psram_strdup(tool->keywords) : NULL;
+    e.def.execute = tool->execute;
+    e.hash = name_hash(tool->name);
+    if (!e.def.name || !e.def.description || !e.def.input_schema_json ||
+        (tool->keywords && !e.def.keywords)) {
+        entry_free(&e);
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = render_schemas(&e);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Tool %s: invalid input schema", tool->name);
+        entry_free(&e);
+        return err;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    int existing = index_find(tool->name, e.hash);
+    if (existing >= 0) {
+        /* Re-registration replaces the definition in place */
+        entry_free(&s_tools[existing]);
+        s_tools[existing] = e;
+        s_blobs_dirty = true;
+        xSemaphoreGive(s_lock);
+        ESP_LOGI(TAG, "Replaced tool: %s", tool->name);
+        return ESP_OK;
+    }
+
+    if (s_tool_count == s_tool_cap) {
+        int cap = s_tool_cap ? s_tool_cap * 2 : TOOLS_INITIAL_CAP;
+        tool_entry_t *grown = heap_caps_realloc(s_tools, cap * sizeof(tool_entry_t), MALLOC_CAP_SPIRAM);
+        if (!grown) {
+            xSemaphoreGive(s_lock);
+            entry_free(&e);
+            return ESP_ERR_NO_MEM;
         }
+        s_tools = grown;
+        s_tool_cap = cap;
+    }
+    s_tools[s_tool_count++] = e;
+
+    if (s_tool_count * 2 > (int)s_index_size) {
+        err = index_rebuild();
+    } else {
+        size_t mask = s_index_size - 1;
+        size_t i = e.hash & mask;
+        while (s_index[i]) i = (i + 1) & mask;
+        s_index[i] = (uint16_t)s_tool_count;
+    }
+    if (err != ESP_OK) {
+        entry_free(&s_tools[--s_tool_count]);
+    }
+    s_blobs_dirty = true;
+    xSemaphoreGive(s_lock);
+
+    if (err == ESP_OK) ESP_LOGI(TAG, "Registered tool: %s", tool->name);
+    return err;
+}
 
-        cJSON_AddItemToArray(arr, tool);
+esp_err_t tool_registry_unregister(const char *name)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int idx = index_find(name, name_hash(name));
+    if (idx < 0) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_NOT_FOUND;
     }
 
-    free(s_tools_json);
-    s_tools_json = cJSON_PrintUnformatted(arr);
-    cJSON_Delete(arr);
+    entry_free(&s_tools[idx]);
+    s_tools[idx] = s_tools[--s_tool_count];
+    memset(&s_tools[s_tool_count], 0, sizeof(tool_entry_t));
+    esp_err_t err = index_rebuild();
+    s_blobs_dirty = true;
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TAG, "Unregistered tool: %s", name);
+    return err;
+}
 
-    ESP_LOGI(TAG, "Tools JSON built (%d tools)", s_tool_count);
+static void register_tool(const mimi_tool_t *tool)
+{
+    if (tool_registry_register(tool) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register tool: %s", tool->name);
+    }
 }
 
 esp_err_t tool_registry_init(void)
 {
-    s_tool_count = 0;
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    tool_cache_init();
+
+    /* Tools without .keywords are the core set offered on every turn; the
+     * rest are only sent when tool_registry_select() routes to them. */
 
     /* Register web_search */
     tool_web_search_init();
@@ -88,10 +320,16 @@ esp_err_t tool_registry_init(void)
     /* Register read_file */
     mimi_tool_t rf = {
         .name = "read_file",
-        .description = "Read a file from SPIFFS storage. Path must start with /spiffs/.",
+        .description = "Read a file from SPIFFS storage. Path must start with /spiffs/. "
+                       "Large files are returned in pieces: use start_line/end_line or offset/length "
+                       "and follow the continuation hint at the end of a truncated result.",
         .input_schema_json =
             "{\"type\":\"object\","
-            "\"properties\":{\"path\":{\"type\":\"string\",\"description\":\"Absolute path starting with /spiffs/\"}},"
+            "\"properties\":{\"path\":{\"type\":\"string\",\"description\":\"Absolute path starting with /spiffs/\"},"
+            "\"start_line\":{\"type\":\"integer\",\"description\":\"First line to return (1-based)\"},"
+            "\"end_line\":{\"type\":\"integer\",\"description\":\"Last line to return (inclusive)\"},"
+            "\"offset\":{\"type\":\"integer\",\"description\":\"Byte offset to start reading at\"},"
+            "\"length\":{\"type\":\"integer\",\"description\":\"Maximum number of bytes to return\"}},"
             "\"required\":[\"path\"]}",
         .execute = tool_read_file_execute,
     };
@@ -100,11 +338,12 @@ esp_err_t tool_registry_init(void)
     /* Register write_file */
     mimi_tool_t wf = {
         .name = "write_file",
-        .description = "Write or overwrite a file on SPIFFS storage. Path must start with /spiffs/.",
+        .description = "Write or overwrite a file on SPIFFS storage, or append to it. Path must start with /spiffs/.",
         .input_schema_json =
             "{\"type\":\"object\","
             "\"properties\":{\"path\":{\"type\":\"string\",\"description\":\"Absolute path starting with /spiffs/\"},"
-            "\"content\":{\"type\":\"string\",\"description\":\"File content to write\"}},"
+            "\"content\":{\"type\":\"string\",\"description\":\"File content to write\"},"
+            "\"append\":{\"type\":\"boolean\",\"description\":\"Append to the end of the file instead of replacing it\"}},"
             "\"required\":[\"path\",\"content\"]}",
         .execute = tool_write_file_execute,
     };
@@ -136,22 +375,42 @@ esp_err_t tool_registry_init(void)
     };
     register_tool(&ld);
 
+    /* Register memory_search */
+    mimi_tool_t ms = {
+        .name = "memory_search",
+        .description = "Search long-term memory (MEMORY.md) and past daily notes by keywords. "
+                       "Returns the best-matching files with matching lines. "
+                       "Use this to recall facts, preferences, or events older than the recent notes in your prompt.",
+        .input_schema_json =
+            "{\"type\":\"object\","
+            "\"properties\":{"
+            "\"query\":{\"type\":\"string\",\"description\":\"Keywords to search for\"},"
+            "\"limit\":{\"type\":\"integer\",\"description\":\"Maximum number of files to return (1-10, default 5)\"}"
+            "},"
+            "\"required\":[\"query\"]}",
+        .execute = tool_memory_search_execute,
+    };
+    register_tool(&ms);
+
     /* Register cron_add */
     mimi_tool_t ca = {
         .name = "cron_add",
-        .description = "Schedule a recurring or one-shot task. The message will trigger an agent turn when the job fires.",
+        .description = "Schedule a recurring or one-shot task. The message will trigger an agent turn when the job fires. "
+                       "Use schedule_type 'cron' for calendar schedules such as weekdays at 8:00.",
         .input_schema_json =
             "{\"type\":\"object\","
             "\"properties\":{"
             "\"name\":{\"type\":\"string\",\"description\":\"Short name for the job\"},"
-            "\"schedule_type\":{\"type\":\"string\",\"description\":\"'every' for recurring interval or 'at' for one-shot at a unix timestamp\"},"
+            "\"schedule_type\":{\"type\":\"string\",\"description\":\"'every' for recurring interval, 'at' for one-shot at a unix timestamp, or 'cron' for a cron expression\"},"
             "\"interval_s\":{\"type\":\"integer\",\"description\":\"Interval in seconds (required for 'every')\"},"
             "\"at_epoch\":{\"type\":\"integer\",\"description\":\"Unix timestamp to fire at (required for 'at')\"},"
+            "\"expr\":{\"type\":\"string\",\"description\":\"5-field cron expression in local time: minute hour day-of-month month day-of-week, e.g. '0 8 * * mon-fri' (required for 'cron')\"},"
             "\"message\":{\"type\":\"string\",\"description\":\"Message to inject when the job fires, triggering an agent turn\"},"
             "\"channel\":{\"type\":\"string\",\"description\":\"Optional reply channel (e.g. 'telegram'). If omitted, current turn channel is used when available\"},"
             "\"chat_id\":{\"type\":\"string\",\"description\":\"Optional reply chat_id. Required when channel='telegram'. If omitted during a Telegram turn, current chat_id is used\"}"
             "},"
             "\"required\":[\"name\",\"schedule_type\",\"message\"]}",
+        .keywords = "cron remind schedul every daily hourly weekly tomorrow later alarm timer recurring",
         .execute = tool_cron_add_execute,
     };
     register_tool(&ca);
@@ -164,6 +423,7 @@ esp_err_t tool_registry_init(void)
             "{\"type\":\"object\","
             "\"properties\":{},"
             "\"required\":[]}",
+        .keywords = "cron remind schedul job",
         .execute = tool_cron_list_execute,
     };
     register_tool(&cl);
@@ -176,6 +436,7 @@ esp_err_t tool_registry_init(void)
             "{\"type\":\"object\","
             "\"properties\":{\"job_id\":{\"type\":\"string\",\"description\":\"The 8-character job ID to remove\"}},"
             "\"required\":[\"job_id\"]}",
+        .keywords = "cron remind schedul job cancel",
         .execute = tool_cron_remove_execute,
     };
     register_tool(&cr);
@@ -187,6 +448,7 @@ esp_err_t tool_registry_init(void)
         .input_schema_json =
             "{\"type\":\"object\","
             "\"properties\":{\"url\":{\"type\":\"string\",\"description\":\"Optional custom firmware URL. Omit to use the default release.\"}}}",
+        .keywords = "ota firmware update upgrade flash",
         .execute = tool_ota_execute,
     };
     register_tool(&ota);
@@ -199,6 +461,7 @@ esp_err_t tool_registry_init(void)
             "{\"type\":\"object\","
             "\"properties\":{\"url\":{\"type\":\"string\",\"description\":\"Full URL to request (http:// or https://)\"}},"
             "\"required\":[\"url\"]}",
+        .keywords = "http url api endpoint fetch",
         .execute = tool_http_get_execute,
     };
     register_tool(&hg);
@@ -212,6 +475,7 @@ esp_err_t tool_registry_init(void)
             "{\"type\":\"object\","
             "\"properties\":{},"
             "\"required\":[]}",
+        .keywords = "version firmware build",
         .execute = tool_version_execute,
     };
     register_tool(&ver);
@@ -240,6 +504,8 @@ esp_err_t tool_registry_init(void)
               "\"description\":\"WLED IP address (only needed if not saved in /spiffs/config/wled_ip.txt)\"}"
             "},"
             "\"required\":[\"action\"]}",
+        /* Always offered: light requests are phrased too many ways ("make it
+         * red", "turn everything off") for keywords to catch */
         .execute = tool_wled_execute,
     };
     register_tool(&wled);
@@ -263,19 +529,88 @@ esp_err_t tool_registry_init(void)
               "\"description\":\"Container or stack name (required for start/stop/restart/redeploy/stack_* actions)\"}"
             "},"
             "\"required\":[\"action\"]}",
+        .keywords = "docker container stack server service arcane deploy redeploy restart vuln cve",
         .execute = tool_arcane_execute,
     };
     register_tool(&arcane);
 
-    build_tools_json();
+    ESP_LOGI(TAG, "Tool registry initialized (%d tools)", s_tool_count);
+    return ESP_OK;
+}
+
+esp_err_t tool_registry_get_tools(llm_tools_t *out)
+{
+    memset(out, 0, sizeof(*out));
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_blobs_dirty) rebuild_blobs();
+    if (s_all_anthropic && s_all_openai) {
+        out->anthropic_json = psram_strdup(s_all_anthropic);
+        out->openai_json = psram_strdup(s_all_openai);
+    }
+    xSemaphoreGive(s_lock);
 
-    ESP_LOGI(TAG, "Tool registry initialized");
+    if (!out->anthropic_json || !out->openai_json) {
+        tool_registry_free_tools(out);
+        return ESP_ERR_NO_MEM;
+    }
     return ESP_OK;
 }
 
-const char *tool_registry_get_tools_json(void)
+/* ── Per-turn selection ───────────────────────────────────────── */
+
+static bool tool_selected(const tool_entry_t *e, const char *text)
 {
-    return s_tools_json;
+    if (!e->def.keywords) return true;              /* core tool */
+    if (strstr(text, e->def.name)) return true;     /* named in history or a skill */
+
+    const char *kw = e->def.keywords;
+    while (*kw) {
+        while (*kw == ' ') kw++;
+        size_t len = strcspn(kw, " ");
+        if (len && text_has_word_prefix(text, kw, len)) return true;
+        kw += len;
+    }
+    return false;
+}
+
+esp_err_t tool_registry_select(const char *channel, const char *text, llm_tools_t *out)
+{
+    if (!text || (channel && strcmp(channel, MIMI_CHAN_SYSTEM) == 0)) {
+        return tool_registry_get_tools(out);
+    }
+    memset(out, 0, sizeof(*out));
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int total = s_tool_count;
+    int picked = 0;
+    bool *include = calloc(total ? total : 1, sizeof(bool));
+    if (include) {
+        for (int i = 0; i < total; i++) {
+            include[i] = tool_selected(&s_tools[i], text);
+            if (include[i]) picked++;
+        }
+        out->anthropic_json = join_array(false, include);
+        out->openai_json = join_array(true, include);
+    }
+    xSemaphoreGive(s_lock);
+    free(include);
+
+    if (!out->anthropic_json || !out->openai_json) {
+        tool_registry_free_tools(out);
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Selected %d/%d tools for this turn (%d bytes)", picked, total,
+             (int)strlen(out->anthropic_json));
+    return ESP_OK;
+}
+
+void tool_registry_free_tools(llm_tools_t *tools)
+{
+    free((char *)tools->anthropic_json);
+    free((char *)tools->openai_json);
+    tools->anthropic_json = NULL;
+    tools->openai_json = NULL;
 }
 
 /*
@@ -300,16 +635,37 @@ static void sanitize_tool_output(char *s)
 esp_err_t tool_registry_execute(const char *name, const char *input_json,
                                 char *output, size_t output_size)
 {
-    for (int i = 0; i < s_tool_count; i++) {
-        if (strcmp(s_tools[i].name, name) == 0) {
-            ESP_LOGI(TAG, "Executing tool: %s", name);
-            esp_err_t err = s_tools[i].execute(input_json, output, output_size);
-            sanitize_tool_output(output);
-            return err;
-        }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int idx = index_find(name, name_hash(name));
+    esp_err_t (*execute)(const char *, char *, size_t) = idx >= 0 ? s_tools[idx].def.execute : NULL;
+    xSemaphoreGive(s_lock);
+
+    if (!execute) {
+        ESP_LOGW(TAG, "Unknown tool: %s", name);
+        snprintf(output, output_size, "Error: unknown tool '%s'", name);
+        return ESP_ERR_NOT_FOUND;
     }
 
-    ESP_LOGW(TAG, "Unknown tool: %s", name);
-    snprintf(output, output_size, "Error: unknown tool '%s'", name);
-    return ESP_ERR_NOT_FOUND;
+    if (deadline_expired()) {
+        ESP_LOGW(TAG, "Deadline exceeded, not running %s", name);
+        snprintf(output, output_size,
+                 "Error: the time budget for this turn is used up; %s was not run", name);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    tool_cache_ticket_t ticket;
+    tool_cache_result_t cached = tool_cache_begin(name, input_json, output, output_size, &ticket);
+    if (cached == TOOL_CACHE_HIT) {
+        return ESP_OK;      /* stored already sanitized */
+    }
+
+    ESP_LOGI(TAG, "Executing tool: %s", name);
+    metrics_inc(METRIC_TOOL_CALLS);
+    esp_err_t err = execute(input_json, output, output_size);
+    if (err != ESP_OK) metrics_inc(METRIC_TOOL_ERRORS);
+    sanitize_tool_output(output);
+    if (cached == TOOL_CACHE_MISS) {
+        tool_cache_end(&ticket, err, output);
+    }
+    return err;
 }
@@ -2,11 +2,13 @@
 
 #include "esp_err.h"
 #include <stddef.h>
+#include "llm/llm_proxy.h"
 
 typedef struct {
     const char *name;
     const char *description;
     const char *input_schema_json;  /* JSON Schema string for input */
+    const char *keywords;           /* space-separated routing words; NULL = always offered */
     esp_err_t (*execute)(const char *input_json, char *output, size_t output_size);
 } mimi_tool_t;
 
@@ -16,13 +18,44 @@ typedef struct {
 esp_err_t tool_registry_init(void);
 
 /**
- * Get the pre-built tools JSON array string for the API request.
- * Returns NULL if no tools are registered.
+ * Register a tool at runtime. Strings are copied; a tool with the same name
+ * is replaced. The schema is rendered for both request formats here, once.
+ *
+ * @return ESP_ERR_INVALID_ARG if input_schema_json is not valid JSON
+ */
+esp_err_t tool_registry_register(const mimi_tool_t *tool);
+
+/**
+ * Remove a tool by name.
+ */
+esp_err_t tool_registry_unregister(const char *name);
+
+/**
+ * Get the tools array for an LLM request in both Anthropic and OpenAI format.
+ * The strings are a snapshot owned by the caller; release with
+ * tool_registry_free_tools(). Registration changes do not affect it.
+ */
+esp_err_t tool_registry_get_tools(llm_tools_t *out);
+
+/**
+ * Like tool_registry_get_tools(), but only the tools relevant to one turn:
+ * tools without keywords (the core set), tools named in text, and tools
+ * with a keyword that starts a word in text. Turns on the system channel
+ * (cron, heartbeat) get every tool. Select once per turn and reuse the
+ * snapshot for every LLM call, so the request prefix stays stable.
+ *
+ * @param channel  Channel of the turn (MIMI_CHAN_*)
+ * @param text     Routing text: the message, recent history, matched skills
+ */
+esp_err_t tool_registry_select(const char *channel, const char *text, llm_tools_t *out);
+
+/**
+ * Free a snapshot from tool_registry_get_tools() or tool_registry_select().
  */
-const char *tool_registry_get_tools_json(void);
+void tool_registry_free_tools(llm_tools_t *tools);
 
 /**
- * Execute a tool by name.
+ * Execute a tool by name (hash lookup).
  *
  * @param name         Tool name (e.g. "web_search")
  * @param input_json   JSON string of tool input
@@ -1,6 +1,7 @@
 #include "tool_web_search.h"
 #include "mimi_config.h"
 #include "proxy/http_proxy.h"
+#include "deadline/deadline.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -134,11 +135,14 @@ static void format_results(cJSON *root, char *output, size_t output_size)
 
 static esp_err_t search_direct(const char *url, search_buf_t *sb)
 {
+    int timeout_ms = deadline_clamp_ms(15000);
+    if (timeout_ms == 0) return ESP_ERR_TIMEOUT;
+
     esp_http_client_config_t config = {
         .url = url,
         .event_handler = http_event_handler,
         .user_data = sb,
-        .timeout_ms = 15000,
+        .timeout_ms = timeout_ms,
         .buffer_size = 4096,
         .crt_bundle_attach = esp_crt_bundle_attach,
     };
@@ -0,0 +1,13 @@
+#include "util/text_match.h"
+
+#include <ctype.h>
+#include <strings.h>
+
+bool text_has_word_prefix(const char *text, const char *word, size_t len)
+{
+    for (const char *p = text; *p; p++) {
+        if (p != text && isalnum((unsigned char)p[-1])) continue;
+        if (strncasecmp(p, word, len) == 0) return true;
+    }
+    return false;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * True if the first len bytes of word start a word in text (any case).
+ * A word starts at the beginning of text or after a non-alphanumeric byte,
+ * so "remind" matches "Reminder" but not "unreminded".
+ */
+bool text_has_word_prefix(const char *text, const char *word, size_t len);
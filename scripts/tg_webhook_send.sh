@@ -0,0 +1,36 @@
+#!/usr/bin/env bash
+# Stand in for Telegram: POST a fake message update to the device's webhook.
+#
+#   scripts/tg_webhook_send.sh <device-ip> <secret> "<text>" [chat_id]
+#
+# The secret is MIMI_SECRET_TG_WEBHOOK_SECRET. Replies go to the real chat_id
+# through the Bot API, so use your own chat ID to see the answer.
+set -euo pipefail
+
+if [[ $# -lt 3 ]]; then
+  echo "usage: $0 <device-ip> <secret> <text> [chat_id]" >&2
+  exit 1
+fi
+
+HOST="$1"
+SECRET="$2"
+TEXT="$3"
+CHAT_ID="${4:-1}"
+PORT="${MIMI_WS_PORT:-18789}"
+
+# No update_id: a made-up one would move the device's update offset past
+# real Telegram updates. A random message_id gets past duplicate detection.
+BODY="$(python3 -c 'import json,random,sys,time; print(json.dumps({
+  "message": {
+    "message_id": random.randint(1, 1 << 30),
+    "date": int(time.time()),
+    "chat": {"id": int(sys.argv[1]), "type": "private"},
+    "text": sys.argv[2],
+  },
+}))' "$CHAT_ID" "$TEXT")"
+
+curl -sS -o /dev/null -w "HTTP %{http_code}\n" \
+  -H "Content-Type: application/json" \
+  -H "X-Telegram-Bot-Api-Secret-Token: $SECRET" \
+  --data "$BODY" \
+  "http://$HOST:$PORT/telegram"
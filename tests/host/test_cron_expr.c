@@ -0,0 +1,148 @@
+/*
+ * Host test for cron/cron_expr.c: parsing, the day-of-month/day-of-week
+ * rule and next-match search across month, year and leap-day boundaries.
+ * Run with "make -C tests/host". All times are UTC.
+ */
+#include "cron/cron_expr.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static int s_failures = 0;
+
+#define CHECK(cond, ...) do {                               \
+        if (!(cond)) {                                      \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__);                   \
+            fputc('\n', stderr);                            \
+            s_failures++;                                   \
+        }                                                   \
+    } while (0)
+
+static int64_t utc(int year, int mon, int day, int hour, int min)
+{
+    struct tm tm = {
+        .tm_year = year - 1900, .tm_mon = mon - 1, .tm_mday = day,
+        .tm_hour = hour, .tm_min = min, .tm_isdst = 0,
+    };
+    return (int64_t)mktime(&tm);
+}
+
+static const char *fmt(int64_t t, char *buf, size_t size)
+{
+    if (t == 0) return "none";
+    time_t tt = (time_t)t;
+    struct tm tm;
+    gmtime_r(&tt, &tm);
+    strftime(buf, size, "%Y-%m-%d %H:%M", &tm);
+    return buf;
+}
+
+/* Parse expr and check the next match after 'after' */
+static void expect_next(const char *expr, int64_t after, int64_t want)
+{
+    cron_expr_t e;
+    if (cron_expr_parse(expr, &e) != ESP_OK) {
+        CHECK(0, "\"%s\" did not parse", expr);
+        return;
+    }
+    int64_t got = cron_expr_next(&e, after);
+    char a[32], g[32], w[32];
+    CHECK(got == want, "\"%s\" after %s: got %s, want %s", expr,
+          fmt(after, a, sizeof(a)), fmt(got, g, sizeof(g)), fmt(want, w, sizeof(w)));
+}
+
+static void test_parse(void)
+{
+    cron_expr_t e;
+
+    CHECK(cron_expr_parse("*/15 9-17 * * mon-fri", &e) == ESP_OK, "steps and names");
+    CHECK(e.minutes == ((1ULL << 0) | (1ULL << 15) | (1ULL << 30) | (1ULL << 45)),
+          "*/15 minutes = %llx", (unsigned long long)e.minutes);
+    CHECK(e.hours == 0x3FE00, "9-17 hours = %x", e.hours);
+    CHECK(e.weekdays == 0x3E, "mon-fri = %x", e.weekdays);
+    CHECK(e.days_any && !e.weekdays_any, "any flags");
+
+    CHECK(cron_expr_parse("0 0 1,15 JAN,jul *", &e) == ESP_OK, "lists");
+    CHECK(e.days == ((1u << 1) | (1u << 15)), "1,15 days = %x", e.days);
+    CHECK(e.months == ((1u << 1) | (1u << 7)), "jan,jul months = %x", e.months);
+
+    CHECK(cron_expr_parse("5/20 0-12/6 * * 7", &e) == ESP_OK, "start/step");
+    CHECK(e.minutes == ((1ULL << 5) | (1ULL << 25) | (1ULL << 45)), "5/20 minutes");
+    CHECK(e.hours == ((1u << 0) | (1u << 6) | (1u << 12)), "0-12/6 hours");
+    CHECK(e.weekdays == 0x01, "7 is Sunday");
+
+    cron_expr_t s;
+    static const struct { const char *shortcut, *expr; } shortcuts[] = {
+        { "@hourly", "0 * * * *" }, { "@daily", "0 0 * * *" },
+        { "@weekly", "0 0 * * 0" }, { "@monthly", "0 0 1 * *" },
+        { "@yearly", "0 0 1 1 *" }, { "  @Daily  ", "0 0 * * *" },
+    };
+    for (size_t i = 0; i < sizeof(shortcuts) / sizeof(shortcuts[0]); i++) {
+        CHECK(cron_expr_parse(shortcuts[i].shortcut, &s) == ESP_OK &&
+              cron_expr_parse(shortcuts[i].expr, &e) == ESP_OK &&
+              memcmp(&s, &e, sizeof(e)) == 0, "%s", shortcuts[i].shortcut);
+    }
+
+    static const char *const bad[] = {
+        "60 * * * *", "* 24 * * *", "* * 0 * *", "* * 32 * *", "* * * 0 *",
+        "* * * 13 *", "* * * * 8", "5-1 * * * *", "*/0 * * * *", "*/61 * * * *",
+        "* * * *", "* * * * * *", "a * * * *", "1, * * * *", "1-* * * * *",
+        "* * * foo *", "@never", "@hourlyx", "", NULL,
+    };
+    for (int i = 0; bad[i]; i++) {
+        CHECK(cron_expr_parse(bad[i], &e) == ESP_ERR_INVALID_ARG, "\"%s\" accepted", bad[i]);
+    }
+    CHECK(cron_expr_parse(NULL, &e) == ESP_ERR_INVALID_ARG, "NULL accepted");
+}
+
+static void test_next(void)
+{
+    /* 2024-03-14 is a Thursday */
+    int64_t t = utc(2024, 3, 14, 10, 7);
+
+    expect_next("* * * * *", t, utc(2024, 3, 14, 10, 8));
+    expect_next("*/15 * * * *", t, utc(2024, 3, 14, 10, 15));
+    expect_next("0 9 * * *", t, utc(2024, 3, 15, 9, 0));
+    expect_next("7 10 * * *", t, utc(2024, 3, 15, 10, 7));     /* strictly after */
+    expect_next("@hourly", utc(2024, 3, 14, 23, 30), utc(2024, 3, 15, 0, 0));
+    expect_next("0 0 * * mon", t, utc(2024, 3, 18, 0, 0));
+
+    /* Month and year rollover */
+    expect_next("0 0 1 * *", utc(2024, 3, 31, 23, 59), utc(2024, 4, 1, 0, 0));
+    expect_next("30 23 31 * *", utc(2024, 4, 1, 0, 0), utc(2024, 5, 31, 23, 30));
+    expect_next("@yearly", utc(2024, 12, 31, 23, 59), utc(2025, 1, 1, 0, 0));
+    expect_next("0 12 * feb *", utc(2024, 3, 1, 0, 0), utc(2025, 2, 1, 12, 0));
+
+    /* Feb 29 only exists in leap years */
+    expect_next("0 0 29 2 *", utc(2024, 3, 1, 0, 0), utc(2028, 2, 29, 0, 0));
+    expect_next("0 0 29 2 *", utc(2024, 1, 1, 0, 0), utc(2024, 2, 29, 0, 0));
+
+    /* Both day fields restricted: either one matching is enough */
+    expect_next("0 0 1 * fri", t, utc(2024, 3, 15, 0, 0));      /* Friday first */
+    expect_next("0 0 15 * mon", t, utc(2024, 3, 15, 0, 0));     /* the 15th first */
+    expect_next("0 0 1 * mon", utc(2024, 3, 19, 0, 0), utc(2024, 3, 25, 0, 0));
+    /* Only one restricted: that one alone decides */
+    expect_next("0 0 1 * *", t, utc(2024, 4, 1, 0, 0));
+    expect_next("0 0 * * fri", t, utc(2024, 3, 15, 0, 0));
+
+    /* Never matches: must give up after the search window, not spin */
+    expect_next("0 0 30 2 *", t, 0);
+    expect_next("0 0 31 4,6,9,11 *", t, 0);
+}
+
+int main(void)
+{
+    setenv("TZ", "UTC", 1);
+    tzset();
+    test_parse();
+    test_next();
+    if (s_failures) {
+        fprintf(stderr, "%d check(s) failed\n", s_failures);
+        return 1;
+    }
+    printf("cron_expr: all checks passed\n");
+    return 0;
+}
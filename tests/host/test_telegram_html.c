@@ -0,0 +1,303 @@
+/*
+ * Host test for telegram/telegram_html.c: Markdown conversion, escaping,
+ * and chunking against Telegram's limits. Every chunk produced is checked
+ * for valid UTF-8, well-nested tags and its length in UTF-16 units.
+ * Run with "make -C tests/host".
+ */
+#include "telegram/telegram_html.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int s_failures = 0;
+
+#define CHECK(cond, ...) do {                               \
+        if (!(cond)) {                                      \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__);                   \
+            fputc('\n', stderr);                            \
+            s_failures++;                                   \
+        }                                                   \
+    } while (0)
+
+#define TG_LIMIT   4096         /* Telegram's message length in UTF-16 units */
+#define BUF_SIZE   (TG_LIMIT * 4 + 256)
+
+static char s_out[BUF_SIZE];
+
+/* Whole input as a single chunk */
+static const char *convert(const char *md)
+{
+    tg_html_t conv;
+    tg_html_init(&conv, md);
+    if (tg_html_next(&conv, s_out, sizeof(s_out), TG_LIMIT) == 0) return "";
+    char rest[64];
+    CHECK(tg_html_next(&conv, rest, sizeof(rest), TG_LIMIT) == 0, "\"%s\" took two chunks", md);
+    return s_out;
+}
+
+static void expect_html(const char *md, const char *want)
+{
+    const char *got = convert(md);
+    CHECK(strcmp(got, want) == 0, "\"%s\"\n  got  \"%s\"\n  want \"%s\"", md, got, want);
+}
+
+/* ── Chunk validation ─────────────────────────────────────────── */
+
+static size_t utf8_seq(const unsigned char *s)
+{
+    size_t n;
+    if (s[0] < 0x80) return 1;
+    if (s[0] >= 0xC2 && s[0] <= 0xDF) n = 2;
+    else if ((s[0] & 0xF0) == 0xE0) n = 3;
+    else if (s[0] >= 0xF0 && s[0] <= 0xF4) n = 4;
+    else return 0;
+    for (size_t i = 1; i < n; i++) {
+        if ((s[i] & 0xC0) != 0x80) return 0;
+    }
+    return n;
+}
+
+/*
+ * Check one chunk the way Telegram would: valid UTF-8, only the tags and
+ * entities the converter may emit, properly nested and all closed, and at
+ * most max_units of text. Returns the text length in UTF-16 units.
+ */
+static size_t check_chunk(const char *html, size_t max_units)
+{
+    static const char *const tags[] = { "b", "i", "s", "pre", "code", "a", NULL };
+    static const char *const entities[] = { "&amp;", "&lt;", "&gt;", "&quot;", NULL };
+    char stack[16][8];
+    int depth = 0;
+    size_t units = 0;
+
+    for (const char *p = html; *p; ) {
+        if (*p == '<') {
+            const char *end = strchr(p, '>');
+            if (!end) {
+                CHECK(0, "unterminated tag in \"%s\"", html);
+                return units;
+            }
+            bool closing = p[1] == '/';
+            const char *name = p + (closing ? 2 : 1);
+            size_t len = strcspn(name, " >");
+            int known = -1;
+            for (int i = 0; tags[i]; i++) {
+                if (strlen(tags[i]) == len && strncmp(name, tags[i], len) == 0) known = i;
+            }
+            CHECK(known >= 0, "unexpected tag \"%.*s\"", (int)(end - p + 1), p);
+            if (known >= 0 && closing) {
+                CHECK(depth > 0 && strcmp(stack[depth - 1], tags[known]) == 0,
+                      "</%s> does not close the innermost tag in \"%s\"", tags[known], html);
+                if (depth > 0) depth--;
+            } else if (known >= 0) {
+                CHECK(depth < 16, "tags nested too deep");
+                if (depth < 16) strcpy(stack[depth++], tags[known]);
+            }
+            p = end + 1;
+            continue;
+        }
+        if (*p == '&') {
+            size_t n = 0;
+            for (int i = 0; entities[i]; i++) {
+                if (strncmp(p, entities[i], strlen(entities[i])) == 0) n = strlen(entities[i]);
+            }
+            CHECK(n > 0, "bare '&' in \"%s\"", html);
+            p += n ? n : 1;
+            units++;
+            continue;
+        }
+        CHECK(*p != '>', "bare '>' in \"%s\"", html);
+        size_t n = utf8_seq((const unsigned char *)p);
+        CHECK(n > 0, "invalid UTF-8 at byte %d of chunk", (int)(p - html));
+        if (n == 0) return units;
+        units += n == 4 ? 2 : 1;
+        p += n;
+    }
+    CHECK(depth == 0, "%d tag(s) left open in \"%s\"", depth, html);
+    CHECK(units <= max_units, "%zu units over the limit of %zu", units, max_units);
+    return units;
+}
+
+/*
+ * Convert md in chunks of at most max_units, check each one and return the
+ * number of chunks. With plain set, the chunks' text is concatenated there.
+ */
+static int convert_chunks(const char *md, size_t max_units, char *plain, size_t plain_size,
+                          size_t *unit_counts, int max_chunks)
+{
+    tg_html_t conv;
+    tg_html_init(&conv, md);
+    int count = 0;
+    if (plain) plain[0] = '\0';
+
+    while (tg_html_next(&conv, s_out, sizeof(s_out), max_units) > 0) {
+        size_t units = check_chunk(s_out, max_units);
+        if (count < max_chunks && unit_counts) unit_counts[count] = units;
+        count++;
+        if (plain) {
+            tg_html_to_plain(s_out);
+            if (strlen(plain) + strlen(s_out) < plain_size) strcat(plain, s_out);
+        }
+        if (count > 100000) {
+            CHECK(0, "no progress");
+            break;
+        }
+    }
+    return count;
+}
+
+/* ── Tests ────────────────────────────────────────────────────── */
+
+static void test_escaping(void)
+{
+    expect_html("a < b && c > d", "a &lt; b &amp;&amp; c &gt; d");
+    expect_html("\"quoted\" 'text'", "\"quoted\" 'text'");
+    expect_html("`<br> & co`", "<code>&lt;br&gt; &amp; co</code>");
+    expect_html("[a<b](https://x.org/?q=\"1\"&r=2)",
+                "<a href=\"https://x.org/?q=&quot;1&quot;&amp;r=2\">a&lt;b</a>");
+    expect_html("[x](javascript:alert(1))", "[x](javascript:alert(1))");
+    expect_html("\\*not italic\\*", "*not italic*");
+    expect_html("bad \xC3 byte", "bad \xEF\xBF\xBD byte");
+
+    /* tg_html_to_plain undoes the escaping */
+    strcpy(s_out, "<b>a &lt; b</b> &amp; <a href=\"u\">c &gt; &quot;d&quot;</a>");
+    tg_html_to_plain(s_out);
+    CHECK(strcmp(s_out, "a < b & c > \"d\"") == 0, "to_plain gave \"%s\"", s_out);
+}
+
+static void test_emphasis(void)
+{
+    expect_html("**bold** and __bold__", "<b>bold</b> and <b>bold</b>");
+    expect_html("*it* _it_ ~~gone~~", "<i>it</i> <i>it</i> <s>gone</s>");
+    expect_html("**bold _both_ bold**", "<b>bold <i>both</i> bold</b>");
+    expect_html("*it **both** it*", "<i>it <b>both</b> it</i>");
+    /* Mis-nested markers still give well-nested tags */
+    expect_html("**a *b** c*", "<b>a <i>b</i></b><i> c</i>");
+
+    /* Markers without a partner stay literal */
+    expect_html("**never closed", "**never closed");
+    expect_html("2 * 3 * 4", "2 * 3 * 4");
+    expect_html("snake_case_name", "snake_case_name");
+    expect_html("a ~b~ c", "a ~b~ c");
+    expect_html("`unclosed code", "`unclosed code");
+    expect_html("**across\n\nparagraphs**", "**across\n\nparagraphs**");
+
+    /* Code can't sit inside other entities */
+    expect_html("**x `y` z**", "<b>x </b><code>y</code><b> z</b>");
+    expect_html("`**not bold**`", "<code>**not bold**</code>");
+
+    expect_html("# Title\n- item\n* item", "<b>Title</b>\n\xE2\x80\xA2 item\n\xE2\x80\xA2 item");
+}
+
+static void test_fences(void)
+{
+    expect_html("```c\nint a = 1 < 2;\n```", "<pre><code class=\"language-c\">int a = 1 &lt; 2;\n</code></pre>");
+    /* Open tags are closed before a block starts */
+    expect_html("**a\n```\ncode\n```\nb**", "<b>a\n</b><pre>code\n</pre>\nb**");
+    expect_html("```\n**raw** _x_\n```", "<pre>**raw** _x_\n</pre>");
+
+    /* A fence spanning several chunks is closed and reopened in each */
+    char md[4096] = "Intro line.\n```py\n";
+    for (int i = 0; i < 40; i++) {
+        char line[64];
+        snprintf(line, sizeof(line), "print('line %d <x>')\n", i);
+        strcat(md, line);
+    }
+    strcat(md, "```\nAfter.");
+
+    char whole[8192], chunked[8192];
+    convert_chunks(md, TG_LIMIT, whole, sizeof(whole), NULL, 0);
+    int n = convert_chunks(md, 200, chunked, sizeof(chunked), NULL, 0);
+    CHECK(n > 3, "fence not split (%d chunks)", n);
+    CHECK(strcmp(whole, chunked) == 0, "split fence lost or changed text");
+
+    tg_html_t conv;
+    tg_html_init(&conv, md);
+    for (int i = 0; tg_html_next(&conv, s_out, sizeof(s_out), 200) > 0; i++) {
+        if (i > 0 && i < n - 1) {
+            CHECK(strncmp(s_out, "<pre><code class=\"language-py\">", 31) == 0,
+                  "chunk %d doesn't reopen the block: \"%.40s\"", i, s_out);
+        }
+        if (i < n - 1) {
+            CHECK(strstr(s_out, "</code></pre>") != NULL, "chunk %d doesn't close the block", i);
+            size_t len = strlen(s_out);
+            CHECK(len >= 14 && s_out[len - 14] == '\n', "chunk %d not cut at a line end", i);
+        }
+    }
+
+    /* Nothing visible: the sender falls back to tg_html_escape */
+    tg_html_init(&conv, "```");
+    CHECK(tg_html_next(&conv, s_out, sizeof(s_out), TG_LIMIT) == 0, "lone fence converted");
+    CHECK(tg_html_escape("`````", s_out, sizeof(s_out), TG_LIMIT) == 5 &&
+          strcmp(s_out, "`````") == 0, "escape fence gave \"%s\"", s_out);
+    CHECK(tg_html_escape("<&>", s_out, sizeof(s_out), TG_LIMIT) > 0 &&
+          strcmp(s_out, "&lt;&amp;&gt;") == 0, "escape gave \"%s\"", s_out);
+    CHECK(tg_html_escape(" \n ", s_out, sizeof(s_out), TG_LIMIT) == 0, "blank escaped");
+}
+
+static void test_utf16_units(void)
+{
+    static char md[3 * 1024 * 4 + 1];
+    size_t counts[8];
+    char plain[sizeof(md)];
+
+    /* U+1F600 is 4 bytes and a surrogate pair: 2 units, never split */
+    md[0] = '\0';
+    for (int i = 0; i < 20; i++) strcat(md, "\xF0\x9F\x98\x80");
+    int n = convert_chunks(md, 11, plain, sizeof(plain), counts, 8);
+    CHECK(n == 4, "20 pairs in 11-unit chunks: %d chunks", n);
+    CHECK(counts[0] == 10 && counts[1] == 10 && counts[3] == 10, "pair chunks %zu %zu %zu",
+          counts[0], counts[1], counts[3]);
+    CHECK(strcmp(plain, md) == 0, "pairs changed");
+
+    /* 2- and 3-byte characters are one unit each */
+    md[0] = '\0';
+    for (int i = 0; i < 15; i++) strcat(md, "\xC3\xA9\xE2\x82\xAC");   /* é€ */
+    n = convert_chunks(md, 7, plain, sizeof(plain), counts, 8);
+    CHECK(n == 5 && counts[0] == 7 && counts[4] == 2, "é€ chunks: %d, first %zu", n, counts[0]);
+    CHECK(strcmp(plain, md) == 0, "é€ changed");
+
+    /* An entity is one unit however many bytes it takes */
+    n = convert_chunks("<<<<<<", 3, plain, sizeof(plain), counts, 8);
+    CHECK(n == 2 && counts[0] == 3 && counts[1] == 3, "entities: %d chunks", n);
+
+    /* The real limit: 3000 pairs are 6000 units, so 2048 fit in the first */
+    md[0] = '\0';
+    for (int i = 0; i < 3000; i++) memcpy(md + i * 4, "\xF0\x9F\x98\x80", 5);
+    n = convert_chunks(md, TG_LIMIT, plain, sizeof(plain), counts, 8);
+    CHECK(n == 2 && counts[0] == TG_LIMIT && counts[1] == 6000 - TG_LIMIT,
+          "3000 pairs: %d chunks, first %zu units", n, counts[0]);
+    CHECK(strcmp(plain, md) == 0, "3000 pairs changed");
+
+    /* Mixed text with spaces still never splits a character */
+    md[0] = '\0';
+    for (int i = 0; i < 400; i++) strcat(md, i % 3 ? "w\xC3\xB6rd " : "\xF0\x9F\x98\x80\xE2\x82\xAC ");
+    n = convert_chunks(md, 101, plain, sizeof(plain), NULL, 0);
+    CHECK(n > 10, "mixed: %d chunks", n);
+    CHECK(strcmp(plain, md) == 0, "mixed text changed");
+
+    /* A small output buffer limits chunks too */
+    tg_html_t conv;
+    tg_html_init(&conv, md);
+    char small[256];
+    while (tg_html_next(&conv, small, sizeof(small), TG_LIMIT) > 0) {
+        CHECK(strlen(small) < sizeof(small), "overflowed the buffer");
+        check_chunk(small, TG_LIMIT);
+    }
+}
+
+int main(void)
+{
+    test_escaping();
+    test_emphasis();
+    test_fences();
+    test_utf16_units();
+    if (s_failures) {
+        fprintf(stderr, "%d check(s) failed\n", s_failures);
+        return 1;
+    }
+    printf("telegram_html: all checks passed\n");
+    return 0;
+}
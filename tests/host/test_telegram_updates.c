@@ -0,0 +1,254 @@
+/*
+ * Host test for telegram/telegram_updates.c: every payload is fed whole,
+ * byte by byte and split in two at every offset, and must give the same
+ * updates each time. Run with "make -C tests/host".
+ */
+#include "telegram/telegram_updates.h"
+#include "mimi_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int s_failures = 0;
+
+#define CHECK(cond, ...) do {                               \
+        if (!(cond)) {                                      \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__);                   \
+            fputc('\n', stderr);                            \
+            s_failures++;                                   \
+        }                                                   \
+    } while (0)
+
+#define MAX_UPDATES 8
+
+typedef struct {
+    int64_t update_id;
+    int message_id;
+    char chat_id[32];
+    char sender[24];
+    bool has_text;
+    char *text;
+} update_t;
+
+typedef struct {
+    update_t updates[MAX_UPDATES];
+    int count;
+} result_t;
+
+static void on_update(const tg_update_t *u, void *ctx)
+{
+    result_t *r = ctx;
+    if (r->count == MAX_UPDATES) return;
+    update_t *out = &r->updates[r->count++];
+    out->update_id = u->update_id;
+    out->message_id = u->message_id;
+    strcpy(out->chat_id, u->chat_id);
+    strcpy(out->sender, u->sender);
+    out->has_text = u->text != NULL;
+    out->text = u->text ? strdup(u->text) : NULL;
+}
+
+static void result_free(result_t *r)
+{
+    for (int i = 0; i < r->count; i++) free(r->updates[i].text);
+    r->count = 0;
+}
+
+/* Feed json in pieces split at the given offsets (ascending, < len) */
+static bool parse(const char *json, size_t len, bool single, const size_t *cuts, int n_cuts,
+                  result_t *r, tg_updates_parser_t *p)
+{
+    memset(r, 0, sizeof(*r));
+    tg_updates_init(p, single, on_update, r);
+    size_t pos = 0;
+    for (int i = 0; i < n_cuts; i++) {
+        tg_updates_feed(p, json + pos, cuts[i] - pos);
+        pos = cuts[i];
+    }
+    tg_updates_feed(p, json + pos, len - pos);
+    bool done = tg_updates_done(p);
+    tg_updates_free(p);
+    return done;
+}
+
+static bool same_update(const update_t *a, const update_t *b)
+{
+    return a->update_id == b->update_id && a->message_id == b->message_id &&
+           strcmp(a->chat_id, b->chat_id) == 0 && strcmp(a->sender, b->sender) == 0 &&
+           a->has_text == b->has_text && (!a->has_text || strcmp(a->text, b->text) == 0);
+}
+
+/*
+ * Parse json whole, then byte by byte, then split at every offset (every
+ * stride-th for large documents), and compare each run with want.
+ */
+static void check_payload(const char *name, const char *json, bool single,
+                          const update_t *want, int n_want, size_t stride)
+{
+    size_t len = strlen(json);
+    tg_updates_parser_t p;
+    result_t r;
+
+    bool done = parse(json, len, single, NULL, 0, &r, &p);
+    CHECK(done, "%s: not complete", name);
+    CHECK(!single ? p.ok : true, "%s: ok not set", name);
+    CHECK(r.count == n_want, "%s: %d updates, want %d", name, r.count, n_want);
+    for (int i = 0; i < r.count && i < n_want; i++) {
+        const update_t *g = &r.updates[i], *w = &want[i];
+        CHECK(g->update_id == w->update_id, "%s[%d]: update_id %lld", name, i, (long long)g->update_id);
+        CHECK(g->message_id == w->message_id, "%s[%d]: message_id %d", name, i, g->message_id);
+        CHECK(strcmp(g->chat_id, w->chat_id) == 0, "%s[%d]: chat_id \"%s\"", name, i, g->chat_id);
+        CHECK(strcmp(g->sender, w->sender) == 0, "%s[%d]: sender \"%s\"", name, i, g->sender);
+        CHECK(g->has_text == w->has_text, "%s[%d]: has_text %d", name, i, g->has_text);
+        if (g->has_text && w->has_text && strcmp(g->text, w->text) != 0) {
+            CHECK(0, "%s[%d]: text \"%.60s\" (%zu bytes), want \"%.60s\" (%zu bytes)", name, i,
+                  g->text, strlen(g->text), w->text, strlen(w->text));
+        }
+    }
+    result_t whole = r;
+
+    /* Byte by byte */
+    size_t *cuts = malloc(len * sizeof(size_t));
+    for (size_t i = 0; i + 1 < len; i++) cuts[i] = i + 1;
+    done = parse(json, len, single, cuts, (int)len - 1, &r, &p);
+    CHECK(done && r.count == whole.count, "%s: byte by byte differs", name);
+    for (int i = 0; i < r.count && i < whole.count; i++) {
+        CHECK(same_update(&r.updates[i], &whole.updates[i]), "%s: byte by byte update %d differs", name, i);
+    }
+    result_free(&r);
+    free(cuts);
+
+    /* Two pieces */
+    for (size_t cut = 1; cut < len; cut += stride) {
+        done = parse(json, len, single, &cut, 1, &r, &p);
+        bool same = done && r.count == whole.count;
+        for (int i = 0; same && i < r.count; i++) {
+            same = same_update(&r.updates[i], &whole.updates[i]);
+        }
+        CHECK(same, "%s: split at %zu differs", name, cut);
+        result_free(&r);
+        if (!same) break;
+    }
+    result_free(&whole);
+}
+
+/* ── Tests ────────────────────────────────────────────────────── */
+
+static void test_get_updates(void)
+{
+    const char *json =
+        "{\"ok\":true,\"result\":[\n"
+        "  {\"update_id\":1001,\"message\":{\"message_id\":5,"
+        "\"from\":{\"id\":42,\"is_bot\":false,\"first_name\":\"Ann\\u00e9\","
+        "\"extra\":{\"a\":[1,{\"b\":\"}]\\\"\"},[[],{}]],\"text\":\"not this\"}},"
+        "\"chat\":{\"id\":-100123,\"type\":\"group\",\"title\":\"x\\\"y\"},\"date\":1700000000,"
+        "\"reply_to_message\":{\"message_id\":1,\"chat\":{\"id\":1},\"text\":\"old\"},"
+        "\"text\":\"hi \\ud83d\\ude00 \\\"q\\\" \\\\ \\/ \\n\\tend \\u20ac\","
+        "\"entities\":[{\"offset\":0,\"length\":2,\"type\":\"bold\"}]}},\n"
+        "  {\"update_id\":1002,\"edited_message\":{\"message_id\":6,\"chat\":{\"id\":7},\"text\":\"edit\"}},\n"
+        "  {\"update_id\":1003,\"message\":{\"message_id\":7,\"chat\":{\"id\":99},"
+        "\"from\":{\"first_name\":\"Bob\"},\"caption\":\"pic\",\"photo\":[{\"file_id\":\"x\",\"w\":1.5e3}],"
+        "\"has_media_spoiler\":true,\"via\":null}},\n"
+        "  {\"update_id\":1004,\"message\":{\"text\":\"lone \\ud83d and \\ude00 halves\"}}\n"
+        "]}";
+
+    static const update_t want[] = {
+        { 1001, 5, "-100123", "Ann\xC3\xA9", true,
+          "hi \xF0\x9F\x98\x80 \"q\" \\ / \n\tend \xE2\x82\xAC" },
+        { 1002, -1, "", "", false, NULL },
+        { 1003, 7, "99", "Bob", false, NULL },
+        { 1004, -1, "", "", true, "lone \xEF\xBF\xBD and \xEF\xBF\xBD halves" },
+    };
+    check_payload("getUpdates", json, false, want, 4, 1);
+
+    tg_updates_parser_t p;
+    result_t r;
+    const char *err = "{\"ok\":false,\"error_code\":409,\"description\":\"Conflict\"}";
+    CHECK(parse(err, strlen(err), false, NULL, 0, &r, &p) && !p.ok && p.error_code == 409 &&
+          r.count == 0, "error response");
+    result_free(&r);
+
+    const char *empty = "{\"ok\":true,\"result\":[]}";
+    CHECK(parse(empty, strlen(empty), false, NULL, 0, &r, &p) && p.ok && r.count == 0, "empty result");
+
+    /* Malformed or too deeply nested documents are not complete */
+    static const char *const bad[] = {
+        "{\"ok\":true,\"result\":[{\"update_id\":1}",
+        "{\"ok\":true,\"result\":[{\"update_id\":1]]}",
+        "{\"ok\":true \"result\":[]}",
+        "{\"ok\":true,\"result\":[{\"message\":{\"text\":\"\\uZZZZ\"}}]}",
+        "{\"a\":[[[[[[[[[[[[[[[[[[1]]]]]]]]]]]]]]]]]]}",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        CHECK(!parse(bad[i], strlen(bad[i]), false, NULL, 0, &r, &p), "bad[%zu] accepted", i);
+        result_free(&r);
+    }
+}
+
+static void test_webhook(void)
+{
+    const char *json =
+        "{\"update_id\":77,\"message\":{\"message_id\":3,\"chat\":{\"id\":12345678901},"
+        "\"from\":{\"first_name\":\"Ann\\u00e9 Verylongname Abcdefgh\"},"
+        "\"text\":\"\\ud83d\\ude00\\ud83d\\ude00x\"}}";
+    /* The sender field keeps 23 bytes */
+    static const update_t want[] = {
+        { 77, 3, "12345678901", "Ann\xC3\xA9 Verylongname Abcd", true,
+          "\xF0\x9F\x98\x80\xF0\x9F\x98\x80x" },
+    };
+    check_payload("webhook", json, true, want, 1, 1);
+
+    /* A name cut inside a multi-byte character loses that character */
+    const char *cut =
+        "{\"update_id\":78,\"message\":{\"from\":{\"first_name\":\"abcdefghijklmnopqrstuv\\u00e9\"}}}";
+    static const update_t want_cut[] = {
+        { 78, -1, "", "abcdefghijklmnopqrstuv", false, NULL },
+    };
+    check_payload("webhook cut name", cut, true, want_cut, 1, 1);
+}
+
+/* Text longer than MIMI_TG_TEXT_MAX keeps the start, whole characters only */
+static void test_text_cap(void)
+{
+    enum { CHARS = 10000 };     /* 2 bytes each, well over the cap */
+    size_t keep = (MIMI_TG_TEXT_MAX - 1) / 2 * 2;
+
+    for (int escaped = 0; escaped < 2; escaped++) {
+        const char *prefix = "{\"update_id\":9,\"message\":{\"text\":\"";
+        const char *suffix = "\",\"chat\":{\"id\":5}}}";
+        const char *ch = escaped ? "\\u00e9" : "\xC3\xA9";
+        size_t json_len = strlen(prefix) + CHARS * strlen(ch) + strlen(suffix);
+        char *json = malloc(json_len + 1);
+        strcpy(json, prefix);
+        char *q = json + strlen(prefix);
+        for (int i = 0; i < CHARS; i++) {
+            memcpy(q, ch, strlen(ch));
+            q += strlen(ch);
+        }
+        strcpy(q, suffix);
+
+        char *text = malloc(keep + 1);
+        for (size_t i = 0; i < keep; i += 2) memcpy(text + i, "\xC3\xA9", 2);
+        text[keep] = '\0';
+
+        update_t want = { 9, -1, "5", "", true, text };
+        check_payload(escaped ? "text cap (escaped)" : "text cap", json, true, &want, 1, 97);
+        free(text);
+        free(json);
+    }
+}
+
+int main(void)
+{
+    test_get_updates();
+    test_webhook();
+    test_text_cap();
+    if (s_failures) {
+        fprintf(stderr, "%d check(s) failed\n", s_failures);
+        return 1;
+    }
+    printf("telegram_updates: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Host test for memory/vec_kernel.c: checks vec_dot_i8 and vec_quantize_i8
+ * against straightforward reference code. Run with "make -C tests/host".
+ */
+#include "memory/vec_kernel.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int s_failures = 0;
+
+#define CHECK(cond, ...) do {                               \
+        if (!(cond)) {                                      \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__);                   \
+            fputc('\n', stderr);                            \
+            s_failures++;                                   \
+        }                                                   \
+    } while (0)
+
+static int64_t ref_dot(const int8_t *a, const int8_t *b, size_t n)
+{
+    int64_t acc = 0;
+    for (size_t i = 0; i < n; i++) acc += (int64_t)a[i] * b[i];
+    return acc;
+}
+
+static void fill_random(int8_t *v, size_t n)
+{
+    for (size_t i = 0; i < n; i++) v[i] = (int8_t)(rand() % 255 - 127);
+}
+
+static void test_dot(void)
+{
+    static const size_t sizes[] = { 0, 1, 15, 16, 17, 31, 64, 255, 256, 1024 };
+    int8_t a[1024 + 16] __attribute__((aligned(16)));
+    int8_t b[1024 + 16] __attribute__((aligned(16)));
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t n = sizes[s];
+        /* Aligned and unaligned starts take different paths on the target */
+        for (size_t off = 0; off < 2; off++) {
+            fill_random(a + off, n);
+            fill_random(b + off, n);
+            int64_t want = ref_dot(a + off, b + off, n);
+            CHECK(vec_dot_i8(a + off, b + off, n) == want,
+                  "vec_dot_i8 n=%zu off=%zu", n, off);
+            CHECK(vec_dot_i8_scalar(a + off, b + off, n) == want,
+                  "vec_dot_i8_scalar n=%zu off=%zu", n, off);
+        }
+    }
+
+    /* Worst case magnitude for the embedding size */
+    memset(a, -127, 256);
+    memset(b, -127, 256);
+    CHECK(vec_dot_i8(a, b, 256) == 127 * 127 * 256, "saturated dot");
+}
+
+static void test_quantize(void)
+{
+    enum { N = 256 };
+    float x[N], y[N];
+    int8_t qx[N] __attribute__((aligned(16)));
+    int8_t qy[N] __attribute__((aligned(16)));
+
+    for (int trial = 0; trial < 50; trial++) {
+        double dot = 0, nx = 0, ny = 0;
+        for (int i = 0; i < N; i++) {
+            x[i] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            y[i] = 0.7f * x[i] + 0.3f * ((float)rand() / RAND_MAX * 2.0f - 1.0f);
+            dot += (double)x[i] * y[i];
+            nx += (double)x[i] * x[i];
+            ny += (double)y[i] * y[i];
+        }
+        double cos_ref = dot / (sqrt(nx) * sqrt(ny));
+
+        float sx = vec_quantize_i8(x, qx, N);
+        float sy = vec_quantize_i8(y, qy, N);
+        CHECK(sx > 0.0f && sy > 0.0f, "scale not positive");
+
+        int peak = 0;
+        for (int i = 0; i < N; i++) {
+            int v = abs(qx[i]);
+            if (v > peak) peak = v;
+            double deq = qx[i] * sx;
+            CHECK(fabs(deq - x[i] / sqrt(nx)) <= sx * 0.5 + 1e-6,
+                  "dequantised component %d off by more than half a step", i);
+        }
+        CHECK(peak == 127, "largest component maps to %d, not 127", peak);
+
+        double cos_q = (double)vec_dot_i8(qx, qy, N) * sx * sy;
+        CHECK(fabs(cos_q - cos_ref) < 0.01, "cosine %f vs reference %f", cos_q, cos_ref);
+    }
+
+    memset(x, 0, sizeof(x));
+    memset(qx, 1, sizeof(qx));
+    CHECK(vec_quantize_i8(x, qx, N) == 0.0f, "zero vector scale");
+    for (int i = 0; i < N; i++) CHECK(qx[i] == 0, "zero vector output");
+}
+
+int main(void)
+{
+    srand(12345);
+    test_dot();
+    test_quantize();
+    if (s_failures) {
+        fprintf(stderr, "%d check(s) failed\n", s_failures);
+        return 1;
+    }
+    printf("vec_kernel: all checks passed\n");
+    return 0;
+}